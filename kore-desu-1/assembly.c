@@ -1,10 +1,13 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
+#include <limits.h>
 
 #include "assembly.h"
 #include "symbol_table.h"
+#include "machine_code.h" // .data windows of the global pointer
+#include "target.h" // instruction forms and latencies of the --target ISA
+#include "error.h" // xrealloc
 
 // temporary registers for expression evaluation (r20–r30)
 // used for intermediate values in expressions
@@ -12,45 +15,410 @@ static int temp_start = 20;
 static int temp_next = 20;
 static int temp_max = 30;
 
-// reset temp register usage and called b4 generating code
+// expression tree built from the RHS text of one statement
+// leaves are literals (op == 0, name empty) or variables (op == 0, name set)
+#define MAX_EXPR_NODES 256
+
+typedef struct ExprNode {
+    char op;                    // '+', '-', '*', '/' or 0 for a leaf
+    long long value;            // literal value
+    char name[MAX_NAME_LEN];    // variable name
+    struct ExprNode *left, *right;
+    int vn;                     // value number of the node (see below)
+    int need;                   // Sethi–Ullman label: temps needed to evaluate the node
+    int occ;                    // 1 if the result ends up occupying a temp
+    int right_first;            // evaluate the right operand before the left one
+} ExprNode;
+
+static ExprNode expr_nodes[MAX_EXPR_NODES];
+static int expr_node_count = 0;
+
+// while loops being generated (nesting level) and labels handed out so far
+static int loop_depth = 0;
+static int loop_count = 0;
+
+// the same for if statements (labels _elseN, _endifN)
+static int if_depth = 0;
+static int if_count = 0;
+
+// spill slots (_spill0, _spill1, ...) in .data for expressions needing more than the temp pool
+// names start with '_' so they can never clash with a user variable
+static int spill_depth = 0;   // slots in use by the expression being generated
+static int spill_slots = 0;   // slots the program needs in total
+
+// large .data (more than ld/sd reach from r0): variables past the first 32 KB go through the
+// global pointer r28 (then kept out of the temp pool), which holds the 64 KB window of the last
+// one used; spill slots and line counters move in front of the variables, in reach of r0
+static int far_data = 0;
+static int far_spills = 0;    // spill slots reserved in front of the variables
+
+// print statements (eduMIPS64 SYSCALL 5, printf): r14 points at an argument block holding the
+// address of the format, then the values for its %d. one block, _print0 .. _printN (N values
+// of the longest print), is shared by every print; each distinct format is one .asciiz _fmtK
+#define SYSCALL_ARGUMENT 14     // r14: address of the argument block
+#define SYSCALL_RESULT   1      // r1: characters printed, overwritten by every print
+static char **formats;          // _fmt0, _fmt1, ...
+static int format_count = 0;
+static int print_values = 0;    // N
+static int *print_format;       // index of a print's first part -> K of its _fmtK
+static int *print_vregs;        // values of the print being generated
+
+// functions: "jal _func_f" calls f, which returns with "jr r31" and its result in r2.
+// the caller stores argument k at -8(k+1)(r29), under its stack pointer: that is where the
+// callee's frame ends, so the parameters are already in place when it moves r29 down
+//     _func_f: daddiu r29, r29, #-F      frame of F bytes, from r29 up:
+//              sd r31, 0(r29)            return address (only if f calls a function itself)
+//              sd rS, 8(r29)             callee-saved registers f overwrites
+//              <body>                    locals, then the parameters (at the top)
+//     _retN:   ld rS, 8(r29)
+//              ld r31, 0(r29)
+//              daddiu r29, r29, #F
+//              jr r31
+// r1 and r3-r19 (and r28 with large .data) are callee-saved, r2, the temps and r31 are not;
+// variables other than the function's own may change in a call. the stack (_stack in .data)
+// grows down from its end, r29 stays out of the temp pool while there is one
+#define RESULT_REGISTER  2
+#define STACK_POINTER    29
+#define RETURN_ADDRESS   31
+#define STACK_BYTES      8192
+#define VALUE_STACK_KEY  -2     // LoadAddress key of _stack
+static int stack_used = 0;      // the program keeps functions (not everything was inlined)
+static FILE *function_code;     // the functions' code, which goes in front of the main program's
+static int function_count = 0;  // functions generated so far (labels _retN)
+static int in_function = 0;     // generating a function body
+static int frame_size;          // its frame (F above)
+static int function_returns;    // its return label is used
+
+// local value numbering (straight-line code, kept across statements)
+// every distinct value gets a number; identical operations on identical
+// value numbers hash to the same number, so a register already holding
+// that number can be reused instead of recomputing or reloading
+#define MAX_VALUES      4096
+#define VALUE_HASH_SIZE 8192    // power of 2, at least 2x MAX_VALUES
+#define NUM_REGISTERS   32
+#define VALUE_CONST     '#'     // literal: imm holds the constant
+#define VALUE_OPAQUE    '$'     // unknown contents (e.g. a variable never assigned here)
+#define VALUE_ADDRESS   '&'     // .data address: imm is K of _fmtK, -1 for _print0
+#define VALUE_NARROW    'n'     // left cut to imm bytes and sign-extended (a char, short or int32)
+
+static struct {
+    char op;
+    int left, right;
+    long long imm;
+} values[MAX_VALUES];
+static int value_count = 0;
+static int value_hash[VALUE_HASH_SIZE]; // index + 1 into values[], 0 = empty slot
+
+static int reg_value[NUM_REGISTERS];         // value number held by each register, -1 = unknown
+static int reg_pinned[NUM_REGISTERS];        // > 0 while an operand of the current expression lives there
+static int reg_reserved[NUM_REGISTERS];      // > 0 while a hoisted loop invariant lives there
+static unsigned reg_last_use[NUM_REGISTERS]; // for evicting the least recently used cached temp
+static unsigned use_clock = 0;
+
+// current value number of every variable (what its memory slot holds)
+typedef struct {
+    char name[MAX_NAME_LEN];
+    int vn;
+} VarValue;
+
+static VarValue var_values[MAX_SYMBOLS];
+static int var_value_count = 0;
+
+// bumped whenever the value table is cleared, so saved value numbers can be recognized as stale
+static int value_epoch = 0;
+
+static int ValueNumber(char op, int left, int right, long long imm);
+
+// forget every known value; registers and variables must be reloaded afterwards
+// (loop reservations stay, the registers are just not known to hold anything)
+static void ResetValueNumbering() {
+    value_count = 0;
+    var_value_count = 0;
+    value_epoch++;
+    memset(value_hash, 0, sizeof(value_hash));
+    for(int r = 0; r < NUM_REGISTERS; r++) {
+        reg_value[r] = -1;
+        reg_pinned[r] = 0;
+        reg_last_use[r] = 0;
+    }
+    reg_value[0] = ValueNumber(VALUE_CONST, -1, -1, 0); // r0 always holds 0
+}
+
+// start over before the value table fills up; extra = values about to be created
+static void EnsureValueCapacity(int extra) {
+    if(value_count + extra >= MAX_VALUES)
+        ResetValueNumbering();
+}
+
+// find or create the value number for (op, left, right, imm)
+// + and * are commutative, so their operands are put in a canonical order
+static int ValueNumber(char op, int left, int right, long long imm) {
+    if((op == '+' || op == '*') && left > right) {
+        int t = left;
+        left = right;
+        right = t;
+    }
+    unsigned long long h = (unsigned char)op;
+    h = h * 31 + (unsigned)left;
+    h = h * 31 + (unsigned)right;
+    h = h * 31 + (unsigned long long)imm;
+    unsigned slot = (unsigned)(h ^ (h >> 17)) & (VALUE_HASH_SIZE - 1);
+
+    while(value_hash[slot]) {
+        int v = value_hash[slot] - 1;
+        if(values[v].op == op && values[v].left == left && values[v].right == right && values[v].imm == imm)
+            return v;
+        slot = (slot + 1) & (VALUE_HASH_SIZE - 1);
+    }
+    int v = value_count++;
+    values[v].op = op;
+    values[v].left = left;
+    values[v].right = right;
+    values[v].imm = imm;
+    value_hash[slot] = v + 1;
+    return v;
+}
+
+// a fresh value number that never matches anything else
+static int NewOpaqueValue() {
+    int v = value_count++;
+    values[v].op = VALUE_OPAQUE;
+    values[v].left = values[v].right = -1;
+    values[v].imm = 0;
+    return v;
+}
+
+// value number currently stored in a variable
+static int VariableValue(const char *name) {
+    for(int i = 0; i < var_value_count; i++)
+        if(strcmp(var_values[i].name, name) == 0)
+            return var_values[i].vn;
+    if(var_value_count >= MAX_SYMBOLS)
+        return NewOpaqueValue();
+    strncpy(var_values[var_value_count].name, name, MAX_NAME_LEN - 1);
+    var_values[var_value_count].name[MAX_NAME_LEN - 1] = '\0';
+    var_values[var_value_count].vn = NewOpaqueValue();
+    return var_values[var_value_count++].vn;
+}
+
+// record that a variable now holds value vn (after it is assigned)
+static void SetVariableValue(const char *name, int vn) {
+    VariableValue(name); // make sure an entry exists
+    for(int i = 0; i < var_value_count; i++)
+        if(strcmp(var_values[i].name, name) == 0)
+            var_values[i].vn = vn;
+}
+
+// value number a variable holds once vn is stored to it: a char, short or int32 only keeps
+// the low bytes, so unless vn is a constant (cut here) or already that narrow it is a new
+// value, which its ld finds in no register
+static int StoredValue(const char *name, int vn) {
+    int bytes = GetSizeOfTheSymbol(name);
+    if(bytes >= 8 || vn < 0)
+        return vn;
+    if(values[vn].op == VALUE_CONST)
+        return ValueNumber(VALUE_CONST, -1, -1, SsaNarrow(values[vn].imm, bytes));
+    if(values[vn].op == VALUE_NARROW && values[vn].imm <= bytes)
+        return vn;
+    return ValueNumber(VALUE_NARROW, vn, -1, bytes);
+}
+
+// register holding value vn without counting it as a use
+static int PeekRegisterHolding(int vn) {
+    if(vn < 0)
+        return -1;
+    for(int r = 0; r < NUM_REGISTERS; r++)
+        if(reg_value[r] == vn)
+            return r;
+    return -1;
+}
+
+// register holding value vn, or -1 if it has to be (re)computed
+static int FindRegisterHolding(int vn) {
+    if(vn < 0)
+        return -1;
+    for(int r = 0; r < NUM_REGISTERS; r++)
+        if(reg_value[r] == vn) {
+            reg_last_use[r] = ++use_clock;
+            return r;
+        }
+    return -1;
+}
+
+// note that reg has just been overwritten with value vn
+static void WriteRegister(int reg, int vn) {
+    reg_value[reg] = vn;
+    reg_last_use[reg] = ++use_clock;
+}
+
+// reset assembly generator state and called b4 generating code
 void AssemblyInit() {
     temp_next = temp_start;
+    spill_depth = 0;
+    memset(reg_reserved, 0, sizeof(reg_reserved));
+    ResetValueNumbering();
+}
+
+// can't be overwritten right now: holds an operand in use or a loop invariant
+static int IsRegisterBusy(int reg) {
+    return reg_pinned[reg] || reg_reserved[reg];
 }
 
 // allocate a temp register for intermediate computation results
-// automatically goes back to 20 if exceeded
+// prefers an empty temp, then the least recently used one whose value is only cached
+// automatically goes back to 20 if every temp holds a live operand
 static int NewTempRegister() {
-    int r = temp_next++;
-    if(temp_next > temp_max)
-        temp_next = temp_start;
+    int best = -1;
+    for(int r = temp_start; r <= temp_max; r++) {
+        if(IsRegisterBusy(r))
+            continue;
+        if(reg_value[r] == -1)
+            return r;
+        if(best == -1 || reg_last_use[r] < reg_last_use[best])
+            best = r;
+    }
+    if(best != -1)
+        return best;
+
+    int r;
+    do {
+        r = temp_next++;
+        if(temp_next > temp_max)
+            temp_next = temp_start;
+    } while((far_data && r == GP_REGISTER) || (stack_used && r == STACK_POINTER));
     return r;
 }
 
+// is reg part of the temp pool
+static int IsTempRegister(int reg) {
+    return reg >= temp_start && reg <= temp_max;
+}
+
+// temps that can still be handed out (holding nothing or only a cached value)
+static int FreeTempCount() {
+    int n = 0;
+    for(int r = temp_start; r <= temp_max; r++)
+        if(!IsRegisterBusy(r))
+            n++;
+    return n;
+}
+
 // reset the temp reg pointer after each statement
 // to prevent register reuse conflicts in multiple lines
 static void ResetTempRegister() {
     temp_next = temp_start;
+    for(int r = 0; r < NUM_REGISTERS; r++)
+        reg_pinned[r] = 0;
+}
+
+// point the global pointer at a .data window (nothing to do if it already holds it)
+static void SetDataWindow(FILE *out, int window) {
+    int vn = ValueNumber(VALUE_CONST, -1, -1, (long long)window << 16);
+    if(reg_value[GP_REGISTER] == vn)
+        return;
+    fprintf(out, "lui r%d, #%d\n", GP_REGISTER, window);
+    WriteRegister(GP_REGISTER, vn);
 }
 
-// (forward declrations) recursive expression parsing
-static int Parse_E(const char **p, FILE *out, int target);
-static int Parse_T(const char **p, FILE *out, int target);
-static int Parse_F(const char **p, FILE *out, int target);
-static void SkipSpacesPtr(const char **p);
+// base register of a variable's ld/sd: r0, or the global pointer set to the variable's window
+static int DataBase(FILE *out, const char *name) {
+    long long offset = (long long)GetOffsetOfTheSymbol(name);
+    if(!far_data || offset < DATA_WINDOW_REACH)
+        return 0;
+    SetDataWindow(out, DATA_WINDOW(offset));
+    return GP_REGISTER;
+}
+
+// a function's parameter or local: its offset from r29 (see the frame above, variables are
+// handed out from the top)
+static int FrameOffset(const char *name) {
+    return frame_size - GetSizeOfTheSymbol(name) - (int)GetOffsetOfTheSymbol(name);
+}
+
+// the frame: the save slots, then the variables in whole doublewords (r29 stays aligned)
+static int FrameSize(int slots) {
+    return 8 * slots + (((int)GetFrameSize() + 7) & ~7);
+}
+
+// load/store mnemonic of a variable's size: lb/sb (char), lh/sh (short), lw/sw (int32), ld/sd
+// (the loads sign-extend to the whole register)
+static const char *MemoryOp(const char *name, int store) {
+    static const char *ops[2][4] = { { "lb", "lh", "lw", "ld" }, { "sb", "sh", "sw", "sd" } };
+    int bytes = GetSizeOfTheSymbol(name);
+    return ops[store][bytes == 1 ? 0 : bytes == 2 ? 1 : bytes == 4 ? 2 : 3];
+}
 
 // load var: generates mips64 insruction to load a var's value into a register
 static void LoadVariable(FILE *out, int reg, const char *name) {
-    fprintf(out, "ld r%d, %s(r0)\n", reg, name);
+    if(in_function && IsFrameSymbol(name)) {
+        fprintf(out, "%s r%d, %d(r%d)\n", MemoryOp(name, 0), reg, FrameOffset(name), STACK_POINTER);
+        return;
+    }
+    int base = DataBase(out, name);
+    fprintf(out, "%s r%d, %s(r%d)\n", MemoryOp(name, 0), reg, name, base);
 }
 
 // store: generate instruction to store a reg's value into memory
 static void StoreVariable(FILE *out, int reg, const char *name) {
-    fprintf(out, "sd r%d, %s(r0)\n", reg, name);
+    if(in_function && IsFrameSymbol(name)) {
+        fprintf(out, "%s r%d, %d(r%d)\n", MemoryOp(name, 1), reg, FrameOffset(name), STACK_POINTER);
+        return;
+    }
+    int base = DataBase(out, name);
+    fprintf(out, "%s r%d, %s(r%d)\n", MemoryOp(name, 1), reg, name, base);
+}
+
+// address of a .data symbol (value key, see VALUE_ADDRESS) into target (0: a temp), unless
+// a register holds it already; returns the register
+static int LoadAddress(FILE *out, int target, const char *name, long long key) {
+    int vn = ValueNumber(VALUE_ADDRESS, -1, -1, key);
+    int r = FindRegisterHolding(vn);
+    if(r != -1 && (target == 0 || r == target))
+        return r;
+    if(target == 0)
+        target = NewTempRegister();
+    int base = DataBase(out, name);
+    fprintf(out, "daddiu r%d, r%d, %s\n", target, base, name);
+    WriteRegister(target, vn);
+    return target;
+}
+
+// does imm fit the 16-bit immediate of daddiu (sign-extended)
+static int FitsImmediate(long long imm) {
+    return imm >= -32768 && imm <= 32767;
+}
+
+// instructions GenerateLoadImmediate takes for imm
+static int ImmediateInstructions(long long imm) {
+    if(FitsImmediate(imm) || (imm >= 0 && imm <= 0xFFFF))
+        return 1;
+    if(imm >= INT_MIN && imm <= INT_MAX)
+        return (imm & 0xFFFF) ? 2 : 1;
+    int count = 3; // lui, dsll, dsll, and an ori per 16 bits below the top ones that aren't 0
+    for(int shift = 0; shift < 48; shift += 16)
+        count += ((imm >> shift) & 0xFFFF) != 0;
+    return count;
 }
 
 // load immediate constant into a register
+// a value past daddiu's 16 bits is built 16 bits at a time: lui sets bits 31..16 (sign-extended),
+// ori the low ones; a value wider than 32 bits starts from its top half and shifts it up with dsll
 static void GenerateLoadImmediate(FILE *out, int reg, long long imm) {
-    if(imm > 15) 
+    if(!FitsImmediate(imm) && imm >= 0 && imm <= 0xFFFF)
+        fprintf(out, "ori r%d, r0, #0x%llX\n", reg, imm);
+    else if(!FitsImmediate(imm)) {
+        unsigned long long bits = (unsigned long long)imm;
+        int wide = imm < INT_MIN || imm > INT_MAX;
+        int top = wide ? 48 : 16;
+        fprintf(out, "lui r%d, #0x%llX\n", reg, (bits >> top) & 0xFFFF);
+        for(int shift = top - 16; shift >= 0; shift -= 16) {
+            if(wide && shift < 32)
+                fprintf(out, "dsll r%d, r%d, #16\n", reg, reg);
+            if((bits >> shift) & 0xFFFF)
+                fprintf(out, "ori r%d, r%d, #0x%llX\n", reg, reg, (bits >> shift) & 0xFFFF);
+        }
+    }
+    else if(imm > 15)
         fprintf(out, "daddiu r%d, r0, #0x%llX\n", reg, imm);
     else if(imm < -15)
         fprintf(out, "daddiu r%d, r0, #-%#llX\n", reg, -imm);
@@ -58,9 +426,12 @@ static void GenerateLoadImmediate(FILE *out, int reg, long long imm) {
         fprintf(out, "daddiu r%d, r0, #%lld\n", reg, imm);
 }
 
-// generate binary arithmetic instructions (+, -, *, /)
+// generate binary arithmetic instructions (+, -, *, /); release 6 targets multiply and divide
+// straight into dst, the others through LO
 static void GenerateBinOp(FILE *out, const char *op_mnemonic, int dst, int r1, int r2) {
-    if(strcmp(op_mnemonic, "dmul") == 0) {
+    if(TargetFind(op_mnemonic) && TargetFind(op_mnemonic)->operands == 3) {
+        fprintf(out, "%s r%d, r%d, r%d\n", op_mnemonic, dst, r1, r2);
+    } else if(strcmp(op_mnemonic, "dmul") == 0) {
         // multiply r1 * r2, result in LO
         fprintf(out, "dmult r%d, r%d\n", r1, r2);
         fprintf(out, "mflo r%d\n", dst);  // move LO directly to dst
@@ -75,186 +446,1541 @@ static void GenerateBinOp(FILE *out, const char *op_mnemonic, int dst, int r1, i
 }
 
 
-// skip spaces to advance pointer past whitespaces in the expression
-static void SkipSpacesPtr(const char **p) {
-    while(**p && isspace(**p))
-        (*p)++;
+// take a node from the per-statement pool
+static ExprNode *NewExprNode(char op, ExprNode *left, ExprNode *right) {
+    if(expr_node_count >= MAX_EXPR_NODES)
+        return NULL;
+    ExprNode *n = &expr_nodes[expr_node_count++];
+    n->op = op;
+    n->value = 0;
+    n->name[0] = '\0';
+    n->left = left;
+    n->right = right;
+    n->vn = -1;
+    return n;
 }
 
-// parse F (factor): lowest precedence
-// F -> (E) | vars | numbers
+// ================= instruction selection =========================
+// every root of the SSA program (a STORE, a loop BRANCH) is covered as one expression tree,
+// rebuilt from the def chains of its operand vregs; the value numbering above then finds
+// what is already sitting in a register, so shared vregs cost nothing twice
+
+static const SsaProgram *sel_prog;  // program being selected
+static int *sel_defs;               // vreg -> index of its defining instruction
+static unsigned char *sel_bytes;    // variable -> bytes of memory (SsaVariableBytes)
+
+// tree for vreg v (NULL for a missing operand, which evaluates to 0)
+static ExprNode *TreeOf(int v) {
+    if(v < 0 || v >= sel_prog->vreg_count || sel_defs[v] < 0)
+        return NULL;
+    const SsaInsn *in = &sel_prog->insns[sel_defs[v]];
+    if(in->kind == SSA_BINOP) {
+        ExprNode *left = TreeOf(in->a);
+        ExprNode *right = TreeOf(in->b);
+        return NewExprNode(in->op, left, right);
+    }
+    ExprNode *n = NewExprNode(0, NULL, NULL);
+    if(n && in->kind == SSA_CONST)
+        n->value = in->imm;
+    else if(n) {
+        strncpy(n->name, NameOf(in->var), MAX_NAME_LEN - 1);
+        n->name[MAX_NAME_LEN - 1] = '\0';
+    }
+    return n;
+}
+
+// tree of one root, in a fresh node pool
+static ExprNode *RootTree(int v) {
+    expr_node_count = 0;
+    return TreeOf(v);
+}
+
+// evaluate a tree made only of literals (+, -, *, / with 64-bit wraparound like the hardware)
+// returns 1 and the value in *result, or 0 if it references a variable or divides by zero
+static int FoldConstant(const ExprNode *n, long long *result) {
+    if(!n)
+        return 0;
+    if(n->op == 0) {
+        if(n->name[0])
+            return 0;
+        *result = n->value;
+        return 1;
+    }
+    long long l, r;
+    if(!FoldConstant(n->left, &l) || !FoldConstant(n->right, &r))
+        return 0;
+    if(n->op == '+')
+        *result = (long long)((unsigned long long)l + (unsigned long long)r);
+    else if(n->op == '-')
+        *result = (long long)((unsigned long long)l - (unsigned long long)r);
+    else if(n->op == '*')
+        *result = (long long)((unsigned long long)l * (unsigned long long)r);
+    else {
+        if(r == 0 || (r == -1 && l == LLONG_MIN))
+            return 0; // leave traps/undefined cases to run time
+        *result = l / r;
+    }
+    return 1;
+}
+
+// is the value stored by insn a compile-time constant; if so it goes to *value
+// such declarations are emitted as initialized data instead of code
+static int ConstantInitializer(const SsaInsn *insn, long long *value) {
+    return FoldConstant(RootTree(insn->a), value);
+}
+
+// value number of a (sub)tree given the current variable values
+// a missing operand (malformed input) is treated as the literal 0
+static int NumberExpr(ExprNode *n) {
+    if(!n)
+        return ValueNumber(VALUE_CONST, -1, -1, 0);
+    if(n->op == 0)
+        n->vn = n->name[0] ? VariableValue(n->name) : ValueNumber(VALUE_CONST, -1, -1, n->value);
+    else
+        n->vn = ValueNumber(n->op, NumberExpr(n->left), NumberExpr(n->right), 0);
+    return n->vn;
+}
+
+// Sethi–Ullman labelling of a numbered tree against the current register contents
+// values already in a register and variables with a free permanent register need no temp;
+// for an operator, evaluating the heavier operand first keeps the lighter one's
+// demand below it, so the order needing fewer temps is chosen (ties keep left first)
+// evaluation order is free for every operator since expressions have no side effects;
+// the operands keep their positions in the emitted instruction
+static void LabelExpr(ExprNode *n) {
+    if(!n)
+        return;
+    int r = PeekRegisterHolding(n->vn);
+    if(r != -1) {
+        n->need = 0;
+        n->occ = IsTempRegister(r);
+        return;
+    }
+    if(n->op == 0) {
+        int reg = n->name[0] ? GetRegisterOfTheSymbol(n->name) : -1;
+        int in_own_reg = (reg != -1 && !IsRegisterBusy(reg));
+        n->need = in_own_reg ? 0 : 1;
+        n->occ = n->need;
+        return;
+    }
+
+    LabelExpr(n->left);
+    LabelExpr(n->right);
+    int ln = n->left ? n->left->need : 0, lo = n->left ? n->left->occ : 0;
+    int rn = n->right ? n->right->need : 0, ro = n->right ? n->right->occ : 0;
+    int left_first = ln > lo + rn ? ln : lo + rn;
+    int right_first = rn > ro + ln ? rn : ro + ln;
+    n->right_first = right_first < left_first;
+    n->need = n->right_first ? right_first : left_first;
+    if(n->need < 1)
+        n->need = 1;
+    n->occ = 1;
+}
+
+static int GenerateExpr(const ExprNode *n, FILE *out, int target);
+
+// evaluate both operands of an operator (or comparison) node
+// heavier operand first, kept pinned while the other one is evaluated
+// the registers come back in *left and *right, in source order
+static void GenerateOperands(const ExprNode *n, FILE *out, int *left, int *right) {
+    ExprNode *first = n->right_first ? n->right : n->left;
+    ExprNode *second = n->right_first ? n->left : n->right;
+    int rfirst = GenerateExpr(first, out, 0);
+    reg_pinned[rfirst]++;
+
+    // relabel against what is in the registers now; if the second operand
+    // cannot be evaluated with the temps left, park the first one in memory
+    int spill = -1;
+    LabelExpr(second);
+    if(second && IsTempRegister(rfirst) && FreeTempCount() < second->need) {
+        spill = spill_depth++;
+        if(spill_depth > spill_slots)
+            spill_slots = spill_depth;
+        fprintf(out, "sd r%d, _spill%d(r0)\n", rfirst, spill);
+        reg_pinned[rfirst]--;
+    }
+
+    int rsecond = GenerateExpr(second, out, 0);
+    if(spill != -1) {
+        // the value may have survived in its temp; reload only if it was evicted
+        rfirst = FindRegisterHolding(first->vn);
+        if(rfirst == -1) {
+            reg_pinned[rsecond]++;
+            rfirst = NewTempRegister();
+            reg_pinned[rsecond]--;
+            fprintf(out, "ld r%d, _spill%d(r0)\n", rfirst, spill);
+            WriteRegister(rfirst, first->vn);
+        }
+        spill_depth--;
+    } else
+        reg_pinned[rfirst]--;
+
+    *left = n->right_first ? rsecond : rfirst;
+    *right = n->right_first ? rfirst : rsecond;
+}
+
+// generate code for an already numbered and labelled tree
+// target: register the result should land in (0 = any temp)
+// values already sitting in a register are reused, nothing is emitted for them
 // returns register number containing result
-static int Parse_F(const char **p, FILE *out, int target) {
-    SkipSpacesPtr(p);
-
-    // (): recursively parse inner expression
-    if(**p == '(') {
-        (*p)++;
-        int r = Parse_E(p, out, target);
-        SkipSpacesPtr(p);
-        if(**p == ')')
-            (*p)++;
+static int GenerateExpr(const ExprNode *n, FILE *out, int target) {
+    if(!n)
+        return 0;
+    int r = FindRegisterHolding(n->vn);
+    if(r != -1)
         return r;
+
+    // variable: load into its own register unless that one is busy (then straight into the
+    // target, so no move follows)
+    if(n->op == 0 && n->name[0]) {
+        int reg = AllocateRegisterForTheSymbol(n->name);
+        if(reg == -1 || IsRegisterBusy(reg))
+            reg = target ? target : NewTempRegister();
+        LoadVariable(out, reg, n->name);
+        WriteRegister(reg, n->vn);
+        return reg;
     }
 
-    // mumeric literal
-    if(isdigit(**p)) {
-        long long val = 0;
-        while(**p && isdigit(**p)) { 
-            val = val * 10 + (**p - '0'); 
-            (*p)++; 
-        }
-        int r = target ? target : NewTempRegister();
-        GenerateLoadImmediate(out, r, val);
+    // literal
+    if(n->op == 0) {
+        r = target ? target : NewTempRegister();
+        GenerateLoadImmediate(out, r, n->value);
+        WriteRegister(r, n->vn);
         return r;
     }
 
-    // variable
-    if(isalpha(**p) || **p == '_') {
-        char name[128];
-        int i = 0;
-        while(**p && (isalnum(**p)||**p == '_')) 
-            if(i < 127)
-                name[i++] = *(*p)++;
-        name[i] = '\0';
-        int reg = GetRegisterOfTheSymbol(name);
-        if(reg == -1) 
-            reg = AllocateRegisterForTheSymbol(name);
-        LoadVariable(out, reg, name);
-        return reg;
+    // operator
+    int left, right;
+    GenerateOperands(n, out, &left, &right);
+    int dst = target ? target : NewTempRegister();
+    if(n->op == '+') 
+        GenerateBinOp(out, "daddu", dst, left, right);
+    else if(n->op == '-')
+        GenerateBinOp(out,"dsubu", dst, left, right);
+    else if(n->op == '*') 
+        GenerateBinOp(out,"dmul",dst,left,right);
+    else 
+        GenerateBinOp(out,"ddiv",dst,left,right);
+    WriteRegister(dst, n->vn);
+    return dst;
+}
+
+// evaluate rhs and store it into lhs (shared by declarations and assignments)
+// the result is computed directly into the lhs register (a temp if lhs has none
+// or if it is holding a loop invariant);
+// if the value is already available in some register it is stored from there instead
+static void GenerateStore(const char *lhs, int lhs_reg, ExprNode *root, FILE *out) {
+    int vn = NumberExpr(root);
+    LabelExpr(root);
+    int target = (lhs_reg == -1 || IsRegisterBusy(lhs_reg)) ? 0 : lhs_reg;
+    int rres = GenerateExpr(root, out, target);
+    StoreVariable(out, rres, lhs);
+    SetVariableValue(lhs, StoredValue(lhs, vn));
+}
+
+// bytes of memory of the variable a declaration declares
+static int DeclaredBytes(const SsaInsn *decl) {
+    return decl->imm > 0 ? (int)decl->imm : 8;
+}
+
+// a declaration gives the variable its register (in declaration order)
+static void GenerateDeclaration(const SsaInsn *insn) {
+    // -1 once r1-r19 are used up: the variable then only lives in memory
+    AllocateRegisterForTheSymbolOfSize(NameOf(insn->var), DeclaredBytes(insn));
+}
+
+// a store: a declaration's initializer or an assignment
+// the rhs tree is evaluated and stored to the variable
+static void GenerateAssignment(const SsaInsn *insn, FILE *out) {
+    const char *name = NameOf(insn->var);
+    int reg = AllocateRegisterForTheSymbol(name);
+
+    // constant initializer: the value is already in .data, no code at all
+    // (not inside a loop, where the declaration re-initializes on every iteration, nor in an
+    // if arm, which may not run, nor for a function's local, which has no .data)
+    long long value;
+    if(insn->init && loop_depth == 0 && if_depth == 0 && !in_function && ConstantInitializer(insn, &value)) {
+        SetVariableValue(name, StoredValue(name, ValueNumber(VALUE_CONST, -1, -1, value)));
+        return;
     }
+    GenerateStore(name, reg, RootTree(insn->a), out);
+}
 
-    return 0;
+// line profiling: "# line N" opens the code of source line N in the listing (the profile
+// map attributes every instruction up to the next marker to it)
+static void GenerateLineMarker(const SsaInsn *count, FILE *out) {
+    fprintf(out, "# line %lld\n", count->imm);
 }
 
-// parse T (term): handles * and / ops
-// left-associative chaining
-// T -> T * F | T / F | F
-static int Parse_T(const char **p, FILE *out, int target) {
-    //int left = Parse_F(p, out, 0);
-    int left = Parse_F(p, out, target ? target : 0);
-    while(1) {
-        SkipSpacesPtr(p);
-        if(**p == '*'||**p == '/') {
-            char op = **p; (*p)++;
-            SkipSpacesPtr(p);
-            int right = Parse_F(p, out, 0);
-            int dst = target ? target : NewTempRegister();
-            if(op == '*') 
-                GenerateBinOp(out,"dmul",dst,left,right);
-            else 
-                GenerateBinOp(out,"ddiv",dst,left,right);
-            left = dst;
-        } else 
-            break;
+// a line counter: _lineN += 1 through a temp
+static void GenerateCounter(const SsaInsn *insn, FILE *out) {
+    const char *name = NameOf(insn->var);
+    GenerateLineMarker(insn, out);
+    int t = NewTempRegister();
+    LoadVariable(out, t, name);
+    fprintf(out, "daddiu r%d, r%d, #1\n", t, t);
+    StoreVariable(out, t, name);
+    WriteRegister(t, NewOpaqueValue());
+}
+
+// a print statement: every value into its slot of the argument block, the format's address
+// into _print0, then one SYSCALL 5 with r14 on the block. returns the index after its last part
+//     daddiu rT, r0, _fmtK
+//     sd rT, _print0(r0)
+//     <value 1>
+//     sd rV, _print1(r0)
+//     ...
+//     daddiu r14, r0, _print0
+//     syscall 5
+static int GeneratePrint(int start, FILE *out) {
+    int end, count;
+    char name[MAX_NAME_LEN];
+    free(SsaPrintFormat(sel_prog, sel_defs, start, &end, print_vregs, &count));
+    ResetTempRegister();
+    EnsureValueCapacity(2 * MAX_EXPR_NODES);
+    snprintf(name, sizeof(name), "_fmt%d", print_format[start]);
+    StoreVariable(out, LoadAddress(out, 0, name, print_format[start]), "_print0");
+    for(int k = 0; k < count; k++) {
+        ResetTempRegister();
+        EnsureValueCapacity(2 * MAX_EXPR_NODES);
+        ExprNode *root = RootTree(print_vregs[k]);
+        NumberExpr(root);
+        LabelExpr(root);
+        snprintf(name, sizeof(name), "_print%d", k + 1);
+        StoreVariable(out, GenerateExpr(root, out, 0), name);
     }
-    return left;
-}
-
-// parse E (expression)
-// Handles + and -; also left-associative
-// E -> E + T | E - T | T
-static int Parse_E(const char **p, FILE *out, int target) {
-    int left = Parse_T(p, out, target);
-    while(1) {
-        SkipSpacesPtr(p);
-        if(**p == '+'||**p == '-') {
-            char op = **p;
-            (*p)++;
-            SkipSpacesPtr(p);
-            int right = Parse_T(p, out, 0);
-            //int dst = NewTempRegister(); 
-            int dst = left; // final result stays in left (target) reg (fixed to not emit unnecessary "daddu")
-            if(op == '+') 
-                GenerateBinOp(out, "daddu", dst, left, right);
-            else 
-                GenerateBinOp(out,"dsubu", dst, left, right);
-            left = dst;
-        } else 
-            break;
+    ResetTempRegister();
+    LoadAddress(out, SYSCALL_ARGUMENT, "_print0", -1);
+    fprintf(out, "syscall 5\n");
+    WriteRegister(SYSCALL_RESULT, NewOpaqueValue());
+    return end;
+}
+
+// a call may store to any variable but the calling function's own
+static void ForgetGlobals() {
+    EnsureValueCapacity(var_value_count + 2 * MAX_EXPR_NODES);
+    for(int i = 0; i < var_value_count; i++)
+        if(!in_function || !IsFrameSymbol(var_values[i].name))
+            var_values[i].vn = NewOpaqueValue();
+}
+
+// a call: the ARG run in front of it into the argument slots, jal, then the result from r2
+// into its variable; the caller-saved registers are unknown afterwards
+//     <argument k>
+//     sd rA, -8(k+1)(r29)
+//     jal _func_f
+//     sd r2, x(r0)
+static void GenerateCall(int call, FILE *out) {
+    const SsaInsn *insn = &sel_prog->insns[call];
+    int first = call;
+    while(first > 0 && sel_prog->insns[first - 1].kind == SSA_ARG)
+        first--;
+    for(int k = first; k < call; k++) {
+        ResetTempRegister();
+        EnsureValueCapacity(2 * MAX_EXPR_NODES);
+        ExprNode *root = RootTree(sel_prog->insns[k].a);
+        NumberExpr(root);
+        LabelExpr(root);
+        int r = GenerateExpr(root, out, 0);
+        fprintf(out, "sd r%d, -%d(r%d)\n", r, 8 * (k - first + 1), STACK_POINTER);
+    }
+    ResetTempRegister();
+    fprintf(out, "jal _func_%s\n", NameOf((int)insn->imm));
+    reg_value[RESULT_REGISTER] = reg_value[RETURN_ADDRESS] = -1;
+    for(int r = temp_start; r <= temp_max; r++)
+        if(!reg_reserved[r])
+            reg_value[r] = -1;
+    ForgetGlobals();
+    int vn = NewOpaqueValue();
+    WriteRegister(RESULT_REGISTER, vn);
+    if(insn->var >= 0) {
+        StoreVariable(out, RESULT_REGISTER, NameOf(insn->var));
+        SetVariableValue(NameOf(insn->var), StoredValue(NameOf(insn->var), vn));
     }
-    return left;
 }
 
-// assembly for declaration
-// allocate register, parse RHS if present
-// generate store instruction to memory
-int AssemblyGenerateDeclaration(const Statement *stmt, FILE *out) {
-    if(!stmt || stmt->type != STMT_DECL)
-        return 0;
+// the next instruction that is not deleted
+static int NextInstruction(int i) {
+    for(i++; i < sel_prog->count && sel_prog->insns[i].kind == SSA_NOP; i++)
+        ;
+    return i;
+}
+
+// return: the value into r2, then to the epilogue (falling into it from the end of the body)
+static void GenerateReturn(int i, FILE *out) {
+    ResetTempRegister();
+    EnsureValueCapacity(2 * MAX_EXPR_NODES);
+    ExprNode *root = RootTree(sel_prog->insns[i].a);
+    int vn = NumberExpr(root);
+    LabelExpr(root);
+    int target = IsRegisterBusy(RESULT_REGISTER) ? 0 : RESULT_REGISTER;
+    int r = FindRegisterHolding(vn);
+    if(r == -1 && target && root && root->op == 0 && root->name[0]) {
+        // a variable not in a register goes straight into r2: its own one would only be copied
+        LoadVariable(out, target, root->name);
+        WriteRegister(target, vn);
+        r = target;
+    }
+    else if(r == -1)
+        r = GenerateExpr(root, out, target);
+    if(r != RESULT_REGISTER)
+        fprintf(out, "daddu r%d, r%d, r0\n", RESULT_REGISTER, r);
+    WriteRegister(RESULT_REGISTER, vn);
+    int next = NextInstruction(i);
+    if(next < sel_prog->count && sel_prog->insns[next].kind == SSA_ENDFUNC)
+        return;
+    fprintf(out, "j _ret%d\n", function_count - 1);
+    function_returns = 1;
+}
 
-    int reg = AllocateRegisterForTheSymbol(stmt->lhs);
-    if(reg == -1) 
+// single statement-level instruction
+// dispatch each declaration/store/line counter to the correct generator
+// reset temp regs and the expression pool between them to avoid overlap
+int GenerateAssemblyStatement(const SsaInsn *insn, FILE *out) {
+    if(!insn || !out)
+        return 0;
+    ResetTempRegister();
+    expr_node_count = 0;
+    // a statement adds at most a couple of values per node; start over before the table fills up
+    EnsureValueCapacity(2 * MAX_EXPR_NODES);
+    if(insn->kind == SSA_DECL)
+        GenerateDeclaration(insn);
+    else if(insn->kind == SSA_STORE)
+        GenerateAssignment(insn, out);
+    else if(insn->kind == SSA_COUNT)
+        GenerateCounter(insn, out);
+    else
         return 0;
+    return 1;
+}
+
+// ============================== while loops ==============================
+// layout (test at the bottom, so an iteration takes exactly one branch):
+//         <loop-invariant values computed once>
+//         j _testN
+// _loopN: <body>
+// _testN: <condition>
+//         bne/beq ... _loopN
+// labels start with '_' so they can never clash with a user variable
+
+// temps left for the body after hoisting (evaluating and spilling needs a few)
+#define LOOP_FREE_TEMPS 4
+
+// variables assigned anywhere inside the loop being set up (interned ids), and whether it
+// calls a function (which may assign any variable: nothing is hoisted then)
+static int loop_vars[MAX_SYMBOLS];
+static int loop_var_count = 0;
+static int loop_calls = 0;
 
-    // only generate code if RHS is non-empty
-    if(stmt->rhs[0] != '\0') {
-        const char *p = stmt->rhs;
-        int rres = Parse_E(&p, out, reg);
-        // only emit daddu if the expr returned a different register & it is not a literal
-        if(rres != reg && rres >= temp_start)
-            fprintf(out,"daddu r%d, r%d, r0\n", reg, rres);
-        StoreVariable(out, reg, stmt->lhs);
+// saved value numbering state, to restore the state at the loop exit
+typedef struct {
+    int reg_value[NUM_REGISTERS];
+    VarValue vars[MAX_SYMBOLS];
+    int var_count;
+    int epoch;
+} ValueSnapshot;
+
+static void SaveValues(ValueSnapshot *snap) {
+    memcpy(snap->reg_value, reg_value, sizeof(reg_value));
+    memcpy(snap->vars, var_values, var_value_count * sizeof(VarValue));
+    snap->var_count = var_value_count;
+    snap->epoch = value_epoch;
+}
+
+// if the value table was cleared in between, the saved numbers mean nothing: forget everything
+static void RestoreValues(const ValueSnapshot *snap) {
+    if(snap->epoch != value_epoch) {
+        ResetValueNumbering();
+        return;
+    }
+    memcpy(reg_value, snap->reg_value, sizeof(reg_value));
+    memcpy(var_values, snap->vars, snap->var_count * sizeof(VarValue));
+    var_value_count = snap->var_count;
+}
+
+static int IsLoopVariableId(int id) {
+    for(int i = 0; i < loop_var_count; i++)
+        if(loop_vars[i] == id)
+            return 1;
+    return 0;
+}
+
+static int IsLoopVariable(const char *name) {
+    int id = FindName(name);
+    return id >= 0 && IsLoopVariableId(id);
+}
+
+// collect every variable stored to in insns[start..end) (nested loops included)
+static void CollectLoopVariables(int start, int end) {
+    loop_var_count = 0;
+    loop_calls = 0;
+    for(int i = start; i < end; i++) {
+        const SsaInsn *in = &sel_prog->insns[i];
+        if(in->kind == SSA_STORE && !IsLoopVariableId(in->var) && loop_var_count < MAX_SYMBOLS)
+            loop_vars[loop_var_count++] = in->var;
+        loop_calls |= in->kind == SSA_CALL;
     }
-    return 1;
 }
 
-// asse,bly for assignment
-// parse expression and store to variable
-int AssemblyGenerateAssignment(const Statement *stmt, FILE *out) {
-    if(!stmt || stmt->type != STMT_ASSIGN)
+// same value on every iteration: no variable assigned in the loop, and no division
+// that could trap when hoisted in front of a loop that runs zero times
+static int IsLoopInvariant(const ExprNode *n) {
+    if(!n)
+        return 1;
+    if(n->op == 0)
+        return !n->name[0] || !IsLoopVariable(n->name);
+    long long divisor;
+    if(n->op == '/' && (!FoldConstant(n->right, &divisor) || divisor == 0))
         return 0;
+    return IsLoopInvariant(n->left) && IsLoopInvariant(n->right);
+}
+
+// compute the largest loop-invariant parts of a numbered tree in front of the loop
+// and reserve their registers for the whole loop (as long as enough temps stay free)
+// 1 while hoisting for a loop with a print in it: r1 and r14 change with every SYSCALL 5
+static int hoist_around_syscall = 0;
+
+static void HoistInvariants(ExprNode *n, FILE *out, int *reserved, int *reserved_count) {
+    if(!n)
+        return;
+    if(!IsLoopInvariant(n)) {
+        if(n->op) {
+            HoistInvariants(n->left, out, reserved, reserved_count);
+            HoistInvariants(n->right, out, reserved, reserved_count);
+        }
+        return;
+    }
+    LabelExpr(n);
+    if(n->occ && FreeTempCount() - 1 < LOOP_FREE_TEMPS)
+        return; // would leave the body too few temps
+    ResetTempRegister();
+    int r = GenerateExpr(n, out, 0);
+    if(r == 0 || reg_reserved[r])
+        return; // r0, or already kept for an enclosing loop
+    if(hoist_around_syscall && (r == SYSCALL_ARGUMENT || r == SYSCALL_RESULT))
+        return;
+    reg_reserved[r]++;
+    reserved[(*reserved_count)++] = r;
+}
 
-    int lhs_reg = GetRegisterOfTheSymbol(stmt->lhs);
-    if(lhs_reg == -1)
-        lhs_reg = AllocateRegisterForTheSymbol(stmt->lhs);
+// the two sides of a loop condition as numbered trees; returns the comparison, one of
+// < > l (<=) g (>=) = (==) ! (!=), or 0 for a plain expression (then *rhs is NULL)
+static char ConditionTrees(const SsaInsn *branch, ExprNode **lhs, ExprNode **rhs) {
+    *lhs = RootTree(branch->a);
+    NumberExpr(*lhs);
+    *rhs = NULL;
+    if(branch->op) {
+        *rhs = TreeOf(branch->b);
+        NumberExpr(*rhs);
+    }
+    return branch->op;
+}
 
-    const char *rhs = stmt->rhs;
-    char *endptr;
-    long imm_val = strtol(rhs, &endptr, 0);
+// hoist the invariant parts of every expression in insns[start..end) (own condition included)
+static void HoistLoop(int start, int end, FILE *out, int *reserved, int *reserved_count) {
+    hoist_around_syscall = 0;
+    for(int i = start; i < end; i++)
+        hoist_around_syscall |= sel_prog->insns[i].kind == SSA_PRINT;
+    for(int i = start; i < end; i++) {
+        const SsaInsn *in = &sel_prog->insns[i];
+        if(in->kind == SSA_CONST || in->kind == SSA_LOAD || in->kind == SSA_BINOP || in->kind == SSA_NOP)
+            continue; // part of the tree of a later root
+        EnsureValueCapacity(2 * MAX_EXPR_NODES);
+        if(in->kind == SSA_BRANCH) {
+            ExprNode *lhs, *rhs;
+            ConditionTrees(in, &lhs, &rhs);
+            HoistInvariants(lhs, out, reserved, reserved_count);
+            HoistInvariants(rhs, out, reserved, reserved_count);
+        } else if(in->kind == SSA_STORE) {
+            ExprNode *root = RootTree(in->a);
+            NumberExpr(root);
+            HoistInvariants(root, out, reserved, reserved_count);
+        }
+    }
+    ResetTempRegister();
+}
 
-    if(*endptr == '\0') {
-        // directly assign literals into permanent registers r1–r19
-        GenerateLoadImmediate(out, lhs_reg, imm_val);
-    } else {
-        int rres = Parse_E(&rhs, out, lhs_reg);
-        if(rres != lhs_reg && rres >= temp_start)
-            fprintf(out,"daddu r%d, r%d, r0\n", lhs_reg, rres);
+// state at _testN: reached from before the loop and from the end of the body, so only
+// the reserved invariants are known to be in registers, and loop variables hold unknown values
+// (the global pointer too if the loop moves it between windows)
+static void EnterLoopHeader(int window_changes) {
+    EnsureValueCapacity(loop_var_count + 2 * MAX_EXPR_NODES);
+    for(int i = 0; i < loop_var_count; i++)
+        SetVariableValue(NameOf(loop_vars[i]), NewOpaqueValue());
+    if(loop_calls)
+        ForgetGlobals();
+    for(int r = 1; r < NUM_REGISTERS; r++)
+        if(!reg_reserved[r])
+            reg_value[r] = -1;
+    if(window_changes)
+        reg_value[GP_REGISTER] = -1;
+}
+
+// .data windows past the first used in insns[start..end): 0, 1 (*window) or 2 (more than one)
+static int LoopWindows(int start, int end, int *window) {
+    int count = 0;
+    for(int i = start; i < end; i++) {
+        const SsaInsn *in = &sel_prog->insns[i];
+        char format[MAX_NAME_LEN];
+        const char *name = NameOf(in->var);
+        if(in->kind == SSA_PRINT && in->init) {
+            snprintf(format, sizeof(format), "_fmt%d", print_format[i]);
+            name = format;
+        } else if(in->kind != SSA_LOAD && in->kind != SSA_STORE && in->kind != SSA_COUNT)
+            continue;
+        long long offset = (long long)GetOffsetOfTheSymbol(name);
+        if(offset < DATA_WINDOW_REACH)
+            continue;
+        if(count == 0) {
+            *window = DATA_WINDOW(offset);
+            count = 1;
+        } else if(DATA_WINDOW(offset) != *window)
+            return 2;
     }
+    return count;
+}
 
-    StoreVariable(out, lhs_reg, stmt->lhs);
-    return 1;
+// branch to label when the condition holds (when = 1) or when it fails (when = 0)
+static void GenerateBranch(const SsaInsn *branch, const char *label, int when, FILE *out) {
+    ResetTempRegister();
+    EnsureValueCapacity(2 * MAX_EXPR_NODES);
+    ExprNode *lhs, *rhs;
+    char op = ConditionTrees(branch, &lhs, &rhs);
+
+    if(op == 0) {
+        // plain expression: true when non-zero
+        LabelExpr(lhs);
+        int r = GenerateExpr(lhs, out, 0);
+        fprintf(out, "%s r%d, r0, %s\n", when ? "bne" : "beq", r, label);
+        return;
+    }
+
+    ExprNode cmp = { 0 };
+    cmp.op = op;
+    cmp.left = lhs;
+    cmp.right = rhs;
+    cmp.vn = -1;
+    LabelExpr(&cmp);
+    int a, b;
+    GenerateOperands(&cmp, out, &a, &b);
+
+    if(op == '=' || op == '!') {
+        fprintf(out, "%s r%d, r%d, %s\n", (op == '=') == when ? "beq" : "bne", a, b, label);
+        return;
+    }
+    // a < b and a >= b test slt a, b; a > b and a <= b test slt b, a
+    int t = NewTempRegister();
+    if(op == '<' || op == 'g')
+        fprintf(out, "slt r%d, r%d, r%d\n", t, a, b);
+    else
+        fprintf(out, "slt r%d, r%d, r%d\n", t, b, a);
+    WriteRegister(t, NewOpaqueValue());
+    fprintf(out, "%s r%d, r0, %s\n", (op == '<' || op == '>') == when ? "bne" : "beq", t, label);
+}
+
+static int GenerateBlock(int start, int end, FILE *out);
+
+// while loop opened at insns[start]; returns the index after its ENDLOOP
+static int GenerateLoop(int start, int count, FILE *out) {
+    int branch = SsaLoopBranch(sel_prog, start);
+    int end = SsaLoopEnd(sel_prog, start);
+    if(end > count)
+        end = count;
+    int label = loop_count++;
+    char body_label[32], test_label[32];
+    snprintf(body_label, sizeof(body_label), "_loop%d", label);
+    snprintf(test_label, sizeof(test_label), "_test%d", label);
+
+    // the while line's counter (profiling) runs with every test; the code in front of
+    // the loop belongs to that line as well
+    const SsaInsn *counter = NULL;
+    for(int i = start + 1; i < branch; i++)
+        if(sel_prog->insns[i].kind == SSA_COUNT)
+            counter = &sel_prog->insns[i];
+    if(counter)
+        GenerateLineMarker(counter, out);
+
+    // 1) loop-invariant code motion: compute once, keep in reserved registers
+    int reserved[NUM_REGISTERS];
+    int reserved_count = 0;
+    CollectLoopVariables(branch + 1, end);
+    if(!loop_calls)
+        HoistLoop(start, end, out, reserved, &reserved_count);
+    // large .data: a loop staying in one window sets the global pointer once, in front of it
+    int window = 0, windows = far_data ? LoopWindows(start, end, &window) : 0;
+    if(windows == 1)
+        SetDataWindow(out, window);
+    fprintf(out, "j %s\n", test_label);
+
+    // 2) the test is generated first: the body is only ever entered from its branch,
+    //    so whatever the test leaves in registers is known at the top of the body
+    //    (without a scratch file the test is generated last, from the header state)
+    EnterLoopHeader(windows > 1);
+    FILE *test = tmpfile();
+    ValueSnapshot *exit_state = test ? malloc(sizeof(ValueSnapshot)) : NULL;
+    if(test) {
+        if(counter)
+            GenerateAssemblyStatement(counter, test);
+        GenerateBranch(&sel_prog->insns[branch], body_label, 1, test);
+        if(exit_state)
+            SaveValues(exit_state);
+    }
+
+    // 3) body
+    loop_depth++;
+    fprintf(out, "%s:\n", body_label);
+    GenerateBlock(branch + 1, end, out);
+    loop_depth--;
+
+    // 4) test at the bottom; the exit is only reached by falling out of it
+    fprintf(out, "%s:\n", test_label);
+    if(test) {
+        char line[BUFSIZ];
+        rewind(test);
+        while(fgets(line, sizeof(line), test))
+            fputs(line, out);
+        fclose(test);
+        if(exit_state)
+            RestoreValues(exit_state);
+        else
+            ResetValueNumbering();
+        free(exit_state);
+    } else {
+        CollectLoopVariables(branch + 1, end); // nested loops reused the list
+        EnterLoopHeader(windows > 1);
+        if(counter)
+            GenerateAssemblyStatement(counter, out);
+        GenerateBranch(&sel_prog->insns[branch], body_label, 1, out);
+    }
+    for(int i = 0; i < reserved_count; i++)
+        reg_reserved[reserved[i]]--;
+    return end < count ? end + 1 : end;
 }
 
-// single statement
-// dispatch each parsed statement to the correct generator
-// reset temp regs between statements to avoid overlap
-int GenerateAssemblyStatement(const Statement *stmt, FILE *out) {
-    if(!stmt || !out)
+// ============================== if statements ==============================
+// small arms free of side effects are lowered without branches: both arms are evaluated,
+// the condition goes to a register, and a conditional move picks each variable's value
+// (an arm not assigning a variable leaves it its old value)
+//         <condition>                 rc: e.g. slt rc, a, b (zero / nonzero tells the outcome)
+//         <then arm, then else arm>   results kept in registers, nothing stored yet
+//         movn rE, rT, rc             (movz when zero means the condition holds)
+//         sd rE, x(r0)
+// anything else branches around the arm not taken:
+//         <condition>
+//         beq/bne ... _elseN          (_endifN without an else part)
+//         <then arm>
+//         j _endifN
+// _elseN: <else arm>
+// _endifN:
+
+#define MAX_SELECT_COST  8      // cycles of the arms' instructions lowered branchless at most (see ArmCost)
+#define MAX_SELECT_VARS  3      // variables assigned in the arms
+#define MAX_SELECT_NODES 32     // expression tree nodes of the arms' stores
+
+// nodes of the tree of vreg v (see TreeOf)
+static int TreeSize(int v) {
+    if(v < 0 || v >= sel_prog->vreg_count || sel_defs[v] < 0)
         return 0;
+    const SsaInsn *in = &sel_prog->insns[sel_defs[v]];
+    if(in->kind != SSA_BINOP)
+        return 1;
+    int left = TreeSize(in->a);
+    if(left > MAX_SELECT_NODES)
+        return left;
+    return 1 + left + TreeSize(in->b);
+}
+
+// cycles of a multiply ('*') or divide ('/') on the target, with the mflo of the HI/LO forms
+// (3 on eduMIPS64, which the limit was made with); anything else takes one
+static int ArmCost(char op) {
+    if(op != '*' && op != '/')
+        return 1;
+    const TargetInstruction *in = op == '/' ? TargetFind("ddiv") : TargetFind("dmul");
+    if(!in)
+        in = TargetFind("dmult");
+    int cost = in ? in->latency : 1;
+    if(in && in->operands == 2 && TargetFind("mflo"))
+        cost += TargetFind("mflo")->latency;
+    return cost;
+}
+
+// can the arms in insns[start..end) (the ELSE at otherwise skipped, -1 if none) run
+// unconditionally: only cheap arithmetic and stores, no division that could trap, nothing
+// opening a region; the variables they assign go to vars, their number is returned (-1: no).
+// targets without movz/movn (release 6) always branch, and so does an arm assigning a char,
+// short or int32 (its value in a register is not yet the cut one the arm may read back)
+static int SelectVariables(int start, int otherwise, int end, int *vars) {
+    int cost = 0, nodes = 0, count = 0;
+    if(!TargetFind("movz") || !TargetFind("movn"))
+        return -1;
+    for(int i = start; i < end; i++) {
+        const SsaInsn *in = &sel_prog->insns[i];
+        if(i == otherwise || in->kind == SSA_NOP || in->kind == SSA_DECL)
+            continue;
+        if(in->kind == SSA_CONST)
+            cost += ImmediateInstructions(in->imm);
+        else if(in->kind == SSA_LOAD)
+            cost++;
+        else if(in->kind == SSA_BINOP) {
+            if(in->op == '/') {
+                const SsaInsn *d = in->b >= 0 && sel_defs[in->b] >= 0 ? &sel_prog->insns[sel_defs[in->b]] : NULL;
+                if(!d || d->kind != SSA_CONST || d->imm == 0 || d->imm == -1)
+                    return -1;
+            }
+            cost += ArmCost(in->op);
+        }
+        else if(in->kind == SSA_STORE) {
+            if(sel_bytes[in->var] < 8)
+                return -1;
+            cost++;
+            nodes += TreeSize(in->a);
+            int k = 0;
+            while(k < count && vars[k] != in->var)
+                k++;
+            if(k == count) {
+                if(count == MAX_SELECT_VARS)
+                    return -1;
+                vars[count++] = in->var;
+            }
+        }
+        else
+            return -1; // a loop, an if, a print or a line counter
+        if(cost > MAX_SELECT_COST || nodes > MAX_SELECT_NODES)
+            return -1;
+    }
+    return count;
+}
+
+// branchless lowering state: registers reserved by it (mine) and references to them still
+// to come (uses), result registers of the variables in each arm (-1: not assigned there)
+static int select_mine[NUM_REGISTERS];
+static int select_uses[NUM_REGISTERS];
+
+static void SelectReserve(int reg) {
+    if(reg <= 0)
+        return;
+    reg_reserved[reg]++;
+    select_mine[reg]++;
+}
+
+// can reg take the value of variable name: reserved by nobody else, nothing coming up reads
+// it, and a temp or the variable's own register (another variable's would have to be reloaded)
+static int SelectDisposable(int reg, int rc, const char *name) {
+    return reg > 0 && reg != rc && select_uses[reg] == 0 && reg_reserved[reg] == select_mine[reg] &&
+           (IsTempRegister(reg) || reg == GetRegisterOfTheSymbol(name));
+}
+
+// evaluate one arm (insns[start..end)), leaving the value of every variable it assigns in a
+// reserved register (result[k] for vars[k]); the variables' values are put back afterwards
+static void SelectArm(int start, int end, const int *vars, int count, int *result, FILE *out) {
+    ValueSnapshot *before = malloc(sizeof(ValueSnapshot));
+    if(before)
+        SaveValues(before);
+    for(int k = 0; k < count; k++)
+        result[k] = -1;
+    for(int i = start; i < end; i++) {
+        const SsaInsn *in = &sel_prog->insns[i];
+        if(in->kind == SSA_DECL)
+            GenerateDeclaration(in);
+        if(in->kind != SSA_STORE)
+            continue;
+        ResetTempRegister();
+        ExprNode *root = RootTree(in->a);
+        int vn = NumberExpr(root);
+        LabelExpr(root);
+        int r = GenerateExpr(root, out, 0);
+        int k = 0;
+        while(vars[k] != in->var)
+            k++;
+        if(result[k] > 0) {
+            reg_reserved[result[k]]--; // assigned twice: the first value is dead
+            select_mine[result[k]]--;
+        }
+        result[k] = r;
+        SelectReserve(r);
+        SetVariableValue(NameOf(in->var), vn);
+    }
     ResetTempRegister();
-    if(stmt->type == STMT_DECL)
-        return AssemblyGenerateDeclaration(stmt, out);
-    if(stmt->type ==  STMT_ASSIGN) 
-        return AssemblyGenerateAssignment(stmt, out);
-    return 0;
+    if(before) {
+        memcpy(var_values, before->vars, before->var_count * sizeof(VarValue));
+        var_value_count = before->var_count;
+        free(before);
+    }
 }
 
-// Full program
-// make entry point for code generation
-// a. iniialize symbol table
-// b. generate .data section w/ var declarations
-// c. generate .code section 
-void AssemblyGenerateProgram(const Statement *stmts,int count,FILE *out){
-    SymbolInit();
-    fprintf(out, ".data\n");
-    // only declare variables, no duplicates, no zero init
-    for(int i = 0; i < count; i++)
-        if(stmts[i].type == STMT_DECL)
-            fprintf(out,"%s: .space 8\n",stmts[i].lhs);
+// the if statement with its BRANCH at insns[branch] and its arms in insns[branch+1..end)
+// without branches (see SelectVariables for the vars)
+static void GenerateSelect(int branch, int otherwise, int end, const int *vars, int count, FILE *out) {
+    const SsaInsn *cond = &sel_prog->insns[branch];
+    memset(select_mine, 0, sizeof(select_mine));
+    memset(select_uses, 0, sizeof(select_uses));
+    ResetTempRegister();
+    EnsureValueCapacity(2 * MAX_EXPR_NODES + 2 * MAX_SELECT_NODES + 4 * MAX_SELECT_VARS + 8);
+
+    // 1) the condition into rc; zero_true: the condition holds when rc is zero
+    ExprNode *lhs, *rhs;
+    char op = ConditionTrees(cond, &lhs, &rhs);
+    int rc, zero_true = 0;
+    if(op == 0) {
+        LabelExpr(lhs);
+        rc = GenerateExpr(lhs, out, 0);
+    } else {
+        ExprNode cmp = { 0 };
+        cmp.op = op;
+        cmp.left = lhs;
+        cmp.right = rhs;
+        cmp.vn = -1;
+        LabelExpr(&cmp);
+        int a, b;
+        GenerateOperands(&cmp, out, &a, &b);
+        rc = NewTempRegister();
+        if(op == '=' || op == '!') {
+            // a - b is zero exactly when a == b
+            GenerateBinOp(out, "dsubu", rc, a, b);
+            WriteRegister(rc, ValueNumber('-', lhs->vn, rhs->vn, 0));
+            zero_true = op == '=';
+        } else {
+            // a < b and a >= b test slt a, b; a > b and a <= b test slt b, a
+            if(op == '<' || op == 'g')
+                fprintf(out, "slt r%d, r%d, r%d\n", rc, a, b);
+            else
+                fprintf(out, "slt r%d, r%d, r%d\n", rc, b, a);
+            WriteRegister(rc, NewOpaqueValue());
+            zero_true = op == 'g' || op == 'l';
+        }
+    }
+    SelectReserve(rc);
+
+    // 2) both arms
+    int then_result[MAX_SELECT_VARS], else_result[MAX_SELECT_VARS];
+    if_depth++;
+    SelectArm(branch + 1, otherwise >= 0 ? otherwise : end, vars, count, then_result, out);
+    if(otherwise >= 0)
+        SelectArm(otherwise + 1, end, vars, count, else_result, out);
+    else
+        SelectArm(end, end, vars, count, else_result, out);
+    if_depth--;
+    for(int k = 0; k < count; k++) {
+        if(then_result[k] > 0)
+            select_uses[then_result[k]]++;
+        if(else_result[k] > 0)
+            select_uses[else_result[k]]++;
+    }
+
+    // 3) one conditional move per variable, then its store
+    for(int k = 0; k < count; k++) {
+        const char *name = NameOf(vars[k]);
+        int t = then_result[k], e = else_result[k];
+        if(t > 0)
+            select_uses[t]--;
+        if(e > 0)
+            select_uses[e]--;
+        if(t == -1 || e == -1) {
+            // the arm not assigning it keeps the old value
+            ResetTempRegister();
+            expr_node_count = 0;
+            ExprNode *old = NewExprNode(0, NULL, NULL);
+            strcpy(old->name, name);
+            NumberExpr(old);
+            LabelExpr(old);
+            int r = GenerateExpr(old, out, 0);
+            SelectReserve(r);
+            if(t == -1)
+                t = r;
+            else
+                e = r;
+        }
+        if(t == e) {
+            StoreVariable(out, t, name);
+            SetVariableValue(name, reg_value[t]);
+            continue;
+        }
+        // dst starts with one side, the move brings in the other when the condition says so
+        int dst, keeps_else = 1;
+        if(SelectDisposable(e, rc, name))
+            dst = e;
+        else if(SelectDisposable(t, rc, name)) {
+            dst = t;
+            keeps_else = 0;
+        } else {
+            int home = GetRegisterOfTheSymbol(name);
+            dst = home != -1 && !IsRegisterBusy(home) && select_uses[home] == 0 ? home : NewTempRegister();
+            fprintf(out, "daddu r%d, r%d, r0\n", dst, e);
+        }
+        if(keeps_else)
+            fprintf(out, "%s r%d, r%d, r%d\n", zero_true ? "movz" : "movn", dst, t, rc);
+        else
+            fprintf(out, "%s r%d, r%d, r%d\n", zero_true ? "movn" : "movz", dst, e, rc);
+        int vn = NewOpaqueValue();
+        WriteRegister(dst, vn);
+        StoreVariable(out, dst, name);
+        SetVariableValue(name, vn);
+    }
+    for(int r = 0; r < NUM_REGISTERS; r++)
+        reg_reserved[r] -= select_mine[r];
+    ResetTempRegister();
+}
+
+// registers and variables known after an if statement: the ones both ways through agree on
+// (snap: the state at the end of the other way)
+static void MergeValues(const ValueSnapshot *snap) {
+    if(snap->epoch != value_epoch) {
+        ResetValueNumbering();
+        return;
+    }
+    for(int r = 0; r < NUM_REGISTERS; r++)
+        if(reg_value[r] != snap->reg_value[r])
+            reg_value[r] = -1;
+    EnsureValueCapacity(var_value_count);
+    if(snap->epoch != value_epoch)
+        return; // started over: nothing is known anyway
+    for(int i = 0; i < var_value_count; i++)
+        if(i >= snap->var_count || strcmp(var_values[i].name, snap->vars[i].name) != 0 ||
+           var_values[i].vn != snap->vars[i].vn)
+            var_values[i].vn = NewOpaqueValue();
+}
+
+// if statement opened at insns[start]; returns the index after its ENDIF
+static int GenerateIf(int start, int count, FILE *out) {
+    int branch = SsaLoopBranch(sel_prog, start);
+    int otherwise;
+    int end = SsaIfEnd(sel_prog, start, &otherwise);
+    if(end > count)
+        end = count;
 
+    // the condition's line counter (profiling) runs in front of it
+    GenerateBlock(start + 1, branch, out);
+    if(branch >= end)
+        return end < count ? end + 1 : end;
+
+    int vars[MAX_SELECT_VARS];
+    int selected = SelectVariables(branch + 1, otherwise, end, vars);
+    if(selected >= 0 && FreeTempCount() >= 2 * selected + 4) {
+        GenerateSelect(branch, otherwise, end, vars, selected, out);
+        return end < count ? end + 1 : end;
+    }
+
+    int label = if_count++;
+    char else_label[32], end_label[32];
+    snprintf(else_label, sizeof(else_label), "_else%d", label);
+    snprintf(end_label, sizeof(end_label), "_endif%d", label);
+    GenerateBranch(&sel_prog->insns[branch], otherwise >= 0 ? else_label : end_label, 0, out);
+
+    // each arm starts from the state after the branch
+    ValueSnapshot *before = xrealloc(NULL, sizeof(ValueSnapshot));
+    SaveValues(before);
+    if_depth++;
+    GenerateBlock(branch + 1, otherwise >= 0 ? otherwise : end, out);
+    if(otherwise >= 0) {
+        fprintf(out, "j %s\n", end_label);
+        ValueSnapshot *then = xrealloc(NULL, sizeof(ValueSnapshot));
+        SaveValues(then);
+        RestoreValues(before);
+        fprintf(out, "%s:\n", else_label);
+        GenerateBlock(otherwise + 1, end, out);
+        MergeValues(then);
+        free(then);
+    } else
+        MergeValues(before);
+    if_depth--;
+    free(before);
+    fprintf(out, "%s:\n", end_label);
+    return end < count ? end + 1 : end;
+}
+
+// ============================== functions ==============================
+// (the calling convention is described at the top.) the frame size has to be known before
+// the body, so the body goes to a scratch file first with room for every register it may
+// overwrite, and only those it actually writes get saved; if it writes one it had no room
+// for it is generated again
+
+// callee-saved: the homes but r2, and the global pointer
+static int IsCalleeSaved(int reg) {
+    return (reg > 0 && reg < temp_start && reg != RESULT_REGISTER) || (far_data && reg == GP_REGISTER);
+}
+
+// registers the instructions of a listing write (their first register operand), added to written
+// (the two-operand ddiv only reads; release 6's writes rd like the rest)
+static void WrittenRegisters(FILE *code, int *written) {
+    static const char *reads_only[] = { "sd", "beq", "bne", "dmult", "jr", "j", "jal" };
+    char line[BUFSIZ], op[16];
+    int reg;
+    rewind(code);
+    while(fgets(line, sizeof(line), code)) {
+        if(sscanf(line, "%15s", op) != 1 || op[0] == '#' || strchr(op, ':'))
+            continue;
+        if(strcmp(op, "syscall") == 0) {
+            written[SYSCALL_RESULT] = 1;
+            continue;
+        }
+        int skip = 0;
+        for(size_t k = 0; k < sizeof(reads_only) / sizeof(reads_only[0]); k++)
+            skip |= strcmp(op, reads_only[k]) == 0;
+        if(strcmp(op, "ddiv") == 0)
+            skip = TargetFind(op) && TargetFind(op)->operands == 2;
+        if(!skip && sscanf(line, "%*s r%d", &reg) == 1 && reg > 0 && reg < NUM_REGISTERS)
+            written[reg] = 1;
+    }
+}
+
+// callee-saved registers the function at insns[start..end) may overwrite: the homes of the
+// variables it uses, the print registers and the global pointer
+static void MaySave(int start, int end, int *saved) {
+    for(int i = start; i < end; i++) {
+        const SsaInsn *in = &sel_prog->insns[i];
+        int reg = in->kind == SSA_LOAD || in->kind == SSA_STORE ? GetRegisterOfTheSymbol(NameOf(in->var)) : -1;
+        if(reg > 0)
+            saved[reg] = 1;
+        if(in->kind == SSA_PRINT && in->init)
+            saved[SYSCALL_RESULT] = saved[SYSCALL_ARGUMENT] = 1;
+    }
+    for(int r = 0; r < NUM_REGISTERS; r++)
+        saved[r] = saved[r] && IsCalleeSaved(r);
+    if(far_data)
+        saved[GP_REGISTER] = 1;
+}
+
+// the body of the function at insns[start..end) with a save slot for every register in
+// saved; the registers it writes go to written (NULL: not looked at). returns 0 if it
+// writes a callee-saved register without a slot (added to saved for the next attempt)
+static int GenerateFunctionBody(int start, int end, int calls, int *saved, int *written, FILE *body) {
+    int slots = calls;
+    for(int r = 0; r < NUM_REGISTERS; r++)
+        slots += saved[r];
+    frame_size = FrameSize(slots);
+    function_returns = 0;
+    for(int r = 1; r < NUM_REGISTERS; r++)
+        reg_value[r] = -1;
+    var_value_count = 0;
+    in_function = 1;
+    GenerateBlock(start + 1, end, body);
+    in_function = 0;
+    int last = start;
+    for(int i = start + 1; i < end; i++)
+        if(sel_prog->insns[i].kind != SSA_NOP)
+            last = i;
+    if(sel_prog->insns[last].kind != SSA_RETURN)
+        fprintf(body, "daddiu r%d, r0, #0\n", RESULT_REGISTER);
+    if(!written)
+        return 1;
+    int fits = 1;
+    WrittenRegisters(body, written);
+    for(int r = 0; r < NUM_REGISTERS; r++)
+        if(written[r] && IsCalleeSaved(r) && !saved[r])
+            saved[r] = 1, fits = 0;
+    return fits;
+}
+
+// sd (or ld) of the return address and of the saved registers written
+static void SaveRegisters(FILE *out, const char *op, int calls, const int *saved, const int *written) {
+    int slot = calls;
+    for(int r = 0; r < NUM_REGISTERS; r++) {
+        if(!saved[r])
+            continue;
+        if(written[r])
+            fprintf(out, "%s r%d, %d(r%d)\n", op, r, 8 * slot, STACK_POINTER);
+        slot++;
+    }
+    if(calls)
+        fprintf(out, "%s r%d, 0(r%d)\n", op, RETURN_ADDRESS, STACK_POINTER);
+}
+
+// a function definition (FUNC at insns[start]), into the function code; returns the index
+// after its ENDFUNC. its parameters (first) and locals get their frame slots and registers up front
+static int GenerateFunction(int start, int count, FILE *out) {
+    int end = SsaFunctionEnd(sel_prog, start);
+    if(end > count)
+        end = count;
+    int label = function_count++, calls = 0;
+    const char *name = NameOf((int)sel_prog->insns[start].imm);
+    ValueSnapshot *before = malloc(sizeof(ValueSnapshot));
+    if(before)
+        SaveValues(before);
+    SymbolEnterFunction();
+    for(int i = start + 1; i < end; i++)
+        if(sel_prog->insns[i].kind == SSA_PARAM)
+            AllocateRegisterForTheSymbol(NameOf(sel_prog->insns[i].var));
+    for(int i = start + 1; i < end; i++) {
+        if(sel_prog->insns[i].kind == SSA_DECL)
+            AllocateRegisterForTheSymbolOfSize(NameOf(sel_prog->insns[i].var), DeclaredBytes(&sel_prog->insns[i]));
+        calls |= sel_prog->insns[i].kind == SSA_CALL;
+    }
+    int saved[NUM_REGISTERS] = {0}, written[NUM_REGISTERS];
+    MaySave(start + 1, end, saved);
+
+    // without function code of its own (no scratch file) the function stands in the main code
+    FILE *code = function_code ? function_code : out;
+    if(!function_code)
+        fprintf(code, "j _skip%d\n", label);
+    FILE *body = tmpfile();
+    while(body) {
+        memset(written, 0, sizeof(written));
+        if(GenerateFunctionBody(start, end, calls, saved, written, body))
+            break;
+        fclose(body);
+        body = tmpfile();
+    }
+    if(!body) {
+        // no scratch file: every register it may overwrite is saved, the body written straight through
+        for(int r = 0; r < NUM_REGISTERS; r++)
+            saved[r] = written[r] = IsCalleeSaved(r);
+    }
+    int slots = calls;
+    for(int r = 0; r < NUM_REGISTERS; r++)
+        slots += saved[r];
+    frame_size = FrameSize(slots);
+    fprintf(code, "_func_%s:\n", name);
+    fprintf(code, "daddiu r%d, r%d, #%d\n", STACK_POINTER, STACK_POINTER, -frame_size);
+    SaveRegisters(code, "sd", calls, saved, written);
+    if(body) {
+        char line[BUFSIZ];
+        rewind(body);
+        while(fgets(line, sizeof(line), body))
+            fputs(line, code);
+        fclose(body);
+    } else
+        GenerateFunctionBody(start, end, calls, saved, NULL, code);
+    if(function_returns)
+        fprintf(code, "_ret%d:\n", label);
+    SaveRegisters(code, "ld", calls, saved, written);
+    fprintf(code, "daddiu r%d, r%d, #%d\n", STACK_POINTER, STACK_POINTER, frame_size);
+    fprintf(code, "jr r%d\n", RETURN_ADDRESS);
+    if(!function_code)
+        fprintf(code, "_skip%d:\n", label);
+    SymbolLeaveFunction();
+    if(before)
+        RestoreValues(before);
+    else
+        ResetValueNumbering();
+    free(before);
+    return end < count ? end + 1 : end;
+}
+
+// generate insns[start..end), expanding while loops and if statements
+static int GenerateBlock(int start, int end, FILE *out) {
+    int i = start;
+    while(i < end) {
+        if(sel_prog->insns[i].kind == SSA_LOOP)
+            i = GenerateLoop(i, end, out);
+        else if(sel_prog->insns[i].kind == SSA_IF)
+            i = GenerateIf(i, end, out);
+        else if(sel_prog->insns[i].kind == SSA_PRINT && sel_prog->insns[i].init)
+            i = GeneratePrint(i, out);
+        else if(sel_prog->insns[i].kind == SSA_FUNC)
+            i = GenerateFunction(i, end, out);
+        else if(sel_prog->insns[i].kind == SSA_CALL)
+            GenerateCall(i++, out);
+        else if(sel_prog->insns[i].kind == SSA_RETURN)
+            GenerateReturn(i++, out);
+        else
+            GenerateAssemblyStatement(&sel_prog->insns[i++], out);
+    }
+    return i;
+}
+
+// the initializing store of the declaration at insns[i], or NULL if it has none
+static const SsaInsn *DeclarationInitializer(int i) {
+    const SsaInsn *decl = &sel_prog->insns[i];
+    for(i++; i < sel_prog->count; i++) {
+        const SsaInsn *in = &sel_prog->insns[i];
+        if(in->kind == SSA_STORE)
+            return in->init && in->var == decl->var ? in : NULL;
+        if(in->kind != SSA_CONST && in->kind != SSA_LOAD && in->kind != SSA_BINOP && in->kind != SSA_NOP)
+            return NULL;
+    }
+    return NULL;
+}
+
+// 1 for the first COUNT of each counter (inlined copies of a function repeat its COUNTs)
+static unsigned char *counter_first;
+
+// line counters (profiling), in program order
+static void GenerateCounterSlots(FILE *out) {
+    for(int i = 0; i < sel_prog->count; i++) {
+        const SsaInsn *in = &sel_prog->insns[i];
+        if(in->kind == SSA_COUNT && counter_first[i]) {
+            AllocateOffsetForTheSymbol(NameOf(in->var));
+            fprintf(out, "%s: .space 8\n", NameOf(in->var));
+        }
+    }
+}
+
+static void GenerateSpillSlots(FILE *out, int count) {
+    for(int i = 0; i < count; i++) {
+        char name[MAX_NAME_LEN];
+        snprintf(name, sizeof(name), "_spill%d", i);
+        AllocateOffsetForTheSymbol(name);
+        fprintf(out, "%s: .space 8\n", name);
+    }
+}
+
+// the argument block and the formats of the print statements, reserved in this order
+static void ReservePrintData() {
+    char name[MAX_NAME_LEN];
+    for(int k = 0; format_count > 0 && k <= print_values; k++) {
+        snprintf(name, sizeof(name), "_print%d", k);
+        AllocateOffsetForTheSymbol(name);
+    }
+    for(int k = 0; k < format_count; k++) {
+        snprintf(name, sizeof(name), "_fmt%d", k);
+        AllocateBytesForTheSymbol(name, strlen(formats[k]) + 1);
+    }
+}
+
+static void GeneratePrintData(FILE *out) {
+    ReservePrintData();
+    for(int k = 0; format_count > 0 && k <= print_values; k++)
+        fprintf(out, "_print%d: .space 8\n", k);
+    for(int k = 0; k < format_count; k++) {
+        fprintf(out, "_fmt%d: .asciiz ", k);
+        SsaWriteString(formats[k], out);
+        fputc('\n', out);
+    }
+}
+
+// a variable's .data directive in its size: its initial value (.word64, .word32, .word16 or
+// .byte, cut to the size), or zero-filled .space
+static void GenerateVariableData(FILE *out, const char *name, const long long *value) {
+    int bytes = GetSizeOfTheSymbol(name);
+    const char *directive = bytes == 1 ? "byte" : bytes == 2 ? "word16" : bytes == 4 ? "word32" : "word64";
+    if(value)
+        fprintf(out, "%s: .%s %lld\n", name, directive, SsaNarrow(*value, bytes));
+    else
+        fprintf(out, "%s: .space %d\n", name, bytes);
+}
+
+// .data section: every declared variable, then the line counters (profiling), the print
+// data and the spill slots (after every variable, so their offsets follow the variables'),
+// and last the stack if functions are called
+// with large .data the slots come first instead (see far_data)
+// variables with a constant initializer get their value here (.word64, or narrower)
+static void GenerateDataSection(FILE *out) {
+    fprintf(out, ".data\n");
+    if(far_data) {
+        GenerateSpillSlots(out, far_spills);
+        GenerateCounterSlots(out);
+        GeneratePrintData(out);
+    }
+    // only declare variables, no duplicates
+    int depth = 0; // loop/if nesting: declarations inside a loop or an if arm are initialized by code
+    for(int i = 0; i < sel_prog->count; i++) {
+        const SsaInsn *in = &sel_prog->insns[i];
+        if(in->kind == SSA_FUNC) {
+            i = SsaFunctionEnd(sel_prog, i); // a function's variables live in its frame
+            continue;
+        }
+        if(in->kind == SSA_LOOP || in->kind == SSA_IF)
+            depth++;
+        else if(in->kind == SSA_ENDLOOP || in->kind == SSA_ENDIF)
+            depth--;
+        if(in->kind != SSA_DECL)
+            continue;
+        const SsaInsn *init = DeclarationInitializer(i);
+        long long value;
+        int constant = depth == 0 && init && ConstantInitializer(init, &value);
+        GenerateVariableData(out, NameOf(in->var), constant ? &value : NULL);
+    }
+    if(!far_data) {
+        GenerateCounterSlots(out);
+        GeneratePrintData(out);
+        GenerateSpillSlots(out, spill_slots);
+    }
+    if(stack_used) {
+        AllocateBytesForTheSymbol("_stack", STACK_BYTES);
+        fprintf(out, "_stack: .space %d\n", STACK_BYTES);
+    }
     fprintf(out, "\n.code\n");
-    for(int i = 0;i < count; i++)
-        GenerateAssemblyStatement(&stmts[i],out);
 }
 
+// fresh generator state for one attempt at the program; with large .data every slot gets its
+// offset up front: spill slots, counters and print data first, then the variables in declaration order
+// (the same registers they get when declared one by one), then the stack
+static void StartProgram() {
+    SymbolInit();
+    AssemblyInit();
+    spill_slots = 0;
+    loop_depth = 0;
+    loop_count = 0;
+    if_depth = 0;
+    if_count = 0;
+    function_count = 0;
+    if(stack_used)
+        reg_reserved[STACK_POINTER] = 1;
+    if(!far_data)
+        return;
+    reg_reserved[GP_REGISTER] = 1;
+    for(int i = 0; i < far_spills; i++) {
+        char name[MAX_NAME_LEN];
+        snprintf(name, sizeof(name), "_spill%d", i);
+        AllocateOffsetForTheSymbol(name);
+    }
+    for(int i = 0; i < sel_prog->count; i++)
+        if(sel_prog->insns[i].kind == SSA_COUNT && counter_first[i])
+            AllocateOffsetForTheSymbol(NameOf(sel_prog->insns[i].var));
+    ReservePrintData();
+    for(int i = 0; i < sel_prog->count; i++) {
+        if(sel_prog->insns[i].kind == SSA_FUNC)
+            i = SsaFunctionEnd(sel_prog, i);
+        else if(sel_prog->insns[i].kind == SSA_DECL)
+            AllocateRegisterForTheSymbolOfSize(NameOf(sel_prog->insns[i].var), DeclaredBytes(&sel_prog->insns[i]));
+    }
+    if(stack_used)
+        AllocateBytesForTheSymbol("_stack", STACK_BYTES);
+}
+
+// .data bytes once the code is generated: variables, counters, print data, spill slots and the stack
+static uint64_t DataSize() {
+    if(far_data)
+        return GetDataSize();
+    uint64_t bytes = ((GetDataSize() + 7) & ~(uint64_t)7) + 8 * (uint64_t)spill_slots;
+    if(format_count > 0)
+        bytes += 8 * (uint64_t)(print_values + 1);
+    for(int k = 0; k < format_count; k++)
+        bytes += (strlen(formats[k]) + 8) & ~(size_t)7;
+    for(int i = 0; i < sel_prog->count; i++)
+        if(sel_prog->insns[i].kind == SSA_COUNT && counter_first[i])
+            bytes += 8;
+    if(stack_used)
+        bytes += STACK_BYTES;
+    return bytes;
+}
+
+static unsigned HashText(const char *s) {
+    unsigned h = 2166136261u; // FNV-1a
+    for(; *s; s++)
+        h = (h ^ (unsigned char)*s) * 16777619u;
+    return h;
+}
+
+// the format of every print statement, equal ones shared, and the most values one has
+static void CollectFormats() {
+    int prints = 0, size = 64;
+    for(int i = 0; i < sel_prog->count; i++)
+        prints += sel_prog->insns[i].kind == SSA_PRINT && sel_prog->insns[i].init;
+    while(size < 2 * prints)
+        size *= 2;
+    int *hash = memset(xrealloc(NULL, size * sizeof(int)), 0, size * sizeof(int)); // format index + 1, 0 = empty
+    formats = xrealloc(NULL, (prints + 1) * sizeof(char *));
+    print_format = xrealloc(NULL, (sel_prog->count + 1) * sizeof(int));
+    print_vregs = xrealloc(NULL, (sel_prog->count + 1) * sizeof(int));
+    format_count = 0;
+    print_values = 0;
+    for(int i = 0; i < sel_prog->count; ) {
+        if(sel_prog->insns[i].kind != SSA_PRINT || !sel_prog->insns[i].init) {
+            i++;
+            continue;
+        }
+        int end, count;
+        char *format = SsaPrintFormat(sel_prog, sel_defs, i, &end, print_vregs, &count);
+        if(count > print_values)
+            print_values = count;
+        unsigned slot = HashText(format) & (size - 1);
+        while(hash[slot] && strcmp(formats[hash[slot] - 1], format) != 0)
+            slot = (slot + 1) & (size - 1);
+        if(hash[slot])
+            free(format);
+        else {
+            formats[format_count++] = format;
+            hash[slot] = format_count;
+        }
+        print_format[i] = hash[slot] - 1;
+        i = end;
+    }
+    free(hash);
+}
+
+// with functions the main program starts by pointing r29 at the end of _stack
+static void GenerateStack(FILE *out) {
+    if(!stack_used)
+        return;
+    LoadAddress(out, STACK_POINTER, "_stack", VALUE_STACK_KEY);
+    fprintf(out, "daddiu r%d, r%d, #%d\n", STACK_POINTER, STACK_POINTER, STACK_BYTES);
+    WriteRegister(STACK_POINTER, NewOpaqueValue());
+}
+
+// Full program
+// make entry point for instruction selection
+// a. iniialize symbol table
+// b. generate .code section into a scratch file (spill slots are only known afterwards)
+// c. if the .data is larger than ld/sd reach from r0, generate it again with the global
+//    pointer (again if that needs more spill slots than were set aside in front)
+// d. generate .data section w/ var declarations and spill slots, then append the code
+//    (with functions: a jump to _main over them, the functions, then the main program)
+void AssemblyGenerateProgram(const SsaProgram *prog, FILE *out){
+    sel_prog = prog;
+    sel_defs = xrealloc(NULL, (prog->vreg_count + 1) * sizeof(int));
+    int vars = 0;
+    for(int i = 0; i < prog->count; i++)
+        if(prog->insns[i].var >= vars)
+            vars = prog->insns[i].var + 1;
+    sel_bytes = xrealloc(NULL, vars + 1);
+    counter_first = memset(xrealloc(NULL, prog->count + 1), 0, prog->count + 1);
+    unsigned char *counted = memset(xrealloc(NULL, MAX_SYMBOLS), 0, MAX_SYMBOLS);
+    SsaDefinitions(prog, sel_defs);
+    SsaVariableBytes(prog, sel_bytes, vars);
+    CollectFormats();
+    far_data = 0;
+    far_spills = 0;
+    stack_used = 0;
+    for(int i = 0; i < prog->count; i++) {
+        const SsaInsn *in = &prog->insns[i];
+        stack_used |= in->kind == SSA_FUNC;
+        if(in->kind == SSA_COUNT && in->var >= 0 && in->var < MAX_SYMBOLS && !counted[in->var])
+            counted[in->var] = counter_first[i] = 1;
+    }
+    free(counted);
+
+    FILE *code = tmpfile();
+    while(code) {
+        function_code = stack_used ? tmpfile() : NULL;
+        StartProgram();
+        GenerateStack(code);
+        GenerateBlock(0, prog->count, code);
+        if(far_data ? spill_slots <= far_spills : DataSize() <= DATA_WINDOW_REACH)
+            break;
+        far_data = 1;
+        far_spills = spill_slots;
+        fclose(code);
+        if(function_code)
+            fclose(function_code);
+        code = tmpfile();
+    }
+    if(!code) {
+        // no scratch file: write straight through (a spilling program then lacks its slots)
+        function_code = NULL;
+        StartProgram();
+        GenerateDataSection(out);
+        GenerateStack(out);
+        GenerateBlock(0, prog->count, out);
+    } else {
+        GenerateDataSection(out);
+        char line[BUFSIZ];
+        if(function_code) {
+            fprintf(out, "j _main\n");
+            rewind(function_code);
+            while(fgets(line, sizeof(line), function_code))
+                fputs(line, out);
+            fclose(function_code);
+            function_code = NULL;
+            fprintf(out, "_main:\n");
+        }
+        rewind(code);
+        while(fgets(line, sizeof(line), code))
+            fputs(line, out);
+        fclose(code);
+    }
+    for(int k = 0; k < format_count; k++)
+        free(formats[k]);
+    free(formats);
+    free(print_format);
+    free(print_vregs);
+    formats = NULL;
+    print_format = print_vregs = NULL;
+    format_count = 0;
+    free(sel_defs);
+    free(sel_bytes);
+    free(counter_first);
+    sel_defs = NULL;
+    sel_bytes = NULL;
+    counter_first = NULL;
+}
@@ -1,14 +1,18 @@
+#ifndef ASSEMBLY_H
 #define ASSEMBLY_H
 
 #include <stdio.h>
-#include "parser.h"
+#include "ssa.h"
 
 // initialize assembly generator (resets temp reg pool)
 void AssemblyInit();
 
-// process a declaration or assignment statement and generate assembly to out file
+// process a declaration or store instruction and generate assembly to out file
+// (only inside AssemblyGenerateProgram: the store's tree is read from that program)
 // returns 1 on success, 0 on failure
-int GenerateAssemblyStatement(const Statement *stmt, FILE *out);
+int GenerateAssemblyStatement(const SsaInsn *insn, FILE *out);
 
-// generate a whole program given an array of statements
-void AssemblyGenerateProgram(const Statement *stmts, int count, FILE *out);
\ No newline at end of file
+// instruction selection for a whole (optimized) SSA program
+void AssemblyGenerateProgram(const SsaProgram *prog, FILE *out);
+
+#endif
@@ -0,0 +1,117 @@
+// machine-code encoding throughput: MachineFromAssembly on a large generated listing with
+// 1, 2, 4, ... worker threads (chunks of whole lines, encoded and formatted in parallel).
+// every run must write the same .mc as the single-threaded one. build and run with
+// "make bench-encode".
+
+#define _DEFAULT_SOURCE // clock_gettime and sysconf under -std=c99
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "machine_code.h"
+#include "symbol_table.h"
+#include "error.h"
+
+#define BENCH_VARS 1000
+#define BENCH_LOOPS 2000
+#define BENCH_BODY 500          // instructions per loop: 1M in all
+#define BENCH_ROUNDS 3
+#define BENCH_ASM "_bench_encode.asm"
+#define BENCH_MC "_bench_encode.mc"
+
+static double Now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// loops of loads, arithmetic and stores over BENCH_VARS variables, like assembly.c writes them
+static int WriteListing(void) {
+    FILE *out = fopen(BENCH_ASM, "w");
+    if(!out)
+        return 0;
+    char name[MAX_NAME_LEN];
+    fprintf(out, ".data\n");
+    for(int v = 0; v < BENCH_VARS; v++) {
+        snprintf(name, sizeof(name), "v%d", v);
+        AllocateOffsetForTheSymbol(name);
+        fprintf(out, "%s: %s\n", name, v % 3 ? ".space 8" : ".word64 7");
+    }
+    fprintf(out, ".code\n");
+    unsigned seed = 1;
+    for(int l = 0; l < BENCH_LOOPS; l++) {
+        fprintf(out, "    j _test%d\n_loop%d:\n", l, l);
+        for(int k = 0; k < BENCH_BODY - 3; k += 6) {
+            seed = seed * 1103515245u + 12345u;
+            int a = (seed >> 8) % BENCH_VARS, b = (seed >> 16) % BENCH_VARS, c = (a + b) % BENCH_VARS;
+            fprintf(out, "    ld r20, v%d(r0)\n    ld r21, v%d(r0)\n    daddu r22, r20, r21\n"
+                         "    dmult r22, r21\n    mflo r23\n    sd r23, v%d(r0)\n", a, b, c);
+        }
+        fprintf(out, "_test%d:\n    daddiu r24, r24, #-1\n    slt r25, r0, r24\n    bne r25, r0, _loop%d\n", l, l);
+    }
+    fclose(out);
+    return 1;
+}
+
+static char *ReadFile(const char *path, long *size) {
+    FILE *in = fopen(path, "rb");
+    if(!in)
+        return NULL;
+    fseek(in, 0, SEEK_END);
+    *size = ftell(in);
+    rewind(in);
+    char *text = malloc(*size + 1);
+    if(text && fread(text, 1, *size, in) != (size_t)*size) {
+        free(text);
+        text = NULL;
+    }
+    fclose(in);
+    return text;
+}
+
+// best time of BENCH_ROUNDS encodings with the given threads
+static double Bench(int threads) {
+    double best = 1e30;
+    MachineSetThreads(threads);
+    for(int r = 0; r < BENCH_ROUNDS; r++) {
+        double t0 = Now();
+        MachineFromAssembly(BENCH_ASM, BENCH_MC);
+        double s = Now() - t0;
+        if(s < best)
+            best = s;
+    }
+    return best;
+}
+
+int main(void) {
+    DiagInit(DIAG_QUIET, BENCH_ASM);
+    SymbolInit();
+    if(!WriteListing()) {
+        printf("can't write " BENCH_ASM "\n");
+        return 1;
+    }
+    long processors = sysconf(_SC_NPROCESSORS_ONLN), asm_size, ref_size, size;
+    printf("%d instructions, %d processor(s), best of %d\n\n", BENCH_LOOPS * (BENCH_BODY / 6 * 6 + 4),
+           (int)processors, BENCH_ROUNDS);
+
+    double serial = Bench(1);
+    char *reference = ReadFile(BENCH_MC, &ref_size), *asm_text = ReadFile(BENCH_ASM, &asm_size);
+    printf("%-10s %10s %10s %10s\n", "threads", "seconds", "MB/s", "speedup");
+    printf("%-10d %10.3f %10.1f %10.2f\n", 1, serial, asm_size / serial / 1e6, 1.0);
+    int ok = reference != NULL;
+    for(int threads = 2; ok && threads <= 2 * (processors > 4 ? processors : 4); threads *= 2) {
+        double s = Bench(threads);
+        char *text = ReadFile(BENCH_MC, &size);
+        int same = text && size == ref_size && memcmp(text, reference, size) == 0;
+        printf("%-10d %10.3f %10.1f %10.2f%s\n", threads, s, asm_size / s / 1e6, serial / s, same ? "" : "  OUTPUT DIFFERS");
+        ok = same;
+        free(text);
+    }
+    printf("\n.mc output %s\n", ok ? "identical for every thread count" : "DIFFERS");
+    free(reference);
+    free(asm_text);
+    remove(BENCH_ASM);
+    remove(BENCH_MC);
+    return ok ? 0 : 1;
+}
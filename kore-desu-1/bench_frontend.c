@@ -0,0 +1,132 @@
+// front-end throughput: the C-subset line validator (+ ParseStatement) vs the
+// table-driven p.0 parser on the same program, generated in memory so disk I/O
+// does not count (both work on views of the buffer, like main.c on the mapped file). build and run with "make bench".
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "line_validator.h"
+#include "parser.h"
+#include "p0_parser.h"
+#include "source.h"
+
+#define BENCH_VARS 64
+#define BENCH_LINES 20000
+#define BENCH_ROUNDS 10
+
+static char *c_src, *p0_src;
+static int c_len, p0_len;
+static Statement *stmts;
+
+
+static int Append(char *dst, int len, const char *text) {
+    int n = (int)strlen(text);
+    memcpy(dst + len, text, n + 1);
+    return len + n;
+}
+
+// same statements in both syntaxes: declarations, then assignment lines
+static void GeneratePrograms(void) {
+    char line[BUFFER];
+    c_src = malloc(BENCH_LINES * 64 + 4096);
+    p0_src = malloc(BENCH_LINES * 64 + 4096);
+    c_len = 0;
+    p0_len = Append(p0_src, 0, ">>>\n");
+
+    for(int i = 0; i < BENCH_VARS; i++) {
+        sprintf(line, "int v%d = %d;\n", i, i);
+        c_len = Append(c_src, c_len, line);
+        sprintf(line, "int v%d = %d\n", i, i);
+        p0_len = Append(p0_src, p0_len, line);
+    }
+    for(int i = 0; i < BENCH_LINES; i++) {
+        int a = i % BENCH_VARS, b = (i * 7 + 3) % BENCH_VARS, c = (i * 13 + 5) % BENCH_VARS;
+        sprintf(line, "v%d = v%d + v%d * 3 - (v%d / 2);\n", a, b, c, a);
+        c_len = Append(c_src, c_len, line);
+        sprintf(line, "v%d = v%d + v%d * 3 - (v%d / 2)\n", a, b, c, a);
+        p0_len = Append(p0_src, p0_len, line);
+    }
+    p0_len = Append(p0_src, p0_len, "<<<\n");
+}
+
+
+// the path main.c takes for C-subset input, minus the per-line printing
+static int RunValidator(int parse) {
+    char errinfo[MAX_VAR_LENGTH];
+    SourceFile src = { c_src, (size_t)c_len, 0 };
+    SourceSpan line;
+    size_t pos = 0;
+    int count = 0;
+
+    valid_buffer_counter = 0;
+    while(SourceNextLine(&src, &pos, &line)) {
+        line = TrimSpan(line);
+        if(line.len == 0)
+            continue;
+        ErrorType err = strncmp(line.text, "int ", 4) == 0 ? StartsWithInt(line.text, errinfo)
+                                                           : StartsWithVariableName(line.text, errinfo);
+        if(err != ERR_NONE)
+            return -1;
+        // stored like main.c does, so both sides write the same Statement array
+        if(parse)
+            count += ParseStatement(line.text, line.len, stmts + count, BENCH_LINES + BENCH_VARS - count);
+    }
+    return count;
+}
+
+static int RunP0(void) {
+    P0Error err;
+    int count;
+    valid_buffer_counter = 0;
+    if(!P0ParseBuffer(p0_src, p0_len, stmts, BENCH_LINES + BENCH_VARS, &count, &err))
+        return -1;
+    return count;
+}
+
+
+// best of BENCH_ROUNDS, in seconds
+static double Time(int which, int *result) {
+    double best = 1e9;
+    for(int r = 0; r < BENCH_ROUNDS; r++) {
+        clock_t t0 = clock();
+        IrReset();
+        *result = which == 0 ? RunValidator(0) : which == 1 ? RunValidator(1) : RunP0();
+        double s = (double)(clock() - t0) / CLOCKS_PER_SEC;
+        if(s < best)
+            best = s;
+    }
+    return best > 0 ? best : 1e-9;
+}
+
+static void Report(const char *name, int bytes, double s, int result) {
+    printf("%-30s %8.2f ms %8.1f MB/s %10.0f lines/s  (%d statements)\n",
+           name, s * 1e3, bytes / s / 1e6, (BENCH_LINES + BENCH_VARS) / s, result);
+}
+
+
+int main(void) {
+    int r0, r1, r2;
+    GeneratePrograms();
+    stmts = malloc(sizeof(Statement) * (BENCH_LINES + BENCH_VARS));
+    if(!c_src || !p0_src || !stmts)
+        return 1;
+
+    double t0 = Time(0, &r0), t1 = Time(1, &r1), t2 = Time(2, &r2);
+    if(r0 < 0 || r1 < 0 || r2 < 0) {
+        printf("bench input rejected\n");
+        return 1;
+    }
+
+    printf("%d lines, %d bytes (C subset) / %d bytes (p.0), best of %d\n\n",
+           BENCH_LINES + BENCH_VARS, c_len, p0_len, BENCH_ROUNDS);
+    Report("line validator", c_len, t0, r1);
+    Report("line validator + parser", c_len, t1, r1);
+    Report("p.0 LALR(1) parser", p0_len, t2, r2);
+    printf("\nspeedup over validator + parser: %.2fx\n", t1 / t2);
+
+    free(c_src);
+    free(p0_src);
+    free(stmts);
+    return 0;
+}
@@ -0,0 +1,293 @@
+// execution speed: the generated MIPS64 run by a (pre-decoded, switch dispatch) interpreter
+// vs the same SSA program compiled to x86-64 by jit.c, on a loop-heavy program. both must end
+// with the same variable values. build and run with "make bench-jit".
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "line_validator.h"
+#include "parser.h"
+#include "source.h"
+#include "ssa.h"
+#include "opt.h"
+#include "assembly.h"
+#include "jit.h"
+
+#define BENCH_ROUNDS 5
+#define MAX_BENCH_STMTS 64
+#define MAX_MIPS_DATA 1024
+#define MAX_MIPS_LABELS 256
+
+static const char *bench_source =
+    "int i = 0;\n"
+    "int j = 0;\n"
+    "int n = 2000;\n"
+    "int m = 1000;\n"
+    "int s = 0;\n"
+    "int t = 0;\n"
+    "int k = 7;\n"
+    "int p = 1;\n"
+    "while (i < n) {\n"
+    "    j = 0;\n"
+    "    while (j < m) {\n"
+    "        t = (i * k + j) - s / 13;\n"
+    "        s = s + t - j * 3;\n"
+    "        p = p * 3 + t;\n"
+    "        j = j + 1;\n"
+    "    }\n"
+    "    i = i + 1;\n"
+    "}\n";
+
+
+// ================= MIPS64 interpreter =========================
+// covers what assembly.c emits; immediates are taken at full width like the listing writes them
+
+typedef enum { M_DADDIU, M_DADDU, M_DSUBU, M_DMULT, M_DDIV, M_MFLO, M_SLT,
+               M_BEQ, M_BNE, M_J, M_LD, M_SD } MipsOp;
+
+typedef struct {
+    MipsOp op;
+    int rd, rs, rt;     // register fields as written (first, second, third operand)
+    int target;         // branch/jump: instruction index; ld/sd: data slot
+    long long imm;
+} MipsInsn;
+
+typedef struct {
+    MipsInsn *code;
+    int count;
+    char names[MAX_MIPS_DATA][64];
+    long long init[MAX_MIPS_DATA];
+    int data_count;
+} MipsProgram;
+
+static int FindLabel(char labels[][64], int count, const char *name) {
+    for(int i = 0; i < count; i++)
+        if(strcmp(labels[i], name) == 0)
+            return i;
+    return -1;
+}
+
+static long long Immediate(const char *s) {
+    int negative = 0;
+    if(*s == '#')
+        s++;
+    if(*s == '-') {
+        negative = 1;
+        s++;
+    }
+    long long v = (long long)strtoull(s, NULL, 0);
+    return negative ? -v : v;
+}
+
+// two passes over the listing: labels and data first, then the decoded instructions
+static int DecodeListing(const char *text, MipsProgram *mp) {
+    static char labels[MAX_MIPS_LABELS][64];
+    static int label_at[MAX_MIPS_LABELS];
+    int label_count = 0;
+    memset(mp, 0, sizeof(*mp));
+    int lines = 0;
+    for(const char *p = text; *p; p++)
+        lines += (*p == '\n');
+    mp->code = malloc((lines + 1) * sizeof(MipsInsn));
+    if(!mp->code)
+        return 0;
+
+    for(int pass = 0; pass < 2; pass++) {
+        int in_code = 0, index = 0;
+        const char *p = text;
+        while(*p) {
+            char line[256], a[64], b[64], c[64], op[16];
+            int len = (int)strcspn(p, "\n");
+            snprintf(line, sizeof(line), "%.*s", len < 255 ? len : 255, p);
+            p += len + (p[len] == '\n');
+            if(strcmp(line, ".data") == 0 || strcmp(line, ".code") == 0) {
+                in_code = (line[1] == 'c');
+                continue;
+            }
+            if(line[0] == '\0')
+                continue;
+            if(!in_code) {
+                if(pass == 0 && mp->data_count < MAX_MIPS_DATA && sscanf(line, "%63[^:]: .%15s %63s", a, op, b) >= 2) {
+                    strcpy(mp->names[mp->data_count], a);
+                    mp->init[mp->data_count++] = strcmp(op, "word64") == 0 ? Immediate(b) : 0;
+                }
+                continue;
+            }
+            if(line[len - 1] == ':') {
+                if(pass == 0 && label_count < MAX_MIPS_LABELS) {
+                    snprintf(labels[label_count], 64, "%.*s", len - 1, line);
+                    label_at[label_count++] = index;
+                }
+                continue;
+            }
+            if(pass == 1) {
+                MipsInsn *in = &mp->code[index];
+                memset(in, 0, sizeof(*in));
+                int n = sscanf(line, "%15s r%d, r%d, %63s", op, &in->rd, &in->rs, c);
+                if(strcmp(op, "ld") == 0 || strcmp(op, "sd") == 0) {
+                    sscanf(line, "%15s r%d, %63[^(]", op, &in->rd, a);
+                    in->op = op[0] == 'l' ? M_LD : M_SD;
+                    in->target = FindLabel(mp->names, mp->data_count, a);
+                } else if(strcmp(op, "j") == 0) {
+                    sscanf(line, "%15s %63s", op, a);
+                    in->op = M_J;
+                    in->target = label_at[FindLabel(labels, label_count, a)];
+                } else if(strcmp(op, "daddiu") == 0) {
+                    in->op = M_DADDIU;
+                    in->imm = Immediate(c);
+                } else if(strcmp(op, "beq") == 0 || strcmp(op, "bne") == 0) {
+                    in->op = op[1] == 'e' ? M_BEQ : M_BNE;
+                    in->target = label_at[FindLabel(labels, label_count, c)];
+                } else if(strcmp(op, "mflo") == 0)
+                    in->op = M_MFLO;
+                else if(strcmp(op, "dmult") == 0 || strcmp(op, "ddiv") == 0) {
+                    in->op = op[1] == 'm' ? M_DMULT : M_DDIV;
+                    in->rt = in->rs;
+                    in->rs = in->rd;
+                } else if(n == 4) {
+                    in->rt = atoi(c + 1);
+                    in->op = strcmp(op, "daddu") == 0 ? M_DADDU : strcmp(op, "dsubu") == 0 ? M_DSUBU : M_SLT;
+                }
+            }
+            index++;
+        }
+        mp->count = index;
+    }
+    return 1;
+}
+
+// returns instructions executed; data holds the final .data image
+static long long Interpret(const MipsProgram *mp, long long *data) {
+    unsigned long long r[32] = { 0 }, lo = 0;
+    long long steps = 0;
+    memcpy(data, mp->init, mp->data_count * sizeof(long long));
+    for(int pc = 0; pc < mp->count; ) {
+        const MipsInsn *in = &mp->code[pc++];
+        steps++;
+        switch(in->op) {
+        case M_DADDIU: r[in->rd] = r[in->rs] + (unsigned long long)in->imm; break;
+        case M_DADDU:  r[in->rd] = r[in->rs] + r[in->rt]; break;
+        case M_DSUBU:  r[in->rd] = r[in->rs] - r[in->rt]; break;
+        case M_DMULT:  lo = r[in->rs] * r[in->rt]; break;
+        case M_DDIV: {
+            long long x = (long long)r[in->rs], y = (long long)r[in->rt];
+            lo = (y == 0 || (y == -1 && x == -9223372036854775807LL - 1)) ? (unsigned long long)x : (unsigned long long)(x / y);
+            break;
+        }
+        case M_MFLO:   r[in->rd] = lo; break;
+        case M_SLT:    r[in->rd] = (long long)r[in->rs] < (long long)r[in->rt]; break;
+        case M_BEQ:    if(r[in->rd] == r[in->rs]) pc = in->target; break;
+        case M_BNE:    if(r[in->rd] != r[in->rs]) pc = in->target; break;
+        case M_J:      pc = in->target; break;
+        case M_LD:     r[in->rd] = (unsigned long long)data[in->target]; break;
+        case M_SD:     data[in->target] = (long long)r[in->rd]; break;
+        }
+        r[0] = 0;
+    }
+    return steps;
+}
+
+
+// ================= bench =========================
+
+static int ParseBenchSource(Statement *stmts) {
+    char errinfo[MAX_VAR_LENGTH];
+    SourceFile src = { (char *)bench_source, strlen(bench_source), 0 };
+    SourceSpan line;
+    size_t pos = 0;
+    int count = 0;
+    while(SourceNextLine(&src, &pos, &line)) {
+        line = TrimSpan(line);
+        if(line.len == 0)
+            continue;
+        ErrorType err = strncmp(line.text, "int ", 4) == 0 ? StartsWithInt(line.text, errinfo)
+                      : IsWhileKeyword(line.text) ? StartsWithWhile(line.text, errinfo)
+                      : StartsWithVariableName(line.text, errinfo);
+        if(err != ERR_NONE)
+            return -1;
+        count += ParseStatement(line.text, line.len, stmts + count, MAX_BENCH_STMTS - count);
+    }
+    return count;
+}
+
+static double Seconds(clock_t t0) {
+    double s = (double)(clock() - t0) / CLOCKS_PER_SEC;
+    return s > 0 ? s : 1e-9;
+}
+
+// compile at one -O level, run both ways, compare; returns 0 on a mismatch
+static int BenchLevel(const Statement *stmts, int count, int level) {
+    SsaProgram prog;
+    SsaLower(stmts, count, &prog);
+    OptSetLevel(level);
+    OptRun(&prog);
+
+    // MIPS64 listing in memory
+    FILE *f = tmpfile();
+    if(!f)
+        return 0;
+    AssemblyGenerateProgram(&prog, f);
+    long size = ftell(f);
+    char *text = malloc(size + 1);
+    rewind(f);
+    size = (long)fread(text, 1, size, f);
+    text[size] = '\0';
+    fclose(f);
+
+    static MipsProgram mp;
+    JitCode code;
+    if(!DecodeListing(text, &mp) || !JitCompile(&prog, &code)) {
+        printf("-O%d: %s\n", level, JitAvailable() ? "compilation failed" : "no native code generator on this host");
+        free(text);
+        SsaFree(&prog);
+        return JitAvailable() ? 0 : 1;
+    }
+    long long mips_data[MAX_MIPS_DATA], *jit_data = calloc(code.var_count + 1, sizeof(long long));
+    long long steps = 0;
+    double interp = 1e9, native = 1e9;
+    for(int r = 0; r < BENCH_ROUNDS; r++) {
+        clock_t t0 = clock();
+        steps = Interpret(&mp, mips_data);
+        double s = Seconds(t0);
+        if(s < interp)
+            interp = s;
+        memset(jit_data, 0, (code.var_count + 1) * sizeof(long long));
+        t0 = clock();
+        JitRun(&code, jit_data);
+        s = Seconds(t0);
+        if(s < native)
+            native = s;
+    }
+
+    int same = 1;
+    for(int d = 0; d < mp.data_count; d++) {
+        int slot = mp.names[d][0] == '_' ? -1 : JitSlotOf(&code, FindName(mp.names[d]));
+        if(slot >= 0 && jit_data[slot] != mips_data[d]) {
+            printf("-O%d: %s = %lld (interpreter) vs %lld (x86-64)\n", level, mp.names[d], mips_data[d], jit_data[slot]);
+            same = 0;
+        }
+    }
+    printf("-O%d  %5d MIPS insns  %10lld executed  interpreter %8.2f ms (%6.0f M insn/s)  x86-64 %7.2f ms (%5zu bytes)  %6.1fx\n",
+           level, mp.count, steps, interp * 1e3, steps / interp / 1e6, native * 1e3, code.size, interp / native);
+
+    free(jit_data);
+    free(mp.code);
+    free(text);
+    JitFree(&code);
+    SsaFree(&prog);
+    return same;
+}
+
+int main(void) {
+    static Statement stmts[MAX_BENCH_STMTS];
+    int count = ParseBenchSource(stmts);
+    if(count < 0) {
+        printf("bench input rejected\n");
+        return 1;
+    }
+    printf("nested loops, 2000 x 1000 iterations, best of %d\n\n", BENCH_ROUNDS);
+    int ok = BenchLevel(stmts, count, 0) & BenchLevel(stmts, count, 2);
+    printf("\nfinal values %s\n", ok ? "match" : "DIFFER");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,167 @@
+// character-scanning throughput in bytes/cycle: the original isspace/isalnum loops,
+// the class-table scalar path and the SSE2/AVX2 scanners of scan.c.
+// build and run with "make bench-scan".
+//
+// "long runs" scans 4 KB stretches of one class (the ceiling of each implementation: spaces,
+// blanks mixing ' ' and '\t', identifier characters, digits);
+// "token mix" walks a realistic statement line token by token, where runs are 1-8
+// characters and the per-call overhead dominates.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include "scan.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define Cycles() __rdtsc()
+#define CYCLE_UNIT "cycle"
+#else
+#define Cycles() ((unsigned long long)clock())
+#define CYCLE_UNIT "clock tick"
+#endif
+
+#define RUN_LEN 4096
+#define RUN_ROUNDS 20000
+#define MIX_LINES 4096
+#define MIX_ROUNDS 200
+
+static char spaces[RUN_LEN + 64], blanks[RUN_LEN + 64], ident[RUN_LEN + 64], digits[RUN_LEN + 64];
+static char *mix;
+static size_t mix_len;
+static volatile size_t sink;   // keeps the scans from being optimized away
+
+
+// the loops the validator and assembly.c used before scan.c
+static const char *OriginalSpaces(const char *p) {
+    while(*p == ' ')
+        p++;
+    return p;
+}
+
+static const char *OriginalWhitespace(const char *p) {
+    while(*p && isspace((unsigned char)*p) && *p != '\n')
+        p++;
+    return p;
+}
+
+static const char *OriginalIdentifier(const char *p) {
+    while(isalnum((unsigned char)*p) || *p == '_')
+        p++;
+    return p;
+}
+
+static const char *OriginalDigits(const char *p) {
+    while(isdigit((unsigned char)*p))
+        p++;
+    return p;
+}
+
+static const char *OriginalStatementEnd(const char *p) {
+    while(*p && *p != ';' && *p != ',' && *p != '\n')
+        p++;
+    return p;
+}
+
+typedef const char *(*Scanner)(const char *p);
+
+typedef struct {
+    const char *name;
+    Scanner spaces, whitespace, identifier, digits, statement;
+} Scanners;
+
+
+static void Generate(void) {
+    memset(spaces, ' ', RUN_LEN);
+    for(int i = 0; i < RUN_LEN; i++) {
+        blanks[i] = i % 5 == 4 ? '\t' : ' ';
+        ident[i] = "abcdefghijklmnopqrstuvwxyz_ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789"[i % 63];
+        digits[i] = '0' + i % 10;
+    }
+    mix = malloc(MIX_LINES * 64 + 64);
+    mix_len = 0;
+    for(int i = 0; i < MIX_LINES; i++)
+        mix_len += sprintf(mix + mix_len, "    total_%d = count + v%d * 3 - (offset / 2);\n", i % 97, i % 13);
+}
+
+// one pass over the mixed text, token by token, the way the validator moves
+static size_t ScanMix(const Scanners *s) {
+    const char *p = mix, *end = mix + mix_len;
+    size_t tokens = 0;
+    while(p < end) {
+        p = s->whitespace(p);
+        if(*p == '_' || isalpha((unsigned char)*p))
+            p = s->identifier(p);
+        else if(isdigit((unsigned char)*p))
+            p = s->digits(p);
+        else
+            p++;
+        tokens++;
+    }
+    return tokens;
+}
+
+static double Measure(const Scanners *s, int which) {
+    unsigned long long start = Cycles();
+    double bytes = 0;
+    if(which < 4) {
+        const char *buf[] = { spaces, blanks, ident, digits };
+        Scanner f[] = { s->spaces, s->whitespace, s->identifier, s->digits };
+        for(int r = 0; r < RUN_ROUNDS; r++)
+            sink += f[which](buf[which] + (r & 15)) - buf[which];   // every alignment
+        bytes = (double)RUN_ROUNDS * (RUN_LEN - 8);
+    }
+    else {
+        for(int r = 0; r < MIX_ROUNDS; r++)
+            sink += ScanMix(s);
+        bytes = (double)MIX_ROUNDS * mix_len;
+    }
+    unsigned long long cycles = Cycles() - start;
+    return cycles ? bytes / cycles : 0;
+}
+
+// every implementation must stop at the same character as the original loops
+static int Agree(const Scanners *s, const Scanners *ref) {
+    for(size_t i = 0; i < mix_len; i++) {
+        const char *p = mix + i;
+        if(s->spaces(p) != ref->spaces(p) || s->whitespace(p) != ref->whitespace(p) ||
+           s->identifier(p) != ref->identifier(p) || s->digits(p) != ref->digits(p) ||
+           s->statement(p) != ref->statement(p))
+            return 0;
+    }
+    return 1;
+}
+
+
+int main(void) {
+    Generate();
+    static const Scanners original = { "original", OriginalSpaces, OriginalWhitespace,
+                                       OriginalIdentifier, OriginalDigits, OriginalStatementEnd };
+    const Scanners current = { "", ScanSpaces, ScanWhitespace, ScanIdentifier, ScanDigits, ScanStatementEnd };
+    const char *isas[] = { "scalar", "sse2", "avx2" };
+
+    printf("bytes/%s          spaces   blanks    ident   digits  token mix\n", CYCLE_UNIT);
+    printf("%-18s", original.name);
+    for(int w = 0; w < 5; w++)
+        printf(" %8.2f", Measure(&original, w));
+    printf("\n");
+
+    for(int k = 0; k < 3; k++) {
+        if(!ScanUse(isas[k])) {
+            printf("%-18s (not supported by this CPU)\n", isas[k]);
+            continue;
+        }
+        if(!Agree(&current, &original)) {
+            printf("%-18s MISMATCH with the original loops\n", isas[k]);
+            return 1;
+        }
+        printf("%-18s", isas[k]);
+        for(int w = 0; w < 5; w++)
+            printf(" %8.2f", Measure(&current, w));
+        printf("\n");
+    }
+    free(mix);
+    return 0;
+}
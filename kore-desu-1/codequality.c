@@ -0,0 +1,236 @@
+// generated-code quality metrics for "make codequality"
+//
+//   codequality_check metrics <name> <MIPS64_ASSEMBLY.txt>
+//       prints "<name> <metric> <value>" lines for one compiled program
+//   codequality_check compare <baseline> <current> <threshold %>
+//       fails (exit 1) when a metric grows more than threshold % over its baseline
+//
+// every metric is "lower is better": instructions, memory accesses, registers, .data bytes
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#define MAX_METRICS 2048
+#define MAX_MNEMONICS 64
+#define LINE_LEN 512
+
+typedef struct {
+    char key[160];   // "<program> <metric>"
+    long value;
+} Metric;
+
+
+// ================= metrics of one assembly file =========================
+
+static int IsRegisterToken(const char *t) {
+    if(t[0] != 'r' || !isdigit((unsigned char)t[1]))
+        return 0;
+    for(t++; *t; t++)
+        if(!isdigit((unsigned char)*t))
+            return 0;
+    return 1;
+}
+
+static int Measure(const char *name, const char *path) {
+    FILE *f = fopen(path, "r");
+    if(!f) {
+        fprintf(stderr, "%s: no assembly generated (%s)\n", name, path);
+        return 0;
+    }
+
+    char mnemonics[MAX_MNEMONICS][16];
+    long counts[MAX_MNEMONICS];
+    int mnemonic_count = 0;
+    int regs_used[32] = {0};
+    long insns = 0, data_bytes = 0;
+    int in_data = 0;
+    char line[LINE_LEN];
+
+    while(fgets(line, sizeof(line), f)) {
+        char *p = line;
+        while(isspace((unsigned char)*p))
+            p++;
+        p[strcspn(p, "\r\n")] = '\0';
+        if(*p == '\0' || *p == '#' || *p == ';')
+            continue;
+        if(strcmp(p, ".data") == 0) { in_data = 1; continue; }
+        if(strcmp(p, ".code") == 0) { in_data = 0; continue; }
+
+        if(in_data) {
+            // name: .space N | name: .word64 v | name: .word32/.word16/.byte v | name: .asciiz "text",
+            // each at a multiple of its size (a char, short or int32) or of a doubleword
+            char *dir = strchr(p, '.');
+            long n, size = 0;
+            if(dir && sscanf(dir, ".space %ld", &n) == 1)
+                size = (n == 1 || n == 2 || n == 4) ? n : (n + 7) / 8 * 8;
+            else if(dir && strncmp(dir, ".word64", 7) == 0)
+                size = 8;
+            else if(dir && strncmp(dir, ".word32", 7) == 0)
+                size = 4;
+            else if(dir && strncmp(dir, ".word16", 7) == 0)
+                size = 2;
+            else if(dir && strncmp(dir, ".byte", 5) == 0)
+                size = 1;
+            else if(dir && strncmp(dir, ".asciiz", 7) == 0 && (dir = strchr(dir, '"'))) {
+                // the characters (an escape is one) and the NUL, in whole doublewords
+                for(n = 1, dir++; *dir && *dir != '"'; dir++, n++)
+                    if(*dir == '\\' && dir[1])
+                        dir++;
+                size = (n + 7) / 8 * 8;
+            }
+            long align = size < 8 ? size : 8;
+            if(size)
+                data_bytes = (data_bytes + align - 1) / align * align + size;
+            continue;
+        }
+
+        if(p[strlen(p) - 1] == ':')
+            continue; // code label
+
+        char op[16];
+        if(sscanf(p, "%15s", op) != 1)
+            continue;
+        insns++;
+        int m = 0;
+        while(m < mnemonic_count && strcmp(mnemonics[m], op) != 0)
+            m++;
+        if(m == mnemonic_count && mnemonic_count < MAX_MNEMONICS) {
+            strcpy(mnemonics[mnemonic_count], op);
+            counts[mnemonic_count++] = 0;
+        }
+        if(m < mnemonic_count)
+            counts[m]++;
+
+        // registers: plain operands and the base of "name(rN)"
+        for(char *t = strtok(p + strlen(op), " ,\t"); t; t = strtok(NULL, " ,\t")) {
+            char *paren = strchr(t, '(');
+            if(paren) {
+                t = paren + 1;
+                t[strcspn(t, ")")] = '\0';
+            }
+            if(IsRegisterToken(t) && atoi(t + 1) > 0 && atoi(t + 1) < 32)
+                regs_used[atoi(t + 1)] = 1;
+        }
+    }
+    fclose(f);
+    data_bytes = (data_bytes + 7) / 8 * 8;  // the image is whole doublewords
+
+    // ld and sd count the narrow loads and stores (lb/lh/lw, sb/sh/sw) too
+    long ld = 0, sd = 0, muldiv = 0, regs = 0;
+    for(int m = 0; m < mnemonic_count; m++) {
+        if(strcmp(mnemonics[m], "ld") == 0 || strcmp(mnemonics[m], "lb") == 0 ||
+           strcmp(mnemonics[m], "lh") == 0 || strcmp(mnemonics[m], "lw") == 0)
+            ld += counts[m];
+        if(strcmp(mnemonics[m], "sd") == 0 || strcmp(mnemonics[m], "sb") == 0 ||
+           strcmp(mnemonics[m], "sh") == 0 || strcmp(mnemonics[m], "sw") == 0)
+            sd += counts[m];
+        if(strcmp(mnemonics[m], "dmult") == 0 || strcmp(mnemonics[m], "ddiv") == 0 ||
+           strcmp(mnemonics[m], "dmul") == 0 || strcmp(mnemonics[m], "dmod") == 0)
+            muldiv += counts[m];
+    }
+    for(int r = 1; r < 32; r++)
+        regs += regs_used[r];
+
+    printf("%s insns %ld\n", name, insns);
+    printf("%s ld %ld\n", name, ld);
+    printf("%s sd %ld\n", name, sd);
+    printf("%s muldiv %ld\n", name, muldiv);
+    printf("%s regs %ld\n", name, regs);
+    printf("%s data %ld\n", name, data_bytes);
+    for(int m = 0; m < mnemonic_count; m++)
+        printf("%s op.%s %ld\n", name, mnemonics[m], counts[m]);
+    return 1;
+}
+
+
+// ================= baseline comparison =========================
+
+static int LoadMetrics(const char *path, Metric *out) {
+    FILE *f = fopen(path, "r");
+    if(!f) {
+        fprintf(stderr, "cannot open %s\n", path);
+        return -1;
+    }
+    int n = 0;
+    char line[LINE_LEN], prog[80], metric[80];
+    long value;
+    while(n < MAX_METRICS && fgets(line, sizeof(line), f)) {
+        if(line[0] == '#' || sscanf(line, "%79s %79s %ld", prog, metric, &value) != 3)
+            continue;
+        snprintf(out[n].key, sizeof(out[n].key), "%s %s", prog, metric);
+        out[n++].value = value;
+    }
+    fclose(f);
+    return n;
+}
+
+static const Metric *FindMetric(const Metric *list, int n, const char *key) {
+    for(int i = 0; i < n; i++)
+        if(strcmp(list[i].key, key) == 0)
+            return &list[i];
+    return NULL;
+}
+
+// a program missing from the current run (it failed to compile) is a regression too
+static int ProgramPresent(const Metric *list, int n, const char *key) {
+    int len = (int)(strchr(key, ' ') - key);
+    for(int i = 0; i < n; i++)
+        if(strncmp(list[i].key, key, len + 1) == 0)
+            return 1;
+    return 0;
+}
+
+static int Compare(const char *baseline_path, const char *current_path, double threshold) {
+    static Metric base[MAX_METRICS], cur[MAX_METRICS];
+    int nb = LoadMetrics(baseline_path, base), nc = LoadMetrics(current_path, cur);
+    if(nb < 0 || nc < 0)
+        return 1;
+
+    int regressions = 0, improvements = 0;
+    for(int i = 0; i < nb; i++) {
+        const Metric *c = FindMetric(cur, nc, base[i].key);
+        long now = c ? c->value : 0;
+        if(!ProgramPresent(cur, nc, base[i].key)) {
+            printf("REGRESSED %-32s missing from this run\n", base[i].key);
+            regressions++;
+        }
+        else if(now > base[i].value + base[i].value * threshold / 100.0) {
+            printf("REGRESSED %-32s %6ld -> %ld\n", base[i].key, base[i].value, now);
+            regressions++;
+        }
+        else if(now < base[i].value) {
+            printf("improved  %-32s %6ld -> %ld\n", base[i].key, base[i].value, now);
+            improvements++;
+        }
+    }
+    // metrics that did not exist before (e.g. a new mnemonic) start from 0
+    for(int i = 0; i < nc; i++) {
+        if(FindMetric(base, nb, cur[i].key) || cur[i].value == 0)
+            continue;
+        if(ProgramPresent(base, nb, cur[i].key)) {
+            printf("REGRESSED %-32s %6d -> %ld\n", cur[i].key, 0, cur[i].value);
+            regressions++;
+        } else
+            printf("new       %-32s %6s    %ld\n", cur[i].key, "", cur[i].value);
+    }
+
+    printf("\ncode quality: %d regression(s), %d improvement(s) (threshold %.0f%%)\n",
+           regressions, improvements, threshold);
+    if(regressions == 0 && improvements > 0)
+        printf("run \"make codequality-update\" to record the improvements as the new baseline\n");
+    return regressions > 0;
+}
+
+
+int main(int argc, char **argv) {
+    if(argc == 4 && strcmp(argv[1], "metrics") == 0)
+        return Measure(argv[2], argv[3]) ? 0 : 1;
+    if(argc == 5 && strcmp(argv[1], "compare") == 0)
+        return Compare(argv[2], argv[3], atof(argv[4]));
+
+    fprintf(stderr, "usage: %s metrics <name> <asm file>\n"
+                    "       %s compare <baseline> <current> <threshold %%>\n", argv[0], argv[0]);
+    return 2;
+}
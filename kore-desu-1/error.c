@@ -1,37 +1,279 @@
 // error.c: not every error is listed, just the most common (and general) ones
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
 #include "error.h"
 
-// prints a human-readable error message
-void ReportError(ErrorType type, int line, const char *extra) {
+#define DIAG_BUFFER (64 * 1024)
+
+static DiagMode diag_mode = DIAG_TEXT;
+static const char *diag_file = "";
+static int diag_counts[3]; // per DiagSeverity
+static int output_open;     // the program's print output (--run) doesn't end with a newline yet
+
+static const char *severity_names[] = { "note", "warning", "error" };
+
+static const char *error_codes[] = {
+    "ERR_NONE", "ERR_UNDECLARED", "ERR_REDECLARED", "ERR_INVALID_IDENTIFIER",
+    "ERR_MISSING_SEMICOLON", "ERR_INVALID_EXPRESSION", "ERR_SYNTAX",
+    "ERR_KEYWORD_AS_IDENTIFIER", "ERR_UNMATCHED_BRACE", "ERR_IO", "ERR_LINK",
+    "ERR_CONST_ASSIGNED", "ERR_NUMBER_RANGE", "ERR_MEMORY"
+};
+
+
+void DiagInit(DiagMode mode, const char *file) {
+    diag_mode = mode;
+    diag_file = file;
+    diag_counts[DIAG_NOTE] = diag_counts[DIAG_WARNING] = diag_counts[DIAG_ERROR] = 0;
+    // fully buffered even on a terminal: one write per 64 KB instead of one per line
+    setvbuf(stdout, NULL, _IOFBF, DIAG_BUFFER);
+}
+
+// a print without a trailing newline leaves its line open: end it before anything else is
+// printed, so "name = value" or a diagnostic never runs into the program's output
+static void EndOutput(void) {
+    if(output_open)
+        putchar('\n');
+    output_open = 0;
+}
+
+void DiagText(const char *format, ...) {
+    if(diag_mode != DIAG_TEXT)
+        return;
+    EndOutput();
+    va_list args;
+    va_start(args, format);
+    vfprintf(stdout, format, args);
+    va_end(args);
+}
+
+// JSON string with the required escapes
+static void JsonString(const char *s) {
+    putchar('"');
+    for(; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if(c == '"' || c == '\\')
+            printf("\\%c", c);
+        else if(c == '\n')
+            fputs("\\n", stdout);
+        else if(c == '\t')
+            fputs("\\t", stdout);
+        else if(c < 0x20)
+            printf("\\u%04x", c);
+        else
+            putchar(c);
+    }
+    putchar('"');
+}
+
+void DiagReport(DiagSeverity severity, ErrorType code, const char *file, int line, int column, const char *message) {
+    diag_counts[severity]++;
+    if(!file)
+        file = diag_file;
+    EndOutput();
+
+    switch(diag_mode) {
+        case DIAG_TEXT:
+            printf("\t%s: %s\n\n", severity == DIAG_ERROR ? "Error" : severity == DIAG_WARNING ? "Warning" : "Note", message);
+            break;
+
+        case DIAG_QUIET:
+            if(severity == DIAG_ERROR)
+                printf("%s:%d:%d: error: %s\n", file, line, column, message);
+            break;
+
+        case DIAG_JSON:
+            fputs("{\"type\":\"diagnostic\",\"file\":", stdout);
+            JsonString(file);
+            printf(",\"line\":%d,\"column\":%d,\"severity\":\"%s\",\"code\":\"%s\",\"message\":",
+                   line, column, severity_names[severity], error_codes[code]);
+            JsonString(message);
+            fputs("}\n", stdout);
+            break;
+    }
+}
+
+void DiagValue(const char *name, long long value) {
+    EndOutput();
+    switch(diag_mode) {
+        case DIAG_TEXT:
+            printf("\t%s = %lld\n", name, value);
+            break;
+
+        case DIAG_QUIET:
+            printf("%s = %lld\n", name, value);
+            break;
+
+        case DIAG_JSON:
+            fputs("{\"type\":\"value\",\"name\":", stdout);
+            JsonString(name);
+            printf(",\"value\":%lld}\n", value);
+            break;
+    }
+}
+
+void DiagOutput(const char *text) {
+    if(diag_mode != DIAG_JSON) {
+        fputs(text, stdout);
+        if(*text)
+            output_open = text[strlen(text) - 1] != '\n';
+        return;
+    }
+    fputs("{\"type\":\"output\",\"text\":", stdout);
+    JsonString(text);
+    fputs("}\n", stdout);
+}
+
+void DiagProfile(int line, long long count, double percent, int instructions, const char *source) {
+    EndOutput();
+    switch(diag_mode) {
+        case DIAG_TEXT:
+            printf("\t%12lld %6.2f%%  line %-4d %4d insn(s)  %s\n", count, percent, line, instructions, source);
+            break;
+
+        case DIAG_QUIET:
+            printf("%lld %.2f%% line %d %d insn(s): %s\n", count, percent, line, instructions, source);
+            break;
+
+        case DIAG_JSON:
+            printf("{\"type\":\"profile\",\"line\":%d,\"count\":%lld,\"percent\":%.2f,\"instructions\":%d,\"source\":",
+                   line, count, percent, instructions);
+            JsonString(source);
+            fputs("}\n", stdout);
+            break;
+    }
+}
+
+void DiagSummary(int lines, int statements, int success) {
+    EndOutput();
+    switch(diag_mode) {
+        case DIAG_TEXT:
+            if(success)
+                printf("Compilation successful. Assembly and machine codes generated.\n\n");
+            else
+                printf("Compilation aborted due to encountered invalid syntax. No assembly and machine codes generated.\n\n");
+            break;
+
+        case DIAG_QUIET:
+            printf("%s: %d lines, %d statements, %d error(s), %d warning(s): %s\n", diag_file, lines, statements,
+                   diag_counts[DIAG_ERROR], diag_counts[DIAG_WARNING], success ? "compiled" : "aborted");
+            break;
+
+        case DIAG_JSON:
+            fputs("{\"type\":\"summary\",\"file\":", stdout);
+            JsonString(diag_file);
+            printf(",\"lines\":%d,\"statements\":%d,\"errors\":%d,\"warnings\":%d,\"notes\":%d,\"success\":%s}\n",
+                   lines, statements, diag_counts[DIAG_ERROR], diag_counts[DIAG_WARNING], diag_counts[DIAG_NOTE],
+                   success ? "true" : "false");
+            break;
+    }
+    fflush(stdout);
+}
+
+void DiagLinkSummary(int objects, int success) {
+    switch(diag_mode) {
+        case DIAG_TEXT:
+            if(success)
+                printf("Link successful. Machine code generated.\n\n");
+            else
+                printf("Link aborted. No machine code generated.\n\n");
+            break;
+
+        case DIAG_QUIET:
+            printf("%d object(s), %d error(s), %d warning(s): %s\n", objects,
+                   diag_counts[DIAG_ERROR], diag_counts[DIAG_WARNING], success ? "linked" : "aborted");
+            break;
+
+        case DIAG_JSON:
+            printf("{\"type\":\"summary\",\"objects\":%d,\"errors\":%d,\"warnings\":%d,\"notes\":%d,\"success\":%s}\n",
+                   objects, diag_counts[DIAG_ERROR], diag_counts[DIAG_WARNING], diag_counts[DIAG_NOTE],
+                   success ? "true" : "false");
+            break;
+    }
+    fflush(stdout);
+}
+
+int DiagErrorCount(void) {
+    return diag_counts[DIAG_ERROR];
+}
+
+
+// human-readable message for an error type
+static void ErrorMessage(ErrorType type, const char *extra, char *message, int size) {
     switch(type) {
         case ERR_UNDECLARED:
-            printf("\tError: Variable '%s' undeclared\n\n", extra);
+            snprintf(message, size, "Variable '%s' undeclared", extra);
             break;
 
         case ERR_REDECLARED:
-            printf("\tError: Variable '%s' redeclared\n\n", extra);
+            snprintf(message, size, "Variable '%s' redeclared", extra);
             break;
 
         case ERR_INVALID_IDENTIFIER:
-            printf("\tError: Invalid identifier '%s'\n\n", extra);
+            snprintf(message, size, "Invalid identifier '%s'", extra);
             break;
 
         case ERR_MISSING_SEMICOLON:
-            printf("\tError: Missing semicolon\n\n");
+            snprintf(message, size, "Missing semicolon");
             break;
 
         case ERR_INVALID_EXPRESSION:
-            printf("\tError: Invalid expression\n\n");
+            snprintf(message, size, "Invalid expression");
             break;
 
         case ERR_KEYWORD_AS_IDENTIFIER:
-            printf("\tError: '%s' is a keyword and can't be a variable name\n\n", extra);
+            snprintf(message, size, "'%s' is a keyword and can't be a variable name", extra);
+            break;
+
+        case ERR_UNMATCHED_BRACE:
+            snprintf(message, size, "Unmatched '%s'", extra);
+            break;
+
+        case ERR_IO:
+            snprintf(message, size, "Unable to access '%s'", extra);
+            break;
+
+        case ERR_LINK:
+            snprintf(message, size, "Link error: %s", extra);
+            break;
+
+        case ERR_CONST_ASSIGNED:
+            snprintf(message, size, "'%s' is a constant and can't be assigned", extra);
+            break;
+
+        case ERR_NUMBER_RANGE:
+            snprintf(message, size, "Number '%s' doesn't fit in 64 bits", extra);
+            break;
+
+        case ERR_MEMORY:
+            snprintf(message, size, "Out of memory");
             break;
 
         case ERR_SYNTAX:
             default:
-            printf("\tError: Syntax error\n\n");
+            snprintf(message, size, "Syntax error");
             break;
     }
-}
\ No newline at end of file
+}
+
+// prints a human-readable error message
+void ReportError(ErrorType type, int line, const char *extra) {
+    ReportErrorAt(type, line, 0, extra);
+}
+
+void ReportErrorAt(ErrorType type, int line, int column, const char *extra) {
+    char message[256];
+    ErrorMessage(type, extra ? extra : "", message, sizeof(message));
+    DiagReport(DIAG_ERROR, type, NULL, line, column, message);
+}
+
+void *xrealloc(void *p, size_t size) {
+    void *grown = realloc(p, size ? size : 1);
+    if(!grown) {
+        ReportError(ERR_MEMORY, 0, NULL);
+        fflush(stdout);
+        exit(1);
+    }
+    return grown;
+}
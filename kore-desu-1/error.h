@@ -2,6 +2,8 @@
 #ifndef ERROR_H
 #define ERROR_H
 
+#include <stddef.h>
+
 
 // ErrorType: list of possible validation / semantic / syntax errors
 typedef enum {
@@ -12,9 +14,50 @@ ERR_INVALID_IDENTIFIER,
 ERR_MISSING_SEMICOLON,
 ERR_INVALID_EXPRESSION,
 ERR_SYNTAX,
-ERR_KEYWORD_AS_IDENTIFIER
+ERR_KEYWORD_AS_IDENTIFIER,
+ERR_UNMATCHED_BRACE,
+ERR_IO,
+ERR_LINK,
+ERR_CONST_ASSIGNED,
+ERR_NUMBER_RANGE,
+ERR_MEMORY
 } ErrorType;
 
+// diagnostics sink: every message of the compiler goes through one buffered stream (stdout)
+//  DIAG_TEXT:  the usual terminal output (each line echoed, errors below it)
+//  DIAG_QUIET: only errors ("file:line:column: error: message") and a summary
+//  DIAG_JSON:  one JSON object per line for every diagnostic, then a summary object
+typedef enum { DIAG_TEXT, DIAG_QUIET, DIAG_JSON } DiagMode;
+typedef enum { DIAG_NOTE, DIAG_WARNING, DIAG_ERROR } DiagSeverity;
+
+// must be called before anything is printed; file is the default for diagnostics
+void DiagInit(DiagMode mode, const char *file);
+
+// progress text (line echoes, headers), printed in DIAG_TEXT mode only
+void DiagText(const char *format, ...);
+
+// one diagnostic; line/column are 1-based, 0 when unknown; file NULL = the one given to DiagInit
+void DiagReport(DiagSeverity severity, ErrorType code, const char *file, int line, int column, const char *message);
+
+// final value of a variable after --run: "name = value" (text, quiet) or a {"type":"value"} object
+void DiagValue(const char *name, long long value);
+
+// what a print statement writes during --run: the text as it is (text, quiet) or an
+// {"type":"output"} object
+void DiagOutput(const char *text);
+
+// one line of the --profile hot-spot report: its count, share of all line executions,
+// instructions and source text
+void DiagProfile(int line, long long count, double percent, int instructions, const char *source);
+
+// final status line (text), count line (quiet) or summary object (json), then flush
+void DiagSummary(int lines, int statements, int success);
+
+// same for the link step (--link): objects linked into one machine code file
+void DiagLinkSummary(int objects, int success);
+
+int DiagErrorCount(void);
+
 
 // Report an error to the user
 // type: the error type
@@ -22,4 +65,11 @@ ERR_KEYWORD_AS_IDENTIFIER
 // extra: optional extra info (variable name, token text, etc.)
 void ReportError(ErrorType type, int line, const char *extra);
 
-#endif
\ No newline at end of file
+// same, with the 1-based column of the offending text (0 if unknown)
+void ReportErrorAt(ErrorType type, int line, int column, const char *extra);
+
+// realloc that doesn't come back without memory: running out is reported as an error (ERR_MEMORY)
+// and ends the program. xrealloc(NULL, size) allocates; a size of 0 still gets a block
+void *xrealloc(void *p, size_t size);
+
+#endif
@@ -0,0 +1,105 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ir.h"
+#include "error.h" // xrealloc
+
+#define ARENA_BLOCK_SIZE (64 * 1024)
+#define MAX_NAMES 32768
+#define NAME_HASH_SIZE 65536    // power of two, at least 2 * MAX_NAMES
+
+struct ArenaBlock {
+    ArenaBlock *next;
+    size_t used, size;
+    char data[];
+};
+
+Arena ir_arena = { NULL };
+
+// interned names: text lives in ir_arena, the hash maps text -> id + 1 (0 = empty slot)
+static const char *names[MAX_NAMES];
+static int name_lengths[MAX_NAMES];
+static int name_count = 0;
+static int name_hash[NAME_HASH_SIZE];
+
+
+// ================= bump arena =========================
+
+void *ArenaAlloc(Arena *a, size_t size) {
+    size = (size + 7) & ~(size_t)7; // keep every allocation 8-byte aligned
+    ArenaBlock *b = a->head;
+    if(!b || b->used + size > b->size) {
+        size_t capacity = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+        b = xrealloc(NULL, sizeof(ArenaBlock) + capacity);
+        b->next = a->head;
+        b->used = 0;
+        b->size = capacity;
+        a->head = b;
+    }
+    void *p = b->data + b->used;
+    b->used += size;
+    return p;
+}
+
+char *ArenaCopy(Arena *a, const char *s, int len) {
+    char *copy = ArenaAlloc(a, len + 1);
+    memcpy(copy, s, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+void ArenaFree(Arena *a) {
+    while(a->head) {
+        ArenaBlock *next = a->head->next;
+        free(a->head);
+        a->head = next;
+    }
+}
+
+
+// ================= interned identifiers =========================
+
+static unsigned HashName(const char *s, int len) {
+    unsigned h = 2166136261u; // FNV-1a
+    for(int i = 0; i < len; i++)
+        h = (h ^ (unsigned char)s[i]) * 16777619u;
+    return h;
+}
+
+// slot holding the name, or the empty slot where it belongs
+static int NameSlot(const char *s, int len) {
+    int slot = HashName(s, len) & (NAME_HASH_SIZE - 1);
+    while(name_hash[slot]) {
+        int id = name_hash[slot] - 1;
+        if(name_lengths[id] == len && memcmp(names[id], s, len) == 0)
+            break;
+        slot = (slot + 1) & (NAME_HASH_SIZE - 1);
+    }
+    return slot;
+}
+
+int InternName(const char *s, int len) {
+    int slot = NameSlot(s, len);
+    if(name_hash[slot])
+        return name_hash[slot] - 1;
+    if(name_count >= MAX_NAMES)
+        return -1;
+    names[name_count] = ArenaCopy(&ir_arena, s, len);
+    name_lengths[name_count] = len;
+    name_hash[slot] = ++name_count;
+    return name_count - 1;
+}
+
+int FindName(const char *s) {
+    return name_hash[NameSlot(s, (int)strlen(s))] - 1;
+}
+
+const char *NameOf(int id) {
+    return id >= 0 && id < name_count ? names[id] : "";
+}
+
+void IrReset(void) {
+    ArenaFree(&ir_arena);
+    memset(name_hash, 0, sizeof(name_hash));
+    name_count = 0;
+}
@@ -0,0 +1,36 @@
+#ifndef IR_H
+#define IR_H
+
+#include <stddef.h>
+
+// bump arena: statement text and interned names are carved out of large blocks
+// and released all at once with ArenaFree()
+typedef struct ArenaBlock ArenaBlock;
+
+typedef struct {
+    ArenaBlock *head;   // newest block (allocation happens here)
+} Arena;
+
+// a view of source text (not NUL-terminated)
+typedef struct {
+    const char *text;
+    int len;
+} SourceSpan;
+
+// arena shared by the front ends and the statement IR
+extern Arena ir_arena;
+
+void *ArenaAlloc(Arena *a, size_t size);
+// NUL-terminated copy of len chars of s
+char *ArenaCopy(Arena *a, const char *s, int len);
+void ArenaFree(Arena *a);
+
+// identifiers are interned once: statements carry the id, NameOf() gives the text back
+int InternName(const char *s, int len);   // id of the name (added if new), -1 if the table is full
+int FindName(const char *s);              // id of an already interned name, -1 if never seen
+const char *NameOf(int id);               // "" for -1
+
+// free ir_arena and forget every interned name
+void IrReset(void);
+
+#endif
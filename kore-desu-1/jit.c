@@ -0,0 +1,890 @@
+#if !defined(_WIN32)
+#define _DEFAULT_SOURCE // MAP_ANONYMOUS under -std=c99
+#include <sys/mman.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "jit.h"
+#include "error.h" // print statements write through the diagnostics sink
+
+#if defined(__x86_64__) && !defined(_WIN32)
+#define JIT_NATIVE 1
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+#endif
+
+// x86-64 register numbers (ModRM/REX encoding)
+enum { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15 };
+
+#define DATA_BASE   RDI     // first argument: the variable block, [rdi + 8*slot]
+#define SCRATCH     RBP     // constant divisors (rax/rdx belong to idiv)
+#define TEMP_COUNT  6
+#define HOME_COUNT  5
+#define MAX_WEIGHT_DEPTH 4  // loop nesting counted for the register choice
+
+// expression temps (caller-saved, never touched by idiv) and variable homes (callee-saved)
+static const int temp_pool[TEMP_COUNT] = { RCX, RSI, R8, R9, R10, R11 };
+static const int home_pool[HOME_COUNT] = { RBX, R12, R13, R14, R15 };
+static const int saved_regs[] = { RBX, RBP, R12, R13, R14, R15 };
+#define SAVED_COUNT ((int)(sizeof(saved_regs) / sizeof(saved_regs[0])))
+
+// jcc opcodes (second byte after 0x0F)
+#define JCC_E   0x84
+#define JCC_NE  0x85
+#define JCC_L   0x8C
+#define JCC_GE  0x8D
+#define JCC_LE  0x8E
+#define JCC_G   0x8F
+
+// an instruction operand: register, variable slot in memory, or 32-bit immediate
+typedef enum { OPD_REG, OPD_MEM, OPD_IMM } OperandKind;
+
+typedef struct {
+    OperandKind kind;
+    int reg;            // OPD_REG, OPD_MEM: the base register (DATA_BASE, or RSP for a frame)
+    int disp;           // OPD_MEM: byte offset from the base
+    long long imm;      // OPD_IMM
+} Operand;
+
+// compilation state: the program being compiled and the code buffer
+static struct {
+    const SsaProgram *prog;
+    int *defs;              // vreg -> defining instruction
+    int *slot;              // interned name -> slot, -1 if unused
+    int *home;              // slot -> register, -1 = memory only
+    int temp_busy[TEMP_COUNT];
+    unsigned char *buf;
+    size_t len, cap;
+    size_t *traps;          // rel32 fields jumping to the division-by-zero exit
+    int trap_count, trap_cap;
+    int print_base;         // first slot of the print values (_print1, _print2, ...)
+    int print_values;       // values of the longest print statement
+    int *print_vregs;       // values of the print being compiled
+    char **formats;         // one per print statement, handed to the JitCode
+    int format_count;
+    int *frame;             // interned name -> byte offset in its function's frame, -1 if not a function's
+    unsigned char *bytes;   // interned name -> storage size (SsaVariableBytes): stores cut a char, short or int32
+    int *function_at;       // interned function name -> code offset, -1 before its definition
+    int functions;          // names function_at has room for
+    int stack_words;        // pushed since the entry of the code being generated (its frame included)
+    int frame_words;        // of those, the frame of the function being generated
+} jit;
+
+// rsp on entry, put back by the trap exit from inside a function
+static void *entry_stack;
+
+
+// ================= code buffer =========================
+
+static void Byte(int b) {
+    if(jit.len == jit.cap) {
+        jit.cap = jit.cap ? 2 * jit.cap : 4096;
+        jit.buf = xrealloc(jit.buf, jit.cap);
+    }
+    jit.buf[jit.len++] = (unsigned char)b;
+}
+
+static void Int32(long long v) {
+    for(int i = 0; i < 4; i++)
+        Byte((int)((unsigned long long)v >> (8 * i)) & 0xFF);
+}
+
+static void Int64(long long v) {
+    for(int i = 0; i < 8; i++)
+        Byte((int)((unsigned long long)v >> (8 * i)) & 0xFF);
+}
+
+static int FitsInt32(long long v) {
+    return v >= -2147483647LL - 1 && v <= 2147483647LL;
+}
+
+static Operand Reg(int reg) {
+    Operand o = { OPD_REG, reg, 0, 0 };
+    return o;
+}
+
+static Operand Imm(long long imm) {
+    Operand o = { OPD_IMM, -1, 0, imm };
+    return o;
+}
+
+// REX.W + opcode (one or two bytes) + ModRM: reg is a register or a /digit,
+// o a register or [base + disp] (rsp as base takes a SIB byte, rdi none)
+static void Instr(int opcode, int reg, Operand o) {
+    int rm = o.reg;
+    Byte(0x48 | ((reg & 8) >> 1) | ((rm & 8) >> 3));
+    if(opcode > 0xFF)
+        Byte(opcode >> 8);
+    Byte(opcode & 0xFF);
+    if(o.kind == OPD_REG) {
+        Byte(0xC0 | ((reg & 7) << 3) | (rm & 7));
+        return;
+    }
+    int small = o.disp >= -128 && o.disp < 128;
+    Byte((small ? 0x40 : 0x80) | ((reg & 7) << 3) | (rm & 7));
+    if((rm & 7) == RSP)
+        Byte(0x24);                                 // SIB: [rsp], no index
+    if(small)
+        Byte(o.disp & 0xFF);
+    else
+        Int32(o.disp);
+}
+
+// group-1 ALU op with an immediate: digit 0 add, 5 sub, 7 cmp
+static void AluImm(int digit, Operand o, long long imm) {
+    if(imm >= -128 && imm < 128) {
+        Instr(0x83, digit, o);
+        Byte((int)imm & 0xFF);
+    } else {
+        Instr(0x81, digit, o);
+        Int32(imm);
+    }
+}
+
+static void MoveImmediate(int reg, long long imm) {
+    if(FitsInt32(imm)) {
+        Instr(0xC7, 0, Reg(reg));           // mov r64, imm32 (sign-extended)
+        Int32(imm);
+    } else {
+        Byte(0x48 | ((reg & 8) >> 3));      // movabs r64, imm64
+        Byte(0xB8 + (reg & 7));
+        Int64(imm);
+    }
+}
+
+// dst = o
+static void Move(int dst, Operand o) {
+    if(o.kind == OPD_IMM)
+        MoveImmediate(dst, o.imm);
+    else if(o.kind != OPD_REG || o.reg != dst)
+        Instr(0x8B, dst, o);
+}
+
+// o = src (register or memory destination)
+static void MoveTo(Operand o, int src) {
+    if(o.kind != OPD_REG || o.reg != src)
+        Instr(0x89, src, o);
+}
+
+// reg = its low bytes sign-extended, what a variable of that many bytes keeps (8: all of it)
+static void Narrow(int reg, int bytes) {
+    if(bytes == 1)
+        Instr(0x0FBE, reg, Reg(reg));               // movsx r64, r8
+    else if(bytes == 2)
+        Instr(0x0FBF, reg, Reg(reg));               // movsx r64, r16
+    else if(bytes == 4)
+        Instr(0x63, reg, Reg(reg));                 // movsxd r64, r32
+}
+
+static void Push(int reg) {
+    if(reg & 8)
+        Byte(0x41);
+    Byte(0x50 + (reg & 7));
+    jit.stack_words++;
+}
+
+static void Pop(int reg) {
+    if(reg & 8)
+        Byte(0x41);
+    Byte(0x58 + (reg & 7));
+    jit.stack_words--;
+}
+
+// rsp += 8 * words (sub for a negative count)
+static void MoveStack(int words) {
+    if(words > 0)
+        AluImm(0, Reg(RSP), 8LL * words);
+    else if(words < 0)
+        AluImm(5, Reg(RSP), -8LL * words);
+    jit.stack_words -= words;
+}
+
+// jmp (0xE9) or jcc rel32 with the target still open; returns the position of the rel32
+static size_t Jump(int cc) {
+    if(cc == 0xE9)
+        Byte(0xE9);
+    else {
+        Byte(0x0F);
+        Byte(cc);
+    }
+    size_t at = jit.len;
+    Int32(0);
+    return at;
+}
+
+static void Patch(size_t at, size_t target) {
+    long long rel = (long long)target - (long long)(at + 4);
+    for(int i = 0; i < 4; i++)
+        jit.buf[at + i] = (unsigned char)((unsigned long long)rel >> (8 * i));
+}
+
+static void JumpToTrap(int cc) {
+    if(jit.trap_count == jit.trap_cap) {
+        jit.trap_cap = jit.trap_cap ? 2 * jit.trap_cap : 16;
+        jit.traps = xrealloc(jit.traps, jit.trap_cap * sizeof(size_t));
+    }
+    jit.traps[jit.trap_count++] = Jump(cc);
+}
+
+
+// ================= temps and variables =========================
+
+static int NewTemp(void) {
+    for(int i = 0; i < TEMP_COUNT; i++)
+        if(!jit.temp_busy[i]) {
+            jit.temp_busy[i] = 1;
+            return temp_pool[i];
+        }
+    return -1;
+}
+
+static void FreeTemp(int reg) {
+    for(int i = 0; i < TEMP_COUNT; i++)
+        if(temp_pool[i] == reg)
+            jit.temp_busy[i] = 0;
+}
+
+static int FreeTempCount(void) {
+    int n = 0;
+    for(int i = 0; i < TEMP_COUNT; i++)
+        n += !jit.temp_busy[i];
+    return n;
+}
+
+static Operand SlotMemory(int s) {
+    Operand o = { OPD_MEM, DATA_BASE, 8 * s, 0 };
+    return o;
+}
+
+// where a variable lives while the code runs (a function's own: its frame, under what
+// has been pushed since)
+static Operand Variable(int name) {
+    if(jit.frame[name] >= 0) {
+        Operand o = { OPD_MEM, RSP, jit.frame[name] + 8 * (jit.stack_words - jit.frame_words), 0 };
+        return o;
+    }
+    int s = jit.slot[name];
+    if(jit.home[s] >= 0)
+        return Reg(jit.home[s]);
+    return SlotMemory(s);
+}
+
+static const SsaInsn *Definition(int v) {
+    if(v < 0 || jit.defs[v] < 0)
+        return NULL;
+    return &jit.prog->insns[jit.defs[v]];
+}
+
+// v as a direct operand (a variable, or a constant that fits imm32), else 0
+// (a missing operand of a malformed expression is the constant 0, as in instruction selection)
+static int LeafOperand(int v, Operand *o) {
+    const SsaInsn *in = Definition(v);
+    if(!in) {
+        *o = Imm(0);
+        return 1;
+    }
+    if(in->kind == SSA_LOAD) {
+        *o = Variable(in->var);
+        return 1;
+    }
+    if(in->kind == SSA_CONST && FitsInt32(in->imm)) {
+        *o = Imm(in->imm);
+        return 1;
+    }
+    return 0;
+}
+
+
+// ================= expressions =========================
+
+// dst = dst / divisor, truncating like ddiv; x / 0 leaves through the trap exit, x / -1 is a
+// negation (LLONG_MIN / -1 would fault in idiv, ddiv just wraps)
+static void Divide(int dst, Operand divisor) {
+    if(divisor.kind == OPD_IMM) {
+        if(divisor.imm == 0)
+            JumpToTrap(0xE9);
+        else if(divisor.imm == -1)
+            Instr(0xF7, 3, Reg(dst));               // neg
+        else if(divisor.imm != 1) {
+            Move(RAX, Reg(dst));
+            MoveImmediate(SCRATCH, divisor.imm);
+            Byte(0x48);                             // cqo
+            Byte(0x99);
+            Instr(0xF7, 7, Reg(SCRATCH));           // idiv
+            Move(dst, Reg(RAX));
+        }
+        return;
+    }
+    if(divisor.kind == OPD_REG)
+        Instr(0x85, divisor.reg, divisor);          // test r, r
+    else
+        AluImm(7, divisor, 0);                      // cmp [m], 0
+    JumpToTrap(JCC_E);
+    AluImm(7, divisor, -1);
+    size_t to_divide = Jump(JCC_NE);
+    Instr(0xF7, 3, Reg(dst));
+    size_t to_done = Jump(0xE9);
+    Patch(to_divide, jit.len);
+    Move(RAX, Reg(dst));
+    Byte(0x48);
+    Byte(0x99);
+    Instr(0xF7, 7, divisor);
+    Move(dst, Reg(RAX));
+    Patch(to_done, jit.len);
+}
+
+// dst = dst op o
+static void Arithmetic(char op, int dst, Operand o) {
+    if(op == '/')
+        Divide(dst, o);
+    else if(o.kind == OPD_IMM) {
+        if(op == '+')
+            AluImm(0, Reg(dst), o.imm);
+        else if(op == '-')
+            AluImm(5, Reg(dst), o.imm);
+        else {
+            Instr(0x69, dst, Reg(dst));             // imul r, r, imm32
+            Int32(o.imm);
+        }
+    } else if(op == '+')
+        Instr(0x03, dst, o);
+    else if(op == '-')
+        Instr(0x2B, dst, o);
+    else
+        Instr(0x0FAF, dst, o);                      // imul r, r/m
+}
+
+static int GenerateValue(int v);
+
+// the right operand of a binop or comparison: direct when it's a leaf, else computed into a
+// temp; with no temp left, the left value waits on the stack and comes back in rax
+// (*left is updated then). returns the temp to free, -1 if none
+static int RightOperand(int v, int *left, Operand *o, int for_divide) {
+    const SsaInsn *in = Definition(v);
+    if(LeafOperand(v, o) || (for_divide && in && in->kind == SSA_CONST)) {
+        if(in && in->kind == SSA_CONST)
+            *o = Imm(in->imm);
+        return -1;
+    }
+    if(FreeTempCount() > 0) {
+        int r = GenerateValue(v);
+        *o = Reg(r);
+        return r;
+    }
+    Push(*left);
+    FreeTemp(*left);
+    int r = GenerateValue(v);
+    Pop(RAX);
+    *left = RAX;
+    *o = Reg(r);
+    return r;
+}
+
+// evaluate vreg v into a fresh temp (the caller guarantees one is free)
+static int GenerateValue(int v) {
+    const SsaInsn *in = Definition(v);
+    if(!in || in->kind != SSA_BINOP) {
+        int r = NewTemp();
+        if(in && in->kind == SSA_CONST)
+            MoveImmediate(r, in->imm);
+        else if(in && in->kind == SSA_LOAD)
+            Move(r, Variable(in->var));
+        else
+            MoveImmediate(r, 0);
+        return r;
+    }
+
+    int left = GenerateValue(in->a);
+    Operand right;
+    int temp = RightOperand(in->b, &left, &right, in->op == '/');
+    Arithmetic(in->op, left, right);
+    if(left == RAX) {
+        // spilled: the result goes to the right operand's temp
+        Move(temp, Reg(RAX));
+        return temp;
+    }
+    if(temp >= 0)
+        FreeTemp(temp);
+    return left;
+}
+
+
+// ================= statements =========================
+
+// a char, short or int32 variable keeps the stored value cut and sign-extended (a variable no
+// wider is copied as it is)
+static void GenerateStore(const SsaInsn *in) {
+    Operand dst = Variable(in->var), value;
+    const SsaInsn *def = Definition(in->a);
+    int bytes = jit.bytes[in->var];
+    if(!def || (def->kind == SSA_CONST && FitsInt32(SsaNarrow(def->imm, bytes)))) {
+        long long imm = def ? SsaNarrow(def->imm, bytes) : 0;
+        if(dst.kind == OPD_REG)
+            MoveImmediate(dst.reg, imm);
+        else {
+            Instr(0xC7, 0, dst);                    // mov qword [m], imm32
+            Int32(imm);
+        }
+        return;
+    }
+    if(def->kind == SSA_LOAD && dst.kind == OPD_REG && jit.bytes[def->var] <= bytes && LeafOperand(in->a, &value)) {
+        Move(dst.reg, value);
+        return;
+    }
+    int r = GenerateValue(in->a);
+    if(def->kind != SSA_LOAD || jit.bytes[def->var] > bytes)
+        Narrow(r, bytes);
+    MoveTo(dst, r);
+    FreeTemp(r);
+}
+
+// compare the branch operands, returns the jcc that jumps when the loop condition holds
+static int GenerateCondition(const SsaInsn *branch) {
+    int left = GenerateValue(branch->a);
+    if(!branch->op) {
+        Instr(0x85, left, Reg(left));               // test
+        FreeTemp(left);
+        return JCC_NE;
+    }
+    Operand right;
+    int temp = RightOperand(branch->b, &left, &right, 0);
+    if(right.kind == OPD_IMM)
+        AluImm(7, Reg(left), right.imm);
+    else
+        Instr(0x3B, left, right);                   // cmp r, r/m
+    FreeTemp(left);
+    if(temp >= 0)
+        FreeTemp(temp);
+    switch(branch->op) {
+    case '<': return JCC_L;
+    case '>': return JCC_G;
+    case 'l': return JCC_LE;
+    case 'g': return JCC_GE;
+    case '=': return JCC_E;
+    }
+    return JCC_NE;
+}
+
+static void GenerateBlock(int start, int end);
+
+// same layout as the MIPS back end: jump to the test at the bottom, one branch per iteration
+static int GenerateLoop(int start) {
+    const SsaProgram *prog = jit.prog;
+    int branch = SsaLoopBranch(prog, start), end = SsaLoopEnd(prog, start);
+    if(branch >= end)
+        return end;
+    size_t to_test = Jump(0xE9);
+    size_t body = jit.len;
+    GenerateBlock(branch + 1, end);
+    Patch(to_test, jit.len);
+    GenerateBlock(start + 1, branch);
+    int cc = GenerateCondition(&prog->insns[branch]);
+    Patch(Jump(cc), body);
+    return end;
+}
+
+// if statement: the condition jumps over the then arm when it fails (the x86 condition codes
+// come in pairs, cc ^ 1 is the opposite test); the then arm jumps over the else arm
+static int GenerateIf(int start) {
+    const SsaProgram *prog = jit.prog;
+    int otherwise, branch = SsaLoopBranch(prog, start), end = SsaIfEnd(prog, start, &otherwise);
+    if(branch >= end)
+        return end;
+    GenerateBlock(start + 1, branch);
+    int cc = GenerateCondition(&prog->insns[branch]);
+    size_t to_else = Jump(cc ^ 1);
+    GenerateBlock(branch + 1, otherwise >= 0 ? otherwise : end);
+    if(otherwise >= 0) {
+        size_t to_end = Jump(0xE9);
+        Patch(to_else, jit.len);
+        GenerateBlock(otherwise + 1, end);
+        Patch(to_end, jit.len);
+    } else
+        Patch(to_else, jit.len);
+    return end;
+}
+
+// SYSCALL 5 of the MIPS program: format with %d and %%, the values in order
+static void JitPrint(const char *format, const long long *values) {
+    size_t size = strlen(format) + 1;
+    for(const char *f = format; *f; f++)
+        size += (*f == '%') * 20;
+    char *text = xrealloc(NULL, size), *t = text;
+    for(const char *f = format; *f; f++) {
+        if(*f == '%' && (f[1] == 'd' || f[1] == 'i'))
+            t += sprintf(t, "%lld", *values++);
+        else if(*f == '%' && f[1] == '%')
+            *t++ = '%';
+        else {
+            *t++ = *f;
+            continue;
+        }
+        f++;
+    }
+    *t = '\0';
+    DiagOutput(text);
+    free(text);
+}
+
+// a print statement: the values into the print slots, then JitPrint(format, slots) as a C call
+// (rdi saved around it; with it an odd number of words is pushed, which keeps the stack
+// 16-byte aligned at the call, see GenerateCall)
+// returns the index after its last part
+static int GeneratePrint(int start) {
+    int end, count;
+    char *format = SsaPrintFormat(jit.prog, jit.defs, start, &end, jit.print_vregs, &count);
+    jit.formats = xrealloc(jit.formats, (jit.format_count + 1) * sizeof(char *));
+    jit.formats[jit.format_count++] = format;
+    for(int k = 0; k < count; k++) {
+        Operand value;
+        if(LeafOperand(jit.print_vregs[k], &value) && value.kind == OPD_REG)
+            MoveTo(SlotMemory(jit.print_base + k), value.reg);
+        else {
+            int r = GenerateValue(jit.print_vregs[k]);
+            MoveTo(SlotMemory(jit.print_base + k), r);
+            FreeTemp(r);
+        }
+    }
+    Push(DATA_BASE);
+    Instr(0x8D, RSI, SlotMemory(jit.print_base));  // lea rsi, [rdi + slot]
+    MoveImmediate(RDI, (long long)(intptr_t)format);
+    MoveImmediate(RAX, (long long)(intptr_t)JitPrint);
+    Byte(0xFF);                                     // call rax
+    Byte(0xD0);
+    Pop(DATA_BASE);
+    return end;
+}
+
+// a call, same convention as the MIPS program's but on the native stack: the arguments go
+// under rsp (argument k at [rsp + 8k] when the call pushes the return address), the result
+// comes back in rax. an odd number of words pushed since the entry of the code keeps rsp
+// 16-byte aligned at the call, so the padding makes the total odd
+static void GenerateCall(int call) {
+    const SsaInsn *in = &jit.prog->insns[call];
+    int first = call;
+    while(first > 0 && jit.prog->insns[first - 1].kind == SSA_ARG)
+        first--;
+    int words = call - first;
+    words += (jit.stack_words + words) % 2 == 0;
+    MoveStack(-words);
+    for(int k = first; k < call; k++) {
+        Operand slot = { OPD_MEM, RSP, 8 * (k - first), 0 };
+        const SsaInsn *def = Definition(jit.prog->insns[k].a);
+        if(!def || (def->kind == SSA_CONST && FitsInt32(def->imm))) {
+            Instr(0xC7, 0, slot);                   // mov qword [rsp + 8k], imm32
+            Int32(def ? def->imm : 0);
+        } else {
+            int r = GenerateValue(jit.prog->insns[k].a);
+            MoveTo(slot, r);
+            FreeTemp(r);
+        }
+    }
+    int f = (int)in->imm;
+    if(f >= 0 && f < jit.functions && jit.function_at[f] >= 0) {
+        Byte(0xE8);                                 // call rel32
+        Int32(0);
+        Patch(jit.len - 4, jit.function_at[f]);
+    } else
+        Instr(0x31, RAX, Reg(RAX));                 // never defined: 0
+    MoveStack(words);
+    if(in->var >= 0) {
+        Narrow(RAX, jit.bytes[in->var]);
+        MoveTo(Variable(in->var), RAX);
+    }
+}
+
+// return: the value to rax, then drop the frame
+static void GenerateReturn(const SsaInsn *in) {
+    Operand value;
+    if(LeafOperand(in->a, &value))
+        Move(RAX, value);
+    else {
+        int r = GenerateValue(in->a);
+        Move(RAX, Reg(r));
+        FreeTemp(r);
+    }
+    if(jit.frame_words > 0)
+        AluImm(0, Reg(RSP), 8LL * jit.frame_words);
+    Byte(0xC3);                                     // ret
+}
+
+// frame of the function defined at insns[start..end): locals from rsp up, an even number of
+// words (so a print inside it pushes an odd total), then the return address and the
+// parameters the caller stored; returns the words of locals
+static int FrameLayout(int start, int end) {
+    int locals = 0;
+    for(int i = start; i < end; i++)
+        locals += jit.prog->insns[i].kind == SSA_DECL;
+    locals += locals % 2;
+    int j = 0;
+    for(int i = start; i < end; i++) {
+        const SsaInsn *in = &jit.prog->insns[i];
+        if(in->kind == SSA_PARAM)
+            jit.frame[in->var] = 8 * (locals + 1 + (int)in->imm);
+        else if(in->kind == SSA_DECL)
+            jit.frame[in->var] = 8 * j++;
+    }
+    return locals;
+}
+
+// a function definition: its code stands where it is defined, jumped over; returns the
+// index of its ENDFUNC
+static int GenerateFunctionCode(int start) {
+    int end = SsaFunctionEnd(jit.prog, start), f = (int)jit.prog->insns[start].imm;
+    size_t over = Jump(0xE9);
+    if(f >= 0 && f < jit.functions)
+        jit.function_at[f] = (int)jit.len;
+    int outer_words = jit.stack_words, outer_frame = jit.frame_words;
+    jit.stack_words = 0;
+    jit.frame_words = FrameLayout(start, end);
+    MoveStack(-jit.frame_words);
+    GenerateBlock(start + 1, end);
+    Instr(0x31, RAX, Reg(RAX));                     // no return at the end: 0
+    MoveStack(jit.frame_words);
+    Byte(0xC3);
+    jit.stack_words = outer_words;
+    jit.frame_words = outer_frame;
+    Patch(over, jit.len);
+    return end;
+}
+
+// stores, loops, ifs, line counters and prints are the roots; everything else is computed where it's used
+static void GenerateBlock(int start, int end) {
+    for(int i = start; i < end && i < jit.prog->count; i++) {
+        const SsaInsn *in = &jit.prog->insns[i];
+        if(in->kind == SSA_STORE)
+            GenerateStore(in);
+        else if(in->kind == SSA_LOOP)
+            i = GenerateLoop(i);
+        else if(in->kind == SSA_IF)
+            i = GenerateIf(i);
+        else if(in->kind == SSA_COUNT)
+            AluImm(0, Variable(in->var), 1);    // add qword counter, 1
+        else if(in->kind == SSA_PRINT && in->init)
+            i = GeneratePrint(i) - 1;
+        else if(in->kind == SSA_FUNC)
+            i = GenerateFunctionCode(i);
+        else if(in->kind == SSA_CALL)
+            GenerateCall(i);
+        else if(in->kind == SSA_RETURN)
+            GenerateReturn(in);
+    }
+}
+
+
+// ================= variables: slots and homes =========================
+
+// values of the longest print statement
+static int PrintValues(void) {
+    const SsaProgram *prog = jit.prog;
+    int most = 0, end, count;
+    jit.print_vregs = xrealloc(NULL, (prog->count + 1) * sizeof(int));
+    for(int i = 0; i < prog->count; i++)
+        if(prog->insns[i].kind == SSA_PRINT && prog->insns[i].init) {
+            free(SsaPrintFormat(prog, jit.defs, i, &end, jit.print_vregs, &count));
+            if(count > most)
+                most = count;
+        }
+    return most;
+}
+
+// slots in declaration order (then first use), the heaviest variables
+// (accesses, x8 per loop level) get the callee-saved registers; the print values
+// (_print1, _print2, ... like the MIPS argument block) come last, always in memory.
+// functions' parameters and locals have no slot, they live in the function's frame
+static int AssignSlots(JitCode *code) {
+    const SsaProgram *prog = jit.prog;
+    int limit = 0;
+    for(int i = 0; i < prog->count; i++) {
+        if(prog->insns[i].var >= limit)
+            limit = prog->insns[i].var + 1;
+        if(prog->insns[i].kind == SSA_FUNC && prog->insns[i].imm >= jit.functions)
+            jit.functions = (int)prog->insns[i].imm + 1;
+    }
+
+    jit.print_values = PrintValues();
+    jit.slot = xrealloc(NULL, (limit + 1) * sizeof(int));
+    jit.frame = xrealloc(NULL, (limit + 1) * sizeof(int));
+    jit.bytes = xrealloc(NULL, limit + 1);
+    SsaVariableBytes(prog, jit.bytes, limit);
+    jit.function_at = xrealloc(NULL, (jit.functions + 1) * sizeof(int));
+    code->names = xrealloc(NULL, (limit + jit.print_values + 1) * sizeof(int));
+    for(int v = 0; v < limit; v++)
+        jit.slot[v] = jit.frame[v] = -1;
+    for(int f = 0; f < jit.functions; f++)
+        jit.function_at[f] = -1;
+    for(int i = 0; i < prog->count; i++)
+        if(prog->insns[i].kind == SSA_FUNC) {
+            int end = SsaFunctionEnd(prog, i);
+            FrameLayout(i, end);
+            i = end;
+        }
+    int count = 0;
+    for(int pass = 0; pass < 2; pass++)
+        for(int i = 0; i < prog->count; i++) {
+            const SsaInsn *in = &prog->insns[i];
+            if(in->var < 0 || jit.slot[in->var] >= 0 || jit.frame[in->var] >= 0 || in->kind == SSA_NOP || in->kind == SSA_PRINT)
+                continue;
+            if(pass == 0 && in->kind != SSA_DECL)
+                continue;
+            jit.slot[in->var] = count;
+            code->names[count++] = in->var;
+        }
+
+    long long *weight = xrealloc(NULL, (count + 1) * sizeof(long long));
+    memset(weight, 0, (count + 1) * sizeof(long long));
+    int depth = 0;
+    for(int i = 0; i < prog->count; i++) {
+        const SsaInsn *in = &prog->insns[i];
+        if(in->kind == SSA_LOOP)
+            depth++;
+        else if(in->kind == SSA_ENDLOOP && depth > 0)
+            depth--;
+        else if((in->kind == SSA_LOAD || in->kind == SSA_STORE || in->kind == SSA_COUNT) && jit.frame[in->var] < 0)
+            weight[jit.slot[in->var]] += 1LL << (3 * (depth < MAX_WEIGHT_DEPTH ? depth : MAX_WEIGHT_DEPTH));
+    }
+    jit.print_base = count;
+    for(int k = 1; k <= jit.print_values; k++) {
+        char name[32];
+        snprintf(name, sizeof(name), "_print%d", k);
+        code->names[count++] = InternName(name, (int)strlen(name));
+    }
+    jit.home = xrealloc(NULL, (count + 1) * sizeof(int));
+    for(int s = 0; s < count; s++)
+        jit.home[s] = -1;
+    for(int h = 0; h < HOME_COUNT; h++) {
+        int best = -1;
+        for(int s = 0; s < count; s++)
+            if(jit.home[s] < 0 && weight[s] > 0 && (best < 0 || weight[s] > weight[best]))
+                best = s;
+        if(best < 0)
+            break;
+        jit.home[best] = home_pool[h];
+    }
+    free(weight);
+    return count;
+}
+
+
+// ================= program =========================
+
+int JitAvailable(void) {
+#ifdef JIT_NATIVE
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+// int entry(long long *data): returns JIT_OK, or JIT_DIVIDE_BY_ZERO from the trap exit
+// (which, with functions, may be taken with their frames still on the stack: rsp is kept
+// in entry_stack for it)
+static void GenerateFunction(int slots) {
+    Operand stack = { OPD_MEM, RAX, 0, 0 };
+    for(int i = 0; i < SAVED_COUNT; i++)
+        Push(saved_regs[i]);
+    for(int s = 0; s < slots; s++)
+        if(jit.home[s] >= 0)
+            Move(jit.home[s], SlotMemory(s));
+    if(jit.functions > 0) {
+        MoveImmediate(RAX, (long long)(intptr_t)&entry_stack);
+        MoveTo(stack, RSP);
+    }
+
+    GenerateBlock(0, jit.prog->count);
+
+    Byte(0x31);                                     // xor eax, eax
+    Byte(0xC0);
+    size_t epilogue = jit.len;
+    for(int s = 0; s < slots; s++)
+        if(jit.home[s] >= 0)
+            MoveTo(SlotMemory(s), jit.home[s]);
+    for(int i = SAVED_COUNT - 1; i >= 0; i--)
+        Pop(saved_regs[i]);
+    Byte(0xC3);                                     // ret
+
+    size_t trap = jit.len;
+    if(jit.functions > 0) {
+        MoveImmediate(RAX, (long long)(intptr_t)&entry_stack);
+        Move(RSP, stack);
+    }
+    Byte(0xB8);                                     // mov eax, JIT_DIVIDE_BY_ZERO
+    Int32(JIT_DIVIDE_BY_ZERO);
+    Patch(Jump(0xE9), epilogue);
+    for(int t = 0; t < jit.trap_count; t++)
+        Patch(jit.traps[t], trap);
+}
+
+int JitCompile(const SsaProgram *prog, JitCode *code) {
+    memset(code, 0, sizeof(*code));
+    memset(&jit, 0, sizeof(jit));
+    jit.prog = prog;
+    jit.defs = xrealloc(NULL, (prog->vreg_count + 1) * sizeof(int));
+    SsaDefinitions(prog, jit.defs);
+    code->var_count = AssignSlots(code);
+    GenerateFunction(code->var_count);
+
+    int ok = 0;
+#ifdef JIT_NATIVE
+    // written through a read-write mapping, then flipped to read-execute (never both)
+    size_t page = 4096, mapped = (jit.len + page - 1) / page * page;
+    void *p = mmap(NULL, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(p != MAP_FAILED) {
+        memcpy(p, jit.buf, jit.len);
+        if(mprotect(p, mapped, PROT_READ | PROT_EXEC) == 0) {
+            code->code = p;
+            code->size = jit.len;
+            code->mapped = mapped;
+            ok = 1;
+        } else
+            munmap(p, mapped);
+    }
+#endif
+    code->formats = jit.formats;
+    code->format_count = jit.format_count;
+    free(jit.defs);
+    free(jit.slot);
+    free(jit.frame);
+    free(jit.bytes);
+    free(jit.function_at);
+    free(jit.home);
+    free(jit.buf);
+    free(jit.traps);
+    free(jit.print_vregs);
+    memset(&jit, 0, sizeof(jit));
+    if(!ok)
+        JitFree(code);
+    return ok;
+}
+
+typedef int (*JitEntry)(long long *data);
+
+JitStatus JitRun(const JitCode *code, long long *data) {
+    if(!code->code)
+        return JIT_OK;
+    JitEntry entry = (JitEntry)code->code;
+    return (JitStatus)entry(data);
+}
+
+int JitSlotOf(const JitCode *code, int name) {
+    for(int s = 0; s < code->var_count; s++)
+        if(code->names[s] == name)
+            return s;
+    return -1;
+}
+
+void JitFree(JitCode *code) {
+#ifdef JIT_NATIVE
+    if(code->code)
+        munmap(code->code, code->mapped);
+#endif
+    for(int k = 0; k < code->format_count; k++)
+        free(code->formats[k]);
+    free(code->formats);
+    free(code->names);
+    memset(code, 0, sizeof(*code));
+}
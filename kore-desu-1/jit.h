@@ -0,0 +1,38 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <stddef.h>
+#include "ssa.h"
+
+// x86-64 back end: the (optimized) SSA program compiled to native code in an executable
+// mapping and run in place. variables live in a block of 64-bit slots (like .data), the
+// most used ones are kept in callee-saved registers while the code runs. print statements
+// call back into the compiler, which writes their text through DiagOutput
+typedef struct {
+    void *code;         // executable mapping, NULL if nothing was compiled
+    size_t size;        // bytes of machine code
+    size_t mapped;      // bytes of the mapping
+    int var_count;      // slots of the variable block
+    int *names;         // slot -> interned variable name, in declaration order
+    char **formats;     // of the print statements, read by the code while it runs
+    int format_count;
+} JitCode;
+
+typedef enum { JIT_OK, JIT_DIVIDE_BY_ZERO } JitStatus;
+
+// 1 if this build can execute native code (x86-64, not Windows)
+int JitAvailable(void);
+
+// compile prog into code; returns 0 (code left empty) if the JIT isn't available or mapping failed
+int JitCompile(const SsaProgram *prog, JitCode *code);
+
+// run the compiled program on data (var_count slots, zero = .space 8); the final values are
+// written back to data, also when a trap (division by zero) stops the program early
+JitStatus JitRun(const JitCode *code, long long *data);
+
+// slot of an interned variable name, -1 if the program never uses it
+int JitSlotOf(const JitCode *code, int name);
+
+void JitFree(JitCode *code);
+
+#endif
@@ -1,8 +1,10 @@
 #include "line_validator.h"
 #include "error.h"      
+#include "scan.h"
 #include <string.h>
 #include <ctype.h>
 #include <stdio.h>
+#include <limits.h>
 
 // global variables to store declared variable names
 char vars[MAX_VARS][MAX_VAR_LENGTH];
@@ -12,32 +14,202 @@ char used_vars[MAX_VARS];
 int registers[30];
 int used_registers[30];
 
+// number of "while (...) {" / "if (...) {" / "else {" blocks not closed yet
+int block_depth = 0;
+
+// which of the open blocks are the first arm of an if (a "}" closing one may go on with "else")
+#define MAX_BLOCK_NESTING 256
+static char block_is_if[MAX_BLOCK_NESTING];
+
+// functions defined so far: name and number of parameters (a call must match it)
+#define MAX_FUNCTIONS 1024
+static struct {
+    char name[MAX_VAR_LENGTH];
+    int params;
+} functions[MAX_FUNCTIONS];
+static int function_count = 0;
+
+// the function whose body is being validated (-1: none) and where its parameters start in
+// vars[]: they and its locals go out of scope at its closing '}'
+static int current_function = -1;
+static int function_first_var;
+
 // TO DO (and optional): add more
-char *forbidden[] = {
+#define KEYWORDS 14
+char *forbidden[KEYWORDS] = {
     "int", "return", "for", "while", "if", "else",
-    "char", "float", "double", "goto", "main", "double"
+    "char", "float", "double", "goto", "main", "const",
+    "short", "int32"
 };
 
+// declaration keywords: int (a doubleword) and the narrow storage types
+#define TYPE_KEYWORDS 4
+static const char *type_keywords[TYPE_KEYWORDS] = { "int ", "int32 ", "short ", "char " };
 
-// check if variable is already declared
-int IsVariableDeclared(char *variableName) {
+// "const int" variables: which of vars[] are constants, and their values (every use of one is
+// replaced by its value, so it must be known here: a constant is made of literals and earlier
+// constants only)
+static char const_vars[MAX_VARS];
+static long long const_values[MAX_VARS];
+
+// set by StartsWithInt while the items of a "const int" declaration are parsed
+static int declaring_const = 0;
+
+// the literal AfterEqualsCheck last rejected for not fitting in 64 bits (empty: none)
+static char number_range[MAX_VAR_LENGTH];
+
+
+// index of a declared variable in vars[], or -1
+static int FindVariable(const char *variableName) {
     for(int v = 0; v < valid_buffer_counter; v++)
         if(strcmp(vars[v], variableName) == 0)
-            return 1;
+            return v;
+    return -1;
+}
+
+// does the literal of len digits (after a '-' if negative) fit in a long long: up to LLONG_MAX,
+// or -LLONG_MAX - 1 with the '-'
+int NumberFits(const char *digits, int len, int negative) {
+    unsigned long long limit = negative ? (unsigned long long)LLONG_MAX + 1 : LLONG_MAX;
+    unsigned long long value = 0;
+    for(int k = 0; k < len; k++) {
+        unsigned digit = (unsigned)(digits[k] - '0');
+        if(value > (limit - digit) / 10)
+            return 0;
+        value = value * 10 + digit;
+    }
+    return 1;
+}
+
+// error for an expression AfterEqualsCheck rejected: a literal past 64 bits (errinfo = the literal),
+// else an invalid expression (errinfo = name, if given)
+static ErrorType ExpressionError(char *errinfo, const char *name) {
+    if(number_range[0]) {
+        strcpy(errinfo, number_range);
+        number_range[0] = '\0';
+        return ERR_NUMBER_RANGE;
+    }
+    if(name)
+        strcpy(errinfo, name);
+    return ERR_INVALID_EXPRESSION;
+}
+
+// check if variable is already declared
+int IsVariableDeclared(const char *variableName) {
+    return FindVariable(variableName) != -1;
+}
+
+// ===================== Does the buffer start with the "const" keyword =========================
+int IsConstKeyword(const char *buffer) {
+    return strncmp(buffer, "const", 5) == 0 && !isalnum(buffer[5]) && buffer[5] != '_';
+}
+
+
+// ================= Does the buffer start with a declaration keyword ==========================
+// returns its length with the space after it, 0 if there is none
+int TypeKeyword(const char *buffer) {
+    for(int k = 0; k < TYPE_KEYWORDS; k++)
+        if(strncmp(buffer, type_keywords[k], strlen(type_keywords[k])) == 0)
+            return (int)strlen(type_keywords[k]);
     return 0;
 }
 
 
+// index of a defined function, or -1
+static int FindFunction(const char *name) {
+    for(int f = 0; f < function_count; f++)
+        if(strcmp(functions[f].name, name) == 0)
+            return f;
+    return -1;
+}
+
+// copy the identifier at buffer[*i] into name (cut at MAX_VAR_LENGTH) and move past it
+static void ReadIdentifier(const char *buffer, int *i, char *name) {
+    int start = *i;
+    *i = (int)(ScanIdentifier(buffer + start) - buffer);
+    int len = *i - start;
+    if(len >= MAX_VAR_LENGTH)
+        len = MAX_VAR_LENGTH - 1;
+    strncpy(name, buffer + start, len);
+    name[len] = '\0';
+}
+
+// is the identifier at buffer[i] followed by '(' (a function call)
+static int IsCall(const char *buffer, int i) {
+    if(!isalpha(buffer[i]))
+        return 0;
+    i = (int)(ScanIdentifier(buffer + i) - buffer);
+    return *ScanSpaces(buffer + i) == '(';
+}
+
+static int ConditionSideCheck(char *side);
+
+// ============ Validates a call "name(expression, ...)" at buffer[*i] (a whole right side) ============
+// the function must be defined above (or be the one being defined) and take as many arguments;
+// moves i past the closing parenthesis
+static ErrorType CallCheck(const char *buffer, int *i, char *errinfo) {
+    char name[MAX_VAR_LENGTH];
+    ReadIdentifier(buffer, i, name);
+    strcpy(errinfo, name);
+    int f = FindFunction(name);
+    if(f == -1)
+        return ERR_UNDECLARED;
+    *i = (int)(ScanSpaces(buffer + *i) - buffer);
+
+    if(buffer[*i] != '(')
+        return ERR_SYNTAX;
+
+    // the arguments: split at the commas outside nested parentheses
+    int start = *i + 1, depth = 0, args = 0;
+    for(int k = *i; ; k++) {
+        char c = buffer[k];
+        if(IS_LINE_END(c))
+            return ERR_SYNTAX; // no matching ')'
+        if(c == '(')
+            depth++;
+        else if(c == ')')
+            depth--;
+        if(!(c == ',' && depth == 1) && !(c == ')' && depth == 0))
+            continue;
+
+        // one argument: buffer[start..k)
+        char arg[BUFFER];
+        int len = k - start;
+        if(len >= BUFFER)
+            return ERR_INVALID_EXPRESSION;
+        strncpy(arg, buffer + start, len);
+        arg[len] = '\0';
+        if(c == ')' && args == 0 && *ScanSpaces(arg) == '\0') {
+            *i = k + 1; // no arguments
+            break;
+        }
+        if(!ConditionSideCheck(arg))
+            return ExpressionError(errinfo, NULL);
+        args++;
+        start = k + 1;
+        if(c == ')') {
+            *i = k + 1;
+            break;
+        }
+    }
+    if(args != functions[f].params) {
+        DiagText("%s takes %d argument(s)\n", name, functions[f].params);
+        return ERR_SYNTAX;
+    }
+    return ERR_NONE;
+}
+
 // ================= Parses and validates an expression after '=' =========================
 // allowClosing: 0 = no closing parenthesis allowed, 1 = allows closing one level of parenthesis
-int AfterEqualsCheck(char *buffer, int *startCounter, int allowClosing) {
+int AfterEqualsCheck(const char *buffer, int *startCounter, int allowClosing) {
     int expectOperand = 1; // Expect variable/number/expression first
     int counter = *startCounter;
 
-    while(buffer[counter] != '\0' && buffer[counter] != ';' && buffer[counter] != ',') {
+    while(!IS_LINE_END(buffer[counter]) && buffer[counter] != ';' && buffer[counter] != ',') {
         // skip spaces
-        while(buffer[counter] == ' ')
-            counter++;
+        counter = (int)(ScanSpaces(buffer + counter) - buffer);
+        if(IS_LINE_END(buffer[counter]))
+            break; // trailing spaces: the line is a view, they are still there
 
         if(expectOperand) {
             if(buffer[counter] == '(') {
@@ -50,34 +222,32 @@ int AfterEqualsCheck(char *buffer, int *startCounter, int allowClosing) {
             else if(isalpha(buffer[counter]) || buffer[counter] == '_') {
                 int start = counter;
                 // parse variable name
-                while(isalnum(buffer[counter]) || buffer[counter] == '_')
-                    counter++;
+                counter = (int)(ScanIdentifier(buffer + counter) - buffer);
                 int len = counter - start;
+                if(len >= MAX_VAR_LENGTH)
+                    len = MAX_VAR_LENGTH - 1; // lines are no longer cut at BUFFER chars
                 char var_name[MAX_VAR_LENGTH];
                 strncpy(var_name, buffer + start, len);
                 var_name[len] = '\0';
 
                 // variable must be declared
                 if(!IsVariableDeclared(var_name)) {
-                    printf("variable is not yet declared\n");
+                    DiagText("variable is not yet declared\n");
                     return 0;
                 }
                
                 expectOperand = 0; // next expect operator
             }
-            else if(buffer[counter] == '-') {
-                counter++;
-                // parse number
-                while(isdigit(buffer[counter]))
-                    counter++;
+            else if(buffer[counter] == '-' || isdigit(buffer[counter])) {
+                // parse number (a leading '-' belongs to it); its value must fit in 64 bits
+                int start = counter, negative = buffer[counter] == '-';
+                counter = (int)(ScanDigits(buffer + counter + negative) - buffer);
+                if(!NumberFits(buffer + start + negative, counter - start - negative, negative)) {
+                    snprintf(number_range, sizeof(number_range), "%.*s", counter - start, buffer + start);
+                    return 0;
+                }
                 expectOperand = 0; // next expect operator
             }
-            else if(isdigit(buffer[counter])) {
-                // parse number
-                while(isdigit(buffer[counter]))
-                    counter++;
-                expectOperand = 0; // next expect operator
-            } 
             else {
                 // invalid operand
                 return 0;
@@ -85,8 +255,7 @@ int AfterEqualsCheck(char *buffer, int *startCounter, int allowClosing) {
         }
         else {
             // operator or closing
-            while(buffer[counter] == ' ')
-                counter++;
+            counter = (int)(ScanSpaces(buffer + counter) - buffer);
             if(buffer[counter] == ')') {
                 if(allowClosing) {
                     counter++; // consume ')'
@@ -122,15 +291,93 @@ int AfterEqualsCheck(char *buffer, int *startCounter, int allowClosing) {
 }
 
 
+// ================ Value of the constant expression at buffer[*i] (already validated) ================
+// E -> E + T | E - T | T,  T -> T * F | T / F | F,  F -> (E) | constants | numbers | -numbers
+// with the 64-bit wraparound arithmetic of the hardware; 0 if an operand is not a constant or a
+// division would trap (it could not be folded into an immediate)
+static int ConstantExpression(const char *buffer, int *i, long long *value);
+
+static int ConstantFactor(const char *buffer, int *i, long long *value) {
+    *i = (int)(ScanSpaces(buffer + *i) - buffer);
+    if(buffer[*i] == '(') {
+        (*i)++;
+        if(!ConstantExpression(buffer, i, value))
+            return 0;
+        *i = (int)(ScanSpaces(buffer + *i) - buffer) + 1; // past ')'
+        return 1;
+    }
+    if(isalpha(buffer[*i]) || buffer[*i] == '_') {
+        char name[MAX_VAR_LENGTH];
+        ReadIdentifier(buffer, i, name);
+        int v = FindVariable(name);
+        if(v == -1 || !const_vars[v]) {
+            DiagText("%s is not a constant\n", name);
+            return 0;
+        }
+        *value = const_values[v];
+        return 1;
+    }
+    int negative = buffer[*i] == '-';
+    if(negative)
+        (*i)++;
+    unsigned long long digits = 0;
+    while(isdigit(buffer[*i]))
+        digits = digits * 10 + (unsigned long long)(buffer[(*i)++] - '0');
+    *value = (long long)(negative ? 0 - digits : digits);
+    return 1;
+}
+
+static int ConstantTerm(const char *buffer, int *i, long long *value) {
+    if(!ConstantFactor(buffer, i, value))
+        return 0;
+    while(1) {
+        *i = (int)(ScanSpaces(buffer + *i) - buffer);
+        char op = buffer[*i];
+        if(op != '*' && op != '/')
+            return 1;
+        (*i)++;
+        long long right;
+        if(!ConstantFactor(buffer, i, &right))
+            return 0;
+        if(op == '*')
+            *value = (long long)((unsigned long long)*value * (unsigned long long)right);
+        else if(right == 0 || (right == -1 && *value == LLONG_MIN)) {
+            DiagText("division by zero or overflow in a constant\n");
+            return 0;
+        }
+        else
+            *value /= right;
+    }
+}
+
+static int ConstantExpression(const char *buffer, int *i, long long *value) {
+    if(!ConstantTerm(buffer, i, value))
+        return 0;
+    while(1) {
+        *i = (int)(ScanSpaces(buffer + *i) - buffer);
+        char op = buffer[*i];
+        if(op != '+' && op != '-')
+            return 1;
+        (*i)++;
+        long long right;
+        if(!ConstantTerm(buffer, i, &right))
+            return 0;
+        if(op == '+')
+            *value = (long long)((unsigned long long)*value + (unsigned long long)right);
+        else
+            *value = (long long)((unsigned long long)*value - (unsigned long long)right);
+    }
+}
+
+
 // ============== Parses one variable declaration or initialization from current startIndex =============
 // examples it handles: "x", "x = 2", "x = (a+3)"
 // moves startIndex to after parsed variable declaration including optional initialization
-ErrorType ParseVariableAssignment(char *buffer, int *startIndex, char *errinfo) {
+ErrorType ParseVariableAssignment(const char *buffer, int *startIndex, char *errinfo) {
     int i = *startIndex;
 
     // skip leading spaces
-    while(buffer[i] == ' ')
-        i++;
+    i = (int)(ScanSpaces(buffer + i) - buffer);
 
     // invalid: identifier cannot start with digit or '_'
     if(buffer[i] == '_' || isdigit(buffer[i])) {
@@ -140,19 +387,20 @@ ErrorType ParseVariableAssignment(char *buffer, int *startIndex, char *errinfo)
     }
 
     int startVar = i;
-    while(isalnum(buffer[i]) || buffer[i] == '_')
-        i++;
+    i = (int)(ScanIdentifier(buffer + i) - buffer);
 
     if(i == startVar) // no variable name
         return ERR_SYNTAX;
 
     int len = i - startVar;
+    if(len >= MAX_VAR_LENGTH)
+        len = MAX_VAR_LENGTH - 1;
     char var_name[MAX_VAR_LENGTH];
     strncpy(var_name, buffer + startVar, len);
     var_name[len] = '\0';
 
     // check keyword-as-identifier
-    for(int k = 0; k < 11; k++) {
+    for(int k = 0; k < KEYWORDS; k++) {
         if(strcmp(var_name, forbidden[k]) == 0) {
             strcpy(errinfo, var_name);
             return ERR_KEYWORD_AS_IDENTIFIER;
@@ -160,42 +408,74 @@ ErrorType ParseVariableAssignment(char *buffer, int *startIndex, char *errinfo)
     }
 
     // skip spaces after var name
-    while(buffer[i] == ' ')
-        i++;
+    i = (int)(ScanSpaces(buffer + i) - buffer);
 
     // redeclared?
     // check for redeclaration b4 declaring it
-    if(IsVariableDeclared(var_name)) {
+    if(IsVariableDeclared(var_name) || FindFunction(var_name) != -1) {
         strcpy(errinfo, var_name);
         return ERR_REDECLARED;
     }
 
     // store variable
     // declare var immediately/add to te symbol table
+    if(valid_buffer_counter >= MAX_VARS) {
+        strcpy(errinfo, var_name);
+        return ERR_SYNTAX; // no room for another variable
+    }
     strcpy(vars[valid_buffer_counter], var_name);
+    const_vars[valid_buffer_counter] = 0; // not usable in constants before its value is known
     valid_buffer_counter++;
 
     // skip trailing spaces after variable/init
-    while(buffer[i] == ' ')
-        i++;
+    i = (int)(ScanSpaces(buffer + i) - buffer);
 
     // optional initialization '='
     if(buffer[i] == '=') {
         i++; // consume '='
-        while(buffer[i] == ' ')
-            i++;
-
+        i = (int)(ScanSpaces(buffer + i) - buffer);
+
+        // a function call as the whole initializer
+        if(IsCall(buffer, i)) {
+            if(declaring_const) {
+                valid_buffer_counter--;
+                strcpy(errinfo, var_name);
+                DiagText("%s is not a constant\n", var_name);
+                return ERR_INVALID_EXPRESSION;
+            }
+            ErrorType err = CallCheck(buffer, &i, errinfo);
+            if(err != ERR_NONE) {
+                valid_buffer_counter--;
+                return err;
+            }
+        }
         // validate expression
-        if(!AfterEqualsCheck(buffer, &i, 0)) {
-            valid_buffer_counter--; // undo the declaration to prevent polluting the symbol table 
-            strcpy(errinfo, var_name);
-            return ERR_INVALID_EXPRESSION;
+        else {
+            int start = i;
+            if(!AfterEqualsCheck(buffer, &i, 0)) {
+                valid_buffer_counter--; // undo the declaration to prevent polluting the symbol table 
+                return ExpressionError(errinfo, var_name);
+            }
+            // a constant: its value is worked out now, later constants may use it
+            if(declaring_const) {
+                if(!ConstantExpression(buffer, &start, &const_values[valid_buffer_counter - 1])) {
+                    valid_buffer_counter--;
+                    strcpy(errinfo, var_name);
+                    return ERR_INVALID_EXPRESSION;
+                }
+                const_vars[valid_buffer_counter - 1] = 1;
+            }
         }
     }
+    else if(declaring_const) {
+        // "const int n;": a constant needs its value
+        valid_buffer_counter--;
+        strcpy(errinfo, var_name);
+        return ERR_SYNTAX;
+    }
     
     // skip trailing spaces after variable/init
-    while(buffer[i] == ' ')
-        i++;
+    i = (int)(ScanSpaces(buffer + i) - buffer);
     *startIndex = i;
     return ERR_NONE;
 }
@@ -203,9 +483,106 @@ ErrorType ParseVariableAssignment(char *buffer, int *startIndex, char *errinfo)
 
 //ErrorType StartsWithVariableName(char *buffer, char *errinfo);
 
+// a block opens: the first arm of an if (is_if) or a while/else/function body
+static void OpenBlock(int is_if);
+
+// ==================== "int name(int a, int b) {": a function definition ========================
+// i is right after "int "; only at the top level, and the body goes on up to the matching '}'
+// (the function is known from here on, so it may call itself)
+static ErrorType StartsWithFunction(const char *buffer, int i, char *errinfo) {
+    char name[MAX_VAR_LENGTH];
+    i = (int)(ScanSpaces(buffer + i) - buffer);
+    ReadIdentifier(buffer, &i, name);
+    strcpy(errinfo, name);
+    for(int k = 0; k < KEYWORDS; k++)
+        if(strcmp(name, forbidden[k]) == 0)
+            return ERR_KEYWORD_AS_IDENTIFIER;
+    if(IsVariableDeclared(name) || FindFunction(name) != -1)
+        return ERR_REDECLARED;
+    if(block_depth > 0 || function_count >= MAX_FUNCTIONS)
+        return ERR_SYNTAX; // no nested definitions
+
+    // parameters: "int name" each, declared like variables until the function ends
+    int first_var = valid_buffer_counter, params = 0;
+    i = (int)(ScanSpaces(buffer + i) - buffer) + 1; // past '('
+    i = (int)(ScanSpaces(buffer + i) - buffer);
+    while(buffer[i] != ')') {
+        if(strncmp(buffer + i, "int ", 4) != 0)
+            return ERR_SYNTAX;
+        i = (int)(ScanSpaces(buffer + i + 4) - buffer);
+        if(buffer[i] == '_' || isdigit(buffer[i])) {
+            strncpy(errinfo, buffer + i, 1);
+            errinfo[1] = '\0';
+            return ERR_INVALID_IDENTIFIER;
+        }
+        char param[MAX_VAR_LENGTH];
+        ReadIdentifier(buffer, &i, param);
+        strcpy(errinfo, param);
+        if(param[0] == '\0')
+            return ERR_SYNTAX;
+        for(int k = 0; k < KEYWORDS; k++)
+            if(strcmp(param, forbidden[k]) == 0)
+                return ERR_KEYWORD_AS_IDENTIFIER;
+        if(IsVariableDeclared(param) || FindFunction(param) != -1 || strcmp(param, name) == 0)
+            return ERR_REDECLARED;
+        if(valid_buffer_counter >= MAX_VARS)
+            return ERR_SYNTAX;
+        const_vars[valid_buffer_counter] = 0;
+        strcpy(vars[valid_buffer_counter++], param);
+        params++;
+        i = (int)(ScanSpaces(buffer + i) - buffer);
+        if(buffer[i] == ',')
+            i = (int)(ScanSpaces(buffer + i + 1) - buffer);
+        else if(buffer[i] != ')')
+            return ERR_SYNTAX;
+    }
+    i = (int)(ScanSpaces(buffer + i + 1) - buffer);
+    strcpy(errinfo, name);
+    if(buffer[i] != '{')
+        return ERR_SYNTAX;
+
+    strcpy(functions[function_count].name, name);
+    functions[function_count].params = params;
+    current_function = function_count++;
+    function_first_var = first_var;
+    OpenBlock(0);
+    i++;
+
+    // statements may follow on the same line
+    while(IS_BLANK(buffer[i]))
+        i++;
+    if(IS_LINE_END(buffer[i]))
+        return ERR_NONE;
+    return StartsWithVariableName(buffer + i, errinfo);
+}
+
+// ===================== Does the buffer start with the "return" keyword =========================
+int IsReturnKeyword(const char *buffer) {
+    return strncmp(buffer, "return", 6) == 0 && !isalnum(buffer[6]) && buffer[6] != '_';
+}
+
+// ============================= Buffer starts with "return" =====================================
+// e.g. "return a * b;": only inside a function
+ErrorType StartsWithReturn(const char *buffer, char *errinfo) {
+    strcpy(errinfo, "return");
+    if(current_function == -1)
+        return ERR_SYNTAX;
+    int i = (int)(ScanSpaces(buffer + 6) - buffer);
+    if(!AfterEqualsCheck(buffer, &i, 0))
+        return ExpressionError(errinfo, NULL);
+    i = (int)(ScanSpaces(buffer + i) - buffer);
+    if(buffer[i] != ';')
+        return ERR_MISSING_SEMICOLON;
+    while(buffer[i] == ' ' || buffer[i] == ';')
+        i++;
+    if(IS_LINE_END(buffer[i]))
+        return ERR_NONE;
+    return StartsWithVariableName(buffer + i, errinfo);
+}
+
 // ============================= Buffer starts with "int" =====================================
 // e.g., "int a; int b;"  or  "int x = 5; int y, z;"
-ErrorType StartsWithInt(char *buffer, char *errinfo) {
+ErrorType StartsWithInt(const char *buffer, char *errinfo) {
     // previous: does not handle multiple declarations in one line and multiple ; (e.g., int a; int b;;;)
     //     int i = 3; // position right after "int"
 
@@ -239,24 +616,48 @@ ErrorType StartsWithInt(char *buffer, char *errinfo) {
     // fixed + added a block to handle multiple declarations mixed with assignment/s
     int i = 0;
 
-    while(buffer[i] != '\0') {
+    while(!IS_LINE_END(buffer[i])) {
         // skip whitespace between statements
-        while(isspace(buffer[i])) i++;
+        while(IS_BLANK(buffer[i])) i++;
 
-        if(buffer[i] == '\0')
+        if(IS_LINE_END(buffer[i]))
             break;
 
-        // must start with "int "
-        if(strncmp(buffer + i, "int ", 4) == 0) {
-            i += 4;  // skip "int "
+        // "const int " declares constants, which take the same items
+        int constant = IsConstKeyword(buffer + i);
+        if(constant) {
+            i = (int)(ScanSpaces(buffer + i + 5) - buffer);
+            if(strncmp(buffer + i, "int ", 4) != 0) {
+                strcpy(errinfo, "const");
+                return ERR_SYNTAX;
+            }
+        }
+
+        // must start with "int " (or "char ", "short ", "int32 ")
+        int type = TypeKeyword(buffer + i);
+        if(type) {
+            int is_int = strncmp(buffer + i, "int ", 4) == 0;
+            if(constant && !is_int) {
+                strcpy(errinfo, "const");
+                return ERR_SYNTAX; // constants are int only
+            }
+            i += type;  // skip the keyword
+            if(IsCall(buffer, (int)(ScanSpaces(buffer + i) - buffer))) {
+                if(constant || !is_int) {
+                    strcpy(errinfo, constant ? "const" : "int");
+                    return ERR_SYNTAX; // a function is no constant, and returns an int
+                }
+                return StartsWithFunction(buffer, i, errinfo);
+            }
             while(1) {
+                declaring_const = constant;
                 ErrorType err = ParseVariableAssignment(buffer, &i, errinfo);
+                declaring_const = 0;
                 if(err != ERR_NONE)
                     return err;
 
                 // skip spaces after variable
-                while(buffer[i] == ' ')
-                    i++;
+                i = (int)(ScanSpaces(buffer + i) - buffer);
 
                 if(buffer[i] == ',') {
                     i++;  // consume comma, continue same declaration line
@@ -282,9 +683,9 @@ ErrorType StartsWithInt(char *buffer, char *errinfo) {
 
     // adter procrssing all "int" statements, nothing else should remain
     // whitespaces are alr skipped in the loop
-    while(isspace(buffer[i]))
+    while(IS_BLANK(buffer[i]))
         i++;
-    if(buffer[i] != '\0')
+    if(!IS_LINE_END(buffer[i]))
         return ERR_SYNTAX;
 
     return ERR_NONE;
@@ -293,7 +694,7 @@ ErrorType StartsWithInt(char *buffer, char *errinfo) {
 
 // ========================== Buffer starts with a variable ===============================
 // e.g. "x = 5; y = x + 3; z = 1;"
-ErrorType StartsWithVariableName(char *buffer, char *errinfo) {
+ErrorType StartsWithVariableName(const char *buffer, char *errinfo) {
     int i = 0;
 
     // last: doesn't hanlde multiple assignments in one line and multiple ; (like x = 12; y = x * 2;;;)
@@ -355,20 +756,31 @@ ErrorType StartsWithVariableName(char *buffer, char *errinfo) {
     //     return ERR_NONE;
 
     // fixed + added a block for multiple assignments mixed with "int" declaration/s
-    while(buffer[i] != '\0') {
+    while(!IS_LINE_END(buffer[i])) {
         // skip whitespace between statements
-        while(isspace(buffer[i]))
+        while(IS_BLANK(buffer[i]))
             i++;
-        if(buffer[i] == '\0')
+        if(IS_LINE_END(buffer[i]))
             break;
         
-        // if the next statement starts with "int", hand it to StartsWithInt
-        // to handle cases like (with sudden int): 
+        // if the next statement starts with "int" (or "const int", "char", ...), hand it to
+        // StartsWithInt to handle cases like (with sudden int):
         // result = result + a;;;; int b;
-        if(strncmp(buffer + i, "int ", 4) == 0) {
+        if(TypeKeyword(buffer + i) || IsConstKeyword(buffer + i)) {
             return StartsWithInt(buffer + i, errinfo);
         }
 
+        // same for a loop header or the end of a loop body:
+        // x = x - 1; }
+        if(IsWhileKeyword(buffer + i))
+            return StartsWithWhile(buffer + i, errinfo);
+        if(IsIfKeyword(buffer + i))
+            return StartsWithIf(buffer + i, errinfo);
+        if(buffer[i] == '}')
+            return StartsWithClosingBrace(buffer + i, errinfo);
+        if(IsReturnKeyword(buffer + i))
+            return StartsWithReturn(buffer + i, errinfo);
+
         // parse identifier (must be a valid variable name)
         if(buffer[i] == '_' || isdigit(buffer[i])) {
             strncpy(errinfo, buffer + i, 1);
@@ -377,27 +789,42 @@ ErrorType StartsWithVariableName(char *buffer, char *errinfo) {
         }
 
         int startVar = i;
-        while(isalnum(buffer[i]) || buffer[i] == '_')
-            i++;
+        i = (int)(ScanIdentifier(buffer + i) - buffer);
 
         if(i == startVar) // no identifier found
             return ERR_SYNTAX;
         
         int len = i - startVar;
+        if(len >= MAX_VAR_LENGTH)
+            len = MAX_VAR_LENGTH - 1;
         char var_name[MAX_VAR_LENGTH];
         strncpy(var_name, buffer + startVar, len);
         var_name[len] = '\0';
         strcpy(errinfo, var_name);  // for error reporting
 
+        // a call on its own: "name(arguments);"
+        if(FindFunction(var_name) != -1) {
+            i = startVar;
+            ErrorType err = CallCheck(buffer, &i, errinfo);
+            if(err != ERR_NONE)
+                return err;
+            i = (int)(ScanSpaces(buffer + i) - buffer);
+            if(buffer[i] != ';')
+                return ERR_MISSING_SEMICOLON;
+            while(buffer[i] == ' ' || buffer[i] == ';')
+                i++;
+            continue;
+        }
+
         if(!IsVariableDeclared(var_name)) {
             // check keyword-as-identifier
-            for(int k = 0; k < 11; k++) {
+            for(int k = 0; k < KEYWORDS; k++) {
                 if(strcmp(var_name, forbidden[k]) == 0) {
                     strcpy(errinfo, var_name);
                     return ERR_SYNTAX;
                 }
             }
-            while(isspace(buffer[(strlen(var_name) - 1) + i]))
+            while(IS_BLANK(buffer[(strlen(var_name) - 1) + i]))
                 i++;
             if(buffer[i] == '=')
                 return ERR_UNDECLARED;
@@ -405,26 +832,34 @@ ErrorType StartsWithVariableName(char *buffer, char *errinfo) {
                 return ERR_SYNTAX;
         }
 
+        // a constant keeps the value it was declared with
+        int v = FindVariable(var_name);
+        if(const_vars[v])
+            return ERR_CONST_ASSIGNED;
+
         // skip spaces after variable name
-        while(buffer[i] == ' ')
-            i++;
+        i = (int)(ScanSpaces(buffer + i) - buffer);
 
         // must have '='
         if(buffer[i] != '=') 
             return ERR_SYNTAX;
         i++;  // consume '='
 
-        while(buffer[i] == ' ')
-            i++;
+        i = (int)(ScanSpaces(buffer + i) - buffer);
 
+        // a function call as the whole right side
+        if(IsCall(buffer, i)) {
+            ErrorType err = CallCheck(buffer, &i, errinfo);
+            if(err != ERR_NONE)
+                return err;
+        }
         // validate the expression after '='
-        if(!AfterEqualsCheck(buffer, &i, 0)) {
-            return ERR_INVALID_EXPRESSION;
+        else if(!AfterEqualsCheck(buffer, &i, 0)) {
+            return ExpressionError(errinfo, NULL);
         }
                
         // skip spaces after expression
-        while(buffer[i] == ' ')
-            i++;
+        i = (int)(ScanSpaces(buffer + i) - buffer);
 
         // must end with ';'
         if(buffer[i] != ';')
@@ -436,14 +871,220 @@ ErrorType StartsWithVariableName(char *buffer, char *errinfo) {
     }
 
     // after processing all assignments, skip trailing whitespace
-    while(isspace(buffer[i]))
+    while(IS_BLANK(buffer[i]))
         i++;
-    if(buffer[i] != '\0')
+    if(!IS_LINE_END(buffer[i]))
         return ERR_SYNTAX;
 
     return ERR_NONE;
 }
 
+// ===================== Does the buffer start with the "while" keyword =========================
+int IsWhileKeyword(const char *buffer) {
+    return strncmp(buffer, "while", 5) == 0 && !isalnum(buffer[5]) && buffer[5] != '_';
+}
+
+// ============== Validates one side of a loop condition (an expression on its own) ==============
+static int ConditionSideCheck(char *side) {
+    // AfterEqualsCheck expects the operand to run right up to the terminator
+    int len = strlen(side);
+    while(len > 0 && side[len - 1] == ' ')
+        side[--len] = '\0';
+    int k = 0;
+    while(side[k] == ' ')
+        k++;
+    if(!AfterEqualsCheck(side, &k, 0))
+        return 0;
+    while(side[k] == ' ')
+        k++;
+    return side[k] == '\0'; // a ';' or ',' inside the condition is not allowed
+}
+
+// ========================= Validates the condition between the parentheses =======================
+// forms: expr, expr < expr, expr <= expr, expr > expr, expr >= expr, expr == expr, expr != expr
+static int ConditionCheck(const char *cond, int len) {
+    char tmp[BUFFER];
+    if(len <= 0 || len >= BUFFER)
+        return 0;
+    strncpy(tmp, cond, len);
+    tmp[len] = '\0';
+
+    int pos = strcspn(tmp, "<>=!");
+    if(tmp[pos] == '\0')
+        return ConditionSideCheck(tmp); // plain expression: true when non-zero
+
+    int oplen = (tmp[pos + 1] == '=') ? 2 : 1;
+    if(oplen == 1 && (tmp[pos] == '=' || tmp[pos] == '!'))
+        return 0; // '=' is assignment and '!' alone is not supported
+    tmp[pos] = '\0';
+    return ConditionSideCheck(tmp) && ConditionSideCheck(tmp + pos + oplen);
+}
+
+// ================ Validates "(condition)" after a while/if keyword, i at the '(' ================
+// moves i past the closing parenthesis
+static ErrorType ConditionHeader(const char *buffer, int *i, char *errinfo) {
+    *i = (int)(ScanSpaces(buffer + *i) - buffer);
+    if(buffer[*i] != '(')
+        return ERR_SYNTAX;
+
+    // find the matching ')'
+    int open = *i, depth = 0, close = -1;
+    for(int k = open; !IS_LINE_END(buffer[k]); k++) {
+        if(buffer[k] == '(')
+            depth++;
+        else if(buffer[k] == ')' && --depth == 0) {
+            close = k;
+            break;
+        }
+    }
+    if(close == -1)
+        return ERR_SYNTAX;
+    if(!ConditionCheck(buffer + open + 1, close - open - 1))
+        return ExpressionError(errinfo, NULL);
+    *i = close + 1;
+    return ERR_NONE;
+}
+
+static void OpenBlock(int is_if) {
+    if(block_depth < MAX_BLOCK_NESTING)
+        block_is_if[block_depth] = (char)is_if;
+    block_depth++;
+}
+
+// ============================= Buffer starts with "while" =====================================
+// e.g., "while (i < n) {"  or  "while (i) { i = i - 1; }"
+// the body goes on the following lines (or the rest of this one) up to the matching '}'
+ErrorType StartsWithWhile(const char *buffer, char *errinfo) {
+    int i = 5; // position right after "while"
+
+    ErrorType err = ConditionHeader(buffer, &i, errinfo);
+    if(err != ERR_NONE)
+        return err;
+    i = (int)(ScanSpaces(buffer + i) - buffer);
+    if(buffer[i] != '{')
+        return ERR_SYNTAX;
+    OpenBlock(0);
+    i++;
+
+    // statements may follow on the same line
+    while(IS_BLANK(buffer[i]))
+        i++;
+    if(IS_LINE_END(buffer[i]))
+        return ERR_NONE;
+    return StartsWithVariableName(buffer + i, errinfo);
+}
+
+// ===================== Does the buffer start with the "if"/"else" keyword =========================
+int IsIfKeyword(const char *buffer) {
+    return strncmp(buffer, "if", 2) == 0 && !isalnum(buffer[2]) && buffer[2] != '_';
+}
+
+static int IsElseKeyword(const char *buffer) {
+    return strncmp(buffer, "else", 4) == 0 && !isalnum(buffer[4]) && buffer[4] != '_';
+}
+
+static ErrorType ElsePart(const char *buffer, char *errinfo);
+
+// ============== Validates one arm of an if statement (after "if (...)" or "else") ==============
+// "{" opens a block (its statements follow up to the matching '}'); otherwise the arm is a
+// single assignment "x = expression;", after which only the first arm may have an else part
+static ErrorType IfArm(const char *buffer, char *errinfo, int first) {
+    int i = (int)(ScanSpaces(buffer) - buffer);
+    if(buffer[i] == '{') {
+        OpenBlock(first);
+        i++;
+        while(IS_BLANK(buffer[i]))
+            i++;
+        if(IS_LINE_END(buffer[i]))
+            return ERR_NONE;
+        return StartsWithVariableName(buffer + i, errinfo);
+    }
+
+    // the single assignment on its own: up to its ';'
+    char statement[BUFFER];
+    int semi = i;
+    while(!IS_LINE_END(buffer[semi]) && buffer[semi] != ';')
+        semi++;
+    if(buffer[semi] != ';')
+        return ERR_MISSING_SEMICOLON;
+    if(semi - i + 1 >= BUFFER)
+        return ERR_INVALID_EXPRESSION;
+    if(IS_LINE_END(buffer[i]) || buffer[i] == '}' || buffer[i] == ';' || TypeKeyword(buffer + i) ||
+       IsConstKeyword(buffer + i) || IsWhileKeyword(buffer + i) || IsIfKeyword(buffer + i) || IsElseKeyword(buffer + i))
+        return ERR_SYNTAX; // a declaration, loop or nested if needs braces
+    memcpy(statement, buffer + i, semi - i + 1);
+    statement[semi - i + 1] = '\0';
+    ErrorType err = StartsWithVariableName(statement, errinfo);
+    if(err != ERR_NONE)
+        return err;
+
+    i = (int)(ScanSpaces(buffer + semi + 1) - buffer);
+    if(IsElseKeyword(buffer + i)) {
+        if(!first) {
+            strcpy(errinfo, "else");
+            return ERR_SYNTAX;
+        }
+        return ElsePart(buffer + i + 4, errinfo);
+    }
+    while(IS_BLANK(buffer[i]) || buffer[i] == ';')
+        i++;
+    if(IS_LINE_END(buffer[i]))
+        return ERR_NONE;
+    return StartsWithVariableName(buffer + i, errinfo);
+}
+
+// ========================== Validates what follows "else" ===========================
+// "else if (...)" chains another if statement, anything else is the second arm
+static ErrorType ElsePart(const char *buffer, char *errinfo) {
+    int i = (int)(ScanSpaces(buffer) - buffer);
+    if(IsIfKeyword(buffer + i))
+        return StartsWithIf(buffer + i, errinfo);
+    return IfArm(buffer + i, errinfo, 0);
+}
+
+// ============================= Buffer starts with "if" =====================================
+// e.g., "if (x < y) {", "if (x < y) { m = x; } else { m = y; }" or "if (x < y) m = x; else m = y;"
+// a block arm goes on up to its '}', where "} else" may follow (on the same line)
+ErrorType StartsWithIf(const char *buffer, char *errinfo) {
+    int i = 2; // position right after "if"
+
+    ErrorType err = ConditionHeader(buffer, &i, errinfo);
+    if(err != ERR_NONE)
+        return err;
+    return IfArm(buffer + i, errinfo, 1);
+}
+
+// ============================= Buffer starts with "}" =====================================
+// closes the innermost block; statements may follow on the same line, and after the first
+// arm of an if its else part
+ErrorType StartsWithClosingBrace(const char *buffer, char *errinfo) {
+    if(block_depth == 0) {
+        strcpy(errinfo, "}");
+        return ERR_UNMATCHED_BRACE;
+    }
+    block_depth--;
+    int closes_if = block_depth < MAX_BLOCK_NESTING && block_is_if[block_depth];
+    if(block_depth == 0 && current_function != -1) {
+        // end of a function body: its parameters and locals go out of scope
+        valid_buffer_counter = function_first_var;
+        current_function = -1;
+    }
+
+    int i = (int)(ScanSpaces(buffer + 1) - buffer);
+    if(IsElseKeyword(buffer + i)) {
+        if(!closes_if) {
+            strcpy(errinfo, "else");
+            return ERR_SYNTAX;
+        }
+        return ElsePart(buffer + i + 4, errinfo);
+    }
+    while(IS_BLANK(buffer[i]) || buffer[i] == ';')
+        i++;
+    if(IS_LINE_END(buffer[i]))
+        return ERR_NONE;
+    return StartsWithVariableName(buffer + i, errinfo);
+}
+
 // ======================== Remove leading and trailing spaces from the buffer =======================
 void RemoveLeadingAndTrailingSpaces(char *buffer) {
     int start = 0;
@@ -6,10 +6,15 @@
 #include <ctype.h>
 #include "error.h"
 
-#define MAX_VARS 1024
+#define MAX_VARS 16384
 #define MAX_VAR_LENGTH 100
 #define BUFFER 256
 
+// lines are views into the source file: a line ends at '\n' ("\r\n") or at the final '\0',
+// and whitespace skipping must never step over that end
+#define IS_LINE_END(c) ((c) == '\0' || (c) == '\n' || (c) == '\r')
+#define IS_BLANK(c) ((c) == ' ' || (c) == '\t' || (c) == '\f' || (c) == '\v')
+
 
 // struct for variable-register pairs (reserved for future use)
 typedef struct {    
@@ -24,13 +29,24 @@ extern int valid_buffer_counter;
 extern char used_vars[MAX_VARS];
 extern int registers[30];
 extern int used_registers[30];
+extern int block_depth;
 
 // function prototypes
-int IsVariableDeclared(char *variableName);
-int AfterEqualsCheck(char *buffer, int *startCounter, int allowClosing);
-ErrorType ParseVariableAssignment(char *buffer, int *startIndex, char *errinfo);
-ErrorType StartsWithInt(char *buffer, char *errinfo);
-ErrorType StartsWithVariableName(char *buffer, char *errinfo);
+int IsVariableDeclared(const char *variableName);
+int NumberFits(const char *digits, int len, int negative);
+int AfterEqualsCheck(const char *buffer, int *startCounter, int allowClosing);
+ErrorType ParseVariableAssignment(const char *buffer, int *startIndex, char *errinfo);
+ErrorType StartsWithInt(const char *buffer, char *errinfo);
+ErrorType StartsWithVariableName(const char *buffer, char *errinfo);
+ErrorType StartsWithWhile(const char *buffer, char *errinfo);
+ErrorType StartsWithIf(const char *buffer, char *errinfo);
+ErrorType StartsWithClosingBrace(const char *buffer, char *errinfo);
+int IsWhileKeyword(const char *buffer);
+int IsIfKeyword(const char *buffer);
+int IsReturnKeyword(const char *buffer);
+int IsConstKeyword(const char *buffer);
+int TypeKeyword(const char *buffer);
+ErrorType StartsWithReturn(const char *buffer, char *errinfo);
 void RemoveLeadingAndTrailingSpaces(char *buffer);
 char* RemoveAllSpaces(char *buffer, char *spacelessBuffer);
 
@@ -0,0 +1,303 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "link.h"
+#include "error.h"
+
+#define GLOBAL_HASH_MIN 1024
+
+static const char *binding_names[] = { "common", "defined", "local", "undefined" };
+
+
+// ================= objects =========================
+
+int ObjectWrite(const MachineModule *module, const char *obj_file) {
+    FILE *out = fopen(obj_file, "w");
+    if(!out)
+        return 0;
+    fprintf(out, "# kore-desu object\n");
+    fprintf(out, ".code %d\n", module->code_count);
+    for(int k = 0; k < module->code_count; k++) {
+        if(module->valid[k])
+            fprintf(out, "%08X\n", module->code[k]);
+        else
+            fprintf(out, "-\n");
+    }
+    fprintf(out, ".data %d\n", module->data_count);
+    for(int i = 0; i < module->data_count; i++) {
+        const DataSymbol *sym = &module->data[i];
+        // its bytes; a string's other doublewords follow its line, one per line
+        int more = sym->image ? (sym->bytes + 7) / 8 - 1 : 0;
+        fprintf(out, "%s %d %016llX %s", binding_names[sym->binding], sym->bytes,
+                (unsigned long long)sym->value, sym->name);
+        fprintf(out, more > 0 ? " +%d\n" : "\n", more);
+        for(int k = 1; k <= more; k++)
+            fprintf(out, "%016llX\n", (unsigned long long)sym->image[k]);
+    }
+    fprintf(out, ".reloc %d\n", module->reloc_count);
+    for(int r = 0; r < module->reloc_count; r++) {
+        const Relocation *rel = &module->relocs[r];
+        if(rel->kind == RELOC_DATA)
+            fprintf(out, "%d data %d\n", rel->index, rel->symbol);
+        else
+            fprintf(out, "%d jump\n", rel->index);
+    }
+    fclose(out);
+    return 1;
+}
+
+int ObjectFromAssembly(const char *asm_file, const char *obj_file) {
+    MachineModule module;
+    if(!MachineAssemble(asm_file, &module))
+        return 0;
+    int ok = ObjectWrite(&module, obj_file);
+    MachineFreeModule(&module);
+    return ok;
+}
+
+// next line that isn't a comment, without its newline; 0 at the end of the file
+static int NextLine(FILE *in, char *line, int size) {
+    while(fgets(line, size, in)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if(line[0] != '#' && line[0] != '\0')
+            return 1;
+    }
+    return 0;
+}
+
+static int ReadSection(FILE *in, const char *name, int *count) {
+    char line[MAX_NAME_LEN + 64], section[16];
+    return NextLine(in, line, sizeof(line)) && sscanf(line, ".%15s %d", section, count) == 2
+           && strcmp(section, name) == 0 && *count >= 0;
+}
+
+int ObjectRead(const char *obj_file, MachineModule *module) {
+    memset(module, 0, sizeof(*module));
+    FILE *in = fopen(obj_file, "r");
+    if(!in)
+        return 0;
+    char line[MAX_NAME_LEN + 64];
+    int count, ok = ReadSection(in, "code", &count);
+    for(int k = 0; ok && k < count; k++) {
+        unsigned int code = 0;
+        ok = NextLine(in, line, sizeof(line));
+        if(ok && strcmp(line, "-") == 0)
+            MachineAddWord(module, 0, 0);
+        else if(ok && (ok = sscanf(line, "%x", &code) == 1))
+            MachineAddWord(module, code, 1);
+    }
+
+    ok = ok && ReadSection(in, "data", &count);
+    for(int i = 0; ok && i < count; i++) {
+        DataSymbol sym;
+        char binding[16];
+        unsigned long long value;
+        int more = 0;
+        memset(&sym, 0, sizeof(sym));
+        ok = NextLine(in, line, sizeof(line)) && sscanf(line, "%15s %d %llx %63s +%d", binding, &sym.bytes, &value, sym.name, &more) >= 4;
+        if(!ok)
+            break;
+        sym.value = value;
+        if(more > 0) {
+            ok = more == (sym.bytes + 7) / 8 - 1 && (sym.image = calloc(more + 1, sizeof(uint64_t))) != NULL;
+            for(int k = 1; ok && k <= more; k++) {
+                ok = NextLine(in, line, sizeof(line)) && sscanf(line, "%llx", &value) == 1;
+                if(ok)
+                    sym.image[k] = value;
+            }
+            if(ok)
+                sym.image[0] = sym.value;
+        }
+        sym.binding = SYM_UNDEFINED + 1;
+        for(int b = SYM_COMMON; b <= SYM_UNDEFINED; b++)
+            if(strcmp(binding, binding_names[b]) == 0)
+                sym.binding = b;
+        ok = ok && sym.binding <= SYM_UNDEFINED && sym.bytes >= 0;
+        if(ok)
+            MachineAddSymbol(module, &sym);
+        free(sym.image);
+    }
+
+    ok = ok && ReadSection(in, "reloc", &count);
+    for(int r = 0; ok && r < count; r++) {
+        int index, symbol = -1;
+        char kind[8];
+        ok = NextLine(in, line, sizeof(line)) && sscanf(line, "%d %7s %d", &index, kind, &symbol) >= 2
+             && index >= 0 && index < module->code_count;
+        if(ok && strcmp(kind, "data") == 0 && symbol >= 0 && symbol < module->data_count)
+            MachineAddRelocation(module, index, RELOC_DATA, symbol);
+        else if(ok && strcmp(kind, "jump") == 0)
+            MachineAddRelocation(module, index, RELOC_JUMP, -1);
+        else
+            ok = 0;
+    }
+    fclose(in);
+    if(!ok)
+        MachineFreeModule(module);
+    return ok ? 1 : -1;
+}
+
+
+// ================= linking =========================
+
+// global (common/defined) symbols of the linked image by name: open addressing, -1 = empty
+static int *global_slots;
+static int global_size;
+
+static unsigned HashName(const char *s) {
+    unsigned h = 2166136261u;
+    for(; *s; s++)
+        h = (h ^ (unsigned char)*s) * 16777619u;
+    return h;
+}
+
+// slot in global_slots of name: its symbol, or the empty slot where it goes
+static int *GlobalSlot(const MachineModule *linked, const char *name) {
+    unsigned i = HashName(name) & (global_size - 1);
+    while(global_slots[i] >= 0 && strcmp(linked->data[global_slots[i]].name, name) != 0)
+        i = (i + 1) & (global_size - 1);
+    return &global_slots[i];
+}
+
+// room for the longest format below with a name of MAX_NAME_LEN; a longer name (an object path)
+// is cut and ends the message with "..."
+#define LINK_MESSAGE_LEN (MAX_NAME_LEN + 128)
+
+static void LinkError(const char *object, const char *format, const char *name) {
+    char message[LINK_MESSAGE_LEN];
+    if(snprintf(message, sizeof(message), format, name) >= (int)sizeof(message))
+        strcpy(message + sizeof(message) - 4, "...");
+    DiagReport(DIAG_ERROR, ERR_LINK, object, 0, 0, message);
+}
+
+// place a module's symbols in the linked image; map[i] = linked index of its symbol i
+// (undefined ones are resolved once every object is placed). returns 0 on a conflict
+static int PlaceSymbols(MachineModule *linked, const MachineModule *m, int *map, const char *object) {
+    int ok = 1;
+    for(int i = 0; i < m->data_count; i++) {
+        const DataSymbol *sym = &m->data[i];
+        map[i] = -1;
+        if(sym->binding == SYM_UNDEFINED)
+            continue;
+        if(sym->binding == SYM_LOCAL) {
+            map[i] = MachineAddSymbol(linked, sym);
+            continue;
+        }
+        int *slot = GlobalSlot(linked, sym->name);
+        if(*slot < 0) {
+            *slot = map[i] = MachineAddSymbol(linked, sym);
+            continue;
+        }
+        DataSymbol *have = &linked->data[*slot];
+        map[i] = *slot;
+        if(sym->binding == SYM_DEFINED && have->binding == SYM_DEFINED && sym->value != have->value) {
+            LinkError(object, "'%s' defined with a different initial value in another object", sym->name);
+            ok = 0;
+        } else if(sym->binding == SYM_DEFINED) {
+            have->binding = SYM_DEFINED;
+            have->value = sym->value;
+        }
+        if(sym->bytes > have->bytes)
+            have->bytes = sym->bytes;
+    }
+    return ok;
+}
+
+int LinkObjects(const char *const *objects, int count, const char *out_file) {
+    MachineModule *modules = calloc(count + 1, sizeof(MachineModule));
+    int **maps = calloc(count + 1, sizeof(int *));
+    MachineModule linked;
+    int ok = modules && maps, symbols = 0;
+    memset(&linked, 0, sizeof(linked));
+
+    for(int m = 0; ok && m < count; m++) {
+        int read = ObjectRead(objects[m], &modules[m]);
+        if(read == 0)
+            ReportError(ERR_IO, 0, objects[m]);
+        else if(read < 0)
+            LinkError(objects[m], "'%s' is not an object file (compile with -c)", objects[m]);
+        ok = read > 0;
+        symbols += modules[m].data_count;
+    }
+    for(global_size = GLOBAL_HASH_MIN; global_size < 2 * symbols; global_size *= 2)
+        ;
+    global_slots = ok ? malloc(global_size * sizeof(int)) : NULL;
+    ok = ok && global_slots;
+    for(int i = 0; ok && i < global_size; i++)
+        global_slots[i] = -1;
+
+    // 1) .data layout: objects in order, each symbol where it first appears
+    for(int m = 0; ok && m < count; m++) {
+        maps[m] = malloc((modules[m].data_count + 1) * sizeof(int));
+        ok = maps[m] && PlaceSymbols(&linked, &modules[m], maps[m], objects[m]) && ok;
+    }
+    for(int m = 0; ok && m < count; m++)
+        for(int i = 0; i < modules[m].data_count; i++) {
+            if(maps[m][i] >= 0)
+                continue;
+            maps[m][i] = *GlobalSlot(&linked, modules[m].data[i].name);
+            if(maps[m][i] < 0) {
+                LinkError(objects[m], "undefined symbol '%s'", modules[m].data[i].name);
+                ok = 0;
+            }
+        }
+    long long *offset = ok ? malloc((linked.data_count + 1) * sizeof(long long)) : NULL;
+    ok = ok && offset;
+    if(ok)
+        MachineDataLayout(&linked, offset);
+
+    // 2) code one object after another, relocations patched against the layout
+    for(int m = 0; ok && m < count; m++) {
+        int base = linked.code_count;
+        for(int k = 0; k < modules[m].code_count; k++)
+            MachineAddWord(&linked, modules[m].code[k], modules[m].valid[k]);
+        // where the module's own listing put its symbols: its lui chose the data windows by it
+        long long *local = malloc((modules[m].data_count + 1) * sizeof(long long));
+        ok = local != NULL;
+        if(ok)
+            MachineDataLayout(&modules[m], local);
+        for(int r = 0; ok && r < modules[m].reloc_count; r++) {
+            const Relocation *rel = &modules[m].relocs[r];
+            uint32_t *code = &linked.code[base + rel->index];
+            if(rel->kind == RELOC_DATA) {
+                long long at = offset[maps[m][rel->symbol]];
+                const char *name = modules[m].data[rel->symbol].name;
+                // an offset the code can't reach is an error, never wrapped into another variable
+                if(!MachineDataReach(*code, at)) {
+                    LinkError(objects[m], "'%s' is placed past the first 32 KB of .data, out of reach of ld/sd from r0", name);
+                    ok = 0;
+                } else if(((*code >> 21) & 31) == GP_REGISTER && DATA_WINDOW(at) != DATA_WINDOW(local[rel->symbol])) {
+                    LinkError(objects[m], "'%s' is placed in another 64 KB data window than its object addresses", name);
+                    ok = 0;
+                }
+                *code = MachinePatch(*code, RELOC_DATA, at);
+            } else
+                *code = MachinePatch(*code, RELOC_JUMP, (*code & 0x3FFFFFF) + base);
+        }
+        free(local);
+    }
+
+    FILE *out = ok ? fopen(out_file, "w") : NULL;
+    if(ok && !out) {
+        ReportError(ERR_IO, 0, out_file);
+        ok = 0;
+    }
+    if(ok) {
+        MachineWrite(&linked, out);
+        fclose(out);
+    }
+
+    for(int m = 0; m < count && modules && maps; m++) {
+        MachineFreeModule(&modules[m]);
+        free(maps[m]);
+    }
+    free(modules);
+    free(maps);
+    free(offset);
+    free(global_slots);
+    global_slots = NULL;
+    MachineFreeModule(&linked);
+    return ok;
+}
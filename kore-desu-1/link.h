@@ -0,0 +1,26 @@
+#ifndef LINK_H
+#define LINK_H
+
+#include "machine_code.h"
+
+// relocatable object (text, like the .mc):
+//   .code <n>        n lines: instruction word in hex ("-" for a line that could not be encoded)
+//   .data <n>        n lines: <common|defined|local|undefined> <words> <first word in hex> <name>
+//   .reloc <n>       n lines: <instruction> data <symbol>  or  <instruction> jump
+// ld/sd offsets are 0 and j targets count from the module's first instruction until linked
+
+// compile step: assemble a listing into an object file; returns 0 on I/O failure
+int ObjectFromAssembly(const char *asm_file, const char *obj_file);
+
+int ObjectWrite(const MachineModule *module, const char *obj_file);
+
+// returns 1, 0 if the file can't be read, -1 if it isn't an object
+int ObjectRead(const char *obj_file, MachineModule *module);
+
+// link step: the objects' code one after another (in the given order), .data merged:
+// common/defined symbols of the same name are one variable (two different initial values
+// are an error), undefined ones must be provided by some object, local ones stay per object;
+// then every ld/sd offset and j target is patched. writes the .mc, returns 0 on any error
+int LinkObjects(const char *const *objects, int count, const char *out_file);
+
+#endif
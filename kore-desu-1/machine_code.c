@@ -1,3 +1,9 @@
+#if !defined(_WIN32)
+#define _DEFAULT_SOURCE // pthreads and sysconf under -std=c99
+#include <pthread.h>
+#include <unistd.h>
+#define MACHINE_THREADS 1
+#endif
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -5,19 +11,104 @@
 #include <stdint.h>
 #include "machine_code.h"
 #include "symbol_table.h"
+#include "scan.h" // .asciiz string literals
+#include "error.h" // diagnostics sink (warnings)
+#include "target.h" // the SPECIAL instructions of the --target ISA
 
 // I-type opcodes
+#define OP_BEQ 0x04 // beq rs, rt, offset
+#define OP_BNE 0x05 // bne rs, rt, offset
 #define OP_DADDIU 0x19 // daddiu rt, rs, immediate
+#define OP_LUI 0x0F // lui rt, immediate (rt = immediate << 16, sign-extended)
+#define OP_ORI 0x0D // ori rt, rs, immediate (zero-extended)
+#define OP_LB 0x20 // load byte (sign-extended)
+#define OP_LH 0x21 // load halfword (sign-extended)
+#define OP_LW 0x23 // load word (sign-extended)
 #define OP_LD 0x37 // 64-bit load doubleword
+#define OP_SB 0x28 // store byte
+#define OP_SH 0x29 // store halfword
+#define OP_SW 0x2B // store word
 #define OP_SD 0x3F // 64-bit store doubleword
 
+// loads and stores: "ld rt, name(rs)" (offset: relocation) or "ld rt, 16(r29)" (a stack slot)
+static const struct {
+    const char *mnemonic;
+    int opcode;
+} memory_ops[] = {
+    { "ld", OP_LD }, { "sd", OP_SD }, { "lb", OP_LB }, { "lh", OP_LH },
+    { "lw", OP_LW }, { "sb", OP_SB }, { "sh", OP_SH }, { "sw", OP_SW }
+};
+#define MEMORY_OPS ((int)(sizeof(memory_ops) / sizeof(memory_ops[0])))
+
+// .data directives with an initial value and its bytes (.word is .word64, like eduMIPS64)
+static const struct {
+    const char *directive;
+    int bytes;
+} data_directives[] = { { ".word64", 8 }, { ".word32", 4 }, { ".word16", 2 }, { ".word", 8 }, { ".byte", 1 } };
+#define DATA_DIRECTIVES ((int)(sizeof(data_directives) / sizeof(data_directives[0])))
+
+// J-type opcodes
+#define OP_J 0x02 // j target
+#define OP_JAL 0x03 // jal target (r31 = return address)
+
 // R-type function codes (funct field)
 #define FUNCT_DADDU 0x2D
 #define FUNCT_DSUBU 0x23
-#define FUNCT_DMULT 0x18
-#define FUNCT_DDIV 0x1A
-#define FUNCT_MFHI 0x10
-#define FUNCT_MFLO 0x12
+#define FUNCT_SLT 0x2A
+#define FUNCT_SLTU 0x2B
+#define FUNCT_DSLL 0x38 // dsll rd, rt, sa
+#define FUNCT_SYSCALL 0x0C // syscall n: n in the 20-bit code field above funct
+// multiply/divide, mflo/mfhi, movz/movn and jr differ between the targets: target.c
+
+// code labels (e.g. _loop0:) and the instruction index they stand for
+#define MAX_LABELS 4096
+static struct {
+    char name[MAX_NAME_LEN];
+    int index;
+} labels[MAX_LABELS];
+static int label_count = 0;
+
+// name -> index into a table whose entries start with their name (labels, .data symbols):
+// open addressing, power-of-two size, -1 empty. built before the workers start, then only read
+typedef struct {
+    int *slots;
+    int size;
+    const char *table;
+    size_t stride;
+} NameIndex;
+
+static NameIndex label_index, symbol_index;
+
+static void *Grow(void *p, int *capacity, int count, size_t size);
+
+// the listing is encoded in chunks of whole lines, one worker thread per chunk; a small
+// listing (or MachineSetThreads(1)) is one chunk on the calling thread
+#define CHUNK_MIN_BYTES (64 * 1024)
+#define MAX_CHUNKS 64
+static int threads_wanted = 0; // 0: one per online processor
+
+// an ld/sd of a symbol the listing doesn't reserve: added (undefined) when the chunks are merged
+typedef struct {
+    int reloc; // index into the chunk's relocations
+    char name[MAX_NAME_LEN];
+} PendingSymbol;
+
+typedef struct {
+    int line_no;
+    int error;      // the line could not be encoded (an error), else a warning
+    char *message;
+} ChunkWarning;
+
+// a stretch of whole lines of the listing and its encoding
+typedef struct {
+    const char *start, *end;
+    int pc, line_no, in_data;       // state at its first line
+    MachineModule part;             // code words and relocations (indices count from the listing's start)
+    PendingSymbol *pending;
+    int pending_count, pending_capacity;
+    ChunkWarning *warnings;         // reported in listing order once every chunk is done
+    int warning_count, warning_capacity;
+} Chunk;
 
 
 // map reister name "r0".."r31" to number
@@ -32,37 +123,520 @@ static uint32_t Encode_R_Type(uint8_t rs, uint8_t rt, uint8_t rd, uint8_t shamt,
 }
 
 // I-type instruction: opcode rs rt immediate
-static uint32_t Encode_I_Type(uint8_t opcode, uint8_t rs, uint8_t rt, int16_t imm) {
-    return (opcode << 26) | (rs << 21) | (rt << 16) | ((uint16_t)imm & 0xFFFF);
+// the immediate is 16 bits: -32768..32767, or 0..0xFFFF for lui and ori, which take the bits as
+// they are; 0 (nothing encoded) if it doesn't fit, never cut to its low bits
+static int Encode_I_Type(uint8_t opcode, uint8_t rs, uint8_t rt, long long imm, uint32_t *code) {
+    int raw = opcode == OP_LUI || opcode == OP_ORI;
+    if(imm < (raw ? 0 : -32768) || imm > (raw ? 0xFFFF : 32767))
+        return 0;
+    *code = (opcode << 26) | (rs << 21) | (rt << 16) | ((uint16_t)imm & 0xFFFF);
+    return 1;
 }
 
-// print 32-bit instruction in binary
-static void PrintBinary(uint32_t code, FILE *out) {
-    for(int i = 31; i >= 0; i--) {
-        fprintf(out, "%c", (code & (1U << i)) ? '1' : '0');
-        if(i % 4 == 0)
-            fprintf(out, " "); // spacing every 4 bits
+// J-type instruction: opcode target (instruction index, code starts at address 0)
+static uint32_t Encode_J_Type(uint8_t opcode, uint32_t target) {
+    return (opcode << 26) | (target & 0x3FFFFFF);
+}
+
+// a SPECIAL instruction of the target (target.c) from its operands: "rd, rs, rt", "rs, rt", or
+// one register, rd of mflo/mfhi and rs of jr; 0 if they don't match its form
+static int EncodeSpecial(const TargetInstruction *in, const char *operands, uint32_t *code) {
+    char reg[3][8];
+    if(sscanf(operands, " %7[^,], %7[^,], %7s", reg[0], reg[1], reg[2]) != in->operands)
+        return 0;
+    int r[3] = { 0, 0, 0 };
+    for(int k = 0; k < in->operands; k++)
+        if(reg[k][0] != 'r' || (r[k] = RegisterNumber(reg[k])) < 0 || r[k] > 31)
+            return 0;
+    if(in->operands == 3)
+        *code = Encode_R_Type(r[1], r[2], r[0], in->shamt, in->funct);
+    else if(in->operands == 2)
+        *code = Encode_R_Type(r[0], r[1], 0, in->shamt, in->funct);
+    else if(strncmp(in->mnemonic, "mf", 2) == 0)
+        *code = Encode_R_Type(0, 0, r[0], in->shamt, in->funct);
+    else
+        *code = Encode_R_Type(r[0], 0, 0, in->shamt, in->funct);
+    return 1;
+}
+
+static unsigned HashName(const char *s) {
+    unsigned h = 2166136261u;
+    for(; *s; s++)
+        h = (h ^ (unsigned char)*s) * 16777619u;
+    return h;
+}
+
+// slot of name: its entry, or the empty slot where it goes
+static int *IndexSlot(const NameIndex *ix, const char *name) {
+    unsigned i = HashName(name) & (ix->size - 1);
+    while(ix->slots[i] >= 0 && strcmp(ix->table + ix->slots[i] * ix->stride, name) != 0)
+        i = (i + 1) & (ix->size - 1);
+    return &ix->slots[i];
+}
+
+// index the first count entries of table; of equal names the first one wins, like a linear search
+static void IndexBuild(NameIndex *ix, const void *table, size_t stride, int count) {
+    ix->table = table;
+    ix->stride = stride;
+    for(ix->size = 64; ix->size < 2 * count; ix->size *= 2)
+        ;
+    ix->slots = xrealloc(NULL, ix->size * sizeof(int));
+    memset(ix->slots, 0xFF, ix->size * sizeof(int));
+    for(int i = 0; i < count; i++) {
+        int *slot = IndexSlot(ix, ix->table + i * stride);
+        if(*slot < 0)
+            *slot = i;
     }
 }
 
+static void IndexFree(NameIndex *ix) {
+    free(ix->slots);
+    memset(ix, 0, sizeof(*ix));
+}
 
-// MAIN TRANSLATION SECTION
-// convert assembly to machine code, one line per assembly
-// each instrcution line is converted into a bits of integer code
-// and teh resulting binary and hex are written to out_file
-int MachineFromAssembly(const char *asm_file, const char *out_file) {
-    FILE *in = fopen(asm_file, "r");
-    if(!in)
+// instruction index of a code label, or -1 if not defined
+static int LabelIndex(const char *name) {
+    int i = *IndexSlot(&label_index, name);
+    return i >= 0 ? labels[i].index : -1;
+}
+
+// opcode of a load/store mnemonic, -1 if it is none
+static int MemoryOpcode(const char *mnemonic) {
+    for(int k = 0; k < MEMORY_OPS; k++)
+        if(strcmp(memory_ops[k].mnemonic, mnemonic) == 0)
+            return memory_ops[k].opcode;
+    return -1;
+}
+
+// load/store offset given as a number (stack slots relative to r29) instead of a .data symbol
+static int IsNumericOffset(const char *text) {
+    return isdigit((unsigned char)text[0]) || (text[0] == '-' && isdigit((unsigned char)text[1]));
+}
+
+// .asciiz "text": the string and its NUL packed little-endian into doublewords (local: a
+// string is never shared with another module)
+static void StringSymbol(const char *literal, DataSymbol *sym) {
+    int len;
+    char *text;
+    if(!ScanString(literal, NULL, 0, &len))
+        return;
+    text = xrealloc(NULL, len + 1);
+    ScanString(literal, text, len + 1, NULL);
+    sym->binding = SYM_LOCAL;
+    sym->bytes = (len + 8) / 8 * 8;
+    sym->image = xrealloc(NULL, sym->bytes);
+    memset(sym->image, 0, sym->bytes);
+    for(int i = 0; i < len; i++)
+        sym->image[i / 8] |= (uint64_t)(unsigned char)text[i] << (8 * (i % 8));
+    sym->value = sym->image[0];
+    free(text);
+}
+
+// .data directive "name: .word64 v" / ".word v" / ".word32 v" / ".word16 v" / ".byte v" /
+// ".space n" / ".asciiz "text"" -> symbol (nothing for other directives)
+static void CollectDataSymbol(const char *p, MachineModule *module) {
+    DataSymbol sym;
+    long long value;
+    int size, at = -1, d;
+    memset(&sym, 0, sizeof(sym));
+    int len = (int)strcspn(p, ":");
+    if(len > MAX_NAME_LEN - 1)
+        len = MAX_NAME_LEN - 1;
+    memcpy(sym.name, p, len);
+    if(sscanf(p, "%*[^:]: .asciiz %n", &at) == 0 && at >= 0) {
+        StringSymbol(p + at, &sym);
+        if(!sym.image)
+            return;
+        MachineAddSymbol(module, &sym);
+        free(sym.image);
+        return;
+    }
+    const char *directive = strchr(p, ':') + 1;
+    while(isspace((unsigned char)*directive))
+        directive++;
+    for(d = 0; d < DATA_DIRECTIVES; d++) {
+        int n = (int)strlen(data_directives[d].directive);
+        if(strncmp(directive, data_directives[d].directive, n) == 0 && isspace((unsigned char)directive[n]))
+            break;
+    }
+    if(d < DATA_DIRECTIVES && sscanf(directive + strlen(data_directives[d].directive), "%lli", &value) == 1) {
+        sym.binding = SYM_DEFINED;
+        sym.bytes = data_directives[d].bytes;
+        sym.value = (uint64_t)value;
+        if(sym.bytes < 8)
+            sym.value &= ((uint64_t)1 << (8 * sym.bytes)) - 1;
+    } else if(sscanf(p, "%*[^:]: .space %i", &size) == 1 && size >= 0) {
+        sym.binding = SYM_COMMON;
+        // zero-filled: a char, short or int32 as it is, anything else rounded up to doublewords
+        sym.bytes = SymbolAlignment(size) == 8 ? (size + 7) / 8 * 8 : size;
+    } else
+        return;
+    if(sym.name[0] == '_')
+        sym.binding = SYM_LOCAL; // compiler-generated (identifiers can't start with '_')
+    MachineAddSymbol(module, &sym);
+}
+
+// next line of the listing text at *at, without its newline and cut to size - 1 characters;
+// 0 at the end of the text
+static int NextLine(const char **at, const char *end, char *line, int size) {
+    if(*at >= end)
         return 0;
-    FILE *out = fopen(out_file, "w");
-    if(!out) { 
-        fclose(in); 
-        return 0; 
+    const char *nl = memchr(*at, '\n', end - *at), *stop = nl ? nl : end;
+    int len = stop - *at < size - 1 ? (int)(stop - *at) : size - 1;
+    memcpy(line, *at, len);
+    line[len] = '\0';
+    line[strcspn(line, "\r")] = '\0';
+    *at = nl ? nl + 1 : end;
+    return 1;
+}
+
+// first pass state at a line start
+typedef struct {
+    size_t offset;
+    int pc, line_no, in_data;
+} LinePosition;
+
+// a listing as it arrives (or read at once): the text so far, how far the first pass got, and
+// every CHECKPOINT_BYTES a line start where a chunk may begin
+#define CHECKPOINT_BYTES 4096
+struct MachineStream {
+    char *text;
+    size_t length, size;
+    LinePosition at;                // where the first pass continues
+    LinePosition *checkpoints;
+    int checkpoint_count, checkpoint_capacity;
+    MachineModule module;           // the .data symbols so far
+};
+
+// first pass over the lines of the text not seen yet (only whole ones unless last): record the
+// instruction index of every label in .code, and every .data symbol in listing order
+// a label may stand on its own line or in front of an instruction
+static void CollectLabels(MachineStream *s, int last) {
+    char line[MAX_SYMBOLS];
+    const char *text = s->text, *end = s->text + s->length;
+    if(!last) {
+        while(end > text + s->at.offset && end[-1] != '\n')
+            end--; // the last line isn't complete yet
     }
+    const char *at = text + s->at.offset;
+    for(;;) {
+        s->at.offset = at - text;
+        if(s->checkpoint_count == 0 || s->at.offset - s->checkpoints[s->checkpoint_count - 1].offset >= CHECKPOINT_BYTES) {
+            s->checkpoints = Grow(s->checkpoints, &s->checkpoint_capacity, s->checkpoint_count, sizeof(LinePosition));
+            s->checkpoints[s->checkpoint_count++] = s->at;
+        }
+        if(!NextLine(&at, end, line, sizeof(line)))
+            break;
+        s->at.line_no++;
+        char *p = line;
+        while(*p && isspace(*p))
+            p++;
+        if(*p == '#' || *p == '\0')
+            continue;
+        if(strncmp(p, ".data", 5) == 0 || strncmp(p, ".code",5) == 0) {
+            s->at.in_data = (p[1] == 'd');
+            continue;
+        }
+        if(s->at.in_data) {
+            if(strchr(p, ':'))
+                CollectDataSymbol(p, &s->module);
+            continue;
+        }
+        char *colon = strchr(p, ':');
+        if(colon) {
+            if(label_count < MAX_LABELS) {
+                int len = colon - p < MAX_NAME_LEN - 1 ? (int)(colon - p) : MAX_NAME_LEN - 1;
+                strncpy(labels[label_count].name, p, len);
+                labels[label_count].name[len] = '\0';
+                labels[label_count++].index = s->at.pc;
+            }
+            p = colon + 1;
+            while(*p && isspace(*p))
+                p++;
+            if(*p == '\0')
+                continue; // label on its own line
+        }
+        s->at.pc++;
+    }
+}
+
+// split the text into chunk_count chunks of about the same size, at checkpoints (the last
+// ones empty if there are too few)
+static void SplitChunks(const MachineStream *s, Chunk *chunks, int chunk_count) {
+    const char *end = s->text + s->length;
+    int next = 0;
+    for(int c = 0; c < chunk_count; c++) {
+        size_t target = s->length * c / chunk_count;
+        while(next < s->checkpoint_count && s->checkpoints[next].offset < target)
+            next++;
+        const LinePosition *from = next < s->checkpoint_count ? &s->checkpoints[next] : &s->at;
+        chunks[c].start = s->text + from->offset;
+        chunks[c].pc = from->pc;
+        chunks[c].line_no = from->line_no;
+        chunks[c].in_data = from->in_data;
+    }
+    for(int c = 0; c < chunk_count; c++)
+        chunks[c].end = c + 1 < chunk_count ? chunks[c + 1].start : end;
+}
+
+// one .mc line: the word in binary (groups of 4 bits, each followed by a space), " : ", then hex
+static char *FormatWord(char *p, uint64_t word, int bits) {
+    static const char hex[] = "0123456789ABCDEF";
+    for(int i = bits - 4; i >= 0; i -= 4) {
+        for(int b = i + 3; b >= i; b--)
+            *p++ = (word >> b) & 1 ? '1' : '0';
+        *p++ = ' ';
+    }
+    *p++ = ' ';
+    *p++ = ':';
+    *p++ = ' ';
+    for(int i = bits - 4; i >= 0; i -= 4)
+        *p++ = hex[(word >> i) & 15];
+    *p++ = '\n';
+    return p;
+}
+
+
+// ================= workers =========================
+
+void MachineSetThreads(int threads) {
+    threads_wanted = threads;
+}
+
+// chunks for work bytes: one per thread, but none smaller than min_bytes
+static int ChunkCount(size_t work, size_t min_bytes) {
+    long threads = threads_wanted;
+#ifdef MACHINE_THREADS
+    if(threads <= 0)
+        threads = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    if(threads < 1)
+        threads = 1;
+    if(threads > MAX_CHUNKS)
+        threads = MAX_CHUNKS;
+    size_t fit = work / min_bytes;
+    return fit < 1 ? 1 : fit < (size_t)threads ? (int)fit : (int)threads;
+}
+
+// work on every item: item 0 on the calling thread, each other one on its own thread
+// (on the calling thread too if it can't be started, or without pthreads)
+static void RunChunks(void *items, int count, size_t size, void *(*work)(void *)) {
+#ifdef MACHINE_THREADS
+    pthread_t workers[MAX_CHUNKS];
+    int started[MAX_CHUNKS] = {0};
+    for(int i = 1; i < count; i++)
+        started[i] = pthread_create(&workers[i], NULL, work, (char *)items + i * size) == 0;
+    work(items);
+    for(int i = 1; i < count; i++) {
+        if(started[i])
+            pthread_join(workers[i], NULL);
+        else
+            work((char *)items + i * size);
+    }
+#else
+    for(int i = 0; i < count; i++)
+        work((char *)items + i * size);
+#endif
+}
+
+// a run of words and the .mc text they format to
+typedef struct {
+    const uint64_t *words;
+    int count, bits;
+    char *text;
+    size_t length;
+} TextChunk;
+
+static void *FormatChunk(void *arg) {
+    TextChunk *t = arg;
+    char *p = t->text = xrealloc(NULL, (size_t)t->count * (t->bits / 4 * 6 + 4) + 1);
+    for(int k = 0; k < t->count; k++)
+        p = FormatWord(p, t->words[k], t->bits);
+    t->length = p - t->text;
+    return NULL;
+}
+
+// format words in chunks on the workers, written in order: the same text as one by one
+static void WriteWords(FILE *out, const uint64_t *words, int count, int bits) {
+    TextChunk chunks[MAX_CHUNKS];
+    int line = bits / 4 * 6 + 4;
+    int chunk_count = ChunkCount((size_t)count * line, CHUNK_MIN_BYTES);
+    for(int c = 0; c < chunk_count; c++) {
+        int first = (int)((long long)count * c / chunk_count), last = (int)((long long)count * (c + 1) / chunk_count);
+        chunks[c].words = words + first;
+        chunks[c].count = last - first;
+        chunks[c].bits = bits;
+    }
+    RunChunks(chunks, chunk_count, sizeof(TextChunk), FormatChunk);
+    for(int c = 0; c < chunk_count; c++) {
+        fwrite(chunks[c].text, 1, chunks[c].length, out);
+        free(chunks[c].text);
+    }
+}
+
+
+// ================= module =========================
+
+static void *Grow(void *p, int *capacity, int count, size_t size) {
+    if(count < *capacity)
+        return p;
+    int new_capacity = *capacity ? *capacity * 2 : 64;
+    *capacity = new_capacity;
+    return xrealloc(p, new_capacity * size);
+}
+
+void MachineAddWord(MachineModule *module, uint32_t code, int valid) {
+    int capacity = module->code_capacity;
+    module->code = Grow(module->code, &module->code_capacity, module->code_count, sizeof(uint32_t));
+    module->valid = Grow(module->valid, &capacity, module->code_count, 1);
+    module->code[module->code_count] = code;
+    module->valid[module->code_count++] = (unsigned char)valid;
+}
+
+int MachineAddSymbol(MachineModule *module, const DataSymbol *symbol) {
+    module->data = Grow(module->data, &module->data_capacity, module->data_count, sizeof(DataSymbol));
+    DataSymbol *sym = &module->data[module->data_count];
+    *sym = *symbol;
+    if(symbol->image) {
+        sym->image = xrealloc(NULL, (symbol->bytes + 7) / 8 * sizeof(uint64_t));
+        memcpy(sym->image, symbol->image, (symbol->bytes + 7) / 8 * sizeof(uint64_t));
+    }
+    return module->data_count++;
+}
+
+void MachineAddRelocation(MachineModule *module, int index, RelocKind kind, int symbol) {
+    module->relocs = Grow(module->relocs, &module->reloc_capacity, module->reloc_count, sizeof(Relocation));
+    Relocation r = { index, kind, symbol };
+    module->relocs[module->reloc_count++] = r;
+}
+
+long long MachineDataLayout(const MachineModule *module, long long *offset) {
+    long long bytes = 0;
+    for(int i = 0; i < module->data_count; i++) {
+        const DataSymbol *sym = &module->data[i];
+        if(sym->binding != SYM_UNDEFINED) {
+            long long align = SymbolAlignment(sym->bytes);
+            bytes = (bytes + align - 1) / align * align;
+        }
+        offset[i] = bytes;
+        if(sym->binding != SYM_UNDEFINED)
+            bytes += sym->bytes;
+    }
+    return bytes;
+}
+
+int MachineFindSymbol(const MachineModule *module, const char *name) {
+    for(int i = 0; i < module->data_count; i++)
+        if(strcmp(module->data[i].name, name) == 0)
+            return i;
+    return -1;
+}
+
+// data symbol referenced by ld/sd, added as undefined if the listing doesn't reserve it
+static int ReferencedSymbol(MachineModule *module, const char *name) {
+    int i = MachineFindSymbol(module, name);
+    if(i >= 0)
+        return i;
+    DataSymbol sym;
+    memset(&sym, 0, sizeof(sym));
+    snprintf(sym.name, sizeof(sym.name), "%s", name);
+    sym.binding = SYM_UNDEFINED;
+    return MachineAddSymbol(module, &sym);
+}
+
+uint32_t MachinePatch(uint32_t code, RelocKind kind, long long value) {
+    if(kind == RELOC_DATA) {
+        if(((code >> 21) & 31) == GP_REGISTER)
+            value -= (long long)DATA_WINDOW(value) << 16;
+        return (code & 0xFFFF0000u) | ((uint16_t)(int16_t)value & 0xFFFF);
+    }
+    return (code & ~0x3FFFFFFu) | ((uint32_t)value & 0x3FFFFFF);
+}
+
+int MachineDataReach(uint32_t code, long long offset) {
+    int base = (code >> 21) & 31;
+    return base == GP_REGISTER ? offset >= 0 : base != 0 || (offset >= 0 && offset < DATA_WINDOW_REACH);
+}
+
+void MachineFreeModule(MachineModule *module) {
+    for(int i = 0; i < module->data_count; i++)
+        free(module->data[i].image);
+    free(module->code);
+    free(module->valid);
+    free(module->data);
+    free(module->relocs);
+    memset(module, 0, sizeof(*module));
+}
+
+void MachineWrite(const MachineModule *module, FILE *out) {
+    int count = 0;
+    uint64_t *words = xrealloc(NULL, (module->code_count + 1) * sizeof(uint64_t));
+    for(int k = 0; k < module->code_count; k++)
+        if(module->valid[k])
+            words[count++] = module->code[k];
+    WriteWords(out, words, count, 32);
+    free(words);
+
+    // initial data image: every symbol's bytes at its offset, little-endian in doublewords
+    long long *offset = xrealloc(NULL, (module->data_count + 1) * sizeof(long long));
+    count = (int)((MachineDataLayout(module, offset) + 7) / 8);
+    if(count > 0) {
+        fprintf(out, "# .data\n");
+        words = xrealloc(NULL, (size_t)count * sizeof(uint64_t));
+        memset(words, 0, (size_t)count * sizeof(uint64_t));
+        for(int i = 0; i < module->data_count; i++) {
+            const DataSymbol *sym = &module->data[i];
+            if(sym->binding == SYM_UNDEFINED)
+                continue;
+            if(offset[i] % 8 == 0) {
+                // a doubleword, or more: whole doublewords
+                for(int k = 0; k < (sym->bytes + 7) / 8; k++)
+                    words[offset[i] / 8 + k] = sym->image ? sym->image[k] : k == 0 ? sym->value : 0;
+            } else
+                words[offset[i] / 8] |= sym->value << (8 * (offset[i] % 8));
+        }
+        WriteWords(out, words, count, 64);
+        free(words);
+    }
+    free(offset);
+}
+
+
+// ================= assembling =========================
+
+// data symbol of an ld/sd for a worker: the listing's own, or -1 and left pending
+static int ChunkSymbol(Chunk *c, const char *name) {
+    int i = *IndexSlot(&symbol_index, name);
+    if(i >= 0)
+        return i;
+    c->pending = Grow(c->pending, &c->pending_capacity, c->pending_count, sizeof(PendingSymbol));
+    c->pending[c->pending_count].reloc = c->part.reloc_count;
+    strcpy(c->pending[c->pending_count++].name, name);
+    return -1;
+}
+
+static void ChunkReport(Chunk *c, int line_no, int error, const char *message) {
+    c->warnings = Grow(c->warnings, &c->warning_capacity, c->warning_count, sizeof(ChunkWarning));
+    c->warnings[c->warning_count].line_no = line_no;
+    c->warnings[c->warning_count].error = error;
+    c->warnings[c->warning_count++].message = strcpy(xrealloc(NULL, strlen(message) + 1), message);
+}
+
+// MAIN TRANSLATION SECTION
+// convert assembly to machine code, one word per instruction line
+// each instrcution line is converted into a bits of integer code; ld/sd offsets and j targets
+// are left for the caller (relocations), so the listing can be encoded on its own
+// one chunk of lines, on a worker: only reads the labels and the symbol index
+static void *EncodeChunk(void *arg) {
+    Chunk *c = arg;
+    const char *at = c->start;
+    int in_data = c->in_data;
+    int pc = c->pc; // index of the instruction being encoded (branch offsets are relative to it)
 
     char line[MAX_SYMBOLS];
-    while(fgets(line, sizeof(line), in)) {
-        line[strcspn(line, "\r\n")] = '\0'; // remove newline
+    int line_no = c->line_no; // for warnings
+    while(NextLine(&at, c->end, line, sizeof(line))) {
+        line_no++;
         char *p = line;
         while(*p && isspace(*p)) 
             p++;
@@ -71,9 +645,18 @@ int MachineFromAssembly(const char *asm_file, const char *out_file) {
 
         ////
         // skip assembler directives and labels
-        if(strncmp(p, ".data", 5) == 0 || strncmp(p, ".code",5) == 0)
+        if(strncmp(p, ".data", 5) == 0 || strncmp(p, ".code",5) == 0) {
+            in_data = (p[1] == 'd');
             continue;
-        if(strchr(p, ':'))   // labels like a: .space 8
+        }
+        if(strchr(p, ':') && !in_data) {  // code labels like _loop0: (already collected)
+            p = strchr(p, ':') + 1;
+            while(*p && isspace(*p))
+                p++;
+            if(*p == '\0')
+                continue;
+        }
+        else if(strchr(p, ':'))  // labels like a: .space 8 or a: .word64 5 (already collected)
             continue;
         ////
 
@@ -82,24 +665,61 @@ int MachineFromAssembly(const char *asm_file, const char *out_file) {
         // 3 regs since most MIPS64 instruction formats have at most 3 registers
         // regB is MAX_NAME_LEN (64) bc it may hold memory operands like "result(r0)" or variable names, w/c can be long
         // regA and regC are size 8 since the longest reg name is of length 3 (r10 - r31) + \0, and extra padding for safety
-        int imm;
+        long long imm;
         uint32_t code = 0;
         int matched = 0; // flag for valid instruction
+        int out_of_range = 0; // parsed, but an immediate or offset doesn't fit its 16 bits
+
+        // the target's SPECIAL instructions (multiply/divide, mflo/mfhi, movz/movn, jr)
+        char mnemonic[8] = "";
+        sscanf(p, "%7s", mnemonic);
+        const TargetInstruction *special = TargetFind(mnemonic);
+        int memory_opcode = MemoryOpcode(mnemonic);
+        if(special)
+            matched = EncodeSpecial(special, p + strlen(mnemonic), &code);
 
         // daddiu
         // %7[^,] means read up to 7 characters and stop at the comma
         // #%i reads an int following a #
         // sscanf(...) == 3 means all 3 fields were parsed successfully
-        if(sscanf(line, "daddiu %7[^,], %7[^,], #%i", regA, regB, &imm) == 3) {
+        else if(sscanf(p, "daddiu %7[^,], %7[^,], #%lli", regA, regB, &imm) == 3) {
             int rt = RegisterNumber(regA);
             int rs = RegisterNumber(regB); // convert rt and rs strings to reg numbers
             if(rt >= 0 && rs >= 0) { 
-                code = Encode_I_Type(OP_DADDIU, rs, rt, imm); 
-                matched = 1; 
+                matched = Encode_I_Type(OP_DADDIU, rs, rt, imm, &code);
+                out_of_range = !matched;
+            }
+        }
+        // ori (the low bits of a constant wider than daddiu's immediate, after lui)
+        else if(sscanf(p, "ori %7[^,], %7[^,], #%lli", regA, regB, &imm) == 3) {
+            int rt = RegisterNumber(regA);
+            int rs = RegisterNumber(regB);
+            if(rt >= 0 && rs >= 0) {
+                matched = Encode_I_Type(OP_ORI, rs, rt, imm, &code);
+                out_of_range = !matched;
+            }
+        }
+        // dsll (a constant wider than 32 bits, 16 bits at a time)
+        else if(sscanf(p, "dsll %7[^,], %7[^,], #%lli", regA, regB, &imm) == 3) {
+            int rd = RegisterNumber(regA);
+            int rt = RegisterNumber(regB);
+            if(rd >= 0 && rt >= 0 && imm >= 0 && imm < 32) {
+                code = Encode_R_Type(0, rt, rd, (uint8_t)imm, FUNCT_DSLL);
+                matched = 1;
+            }
+        }
+        // daddiu with a .data symbol: its address (offset: relocation, like ld/sd)
+        else if(sscanf(p, "daddiu %7[^,], %7[^,], %63s", regA, regC, regB) == 3 && regB[0] != '#') {
+            int rt = RegisterNumber(regA);
+            int rs = RegisterNumber(regC);
+            if(rt >= 0 && rs >= 0 && rs < 32) {
+                Encode_I_Type(OP_DADDIU, rs, rt, 0, &code);
+                MachineAddRelocation(&c->part, pc, RELOC_DATA, ChunkSymbol(c, regB));
+                matched = 1;
             }
         }
         // daddu
-        else if(sscanf(line, "daddu %7[^,], %7[^,], %7s", regA, regB, regC) == 3) {
+        else if(sscanf(p, "daddu %7[^,], %7[^,], %7s", regA, regB, regC) == 3) {
             int rd = RegisterNumber(regA);
             int rs = RegisterNumber(regB);
             int rt = RegisterNumber(regC);
@@ -109,7 +729,7 @@ int MachineFromAssembly(const char *asm_file, const char *out_file) {
             }
         }
         // dsubu
-        else if(sscanf(line, "dsubu %7[^,], %7[^,], %7s", regA, regB, regC) == 3) {
+        else if(sscanf(p, "dsubu %7[^,], %7[^,], %7s", regA, regB, regC) == 3) {
             int rd = RegisterNumber(regA);
             int rs = RegisterNumber(regB);
             int rt = RegisterNumber(regC);
@@ -118,76 +738,228 @@ int MachineFromAssembly(const char *asm_file, const char *out_file) {
                 matched = 1;
             }
         }
-        // dmult
-        else if(sscanf(line, "dmult %7[^,], %7s", regA, regB) == 2) {
-            int rs = RegisterNumber(regA);
-            int rt = RegisterNumber(regB);
-            if(rs >= 0 && rt >= 0) {
-                code = Encode_R_Type(rs, rt, 0, 0, FUNCT_DMULT + 4); // + 4 bc 0x1C - 0x18 = 0x04 (this outputs ...18 while in the simlator it is ...1C); same for ddiv
-                matched = 1; 
+        // sltu (before slt, whose pattern would take "sltu" too)
+        else if(sscanf(p, "sltu %7[^,], %7[^,], %7s", regA, regB, regC) == 3) {
+            int rd = RegisterNumber(regA);
+            int rs = RegisterNumber(regB);
+            int rt = RegisterNumber(regC);
+            if(rd >= 0 && rs >= 0 && rt >= 0) {
+                code = Encode_R_Type(rs, rt, rd, 0, FUNCT_SLTU);
+                matched = 1;
             }
         }
-        // ddiv
-        else if(sscanf(line, "ddiv %7[^,], %7s", regA, regB) == 2) {
+        // slt
+        else if(sscanf(p, "slt %7[^,], %7[^,], %7s", regA, regB, regC) == 3) {
+            int rd = RegisterNumber(regA);
+            int rs = RegisterNumber(regB);
+            int rt = RegisterNumber(regC);
+            if(rd >= 0 && rs >= 0 && rt >= 0) { 
+                code = Encode_R_Type(rs, rt, rd, 0, FUNCT_SLT);
+                matched = 1;
+            }
+        }
+        // beq/bne: offset counts instructions from the one after the branch
+        else if(sscanf(p, "beq %7[^,], %7[^,], %63s", regA, regC, regB) == 3 ||
+                sscanf(p, "bne %7[^,], %7[^,], %63s", regA, regC, regB) == 3) {
             int rs = RegisterNumber(regA);
-            int rt = RegisterNumber(regB);
-            if(rs >= 0 && rt >= 0) { 
-                code = Encode_R_Type(rs, rt, 0, 0, FUNCT_DDIV + 4);  
-                matched = 1; 
+            int rt = RegisterNumber(regC);
+            int target = LabelIndex(regB);
+            if(rs >= 0 && rt >= 0 && target >= 0) {
+                matched = Encode_I_Type(p[1] == 'e' ? OP_BEQ : OP_BNE, rs, rt, target - (pc + 1), &code);
+                out_of_range = !matched;
             }
         }
-        // mflo
-        else if(sscanf(line, "mflo %7s", regA) == 1) {
-            int rd = RegisterNumber(regA);
-            if(rd >= 0) {
-                code = Encode_R_Type(0, 0, rd, 0, FUNCT_MFLO);
+        // jal: function call (before j, whose pattern would take it too)
+        else if(sscanf(p, "jal %63s", regB) == 1) {
+            int target = LabelIndex(regB);
+            if(target >= 0) {
+                code = Encode_J_Type(OP_JAL, target);
+                MachineAddRelocation(&c->part, pc, RELOC_JUMP, -1);
                 matched = 1;
             }
         }
-        // mfhi
-        else if(sscanf(line, "mfhi %7s", regA) == 1) {
-            int rd = RegisterNumber(regA);
-            if(rd >= 0 ){ 
-                code = Encode_R_Type(0, 0, rd, 0, FUNCT_MFHI); 
-                matched = 1; 
+        // j
+        else if(sscanf(p, "j %63s", regB) == 1) {
+            int target = LabelIndex(regB);
+            if(target >= 0) {
+                code = Encode_J_Type(OP_J, target); // module-relative, base added when linked
+                MachineAddRelocation(&c->part, pc, RELOC_JUMP, -1);
+                matched = 1;
             }
         }
-        // ld (load doubleword)
-        else if(sscanf(line, "ld %7[^,], %7[^)]", regA, regB) == 2) {
+        // lui (the global pointer's data window, the high bits of a wide constant)
+        else if(sscanf(p, "lui %7[^,], #%lli", regA, &imm) == 2) {
             int rt = RegisterNumber(regA);
-            int rs = 0;
-            int16_t imm = 0;
-            char var_name[MAX_NAME_LEN] = {0};
-            sscanf(regB, "%63[^ (]", var_name);
-            imm = (int16_t)GetOffsetOfTheSymbol(var_name);
             if(rt >= 0) {
-                code = Encode_I_Type(OP_LD, rs, rt, imm);
+                matched = Encode_I_Type(OP_LUI, 0, rt, imm, &code);
+                out_of_range = !matched;
+            }
+        }
+        // syscall (5: printf, eduMIPS64)
+        else if(sscanf(p, "syscall %lli", &imm) == 1) {
+            if(imm >= 0 && imm < (1 << 20)) {
+                code = Encode_R_Type(0, 0, 0, 0, FUNCT_SYSCALL) | ((uint32_t)imm << 6);
                 matched = 1;
             }
         }
-        // sd (store doubleword)
-        else if(sscanf(line, "sd %7[^,], %7[^)]", regA, regB) == 2) {
+        // loads and stores (ld/sd, and lb/lh/lw/sb/sh/sw of the narrow variables)
+        else if(memory_opcode >= 0 && sscanf(p, "%*s %7[^,], %63[^)]", regA, regB) == 2) {
             int rt = RegisterNumber(regA);
-            int rs = 0;
-            int16_t imm = 0;
-            char var_name[MAX_NAME_LEN] = {0};
-            sscanf(regB, "%63[^ (]", var_name);
-            imm = (int16_t)GetOffsetOfTheSymbol(var_name);
-            if(rt >= 0) {
-                code = Encode_I_Type(OP_SD, rs, rt, imm);
-                matched = 1;
+            int rs = 0; // base register: r0, or the global pointer for data past the first 32 KB
+            long long offset = 0;
+            char var_name[MAX_NAME_LEN] = {0}, base[8];
+            if(sscanf(regB, "%63[^ (] ( %7[^) ]", var_name, base) == 2)
+                rs = RegisterNumber(base);
+            int numeric = IsNumericOffset(var_name); // a stack slot: "16(r29)"
+            if(numeric)
+                offset = strtoll(var_name, NULL, 0);
+            if(rt >= 0 && rs >= 0 && rs < 32) {
+                matched = Encode_I_Type(memory_opcode, rs, rt, offset, &code); // offset: relocation, unless numeric
+                out_of_range = !matched;
+                if(matched && !numeric)
+                    MachineAddRelocation(&c->part, pc, RELOC_DATA, ChunkSymbol(c, var_name));
             }
         }
 
-        if(matched) {
-            PrintBinary(code, out);
-            fprintf(out," : %08X\n", code); // hex representation
-        } else {
-            fprintf(stderr,"Warning: could not parse line: %s\n", line);
+        if(!matched) {
+            char message[MAX_SYMBOLS + 64];
+            if(out_of_range)
+                snprintf(message, sizeof(message), "immediate or offset out of range (16 bits): %s", p);
+            else if(!special && TargetKnows(mnemonic))
+                snprintf(message, sizeof(message), "%s is not available on target %s", mnemonic, TargetName());
+            else
+                snprintf(message, sizeof(message), "could not parse line: %s", line);
+            ChunkReport(c, line_no, out_of_range, message);
         }
+        MachineAddWord(&c->part, code, matched);
+        pc++;
     }
+    return NULL;
+}
 
+// read the whole listing; NULL if it can't be read
+static char *ReadListing(const char *asm_file, size_t *size) {
+    FILE *in = fopen(asm_file, "rb");
+    if(!in)
+        return NULL;
+    int capacity = 0;
+    char *text = NULL;
+    size_t length = 0, got;
+    do {
+        text = Grow(text, &capacity, (int)(length / CHUNK_MIN_BYTES), CHUNK_MIN_BYTES);
+        got = fread(text + length, 1, (size_t)capacity * CHUNK_MIN_BYTES - length, in);
+        length += got;
+    } while(got > 0);
     fclose(in);
+    *size = length;
+    return text;
+}
+
+MachineStream *MachineStreamOpen(void) {
+    MachineStream *s = xrealloc(NULL, sizeof(MachineStream));
+    memset(s, 0, sizeof(*s));
+    label_count = 0;
+    return s;
+}
+
+void MachineStreamWrite(MachineStream *s, const char *text, size_t length) {
+    if(s->length + length > s->size) {
+        size_t size = s->size ? s->size : CHUNK_MIN_BYTES;
+        while(size < s->length + length)
+            size *= 2;
+        s->text = xrealloc(s->text, size);
+        s->size = size;
+    }
+    memcpy(s->text + s->length, text, length);
+    s->length += length;
+    CollectLabels(s, 0);
+}
+
+// the chunks are encoded on the workers, then merged in listing order: the module (code,
+// relocations, symbols the listing only references, warnings) is the same as line by line
+void MachineStreamFinish(MachineStream *s, const char *asm_file, MachineModule *module) {
+    CollectLabels(s, 1);
+    *module = s->module;
+
+    Chunk chunks[MAX_CHUNKS];
+    int chunk_count = ChunkCount(s->length, CHUNK_MIN_BYTES);
+    memset(chunks, 0, sizeof(chunks));
+    SplitChunks(s, chunks, chunk_count);
+    IndexBuild(&label_index, labels, sizeof(labels[0]), label_count);
+    IndexBuild(&symbol_index, module->data, sizeof(DataSymbol), module->data_count);
+    RunChunks(chunks, chunk_count, sizeof(Chunk), EncodeChunk);
+
+    for(int i = 0; i < chunk_count; i++) {
+        Chunk *c = &chunks[i];
+        int first_reloc = module->reloc_count;
+        for(int k = 0; k < c->part.code_count; k++)
+            MachineAddWord(module, c->part.code[k], c->part.valid[k]);
+        for(int r = 0; r < c->part.reloc_count; r++)
+            MachineAddRelocation(module, c->part.relocs[r].index, c->part.relocs[r].kind, c->part.relocs[r].symbol);
+        for(int k = 0; k < c->pending_count; k++)
+            module->relocs[first_reloc + c->pending[k].reloc].symbol = ReferencedSymbol(module, c->pending[k].name);
+        for(int w = 0; w < c->warning_count; w++) {
+            DiagReport(c->warnings[w].error ? DIAG_ERROR : DIAG_WARNING, ERR_SYNTAX, asm_file, c->warnings[w].line_no, 1,
+                       c->warnings[w].message);
+            free(c->warnings[w].message);
+        }
+        MachineFreeModule(&c->part);
+        free(c->pending);
+        free(c->warnings);
+    }
+    IndexFree(&label_index);
+    IndexFree(&symbol_index);
+    free(s->text);
+    free(s->checkpoints);
+    free(s);
+}
+
+int MachineAssemble(const char *asm_file, MachineModule *module) {
+    memset(module, 0, sizeof(*module));
+    size_t size;
+    char *text = ReadListing(asm_file, &size);
+    if(!text)
+        return 0;
+    MachineStream *s = MachineStreamOpen();
+    s->text = text;
+    s->length = s->size = size;
+    MachineStreamFinish(s, asm_file, module);
+    return 1;
+}
+
+// single listing: .data offsets as the symbol table gave them to the code generator, code at 0
+int MachineFromAssembly(const char *asm_file, const char *out_file) {
+    MachineModule module;
+    if(!MachineAssemble(asm_file, &module))
+        return 0;
+    return MachineFromModule(&module, asm_file, out_file);
+}
+
+int MachineFromModule(MachineModule *module, const char *asm_file, const char *out_file) {
+    FILE *out = fopen(out_file, "w");
+    if(!out) { 
+        MachineFreeModule(module);
+        return 0; 
+    }
+    // an offset the instruction can't reach is reported, never wrapped into another variable
+    char *reported = calloc(module->data_count + 1, 1);
+    for(int r = 0; r < module->reloc_count; r++) {
+        Relocation *rel = &module->relocs[r];
+        if(rel->kind != RELOC_DATA)
+            continue;
+        int64_t offset = (int64_t)GetOffsetOfTheSymbol(module->data[rel->symbol].name);
+        module->code[rel->index] = MachinePatch(module->code[rel->index], RELOC_DATA, offset);
+        if(!MachineDataReach(module->code[rel->index], offset) && reported && !reported[rel->symbol]) {
+            char message[MAX_NAME_LEN + 96];
+            snprintf(message, sizeof(message), "'%s' is at .data offset 0x%llX, out of reach of ld/sd from r0 (use the global pointer r%d)",
+                     module->data[rel->symbol].name, (long long)offset, GP_REGISTER);
+            DiagReport(DIAG_ERROR, ERR_SYNTAX, asm_file, 0, 0, message);
+            reported[rel->symbol] = 1;
+        }
+    }
+    free(reported);
+    MachineWrite(module, out);
+    MachineFreeModule(module);
     fclose(out);
     return 1;
 }
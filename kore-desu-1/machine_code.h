@@ -2,12 +2,102 @@
 #define MACHINE_CODE_H
 
 #include <stdio.h>
+#include <stdint.h>
+#include "symbol_table.h"
+
+// .data addressing: ld/sd take a 16-bit signed displacement from their base register
+//  r0:  the first DATA_WINDOW_REACH bytes
+//  r28 (global pointer, set by "lui r28, #w"): window w, the 64 KB around w << 16; the listing
+//       still names the variable, the assembler subtracts the window's base from its offset
+#define GP_REGISTER 28
+#define DATA_WINDOW_REACH 0x8000
+#define DATA_WINDOW(offset) ((int)(((offset) + DATA_WINDOW_REACH) >> 16))
+
+// a .data symbol of an assembled listing
+//  SYM_COMMON:    .space, zero-filled (the same name in another module is the same variable)
+//  SYM_DEFINED:   .word64/.word (.word32, .word16, .byte: a narrow variable) with an initial value
+//  SYM_LOCAL:     compiler-generated slot (_spillN) or a string (.asciiz), never shared with other modules
+//  SYM_UNDEFINED: only referenced by ld/sd, another module has to provide it
+typedef enum { SYM_COMMON, SYM_DEFINED, SYM_LOCAL, SYM_UNDEFINED } SymbolBinding;
+
+typedef struct {
+    char name[MAX_NAME_LEN];
+    SymbolBinding binding;
+    int bytes;          // reserved (0 if undefined), at a multiple of SymbolAlignment(bytes)
+    uint64_t value;     // first doubleword (of a narrow symbol: its low bytes), the others are zero
+    uint64_t *image;    // .asciiz: every doubleword (the module owns a copy), else NULL
+} DataSymbol;
+
+// a field still to be patched once the final layout is known
+//  RELOC_DATA: 16-bit offset of a load/store (or immediate of daddiu, an address) <- byte offset of data[symbol]
+//  RELOC_JUMP: 26-bit target of j, relative to the module's first instruction <- + code base
+typedef enum { RELOC_DATA, RELOC_JUMP } RelocKind;
+
+typedef struct {
+    int index;          // instruction
+    RelocKind kind;
+    int symbol;         // RELOC_DATA: index into data
+} Relocation;
+
+// one assembled listing: code words, .data symbol table (listing order) and relocations
+typedef struct {
+    uint32_t *code;
+    unsigned char *valid;   // 0: the line could not be encoded (warned, not written)
+    int code_count, code_capacity;
+    DataSymbol *data;
+    int data_count, data_capacity;
+    Relocation *relocs;
+    int reloc_count, reloc_capacity;
+} MachineModule;
 
 // convert assembly (simple textual asm) to mock machine-code textual file
 // asm_file: input assembly file path
 // out_file: output machine code (textual) path
+// .data offsets come from the symbol table filled by the code generator
 int MachineFromAssembly(const char *asm_file, const char *out_file);
 
-#endif
+// encode a listing with the ld/sd offsets and j targets left open (see Relocation)
+// returns 0 if the file can't be read
+int MachineAssemble(const char *asm_file, MachineModule *module);
+
+// the same for a listing handed over in pieces while it is generated: the first pass (labels,
+// .data symbols) runs over the whole lines of each piece as it arrives, the encoding at the
+// end; asm_file only names the listing in warnings. one stream at a time
+typedef struct MachineStream MachineStream;
+MachineStream *MachineStreamOpen(void);
+void MachineStreamWrite(MachineStream *stream, const char *text, size_t length);
+void MachineStreamFinish(MachineStream *stream, const char *asm_file, MachineModule *module);
+
+// MachineFromAssembly for a module already assembled from asm_file (freed)
+int MachineFromModule(MachineModule *module, const char *asm_file, const char *out_file);
 
+// worker threads for encoding and for formatting the .mc (0, the default: one per online
+// processor; 1: everything on the calling thread). the output doesn't depend on it
+void MachineSetThreads(int threads);
 
+// .data layout of the symbols in order, each aligned for its size (undefined ones take no
+// room): offset[i] for symbol i, returns the bytes of the image
+long long MachineDataLayout(const MachineModule *module, long long *offset);
+
+// index of a data symbol, -1 if the module has none of that name
+int MachineFindSymbol(const MachineModule *module, const char *name);
+
+// append a symbol / relocation / instruction (for the object reader and the linker);
+// a symbol's image is copied
+int MachineAddSymbol(MachineModule *module, const DataSymbol *symbol);
+void MachineAddRelocation(MachineModule *module, int index, RelocKind kind, int symbol);
+void MachineAddWord(MachineModule *module, uint32_t code, int valid);
+
+// patch a relocated field: ld/sd offset (from r0, or within its window from the global
+// pointer) or j target
+uint32_t MachinePatch(uint32_t code, RelocKind kind, long long value);
+
+// 1 if an ld/sd reaches a .data offset from its base register (r0: the first 32 KB)
+int MachineDataReach(uint32_t code, long long offset);
+
+// the .mc text: every valid code word, then the initial data image under "# .data"
+void MachineWrite(const MachineModule *module, FILE *out);
+
+void MachineFreeModule(MachineModule *module);
+
+#endif
@@ -7,96 +7,515 @@
 #include "assembly.h" // assembly code generation from parsed statements
 #include "symbol_table.h" // variable2register mapping management
 #include "machine_code.h"  // conversion of assembly to machine code
+#include "p0_parser.h" // table-driven LALR(1) front end for p.0 programs
+#include "source.h" // memory-mapped input, lines as views
+#include "ssa.h" // three-address SSA IR between statements and instruction selection
+#include "opt.h" // pass manager: -O levels, -f<pass>/-fno-<pass>
+#include "jit.h" // x86-64 back end: --run executes the program natively
+#include "link.h" // relocatable objects (-c) and the link step (--link)
+#include "profile.h" // --profile: per-line execution counters, side map, hot-spot report
+#include "target.h" // --target: the MIPS64 revision instructions are selected and encoded for
+#include "pipeline.h" // stage threads and the bounded queues between them
 
-int main(void) {
-    // 1) OPEN SOURCE FILE
-    FILE *f = fopen("INPUT.txt", "r"); 
-    if(!f) {
-        printf("Unable to access the input text file\n");
+#define MAX_STATEMENTS 32768
+#define MAX_OBJECTS 256
+#define MAX_PATH_LEN 1024
+#define PROFILE_MAP "PROFILE_MAP.txt"
+#define LINE_QUEUE 16             // batches of validated lines waiting for the parser
+#define LINE_BATCH 256
+#define LISTING_QUEUE 16          // listing blocks waiting for the encoder
+#define LISTING_BLOCK (64 * 1024)
+
+// p.0 programs (see CFG.txt) open with ">>>"; anything else is the C subset
+static int StartsWithProgramOpen(const SourceFile *src) {
+    size_t i = 0;
+    while(i < src->size && (src->data[i] == ' ' || src->data[i] == '\t' || src->data[i] == '\r' || src->data[i] == '\n'))
+        i++;
+    return src->size - i >= 3 && strncmp(src->data + i, ">>>", 3) == 0;
+}
+
+// 1-based column of info inside the line (e.g. the undeclared name), else of the line's first character
+static int ErrorColumn(SourceSpan raw, SourceSpan line, const char *info) {
+    int n = (int)strlen(info);
+    for(int i = 0; n > 0 && i + n <= line.len; i++)
+        if(strncmp(line.text + i, info, n) == 0)
+            return (int)(line.text + i - raw.text) + 1;
+    return (int)(line.text - raw.text) + 1;
+}
+
+// --run: the same SSA program as native x86-64 code, executed here (with the output of its print
+// statements); prints every variable's final value
+// (profiling: the line counters go into the hot-spot report of map_file instead)
+static void RunNative(const SsaProgram *prog, const char *map_file) {
+    JitCode code;
+    if(!JitCompile(prog, &code)) {
+        DiagReport(DIAG_WARNING, ERR_NONE, NULL, 0, 0, JitAvailable() ? "--run: unable to map executable memory"
+                                                                     : "--run: native execution needs an x86-64 host");
+        return;
+    }
+    long long *data = calloc(code.var_count + 1, sizeof(long long));
+    if(!data) {
+        JitFree(&code);
+        return;
+    }
+    DiagText("****** RUN (x86-64, %zu bytes of code) ******\n", code.size);
+    JitStatus status = JitRun(&code, data); // print statements write while it runs
+    int words = 0;
+    for(int s = 0; s < code.var_count; s++) {
+        if(NameOf(code.names[s])[0] != '_')
+            DiagValue(NameOf(code.names[s]), data[s]);
+        else if((int)GetOffsetOfTheSymbol(NameOf(code.names[s])) / 8 + 1 > words)
+            words = (int)GetOffsetOfTheSymbol(NameOf(code.names[s])) / 8 + 1;
+    }
+    DiagText("\n");
+    // the counters at their .data offsets, like a memory image of the MIPS program
+    long long *image = map_file ? calloc(words + 1, sizeof(long long)) : NULL;
+    for(int s = 0; image && s < code.var_count; s++)
+        if(NameOf(code.names[s])[0] == '_')
+            image[GetOffsetOfTheSymbol(NameOf(code.names[s])) / 8] = data[s];
+    if(image && !ProfileReport(map_file, image, words))
+        ReportError(ERR_IO, 0, map_file);
+    free(image);
+    if(status == JIT_DIVIDE_BY_ZERO)
+        DiagReport(DIAG_WARNING, ERR_NONE, NULL, 0, 0, "--run: division by zero, program stopped (values at that point)");
+    free(data);
+    JitFree(&code);
+}
+
+// ============================== pipeline ==============================
+// the parser runs on its own thread, a line behind the validator; the generated listing
+// streams through a pipe to a thread writing the listing file, which hands it on in blocks to
+// the encoder's first pass. the output is the same as with the stages one after another
+
+// lines go to the parser in batches (one wakeup per batch, not per line)
+typedef struct {
+    SourceSpan lines[LINE_BATCH];
+    int count;
+} LineBatch;
+
+// parser stage: statements of the lines it is given, count so far (read once it is stopped)
+typedef struct {
+    Channel *lines;
+    Stage *thread;
+    LineBatch batch;        // being filled by the validator
+    Statement *stmts;
+    int count;
+} ParserStage;
+
+static void *RunParser(void *arg) {
+    ParserStage *ps = arg;
+    LineBatch *batch = xrealloc(NULL, sizeof(LineBatch));
+    while(ChannelPop(ps->lines, batch))
+        for(int i = 0; i < batch->count; i++)
+            ps->count += ParseStatement(batch->lines[i].text, batch->lines[i].len, ps->stmts + ps->count, MAX_STATEMENTS - ps->count);
+    free(batch);
+    return NULL;
+}
+
+// hand a validated line to the parser stage
+static void ParseLater(ParserStage *ps, SourceSpan line) {
+    ps->batch.lines[ps->batch.count++] = line;
+    if(ps->batch.count == LINE_BATCH) {
+        ChannelPush(ps->lines, &ps->batch);
+        ps->batch.count = 0;
+    }
+}
+
+// threaded 0: the caller parses everything
+static void StartParser(ParserStage *ps, Statement *stmts, int threaded) {
+    memset(ps, 0, sizeof(*ps));
+    ps->stmts = stmts;
+    if(!threaded)
+        return;
+    ps->lines = ChannelOpen(LINE_QUEUE, sizeof(LineBatch));
+    if(ps->lines && !(ps->thread = StageStart(RunParser, ps))) {
+        ChannelFree(ps->lines);
+        ps->lines = NULL;
+    }
+}
+
+// wait until every line handed over is parsed; from then on the caller parses
+static void StopParser(ParserStage *ps) {
+    if(!ps->thread)
+        return;
+    if(ps->batch.count > 0)
+        ChannelPush(ps->lines, &ps->batch);
+    ChannelClose(ps->lines);
+    StageJoin(ps->thread);
+    ChannelFree(ps->lines);
+    ps->lines = NULL;
+    ps->thread = NULL;
+}
+
+// listing stages: blocks read from the generator's pipe go to the file, then to the encoder
+typedef struct {
+    char *text;
+    long length;
+} ListingBlock;
+
+typedef struct {
+    int from;               // read end of the pipe
+    FILE *file;             // the listing file
+    Channel *blocks;
+    Stage *writer, *encoder;
+    MachineStream *stream;
+} ListingStages;
+
+static void *RunListingWriter(void *arg) {
+    ListingStages *ls = arg;
+    for(;;) {
+        ListingBlock block;
+        block.text = xrealloc(NULL, LISTING_BLOCK);
+        block.length = PipeRead(ls->from, block.text, LISTING_BLOCK);
+        if(block.length == 0) {
+            free(block.text);
+            break;
+        }
+        fwrite(block.text, 1, block.length, ls->file);
+        ChannelPush(ls->blocks, &block);
+    }
+    ChannelClose(ls->blocks);
+    return NULL;
+}
+
+static void *RunEncoder(void *arg) {
+    ListingStages *ls = arg;
+    ListingBlock block;
+    ls->stream = MachineStreamOpen();
+    while(ChannelPop(ls->blocks, &block)) {
+        MachineStreamWrite(ls->stream, block.text, block.length);
+        free(block.text);
+    }
+    return NULL;
+}
+
+// the FILE the generator writes the listing to: a pipe into the stages, or the listing file
+// itself if they can't be started
+static FILE *StartListing(ListingStages *ls, FILE *file) {
+    memset(ls, 0, sizeof(*ls));
+    ls->file = file;
+    ls->blocks = ChannelOpen(LISTING_QUEUE, sizeof(ListingBlock));
+    FILE *pipe = ls->blocks ? PipeOpen(&ls->from) : NULL;
+    if(pipe && (ls->encoder = StageStart(RunEncoder, ls)) && (ls->writer = StageStart(RunListingWriter, ls)))
+        return pipe;
+    if(pipe) {
+        fclose(pipe);
+        PipeClose(ls->from);
+    }
+    if(ls->encoder) {
+        ChannelClose(ls->blocks);
+        StageJoin(ls->encoder);
+        ls->encoder = NULL;
+        MachineModule none;
+        MachineStreamFinish(ls->stream, "", &none); // nothing came through
+        MachineFreeModule(&none);
+    }
+    ChannelFree(ls->blocks);
+    ls->blocks = NULL;
+    ls->stream = NULL;
+    return file;
+}
+
+// the listing is complete (listing: what StartListing returned): the file is written and the
+// first pass is done; 0 if there were no stages (assemble the file then)
+static int StopListing(ListingStages *ls, FILE *listing) {
+    if(!ls->writer)
+        return 0;
+    fclose(listing);
+    StageJoin(ls->writer);
+    StageJoin(ls->encoder);
+    PipeClose(ls->from);
+    ChannelFree(ls->blocks);
+    return 1;
+}
+
+// path with its extension replaced: "dir/a.txt" -> "dir/a.obj"
+static void ReplaceExtension(const char *path, const char *ext, char *out, int size) {
+    const char *dot = strrchr(path, '.'), *slash = strrchr(path, '/');
+    int len = dot && (!slash || dot > slash) ? (int)(dot - path) : (int)strlen(path);
+    snprintf(out, size, "%.*s%s", len, path, ext);
+}
+
+static void Usage(const char *program) {
+    fprintf(stderr, "usage: %s [--quiet | --json] [-O0 | -O1 | -O2] [-f<pass> | -fno-<pass>] [--time-passes] [--dump-ir] [--run]\n"
+                    "          [--profile] [--target <isa>] [-c] [-o <file>] [-j <threads>] [<source> (default INPUT.txt)]\n"
+                    "       %s [--quiet | --json] --link [-o <file> (default MACHINE_CODE.mc)] [-j <threads>] <object>...\n"
+                    "       %s [--quiet | --json] --profile-report <memory image> [<map> (default " PROFILE_MAP ")]\n"
+                    "-c writes <source>.asm and the relocatable <source>.obj (or -o) instead of the machine code\n"
+                    "--profile counts executions per source line and writes the map " PROFILE_MAP " (-c: <source>.map)\n"
+                    "-j encodes the machine code on that many threads and runs the stages on their own (default: one per processor)\n"
+                    "targets (--target):\n", program, program, program);
+    TargetList(stderr);
+    fprintf(stderr, "passes (in pipeline order, with the level that turns them on):\n");
+    OptListPasses(stderr);
+}
+
+int main(int argc, char **argv) {
+    // 0) OUTPUT MODE: --quiet (errors + summary) or --json (JSON lines)
+    //    OPTIMIZATION: -O0 (default) .. -O2, single passes on/off, pass timing, IR listing
+    //    EXECUTION: --run (native x86-64, final variable values)
+    //    SEPARATE COMPILATION: -c (source -> object), --link (objects -> machine code), -o <file>
+    //    PROFILING: --profile (line counters + map), --profile-report <image> (counts -> hot spots)
+    //    ENCODING: -j <threads> (machine code encoded in chunks on a worker pool, stages pipelined)
+    //    TARGET: --target <isa> (edumips64 default, mips64r2, mips64r6)
+    DiagMode mode = DIAG_TEXT;
+    int time_passes = 0, dump_ir = 0, run = 0, compile_only = 0, link = 0, profile = 0;
+    const char *input = "INPUT.txt", *output = NULL, *image_file = NULL;
+    const char *objects[MAX_OBJECTS];
+    int object_count = 0, inputs = 0;
+    OptSetLevel(0);
+    for(int a = 1; a < argc; a++) {
+        if(strcmp(argv[a], "--quiet") == 0)
+            mode = DIAG_QUIET;
+        else if(strcmp(argv[a], "--json") == 0)
+            mode = DIAG_JSON;
+        else if(strncmp(argv[a], "-O", 2) == 0 && argv[a][2] >= '0' && argv[a][2] <= '0' + OPT_MAX_LEVEL && !argv[a][3])
+            OptSetLevel(argv[a][2] - '0');
+        else if(strcmp(argv[a], "--time-passes") == 0)
+            time_passes = 1;
+        else if(strcmp(argv[a], "--dump-ir") == 0)
+            dump_ir = 1;
+        else if(strcmp(argv[a], "--run") == 0)
+            run = 1;
+        else if(strcmp(argv[a], "-c") == 0)
+            compile_only = 1;
+        else if(strcmp(argv[a], "--link") == 0)
+            link = 1;
+        else if(strcmp(argv[a], "--profile") == 0)
+            profile = 1;
+        else if(strcmp(argv[a], "--profile-report") == 0 && a + 1 < argc)
+            image_file = argv[++a];
+        else if(strcmp(argv[a], "-o") == 0 && a + 1 < argc)
+            output = argv[++a];
+        else if(strcmp(argv[a], "-j") == 0 && a + 1 < argc && atoi(argv[a + 1]) > 0) {
+            MachineSetThreads(atoi(argv[a + 1]));
+            StageSetThreads(atoi(argv[++a]));
+        }
+        else if(strcmp(argv[a], "--target") == 0 && a + 1 < argc && TargetSet(argv[a + 1]))
+            a++;
+        else if(argv[a][0] != '-' && object_count < MAX_OBJECTS) {
+            objects[object_count++] = argv[a]; // the source, or the objects to link
+            input = argv[a];
+            inputs++;
+        }
+        else if(strncmp(argv[a], "-fno-", 5) == 0 && OptSetPass(argv[a] + 5, 0))
+            continue;
+        else if(strncmp(argv[a], "-f", 2) == 0 && OptSetPass(argv[a] + 2, 1))
+            continue;
+        else {
+            Usage(argv[0]);
+            return 2;
+        }
+    }
+    if(link ? (object_count == 0 || compile_only || run || image_file) : inputs > 1 || (image_file && (compile_only || run || profile))) {
+        Usage(argv[0]);
+        return 2;
+    }
+    DiagInit(mode, input);
+
+    // LINK STEP: objects -> one machine code file (no source involved)
+    if(link) {
+        const char *mc = output ? output : "MACHINE_CODE.mc";
+        DiagText("****** LINK %d OBJECT(S) -> %s ******\n", object_count, mc);
+        int ok = LinkObjects(objects, object_count, mc);
+        DiagLinkSummary(object_count, ok);
+        return ok ? 0 : 1;
+    }
+
+    // HOT-SPOT REPORT: counters read from the final memory image of an instrumented program
+    if(image_file) {
+        const char *map = inputs ? input : PROFILE_MAP;
+        int words;
+        long long *image = ProfileReadImage(image_file, &words);
+        if(!image)
+            ReportError(ERR_IO, 0, image_file);
+        else if(!ProfileReport(map, image, words))
+            ReportError(ERR_IO, 0, map);
+        free(image);
+        return DiagErrorCount() ? 1 : 0;
+    }
+
+    // 1) OPEN SOURCE FILE (mapped, or read in one go)
+    SourceFile src;
+    if(!SourceOpen(input, &src)) {
+        ReportError(ERR_IO, 0, input);
+        DiagSummary(0, 0, 0);
         return 1;                        
     }
 
     // 2) INITIAL SETUP
-    char buffer[BUFFER]; // stores each line read from source file; BUFFER defined in line_validator.c
-    Statement stmts[1024];  // global storage for all parsed statements from the entire text file
-    int stmt_count = 0; // total count of valid parsed statements or keeps track of how many valid statements have been stored
+    SourceSpan line; // current line: a view into src, nothing is copied
+    size_t pos = 0;  // read position in src
+    static Statement stmts[MAX_STATEMENTS];  // global storage for all parsed statements from the entire text file
 
     SymbolInit(); // initialize the symbol table before parsing
 
     // display header for readability in terminal
-    printf("****** SOURCE->MIPS64->MACHINE CODE ******\n");
+    DiagText("****** SOURCE->MIPS64->MACHINE CODE ******\n");
 
-    int buffer_count = 1;
+    int buffer_count = 1;  // non-blank lines, as numbered in the terminal output
+    int line_no = 0;       // actual source line, for diagnostics
     int error_found = 0;   // error flag to stop output generation
 
-    // 3) READ FILE LINE BY LINE
-    while(fgets(buffer, sizeof(buffer), f)) {
-        RemoveLeadingAndTrailingSpaces(buffer); // trim leading/trailing spaces
-        if(buffer[0] == '\0')
+    // 3) p.0 PROGRAM: VALIDATE AND BUILD STATEMENTS IN ONE PASS
+    int p0 = StartsWithProgramOpen(&src);
+    ParserStage parser;
+    StartParser(&parser, stmts, !p0); // p.0: validated and parsed in one pass
+    if(p0) {
+        P0Error perr;
+        if(!P0ParseBuffer(src.data, (int)src.size, stmts, MAX_STATEMENTS, &parser.count, &perr)) {
+            DiagText("[Line %d]: %s\n", perr.line, perr.text);
+            ReportErrorAt(perr.type, perr.line, perr.column, perr.info);
+            error_found = 1;
+        } else
+            DiagText("p.0 program: %d statements\n\n", parser.count);
+        while(SourceNextLine(&src, &pos, &line))
+            line_no++; // for the summary
+    }
+
+    // 3) OTHERWISE READ FILE LINE BY LINE
+    while(!p0 && SourceNextLine(&src, &pos, &line)) {
+        SourceSpan raw = line;
+        line_no++;
+        line = TrimSpan(line); // trim leading/trailing spaces (narrows the view only)
+        if(line.len == 0)
             continue; // skip blank lines
+        const char *buffer = line.text; // ends at the newline: the validator stops there
 
-        printf("[Line %d]: ", buffer_count++);
+        DiagText("[Line %d]: ", buffer_count++);
         //int isbuffervalid = 0; // flag for syntax validation result
         char errinfo[MAX_VAR_LENGTH];  // buffer for error info
         ErrorType err;
 
         // 3A) DETERMINE LINE TYPE
-        if(strncmp(buffer, "int ", 4) == 0)
+        if(TypeKeyword(buffer) || IsConstKeyword(buffer))
             err = StartsWithInt(buffer, errinfo);
+        else if(IsWhileKeyword(buffer))
+            err = StartsWithWhile(buffer, errinfo);
+        else if(IsIfKeyword(buffer))
+            err = StartsWithIf(buffer, errinfo);
         else
-            err = StartsWithVariableName(buffer, errinfo);
+            err = StartsWithVariableName(buffer, errinfo); // also handles a leading '}' (and "} else")
 
         // 3B) HANDLE INVALID LINES
         if(err != ERR_NONE) {
-            printf("%s\n", buffer);
-            ReportError(err, buffer_count - 1, errinfo);
+            StopParser(&parser);
+            DiagText("%.*s\n", line.len, buffer);
+            ReportErrorAt(err, line_no, ErrorColumn(raw, line, errinfo), errinfo);
             error_found = 1;
             goto end_message;
         }
 
         // 3C) VALID LINE HANDLING
-        printf("%s\n\tTransform: Correct syntax\n\n", buffer);
+        DiagText("%.*s\n\tTransform: Correct syntax\n\n", line.len, buffer);
 
-        // parse valid line into Statement structures
-        Statement parsed[32];
-        int parsed_count = ParseStatement(buffer, parsed);
+        // parse valid line straight into the statement array (but do NOT generate assembly yet),
+        // on the parser stage while the next lines are validated
+        // every statement on it points at the line in src as its raw text
+        if(parser.thread && line.len < MAX_STMT_LEN) {
+            ParseLater(&parser, line);
+            continue;
+        }
+        // a line whose expression may be too long: parsed here, after everything before it, so
+        // the error comes right after the line (the rest of the file is parsed here too)
+        StopParser(&parser);
+        int parsed_count = ParseStatement(line.text, line.len, stmts + parser.count, MAX_STATEMENTS - parser.count);
 
-        // store parsed statements (but do NOT generate assembly yet)
-        for(int k = 0; k < parsed_count; k++) {
-            if(stmt_count < (int)(sizeof(stmts)/sizeof(stmts[0])))
-                stmts[stmt_count++] = parsed[k];
+        // lines are no longer cut at BUFFER chars, but an expression still has to fit the
+        // code generator's expression tree (MAX_STMT_LEN chars never exceed it)
+        for(int k = parser.count; k < parser.count + parsed_count; k++) {
+            if(strlen(stmts[k].rhs) >= MAX_STMT_LEN) {
+                ReportErrorAt(ERR_INVALID_EXPRESSION, line_no, ErrorColumn(raw, line, stmts[k].rhs), NameOf(stmts[k].lhs));
+                error_found = 1;
+                goto end_message;
+            }
         }
+        parser.count += parsed_count;
     }
+    StopParser(&parser);
 
-    fclose(f); // close source file
+    // every while/if block must be closed by the end of the file
+    if(!error_found && block_depth > 0) {
+        DiagText("[Line %d]: <end of file>\n", buffer_count);
+        ReportError(ERR_UNMATCHED_BRACE, line_no, "{");
+        error_found = 1;
+    }
 
     // abort if any syntax error found
     if(error_found) {
         end_message:
-        printf("Compilation aborted due to encountered invalid syntax. No assembly and machine codes generated.\n\n");
+        DiagSummary(line_no, parser.count, 0);
         return 1;
     }
+    int stmt_count = parser.count;
 
     // 8): FINAL OUTPUT FILES
+    // -c: listing and object named after the source, so several sources can be compiled side by side
+    char asm_path[MAX_PATH_LEN], obj_path[MAX_PATH_LEN], map_path[MAX_PATH_LEN];
+    ReplaceExtension(input, ".asm", asm_path, sizeof(asm_path));
+    ReplaceExtension(input, ".obj", obj_path, sizeof(obj_path));
+    ReplaceExtension(input, ".map", map_path, sizeof(map_path));
+    const char *map_file = compile_only ? map_path : PROFILE_MAP;
+    const char *asm_file = compile_only ? asm_path : "MIPS64_ASSEMBLY.txt";
+    const char *mc_file = output ? output : compile_only ? obj_path : "MACHINE_CODE.mc";
+
     // generate full MIPS64 assembly program
-    FILE *MIPS64_ASSEMBLY = fopen("MIPS64_ASSEMBLY.txt", "w");
+    FILE *MIPS64_ASSEMBLY = fopen(asm_file, "w");
     if(!MIPS64_ASSEMBLY) {
-        printf("Cannot create file\n");
+        ReportError(ERR_IO, 0, asm_file);
+        DiagSummary(line_no, stmt_count, 0);
         return 1;
     }
-    AssemblyGenerateProgram(stmts, stmt_count, MIPS64_ASSEMBLY);
+    // statements -> SSA -> passes of the -O level -> instruction selection
+    SsaProgram program;
+    SsaSetProfiling(profile ? src.data : NULL);
+    SsaLower(stmts, stmt_count, &program);
+    OptRun(&program);
+    if(dump_ir)
+        SsaPrint(&program, stderr);
+    ListingStages stages;
+    FILE *listing = StartListing(&stages, MIPS64_ASSEMBLY);
+    AssemblyGenerateProgram(&program, listing);
+    int streamed = StopListing(&stages, listing);
     fclose(MIPS64_ASSEMBLY);
+    if(time_passes)
+        OptReport(stderr);
+    // profiling: which counter and which instructions belong to which line
+    if(profile && !ProfileWriteMap(asm_file, map_file, src.data, src.size))
+        ReportError(ERR_IO, 0, map_file);
 
     // generate final machine code (based on completed assembly)
-    FILE *MACHINE_CODE = fopen("MACHINE_CODE.mc", "w");
+    FILE *MACHINE_CODE = fopen(mc_file, "w");
     if(!MACHINE_CODE) {
-        printf("Cannot create machine code output file\n");
+        ReportError(ERR_IO, 0, mc_file);
+        SsaFree(&program);
+        DiagSummary(line_no, stmt_count, 0);
         return 1;
     }
-
-    // convert the full assembly to machine code
-    MachineFromAssembly("MIPS64_ASSEMBLY.txt", "MACHINE_CODE.mc");
     fclose(MACHINE_CODE);
 
-    printf("Compilation successful. Assembly and machine codes generated.\n\n");
+    // convert the full assembly to machine code, or (-c) to an object with the .data offsets left open
+    // (streamed: its first pass is done, encode it from memory)
+    MachineModule module;
+    if(streamed) {
+        MachineStreamFinish(stages.stream, asm_file, &module);
+        if(compile_only) {
+            ObjectWrite(&module, mc_file);
+            MachineFreeModule(&module);
+        } else
+            MachineFromModule(&module, asm_file, mc_file);
+    } else if(compile_only)
+        ObjectFromAssembly(asm_file, mc_file);
+    else
+        MachineFromAssembly(asm_file, mc_file);
+
+    // 9) --run: execute the optimized program natively
+    if(run)
+        RunNative(&program, profile ? map_file : NULL);
+    SsaFree(&program);
+
+    IrReset(); // statements, expression text and names go away in one shot
+    SourceClose(&src);
+
+    DiagSummary(line_no, stmt_count, 1);
 }
@@ -0,0 +1,1166 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+
+#include "opt.h"
+#include "error.h" // xrealloc
+#include "symbol_table.h" // MAX_NAME_LEN: renamed variables are cut like any other
+
+#define MAX_ROUNDS 8    // -O2 repeats the pipeline until it settles, at most this often
+
+// a pass rewrites the program in place and returns how many changes it made
+typedef int (*PassFunction)(SsaProgram *prog);
+
+static int Inline(SsaProgram *prog);
+static int ConstantPropagation(SsaProgram *prog);
+static int CopyPropagation(SsaProgram *prog);
+static int ConstantFolding(SsaProgram *prog);
+static int Simplify(SsaProgram *prog);
+static int Reassociate(SsaProgram *prog);
+static int CommonSubexpressions(SsaProgram *prog);
+static int DeadStores(SsaProgram *prog);
+static int DeadCode(SsaProgram *prog);
+
+// the pipeline, in the order the passes run
+static struct {
+    const char *name;
+    const char *summary;
+    PassFunction run;
+    int level;          // lowest -O level running it
+    int enabled;        // after -O and -f/-fno- options
+    int runs, changes;
+    clock_t time;
+} passes[] = {
+    { "inline",    "small or once-called functions are expanded at their calls",    Inline,              1 },
+    { "constprop", "loads of a variable holding a known constant become that constant", ConstantPropagation, 1 },
+    { "copyprop",  "loads of a variable holding a copy of another one load that one",  CopyPropagation,     1 },
+    { "fold",      "operations on constants are evaluated at compile time",           ConstantFolding,     1 },
+    { "simplify",  "x+0, x-0, x*1, x/1 -> x;  x*0, x-x -> 0;  x*2 -> x+x",           Simplify,            1 },
+    { "reassoc",   "chains of + or * become balanced trees (a+b+c+d -> (a+b)+(c+d))", Reassociate,        2 },
+    { "cse",       "an operation or load computed before is reused",                 CommonSubexpressions, 2 },
+    { "dse",       "stores overwritten before anything reads them are dropped",      DeadStores,          2 },
+    { "dce",       "instructions whose result is never used are deleted",            DeadCode,            1 },
+};
+#define PASS_COUNT ((int)(sizeof(passes) / sizeof(passes[0])))
+
+static int opt_level = 0;
+
+
+// ================= pass manager =========================
+
+void OptSetLevel(int level) {
+    opt_level = level < 0 ? 0 : level > OPT_MAX_LEVEL ? OPT_MAX_LEVEL : level;
+    for(int p = 0; p < PASS_COUNT; p++)
+        passes[p].enabled = opt_level >= passes[p].level;
+}
+
+int OptSetPass(const char *name, int enabled) {
+    for(int p = 0; p < PASS_COUNT; p++)
+        if(strcmp(passes[p].name, name) == 0) {
+            passes[p].enabled = enabled;
+            return 1;
+        }
+    return 0;
+}
+
+void OptRun(SsaProgram *prog) {
+    int rounds = opt_level >= 2 ? MAX_ROUNDS : 1;
+    for(int round = 0; round < rounds; round++) {
+        int changes = 0;
+        for(int p = 0; p < PASS_COUNT; p++) {
+            if(!passes[p].enabled)
+                continue;
+            clock_t start = clock();
+            int n = passes[p].run(prog);
+            passes[p].time += clock() - start;
+            passes[p].runs++;
+            passes[p].changes += n;
+            changes += n;
+        }
+        if(changes == 0)
+            break;
+    }
+}
+
+void OptReport(FILE *out) {
+    clock_t total = 0;
+    fprintf(out, "pass        runs  changes   time (ms)   (-O%d)\n", opt_level);
+    for(int p = 0; p < PASS_COUNT; p++) {
+        fprintf(out, "%-10s %5d %8d %11.3f%s\n", passes[p].name, passes[p].runs, passes[p].changes,
+                1000.0 * passes[p].time / CLOCKS_PER_SEC, passes[p].enabled ? "" : "   (off)");
+        total += passes[p].time;
+    }
+    fprintf(out, "%-10s %5s %8s %11.3f\n", "total", "", "", 1000.0 * total / CLOCKS_PER_SEC);
+}
+
+void OptListPasses(FILE *out) {
+    for(int p = 0; p < PASS_COUNT; p++)
+        fprintf(out, "  %-10s -O%d  %s\n", passes[p].name, passes[p].level, passes[p].summary);
+}
+
+
+// ================= shared helpers =========================
+
+// count elements of size bytes, zeroed (at least one)
+static void *Allocate(size_t count, size_t size) {
+    if(!count)
+        count = 1;
+    return memset(xrealloc(NULL, count * size), 0, count * size);
+}
+
+// number of variable ids used by the program (arrays indexed by variable are this long)
+static int VariableLimit(const SsaProgram *prog) {
+    int limit = 0;
+    for(int i = 0; i < prog->count; i++)
+        if(prog->insns[i].var >= limit)
+            limit = prog->insns[i].var + 1;
+    return limit;
+}
+
+// a pass that deletes an instruction redirects its uses: alias[v] is the vreg now standing for v
+// (uses always come after the definition, so one forward sweep rewrites all of them)
+static int *NewAliases(const SsaProgram *prog) {
+    int *alias = Allocate(prog->vreg_count, sizeof(int));
+    for(int v = 0; v < prog->vreg_count; v++)
+        alias[v] = v;
+    return alias;
+}
+
+static void ResolveOperands(SsaInsn *in, const int *alias) {
+    if(in->a >= 0)
+        in->a = alias[in->a];
+    if(in->b >= 0)
+        in->b = alias[in->b];
+}
+
+static int HasOperands(const SsaInsn *in) {
+    return in->kind == SSA_BINOP || in->kind == SSA_STORE || in->kind == SSA_BRANCH || in->kind == SSA_PRINT ||
+           in->kind == SSA_ARG || in->kind == SSA_RETURN;
+}
+
+static void MakeConstant(SsaInsn *in, long long value) {
+    in->kind = SSA_CONST;
+    in->op = 0;
+    in->a = in->b = in->var = -1;
+    in->imm = value;
+}
+
+// mark every variable stored to inside the loop opened at insns[start] (all of them if it
+// calls a function: vars is the length of stored)
+static void StoredInLoop(const SsaProgram *prog, int start, char *stored, int vars) {
+    int end = SsaLoopEnd(prog, start);
+    for(int i = start; i < end; i++) {
+        if(prog->insns[i].kind == SSA_STORE)
+            stored[prog->insns[i].var] = 1;
+        else if(prog->insns[i].kind == SSA_CALL)
+            memset(stored, 1, vars);
+    }
+}
+
+// the same 64-bit wraparound arithmetic the hardware does; 0 if the division would trap
+static int Evaluate(char op, long long l, long long r, long long *result) {
+    if(op == '+')
+        *result = (long long)((unsigned long long)l + (unsigned long long)r);
+    else if(op == '-')
+        *result = (long long)((unsigned long long)l - (unsigned long long)r);
+    else if(op == '*')
+        *result = (long long)((unsigned long long)l * (unsigned long long)r);
+    else {
+        if(r == 0 || (r == -1 && l == LLONG_MIN))
+            return 0; // leave traps/undefined cases to run time
+        *result = l / r;
+    }
+    return 1;
+}
+
+
+// ================= inline =========================
+// a call of a small function (or of one called only once) becomes a copy of its body: the
+// arguments are stored to fresh variables standing for the parameters, the callee's locals
+// are renamed the same way ("_in<n>_x"), every vreg is renamed, and the RETURN stores to the
+// call's destination. only single-exit callees qualify (no RETURN but as the last instruction),
+// and recursive ones never. callees are defined above their callers, so when a call is
+// reached its callee has already had its own calls expanded. small callees grow the program,
+// which stops at INLINE_BUDGET; a function no live code calls any more is deleted
+
+#define INLINE_SMALL 24         // instructions: inlined at every call (within the budget)
+#define INLINE_ONCE 1024        // instructions: inlined when there is a single call
+#define INLINE_BUDGET 512       // instructions the program may grow by
+
+typedef struct {
+    int name;
+    int start, end;             // FUNC and ENDFUNC in the program being rebuilt, end -1 while open
+    int calls;                  // calls from outside its body
+    int recursive, single_exit;
+    int dead;                   // deleted: its calls don't count
+} InlineFunction;
+
+static int inline_copies = 0;   // expansions so far, numbers the renamed variables
+
+// scratch maps of an expansion: vreg -> its copy, callee variable -> its copy (-1: not the
+// callee's); names and vregs made by earlier expansions are past the original program's, so they grow
+typedef struct {
+    int *vreg, *var;
+    int vregs, vars;
+} InlineMaps;
+
+// map[0 .. needed) usable, new entries -1
+static int *GrowMap(int *map, int *size, int needed) {
+    if(needed <= *size)
+        return map;
+    int grown = *size ? *size : 64;
+    while(grown < needed)
+        grown *= 2;
+    map = xrealloc(map, grown * sizeof(int));
+    for(int k = *size; k < grown; k++)
+        map[k] = -1;
+    *size = grown;
+    return map;
+}
+
+// the function named name, or NULL
+static InlineFunction *FindInlineFunction(InlineFunction *functions, int count, int name) {
+    for(int f = 0; f < count; f++)
+        if(functions[f].name == name)
+            return &functions[f];
+    return NULL;
+}
+
+// collect every function of prog with its calls, recursion and exits
+static InlineFunction *InlineFunctions(const SsaProgram *prog, int *count) {
+    InlineFunction *functions = NULL;
+    int capacity = 0, current = -1;
+    *count = 0;
+    for(int i = 0; i < prog->count; i++) {
+        const SsaInsn *in = &prog->insns[i];
+        if(in->kind == SSA_FUNC) {
+            if(*count == capacity) {
+                capacity = capacity ? 2 * capacity : 16;
+                functions = xrealloc(functions, capacity * sizeof(InlineFunction));
+            }
+            InlineFunction *f = &functions[*count];
+            memset(f, 0, sizeof(*f));
+            f->name = (int)in->imm;
+            f->start = i;
+            f->end = SsaFunctionEnd(prog, i);
+            int returns = 0, last = i;
+            for(int k = i + 1; k < f->end; k++)
+                if(prog->insns[k].kind != SSA_NOP) {
+                    returns += prog->insns[k].kind == SSA_RETURN;
+                    last = k;
+                }
+            f->single_exit = returns == 0 || (returns == 1 && prog->insns[last].kind == SSA_RETURN);
+            current = (*count)++;
+        }
+        else if(in->kind == SSA_ENDFUNC)
+            current = -1;
+        else if(in->kind == SSA_CALL) {
+            InlineFunction *f = FindInlineFunction(functions, *count, (int)in->imm);
+            if(f && f - functions == current)
+                f->recursive = 1;
+            else if(f)
+                f->calls++;
+        }
+    }
+    return functions;
+}
+
+// renamed copy of a callee's variable "f.x" (or an earlier copy's "_in<n>_x") for copy n
+static int InlineName(int var, int copy) {
+    const char *name = NameOf(var);
+    const char *base = strchr(name, '.');
+    char text[2 * MAX_NAME_LEN];
+    int len = snprintf(text, sizeof(text), "_in%d_%s", copy, base ? base + 1 : name);
+    if(len > MAX_NAME_LEN - 1)
+        len = MAX_NAME_LEN - 1;
+    return InternName(text, len);
+}
+
+// append the body of f (already in out) in place of a call: args are the argument vregs,
+// dest the variable the result goes to (-1: none), loops/ifs the next free loop and if numbers
+static void ExpandCall(SsaProgram *prog, SsaProgram *out, const InlineFunction *f, const int *args, int dest,
+                       InlineMaps *maps, int *loops, int *ifs) {
+    int copy = inline_copies++;
+    // the callee's parameters and locals get their renamed copies
+    for(int k = f->start + 1; k < f->end; k++) {
+        const SsaInsn *in = &out->insns[k];
+        if((in->kind == SSA_PARAM || in->kind == SSA_DECL) && in->var >= 0) {
+            maps->var = GrowMap(maps->var, &maps->vars, in->var + 1);
+            maps->var[in->var] = InlineName(in->var, copy);
+        }
+    }
+    // structured numbers stay unique: LOOP/ENDLOOP and IF/ELSE/ENDIF pairs by nesting
+    int *numbers = Allocate(f->end - f->start, sizeof(int));
+    int open = 0, returned = 0;
+    for(int k = f->start + 1; k < f->end; k++) {
+        SsaInsn in = out->insns[k];
+        if(in.kind == SSA_NOP)
+            continue;
+        if(in.kind == SSA_PARAM) {
+            SsaInsn decl = in;
+            decl.kind = SSA_DECL;
+            decl.var = maps->var[in.var];
+            decl.imm = 0;
+            SsaAppend(out, decl);
+            decl.kind = SSA_STORE;
+            decl.init = 1;
+            decl.a = args[in.imm];
+            SsaAppend(out, decl);
+            continue;
+        }
+        if(in.kind == SSA_RETURN) {
+            returned = 1;
+            if(dest < 0)
+                continue;
+            in.kind = SSA_STORE;
+            in.var = dest;
+        }
+        else if(in.kind == SSA_LOOP || in.kind == SSA_IF) {
+            numbers[open++] = in.kind == SSA_LOOP ? (*loops)++ : (*ifs)++;
+            in.imm = numbers[open - 1];
+        }
+        else if(in.kind == SSA_ELSE)
+            in.imm = numbers[open - 1];
+        else if(in.kind == SSA_ENDLOOP || in.kind == SSA_ENDIF)
+            in.imm = numbers[--open];
+        // operands are defined earlier in the body, so their copies are in the map
+        if(in.a >= 0)
+            in.a = maps->vreg[in.a];
+        if(in.b >= 0)
+            in.b = maps->vreg[in.b];
+        if(in.dst >= 0) {
+            maps->vreg = GrowMap(maps->vreg, &maps->vregs, in.dst + 1);
+            maps->vreg[in.dst] = SsaNewVreg(prog);
+            in.dst = maps->vreg[in.dst];
+        }
+        if((in.kind == SSA_LOAD || in.kind == SSA_STORE || in.kind == SSA_DECL || in.kind == SSA_CALL) &&
+           in.var >= 0 && in.var < maps->vars && maps->var[in.var] >= 0)
+            in.var = maps->var[in.var];
+        SsaAppend(out, in);
+    }
+    if(!returned && dest >= 0) {
+        // no return: the result is 0
+        SsaInsn zero;
+        memset(&zero, 0, sizeof(zero));
+        zero.kind = SSA_CONST;
+        zero.a = zero.b = zero.var = -1;
+        zero.dst = SsaNewVreg(prog);
+        SsaAppend(out, zero);
+        zero.kind = SSA_STORE;
+        zero.var = dest;
+        zero.a = zero.dst;
+        zero.dst = -1;
+        SsaAppend(out, zero);
+    }
+    for(int k = f->start + 1; k < f->end; k++)
+        if((out->insns[k].kind == SSA_PARAM || out->insns[k].kind == SSA_DECL) && out->insns[k].var >= 0)
+            maps->var[out->insns[k].var] = -1;
+    free(numbers);
+}
+
+static int Inline(SsaProgram *prog) {
+    int count, changes = 0, budget = INLINE_BUDGET;
+    InlineFunction *functions = InlineFunctions(prog, &count);
+    if(count == 0)
+        return 0;
+
+    int loops = 0, ifs = 0;
+    InlineMaps maps = { NULL, NULL, 0, 0 };
+    int *args = Allocate(prog->count, sizeof(int));
+    for(int i = 0; i < prog->count; i++) {
+        const SsaInsn *in = &prog->insns[i];
+        if(in->kind == SSA_LOOP && in->imm >= loops)
+            loops = (int)in->imm + 1;
+        else if(in->kind == SSA_IF && in->imm >= ifs)
+            ifs = (int)in->imm + 1;
+    }
+
+    // rebuild the program in order; a function's span is where its processed body went
+    SsaProgram out;
+    memset(&out, 0, sizeof(out));
+    for(int i = 0; i < prog->count; i++) {
+        SsaInsn in = prog->insns[i];
+        InlineFunction *f = in.kind == SSA_CALL ? FindInlineFunction(functions, count, (int)in.imm) : NULL;
+        if(in.kind == SSA_FUNC || in.kind == SSA_ENDFUNC) {
+            f = FindInlineFunction(functions, count, (int)in.imm);
+            if(in.kind == SSA_FUNC) {
+                f->start = out.count;
+                f->end = -1;
+            }
+            else
+                f->end = out.count;
+        }
+        else if(f && f->end >= 0 && !f->recursive && f->single_exit) {
+            int size = 0;
+            for(int k = f->start + 1; k < f->end; k++)
+                size += out.insns[k].kind != SSA_NOP;
+            int once = f->calls == 1 && size <= INLINE_ONCE;
+            if(once || (size <= INLINE_SMALL && size <= budget)) {
+                // the ARG run just appended goes, its vregs are the arguments
+                int argc = 0;
+                while(argc < out.count && out.insns[out.count - 1 - argc].kind == SSA_ARG)
+                    argc++;
+                out.count -= argc;
+                for(int k = 0; k < argc; k++)
+                    args[k] = out.insns[out.count + k].a;
+                if(!once)
+                    budget -= size;
+                ExpandCall(prog, &out, f, args, in.var, &maps, &loops, &ifs);
+                changes++;
+                continue;
+            }
+        }
+        SsaAppend(&out, in);
+    }
+    free(prog->insns);
+    prog->insns = out.insns;
+    prog->count = out.count;
+    prog->capacity = out.capacity;
+
+    // functions nothing live calls any more go away, last first (only earlier ones are called)
+    for(int f = count - 1; f >= 0; f--) {
+        int called = 0;
+        for(int i = 0; i < prog->count && !called; i++) {
+            if(prog->insns[i].kind != SSA_CALL || prog->insns[i].imm != functions[f].name)
+                continue;
+            int g = count - 1; // the function the call is in, if any
+            while(g >= 0 && !(functions[g].start < i && i < functions[g].end))
+                g--;
+            called = g != f && (g < 0 || !functions[g].dead);
+        }
+        if(!called) {
+            for(int i = functions[f].start; i <= functions[f].end; i++)
+                prog->insns[i].kind = SSA_NOP;
+            functions[f].dead = 1;
+            changes++;
+        }
+    }
+    free(args);
+    free(maps.var);
+    free(maps.vreg);
+    free(functions);
+    return changes;
+}
+
+
+// ================= constprop =========================
+// known[var] is set while the variable's memory holds a constant stored in straight-line code
+// (operations on constants are folded on the way, so chains of such statements collapse);
+// a loop header is also reached from the end of the body, so variables the loop stores to
+// are unknown from its LOOP on, and the state after the loop is the one at its header.
+// an if statement's arms both start from the state at its IF, and after the ENDIF a variable
+// is known only if both ways through (then and else arm, or then arm and none) agree on it
+// a function body starts knowing nothing (it runs from wherever it is called) and leaves the
+// state of the code around it alone; a call may store to any variable
+
+typedef struct {
+    char *valid;
+    long long *value;
+} KnownConstants;
+
+static int ConstantPropagation(SsaProgram *prog) {
+    int vars = VariableLimit(prog), changes = 0, depth = 0;
+    int *defs = Allocate(prog->vreg_count, sizeof(int));
+    SsaDefinitions(prog, defs);
+    KnownConstants known = { Allocate(vars, 1), Allocate(vars, sizeof(long long)) };
+    unsigned char *bytes = Allocate(vars, 1);
+    SsaVariableBytes(prog, bytes, vars);
+    KnownConstants *saved = NULL;
+    int saved_cap = 0;
+
+    for(int i = 0; i < prog->count; i++) {
+        SsaInsn *in = &prog->insns[i];
+        if(in->kind == SSA_LOOP || in->kind == SSA_IF || in->kind == SSA_FUNC) {
+            if(in->kind == SSA_LOOP) {
+                char *stored = Allocate(vars, 1);
+                StoredInLoop(prog, i, stored, vars);
+                for(int v = 0; v < vars; v++)
+                    if(stored[v])
+                        known.valid[v] = 0;
+                free(stored);
+            }
+            if(depth == saved_cap) {
+                saved_cap = saved_cap ? 2 * saved_cap : 8;
+                saved = xrealloc(saved, saved_cap * sizeof(KnownConstants));
+            }
+            saved[depth].valid = Allocate(vars, 1);
+            saved[depth].value = Allocate(vars, sizeof(long long));
+            memcpy(saved[depth].valid, known.valid, vars);
+            memcpy(saved[depth].value, known.value, vars * sizeof(long long));
+            depth++;
+            if(in->kind == SSA_FUNC)
+                memset(known.valid, 0, vars);
+        }
+        else if((in->kind == SSA_ENDLOOP || in->kind == SSA_ENDFUNC) && depth > 0) {
+            depth--;
+            memcpy(known.valid, saved[depth].valid, vars);
+            memcpy(known.value, saved[depth].value, vars * sizeof(long long));
+            free(saved[depth].valid);
+            free(saved[depth].value);
+        }
+        else if(in->kind == SSA_ELSE && depth > 0) {
+            // the else arm starts from the state at the IF, the then arm's end waits for the ENDIF
+            KnownConstants then = known;
+            known = saved[depth - 1];
+            saved[depth - 1] = then;
+        }
+        else if(in->kind == SSA_ENDIF && depth > 0) {
+            depth--;
+            for(int v = 0; v < vars; v++)
+                if(!saved[depth].valid[v] || saved[depth].value[v] != known.value[v])
+                    known.valid[v] = 0;
+            free(saved[depth].valid);
+            free(saved[depth].value);
+        }
+        else if(in->kind == SSA_STORE) {
+            int d = in->a >= 0 ? defs[in->a] : -1;
+            known.valid[in->var] = d >= 0 && prog->insns[d].kind == SSA_CONST;
+            if(known.valid[in->var])
+                known.value[in->var] = SsaNarrow(prog->insns[d].imm, bytes[in->var]); // what a narrow one keeps
+        }
+        else if(in->kind == SSA_CALL)
+            memset(known.valid, 0, vars);
+        else if(in->kind == SSA_LOAD && known.valid[in->var]) {
+            MakeConstant(in, known.value[in->var]);
+            changes++;
+        }
+        else if(in->kind == SSA_BINOP && in->a >= 0 && in->b >= 0 && defs[in->a] >= 0 && defs[in->b] >= 0) {
+            // fold on the way, so a constant computed from constants reaches later statements too
+            const SsaInsn *l = &prog->insns[defs[in->a]], *r = &prog->insns[defs[in->b]];
+            long long value;
+            if(l->kind == SSA_CONST && r->kind == SSA_CONST && Evaluate(in->op, l->imm, r->imm, &value)) {
+                MakeConstant(in, value);
+                changes++;
+            }
+        }
+    }
+    while(depth > 0) {
+        depth--;
+        free(saved[depth].valid);
+        free(saved[depth].value);
+    }
+    free(saved);
+    free(known.valid);
+    free(known.value);
+    free(bytes);
+    free(defs);
+    return changes;
+}
+
+
+// ================= copyprop =========================
+// after "a = b;" (a store of a load of b, b not stored in between) a's memory holds a copy of
+// b's (unless a is a narrower type, which cuts it), so a load of a can load b instead while
+// neither is stored again: the code generator then finds b's register instead of loading a
+// into its own (and cse merges the two loads).
+// every store stamps its variable with a clock; a copy is valid while its source has not been
+// stored since the copy was made. the control flow is followed like constprop does: a loop
+// header stamps the variables the loop stores to (the back edge brings those stores in front
+// of everything in the body), an if statement keeps a copy only if both ways through agree,
+// a function body starts knowing nothing and a call may store to any variable.
+// the code generators rebuild a load where its value is used, from what the variable holds
+// there: a load only loads b instead if b keeps its value up to the last use (CopyHolds)
+
+typedef struct {
+    int *source;    // variable a holds a copy of, -1 none
+    int *stamp;     // clock when the copy was made
+} KnownCopies;
+
+// used[v] = index of the last instruction using vreg v, through the operations using it (an
+// operation is generated where its own value is used)
+static void LastUses(const SsaProgram *prog, int *used) {
+    for(int v = 0; v < prog->vreg_count; v++)
+        used[v] = -1;
+    for(int i = prog->count - 1; i >= 0; i--) {
+        const SsaInsn *in = &prog->insns[i];
+        if(!HasOperands(in))
+            continue;
+        int at = in->kind == SSA_BINOP && used[in->dst] >= 0 ? used[in->dst] : i;
+        if(in->a >= 0 && used[in->a] < at)
+            used[in->a] = at;
+        if(in->b >= 0 && used[in->b] < at)
+            used[in->b] = at;
+    }
+}
+
+// does variable var keep its value from insns[from] until it is used at insns[to]: no store
+// to it and no call in between, nor anywhere in a loop entered on the way (its back edge
+// brings the stores of the whole body in front of the use)
+static int CopyHolds(const SsaProgram *prog, int var, int from, int to) {
+    for(int i = from + 1; i < to; i++) {
+        const SsaInsn *in = &prog->insns[i];
+        if((in->kind == SSA_STORE && in->var == var) || in->kind == SSA_CALL)
+            return 0;
+        if(in->kind == SSA_LOOP) {
+            int end = SsaLoopEnd(prog, i);
+            if(to < end)
+                to = end;
+        }
+    }
+    return 1;
+}
+
+static int CopyPropagation(SsaProgram *prog) {
+    int vars = VariableLimit(prog), changes = 0, depth = 0, clock = 0, last_call = 0;
+    int *defs = Allocate(prog->vreg_count, sizeof(int));
+    int *used = Allocate(prog->vreg_count, sizeof(int));
+    SsaDefinitions(prog, defs);
+    LastUses(prog, used);
+    int *stored = Allocate(vars, sizeof(int));              // clock of the variable's last store
+    int *loaded = Allocate(prog->vreg_count, sizeof(int));  // clock when a LOAD's value was read
+    KnownCopies known = { Allocate(vars, sizeof(int)), Allocate(vars, sizeof(int)) };
+    unsigned char *bytes = Allocate(vars, 1);
+    SsaVariableBytes(prog, bytes, vars);
+    for(int v = 0; v < vars; v++)
+        known.source[v] = -1;
+    KnownCopies *saved = NULL;
+    int saved_cap = 0;
+
+    for(int i = 0; i < prog->count; i++) {
+        SsaInsn *in = &prog->insns[i];
+        if(in->kind == SSA_LOOP || in->kind == SSA_IF || in->kind == SSA_FUNC) {
+            if(in->kind == SSA_LOOP) {
+                char *in_loop = Allocate(vars, 1);
+                StoredInLoop(prog, i, in_loop, vars);
+                clock++;
+                for(int v = 0; v < vars; v++)
+                    if(in_loop[v]) {
+                        stored[v] = clock;
+                        known.source[v] = -1;
+                    }
+                free(in_loop);
+            }
+            if(depth == saved_cap) {
+                saved_cap = saved_cap ? 2 * saved_cap : 8;
+                saved = xrealloc(saved, saved_cap * sizeof(KnownCopies));
+            }
+            saved[depth].source = Allocate(vars, sizeof(int));
+            saved[depth].stamp = Allocate(vars, sizeof(int));
+            memcpy(saved[depth].source, known.source, vars * sizeof(int));
+            memcpy(saved[depth].stamp, known.stamp, vars * sizeof(int));
+            depth++;
+            if(in->kind == SSA_FUNC)
+                for(int v = 0; v < vars; v++)
+                    known.source[v] = -1;
+        }
+        else if((in->kind == SSA_ENDLOOP || in->kind == SSA_ENDFUNC) && depth > 0) {
+            depth--;
+            memcpy(known.source, saved[depth].source, vars * sizeof(int));
+            memcpy(known.stamp, saved[depth].stamp, vars * sizeof(int));
+            free(saved[depth].source);
+            free(saved[depth].stamp);
+        }
+        else if(in->kind == SSA_ELSE && depth > 0) {
+            // the else arm starts from the state at the IF, the then arm's end waits for the ENDIF
+            KnownCopies then = known;
+            known = saved[depth - 1];
+            saved[depth - 1] = then;
+        }
+        else if(in->kind == SSA_ENDIF && depth > 0) {
+            depth--;
+            for(int v = 0; v < vars; v++)
+                if(saved[depth].source[v] != known.source[v] || saved[depth].stamp[v] != known.stamp[v])
+                    known.source[v] = -1;
+            free(saved[depth].source);
+            free(saved[depth].stamp);
+        }
+        else if(in->kind == SSA_STORE) {
+            const SsaInsn *d = in->a >= 0 && defs[in->a] >= 0 ? &prog->insns[defs[in->a]] : NULL;
+            stored[in->var] = ++clock;
+            known.source[in->var] = -1;
+            if(d && d->kind == SSA_LOAD && d->var != in->var && loaded[in->a] >= stored[d->var] &&
+               loaded[in->a] >= last_call && bytes[in->var] >= bytes[d->var]) {
+                known.source[in->var] = d->var;
+                known.stamp[in->var] = clock;
+            }
+        }
+        else if(in->kind == SSA_CALL) {
+            last_call = ++clock;
+            for(int v = 0; v < vars; v++)
+                known.source[v] = -1;
+            if(in->var >= 0)
+                stored[in->var] = clock;
+        }
+        else if(in->kind == SSA_LOAD) {
+            int source = known.source[in->var];
+            if(source >= 0 && stored[source] <= known.stamp[in->var] && CopyHolds(prog, source, i, used[in->dst])) {
+                in->var = source;
+                changes++;
+            }
+            loaded[in->dst] = clock;
+        }
+    }
+    while(depth > 0) {
+        depth--;
+        free(saved[depth].source);
+        free(saved[depth].stamp);
+    }
+    free(saved);
+    free(known.source);
+    free(known.stamp);
+    free(loaded);
+    free(stored);
+    free(bytes);
+    free(used);
+    free(defs);
+    return changes;
+}
+
+
+// ================= fold =========================
+
+static int ConstantFolding(SsaProgram *prog) {
+    int changes = 0;
+    int *defs = Allocate(prog->vreg_count, sizeof(int));
+    SsaDefinitions(prog, defs);
+    for(int i = 0; i < prog->count; i++) {
+        SsaInsn *in = &prog->insns[i];
+        if(in->kind != SSA_BINOP || in->a < 0 || in->b < 0 || defs[in->a] < 0 || defs[in->b] < 0)
+            continue;
+        const SsaInsn *l = &prog->insns[defs[in->a]], *r = &prog->insns[defs[in->b]];
+        long long value;
+        if(l->kind == SSA_CONST && r->kind == SSA_CONST && Evaluate(in->op, l->imm, r->imm, &value)) {
+            MakeConstant(in, value);
+            changes++;
+        }
+    }
+    free(defs);
+    return changes;
+}
+
+
+// ================= simplify =========================
+
+// is vreg v the constant c
+static int IsConstant(const SsaProgram *prog, const int *defs, int v, long long c) {
+    return v >= 0 && defs[v] >= 0 && prog->insns[defs[v]].kind == SSA_CONST && prog->insns[defs[v]].imm == c;
+}
+
+static int Simplify(SsaProgram *prog) {
+    int changes = 0;
+    int *defs = Allocate(prog->vreg_count, sizeof(int));
+    int *alias = NewAliases(prog);
+    SsaDefinitions(prog, defs);
+    for(int i = 0; i < prog->count; i++) {
+        SsaInsn *in = &prog->insns[i];
+        if(HasOperands(in))
+            ResolveOperands(in, alias);
+        if(in->kind != SSA_BINOP || in->a < 0 || in->b < 0)
+            continue;
+        int same = -1; // operand the result equals
+        if(in->op == '+' && IsConstant(prog, defs, in->b, 0))
+            same = in->a;
+        else if(in->op == '+' && IsConstant(prog, defs, in->a, 0))
+            same = in->b;
+        else if(in->op == '-' && IsConstant(prog, defs, in->b, 0))
+            same = in->a;
+        else if((in->op == '*' || in->op == '/') && IsConstant(prog, defs, in->b, 1))
+            same = in->a;
+        else if(in->op == '*' && IsConstant(prog, defs, in->a, 1))
+            same = in->b;
+
+        if(same >= 0) {
+            alias[in->dst] = same;
+            in->kind = SSA_NOP;
+            changes++;
+        }
+        else if((in->op == '*' && (IsConstant(prog, defs, in->a, 0) || IsConstant(prog, defs, in->b, 0))) ||
+                (in->op == '-' && in->a == in->b)) {
+            MakeConstant(in, 0);
+            changes++;
+        }
+        else if(in->op == '*' && (IsConstant(prog, defs, in->a, 2) || IsConstant(prog, defs, in->b, 2))) {
+            // one add instead of a multiply and a move from LO
+            int x = IsConstant(prog, defs, in->b, 2) ? in->a : in->b;
+            in->op = '+';
+            in->a = in->b = x;
+            changes++;
+        }
+    }
+    free(alias);
+    free(defs);
+    return changes;
+}
+
+
+// ================= reassoc =========================
+// a chain of + (or of *) is parsed left-associative: in a + b + c + d every add waits for the
+// one before it. the chain is rebuilt as a tree of least height, (a + b) + (c + d), so its
+// halves no longer depend on each other; + and * wrap around in 64 bits, so the order doesn't
+// change the value. an operation joins its parent's chain when it has the same operator, no
+// other use, and sits in the same straight-line code (nothing is moved into a loop or an arm).
+// constants go first, next to each other, for fold to combine. a balanced tree of 2^k operands
+// needs k + 1 temps, so operands are balanced in groups of REASSOC_GROUP (4 temps) and the
+// groups summed left to right: one more temp, whatever the chain's length
+
+#define REASSOC_GROUP 8     // operands per balanced tree
+#define REASSOC_MAX 256     // operands per chain (a longer chain is left as it is)
+
+typedef struct {
+    const SsaProgram *prog;
+    const int *defs, *uses, *region;
+    char op;
+    int root;                       // index of the chain's last operation
+    int operands[REASSOC_MAX];      // in source order
+    int inner[REASSOC_MAX];         // indexes of the operations below the root
+    int operand_count, inner_count;
+} Chain;
+
+// is the value of vreg v an operation of chain c (rather than an operand)
+static int InChain(const Chain *c, int v) {
+    int d = c->defs[v];
+    return d >= 0 && c->prog->insns[d].kind == SSA_BINOP && c->prog->insns[d].op == c->op &&
+           c->uses[v] == 1 && c->region[d] == c->region[c->root];
+}
+
+// collect the operands under vreg v, left to right; returns the height of its subtree
+// (-1 once the chain is too long)
+static int GatherChain(Chain *c, int v) {
+    if(!InChain(c, v)) {
+        if(c->operand_count == REASSOC_MAX)
+            return -1;
+        c->operands[c->operand_count++] = v;
+        return 0;
+    }
+    if(c->inner_count == REASSOC_MAX)
+        return -1;
+    const SsaInsn *in = &c->prog->insns[c->defs[v]];
+    c->inner[c->inner_count++] = c->defs[v];
+    int left = GatherChain(c, in->a);
+    int right = left < 0 ? -1 : GatherChain(c, in->b);
+    if(right < 0)
+        return -1;
+    return 1 + (left > right ? left : right);
+}
+
+// height of the tree BuildChain makes of n operands
+static int BalancedHeight(int n) {
+    int height = 0, groups = (n + REASSOC_GROUP - 1) / REASSOC_GROUP;
+    for(int size = 1; size < (n < REASSOC_GROUP ? n : REASSOC_GROUP); size *= 2)
+        height++;
+    return height + groups - 1;
+}
+
+// gather the chain ending at insns[root]: 1 if it is worth rebuilding (its height drops, or
+// constants are moved together), its operands reordered constants first
+static int GatherRebuild(Chain *c, int root) {
+    const SsaInsn *in = &c->prog->insns[root];
+    c->root = root;
+    c->op = in->op;
+    c->operand_count = c->inner_count = 0;
+    int left = GatherChain(c, in->a);
+    int right = left < 0 ? -1 : GatherChain(c, in->b);
+    if(right < 0)
+        return 0;
+    int height = 1 + (left > right ? left : right);
+
+    int order[REASSOC_MAX], n = 0, moved = 0, constants = 0;
+    for(int pass = 0; pass < 2; pass++)
+        for(int k = 0; k < c->operand_count; k++) {
+            int d = c->defs[c->operands[k]];
+            int constant = d >= 0 && c->prog->insns[d].kind == SSA_CONST;
+            if(constant == pass)
+                continue;
+            constants += constant;
+            moved |= n != k;
+            order[n++] = c->operands[k];
+        }
+    memcpy(c->operands, order, n * sizeof(int));
+    return height > BalancedHeight(n) || (moved && constants > 1);
+}
+
+// append the operation a op b to out, defining dst (-1: the vreg of the next inner operation,
+// *next counts them out)
+static int AppendOperation(const Chain *c, SsaProgram *out, int a, int b, int *next, int dst) {
+    SsaInsn in = c->prog->insns[c->root];
+    in.a = a;
+    in.b = b;
+    in.dst = dst >= 0 ? dst : c->prog->insns[c->inner[(*next)++]].dst;
+    SsaAppend(out, in);
+    return in.dst;
+}
+
+// append a balanced tree of operands[lo..hi) to out; returns the vreg of its value
+static int BuildTree(const Chain *c, SsaProgram *out, int lo, int hi, int *next, int dst) {
+    if(hi - lo == 1)
+        return c->operands[lo];
+    int mid = lo + (hi - lo + 1) / 2;
+    int a = BuildTree(c, out, lo, mid, next, -1);
+    int b = BuildTree(c, out, mid, hi, next, -1);
+    return AppendOperation(c, out, a, b, next, dst);
+}
+
+// append the chain rebuilt: one balanced tree per group of operands, summed left to right,
+// the last operation defining the root's dst
+static void BuildChain(const Chain *c, SsaProgram *out) {
+    int n = c->operand_count, next = 0, sum = -1, dst = c->prog->insns[c->root].dst;
+    for(int lo = 0; lo < n; lo += REASSOC_GROUP) {
+        int hi = lo + REASSOC_GROUP < n ? lo + REASSOC_GROUP : n;
+        if(sum < 0)
+            sum = BuildTree(c, out, lo, hi, &next, hi == n ? dst : -1);
+        else
+            sum = AppendOperation(c, out, sum, BuildTree(c, out, lo, hi, &next, -1), &next, hi == n ? dst : -1);
+    }
+}
+
+static int Reassociate(SsaProgram *prog) {
+    int changes = 0;
+    int *defs = Allocate(prog->vreg_count, sizeof(int));
+    int *uses = Allocate(prog->vreg_count, sizeof(int));
+    int *region = Allocate(prog->count, sizeof(int));
+    char *rebuild = Allocate(prog->count, 1);     // 1: a chain's root, 2: an operation inside one
+    SsaDefinitions(prog, defs);
+    for(int i = 0, r = 0; i < prog->count; i++) {
+        const SsaInsn *in = &prog->insns[i];
+        if(in->kind == SSA_LOOP || in->kind == SSA_BRANCH || in->kind == SSA_ENDLOOP || in->kind == SSA_IF ||
+           in->kind == SSA_ELSE || in->kind == SSA_ENDIF || in->kind == SSA_FUNC || in->kind == SSA_ENDFUNC)
+            r++;
+        region[i] = r;
+        if(HasOperands(in)) {
+            if(in->a >= 0)
+                uses[in->a]++;
+            if(in->b >= 0)
+                uses[in->b]++;
+        }
+    }
+
+    // the roots: operations that are not inside a longer chain, last first so a chain is
+    // claimed whole by its root
+    Chain *c = Allocate(1, sizeof(Chain));
+    c->prog = prog;
+    c->defs = defs;
+    c->uses = uses;
+    c->region = region;
+    for(int i = prog->count - 1; i >= 0; i--) {
+        const SsaInsn *in = &prog->insns[i];
+        if(in->kind != SSA_BINOP || (in->op != '+' && in->op != '*') || rebuild[i])
+            continue;
+        if(!GatherRebuild(c, i))
+            continue;
+        rebuild[i] = 1;
+        for(int k = 0; k < c->inner_count; k++)
+            rebuild[c->inner[k]] = 2;
+        changes++;
+    }
+
+    if(changes) {
+        // the operations inside a chain go, its root is replaced by the balanced tree
+        SsaProgram out;
+        memset(&out, 0, sizeof(out));
+        for(int i = 0; i < prog->count; i++) {
+            if(rebuild[i] == 1) {
+                GatherRebuild(c, i);
+                BuildChain(c, &out);
+            }
+            else if(rebuild[i] == 0)
+                SsaAppend(&out, prog->insns[i]);
+        }
+        free(prog->insns);
+        prog->insns = out.insns;
+        prog->count = out.count;
+        prog->capacity = out.capacity;
+    }
+    free(c);
+    free(rebuild);
+    free(region);
+    free(uses);
+    free(defs);
+    return changes;
+}
+
+
+// ================= cse =========================
+// an instruction equal to one seen before (same operation on the same vregs, a load of the
+// same variable with no store in between) is replaced by the earlier vreg. the earlier one
+// must dominate: entries made inside a loop are dropped at its end, and loads of variables
+// the loop stores to are dropped at its header; an if statement counts as a level too, its
+// entries are dropped at the ELSE and at the ENDIF. nothing from outside a function body is
+// available in it (nor, to keep it simple, after it); a call drops every load
+
+typedef struct {
+    SsaInsn key;    // kind, op, a, b, var, imm
+    int vreg;
+    int depth;      // loop nesting where it was made
+    int valid;
+} Available;
+
+static unsigned HashInsn(const SsaInsn *in) {
+    unsigned long long h = in->kind;
+    h = h * 31 + (unsigned char)in->op;
+    h = h * 31 + (unsigned)in->a;
+    h = h * 31 + (unsigned)in->b;
+    h = h * 31 + (unsigned)in->var;
+    h = h * 31 + (unsigned long long)in->imm;
+    return (unsigned)(h ^ (h >> 29));
+}
+
+static int SameInsn(const SsaInsn *x, const SsaInsn *y) {
+    return x->kind == y->kind && x->op == y->op && x->a == y->a && x->b == y->b &&
+           x->var == y->var && x->imm == y->imm;
+}
+
+static int CommonSubexpressions(SsaProgram *prog) {
+    int changes = 0, depth = 0, count = 0;
+    int size = 64;
+    while(size < 2 * prog->count)
+        size *= 2;
+    int *hash = Allocate(size, sizeof(int));           // entry index + 1, 0 = empty
+    Available *entries = Allocate(prog->count, sizeof(Available));
+    int vars = VariableLimit(prog);
+    int *load_entry = Allocate(vars, sizeof(int));     // entry of the available load of a variable, -1 none
+    for(int v = 0; v < vars; v++)
+        load_entry[v] = -1;
+    int *alias = NewAliases(prog);
+
+    for(int i = 0; i < prog->count; i++) {
+        SsaInsn *in = &prog->insns[i];
+        if(HasOperands(in))
+            ResolveOperands(in, alias);
+
+        if(in->kind == SSA_LOOP) {
+            char *stored = Allocate(vars, 1);
+            StoredInLoop(prog, i, stored, vars);
+            for(int v = 0; v < vars; v++)
+                if(stored[v] && load_entry[v] >= 0) {
+                    entries[load_entry[v]].valid = 0;
+                    load_entry[v] = -1;
+                }
+            free(stored);
+            depth++;
+        }
+        else if(in->kind == SSA_IF)
+            depth++;
+        else if(in->kind == SSA_FUNC) {
+            for(int e = 0; e < count; e++)
+                entries[e].valid = 0;
+            for(int v = 0; v < vars; v++)
+                load_entry[v] = -1;
+            depth++;
+        }
+        else if(in->kind == SSA_CALL) {
+            for(int v = 0; v < vars; v++)
+                if(load_entry[v] >= 0) {
+                    entries[load_entry[v]].valid = 0;
+                    load_entry[v] = -1;
+                }
+        }
+        else if(in->kind == SSA_ENDLOOP || in->kind == SSA_ELSE || in->kind == SSA_ENDIF || in->kind == SSA_ENDFUNC) {
+            for(int e = count - 1; e >= 0 && entries[e].depth >= depth; e--)
+                if(entries[e].valid) {
+                    entries[e].valid = 0;
+                    if(entries[e].key.kind == SSA_LOAD)
+                        load_entry[entries[e].key.var] = -1;
+                }
+            if(in->kind != SSA_ELSE)
+                depth--;
+        }
+        else if(in->kind == SSA_STORE && load_entry[in->var] >= 0) {
+            entries[load_entry[in->var]].valid = 0;
+            load_entry[in->var] = -1;
+        }
+        if(in->kind != SSA_CONST && in->kind != SSA_LOAD && in->kind != SSA_BINOP)
+            continue;
+
+        SsaInsn key = *in;
+        key.dst = -1;
+        if(key.kind == SSA_BINOP && (key.op == '+' || key.op == '*') && key.a > key.b) {
+            int t = key.a; // commutative: one canonical operand order
+            key.a = key.b;
+            key.b = t;
+        }
+        unsigned slot = HashInsn(&key) & (size - 1);
+        int found = -1;
+        while(hash[slot]) {
+            Available *e = &entries[hash[slot] - 1];
+            if(e->valid && SameInsn(&e->key, &key)) {
+                found = e->vreg;
+                break;
+            }
+            slot = (slot + 1) & (size - 1);
+        }
+        if(found >= 0) {
+            alias[in->dst] = found;
+            in->kind = SSA_NOP;
+            changes++;
+            continue;
+        }
+        // slot is the empty one the probe stopped at
+        entries[count].key = key;
+        entries[count].vreg = in->dst;
+        entries[count].depth = depth;
+        entries[count].valid = 1;
+        hash[slot] = ++count;
+        if(key.kind == SSA_LOAD)
+            load_entry[key.var] = count - 1;
+    }
+    free(alias);
+    free(load_entry);
+    free(entries);
+    free(hash);
+    return changes;
+}
+
+
+// ================= dse =========================
+// within straight-line code, a store followed by another store to the same variable with no
+// load of it in between is dead; control flow (loop or if header, branch, else, end, function
+// boundaries, calls and returns) ends the region
+
+static int DeadStores(SsaProgram *prog) {
+    int vars = VariableLimit(prog), changes = 0, touched_count = 0;
+    int *pending = Allocate(vars, sizeof(int));   // unread store to the variable, -1 none
+    int *touched = Allocate(prog->count, sizeof(int)); // variables with a pending store (may repeat)
+    for(int v = 0; v < vars; v++)
+        pending[v] = -1;
+
+    for(int i = 0; i < prog->count; i++) {
+        SsaInsn *in = &prog->insns[i];
+        if(in->kind == SSA_LOOP || in->kind == SSA_BRANCH || in->kind == SSA_ENDLOOP ||
+           in->kind == SSA_IF || in->kind == SSA_ELSE || in->kind == SSA_ENDIF || in->kind == SSA_FUNC ||
+           in->kind == SSA_ENDFUNC || in->kind == SSA_CALL || in->kind == SSA_RETURN) {
+            while(touched_count > 0)
+                pending[touched[--touched_count]] = -1;
+        }
+        else if(in->kind == SSA_LOAD)
+            pending[in->var] = -1;
+        else if(in->kind == SSA_STORE) {
+            if(pending[in->var] >= 0) {
+                prog->insns[pending[in->var]].kind = SSA_NOP;
+                changes++;
+            } else
+                touched[touched_count++] = in->var;
+            pending[in->var] = i;
+        }
+    }
+    free(touched);
+    free(pending);
+    return changes;
+}
+
+
+// ================= dce =========================
+
+static int DeadCode(SsaProgram *prog) {
+    int changes = 0;
+    char *used = Allocate(prog->vreg_count, 1);
+    for(int i = prog->count - 1; i >= 0; i--) {
+        SsaInsn *in = &prog->insns[i];
+        if(in->kind == SSA_CONST || in->kind == SSA_LOAD || in->kind == SSA_BINOP) {
+            if(!used[in->dst]) {
+                in->kind = SSA_NOP;
+                changes++;
+                continue;
+            }
+        }
+        if(HasOperands(in)) {
+            if(in->a >= 0)
+                used[in->a] = 1;
+            if(in->b >= 0)
+                used[in->b] = 1;
+        }
+    }
+    free(used);
+    return changes;
+}
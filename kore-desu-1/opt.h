@@ -0,0 +1,27 @@
+#ifndef OPT_H
+#define OPT_H
+
+#include <stdio.h>
+#include "ssa.h"
+
+// middle end: ordered passes over the SSA program, picked by the -O level
+//   -O0  no passes (the code generator sees the statements as written)
+//   -O1  one round of the level-1 passes
+//   -O2  every pass, repeated until nothing changes
+#define OPT_MAX_LEVEL 2
+
+void OptSetLevel(int level);
+
+// -f<pass> / -fno-<pass> on top of the level; returns 0 if there is no such pass
+int OptSetPass(const char *name, int enabled);
+
+// run the enabled passes over prog, in pipeline order
+void OptRun(SsaProgram *prog);
+
+// runs, changes and time of every pass (--time-passes)
+void OptReport(FILE *out);
+
+// pass names and what they do, for the usage text
+void OptListPasses(FILE *out);
+
+#endif
@@ -0,0 +1,299 @@
+/* p0_grammar.y: LALR(1) grammar for p.0 (see CFG.txt)
+ * regenerate the checked-in parser with "make grammar" (bison -d -o p0_parser.c p0_grammar.y)
+ *
+ * differences from CFG.txt, all accepting the same programs:
+ *  - LINES, DECL_ITEMS, MORE_ASSIGN and PRINT_PARTS are left-recursive so the parse stack
+ *    stays flat however long the program is, and statements come out in source order
+ *  - FACTOR also accepts "-" NUM (negative literal), as used in the sample code
+ *  - newlines are allowed before ">>>" and after "<<<"
+ */
+%define api.prefix {p0}
+%define parse.error verbose
+
+%code requires {
+#include <stdio.h>
+#include "parser.h"
+#include "error.h"
+
+// a piece of the source buffer: [start, end)
+typedef struct {
+    int start, end;
+} P0Span;
+
+// first error found while parsing a p.0 program
+typedef struct {
+    ErrorType type;
+    int line;            // 1-based
+    int column;          // 1-based, of the offending token
+    char info[100];      // variable name / token text for ReportError
+    char text[256];      // the offending source line
+} P0Error;
+}
+
+%code provides {
+// parse a whole p.0 program held in src[0..len) in one pass
+// every declaration item / assignment becomes a Statement in out (at most max)
+// returns 1 on success, 0 on the first error (described in *error)
+// the statements point into src, so it has to outlive them
+int P0ParseBuffer(const char *src, int len, Statement *out, int max, int *count, P0Error *error);
+}
+
+%code {
+#include <stdio.h>
+#include <string.h>
+#include "p0_lexer.h"
+#include "line_validator.h" // declared-variable list shared with the C-subset validator
+
+static Statement *p0_out;
+static int p0_max, p0_count;
+static P0Error *p0_error;
+
+// declared names, hashed straight from the source span (index into vars[] + 1, 0 = empty)
+#define P0_NAME_HASH 32768
+static int p0_names[P0_NAME_HASH];
+
+static void p0error(const char *msg);
+static int P0Fail(ErrorType type, const char *info, int at);
+static int P0Number(P0Span s, int negative);
+static int P0IsDeclared(P0Span s);
+static int P0Declare(P0Span s);
+static void P0Text(P0Span s, char *dst, int size);
+static int P0Emit(StmtType type, P0Span lhs, const P0Span *rhs);
+}
+
+%union {
+    P0Span span;
+}
+
+%token <span> ID NUM STR
+%token KW_INT KW_PRINT NEWLINE PROG_OPEN PROG_CLOSE
+%token LEX_ERROR
+
+%type <span> expr term factor decl_name print_parts print_part
+
+%%
+
+program
+    : opt_newlines PROG_OPEN lines PROG_CLOSE opt_newlines
+    ;
+
+opt_newlines
+    : %empty
+    | opt_newlines NEWLINE
+    ;
+
+lines
+    : %empty
+    | lines line
+    ;
+
+line
+    : full_line NEWLINE
+    | NEWLINE
+    ;
+
+full_line
+    : decl
+    | print
+    | assign
+    ;
+
+/* declarations */
+decl
+    : KW_INT decl_items
+    ;
+
+decl_items
+    : decl_item
+    | decl_items ',' decl_item
+    ;
+
+decl_item
+    : decl_name                 { if(!P0Emit(STMT_DECL, $1, NULL)) YYABORT; }
+    | decl_name '=' expr        { if(!P0Emit(STMT_DECL, $1, &$3)) YYABORT; }
+    ;
+
+/* declared as soon as the name is seen, so "int x = x + 1" behaves like the C subset */
+decl_name
+    : ID {
+        if(!P0Declare($1))
+            YYABORT;
+        $$ = $1;
+    }
+    ;
+
+/* assignments */
+assign
+    : assign_item
+    | assign ',' assign_item
+    ;
+
+assign_item
+    : ID '=' expr {
+        if(!P0IsDeclared($1))
+            YYABORT;
+        if(!P0Emit(STMT_ASSIGN, $1, &$3))
+            YYABORT;
+    }
+    ;
+
+/* print: the parts go to the back end as one text, literals with their quotes */
+print
+    : KW_PRINT ':' print_parts  { if(!P0Emit(STMT_PRINT, $3, &$3)) YYABORT; }
+    ;
+
+print_parts
+    : print_part
+    | print_parts ',' print_part { $$.start = $1.start; $$.end = $3.end; }
+    ;
+
+print_part
+    : STR
+    | expr
+    ;
+
+/* expressions (left associative); the value is the source span, handed to assembly.c as text */
+expr
+    : expr '+' term             { $$.start = $1.start; $$.end = $3.end; }
+    | expr '-' term             { $$.start = $1.start; $$.end = $3.end; }
+    | term
+    ;
+
+term
+    : term '*' factor           { $$.start = $1.start; $$.end = $3.end; }
+    | term '/' factor           { $$.start = $1.start; $$.end = $3.end; }
+    | factor
+    ;
+
+factor
+    : NUM {
+        if(!P0Number($1, 0))
+            YYABORT;
+    }
+    | '-' NUM {
+        if(!P0Number($2, 1))
+            YYABORT;
+        $$.start = $<span>1.start;
+        $$.end = $2.end;
+    }
+    | ID {
+        if(!P0IsDeclared($1))
+            YYABORT;
+    }
+    | '(' expr ')'              { $$.start = $<span>1.start; $$.end = $<span>3.end; }
+    ;
+
+%%
+
+// record the first error (the parser stops right after it)
+// at: source offset of the offending text, -1 for the current token
+static int P0Fail(ErrorType type, const char *info, int at) {
+    if(p0_error && p0_error->type == ERR_NONE) {
+        P0Span line = P0LexerLineSpan();
+        p0_error->type = type;
+        p0_error->line = P0LexerLine();
+        p0_error->column = (at < 0 ? p0lval.span.start : at) - line.start + 1;
+        if(p0_error->column < 1)
+            p0_error->column = 1;
+        strncpy(p0_error->info, info ? info : "", sizeof(p0_error->info) - 1);
+        p0_error->info[sizeof(p0_error->info) - 1] = '\0';
+        P0Text(line, p0_error->text, sizeof(p0_error->text));
+    }
+    return 0;
+}
+
+static void p0error(const char *msg) {
+    (void)msg;
+    P0Fail(ERR_SYNTAX, "", -1);
+}
+
+// slot of the name in p0_names: either its entry or the empty slot where it belongs
+static int P0NameSlot(P0Span s) {
+    const char *src = P0LexerSource();
+    int len = s.end - s.start;
+    unsigned h = 2166136261u; // FNV-1a
+    for(int i = s.start; i < s.end; i++)
+        h = (h ^ (unsigned char)src[i]) * 16777619u;
+    for(int slot = h & (P0_NAME_HASH - 1); ; slot = (slot + 1) & (P0_NAME_HASH - 1)) {
+        int v = p0_names[slot] - 1;
+        if(v < 0 || (strncmp(vars[v], src + s.start, len) == 0 && vars[v][len] == '\0'))
+            return slot;
+    }
+}
+
+// a literal must fit in 64 bits (negative: the digits after a '-')
+static int P0Number(P0Span s, int negative) {
+    if(NumberFits(P0LexerSource() + s.start, s.end - s.start, negative))
+        return 1;
+    char text[MAX_VAR_LENGTH];
+    P0Text(s, text, sizeof(text));
+    return P0Fail(ERR_NUMBER_RANGE, text, s.start);
+}
+
+static int P0IsDeclared(P0Span s) {
+    if(p0_names[P0NameSlot(s)])
+        return 1;
+    char name[MAX_VAR_LENGTH];
+    P0Text(s, name, sizeof(name));
+    return P0Fail(ERR_UNDECLARED, name, s.start);
+}
+
+// add to vars[] (shared with the C-subset validator) and to the hash
+static int P0Declare(P0Span s) {
+    char name[MAX_VAR_LENGTH];
+    P0Text(s, name, sizeof(name));
+    int slot = P0NameSlot(s);
+    if(p0_names[slot])
+        return P0Fail(ERR_REDECLARED, name, s.start);
+    if(valid_buffer_counter >= MAX_VARS)
+        return P0Fail(ERR_SYNTAX, name, s.start);
+    strcpy(vars[valid_buffer_counter++], name);
+    p0_names[slot] = valid_buffer_counter;
+    return 1;
+}
+
+// copy a span of the source into dst (cut to size)
+static void P0Text(P0Span s, char *dst, int size) {
+    int len = s.end - s.start;
+    if(len > size - 1)
+        len = size - 1;
+    memcpy(dst, P0LexerSource() + s.start, len);
+    dst[len] = '\0';
+}
+
+// append one statement; raw is the current source line (src must outlive the statements)
+static int P0Emit(StmtType type, P0Span lhs, const P0Span *rhs) {
+    if(p0_count >= p0_max)
+        return P0Fail(ERR_SYNTAX, "too many statements", lhs.start);
+    const char *src = P0LexerSource();
+    P0Span line = P0LexerLineSpan();
+    Statement *s = &p0_out[p0_count++];
+    s->type = type;
+    s->bytes = 0;
+    s->lhs = type == STMT_PRINT ? -1 : InternName(src + lhs.start, lhs.end - lhs.start);
+    s->rhs = rhs ? ArenaCopy(&ir_arena, src + rhs->start, rhs->end - rhs->start) : "";
+    s->raw.text = src + line.start;
+    s->raw.len = line.end - line.start;
+    return 1;
+}
+
+int P0ParseBuffer(const char *src, int len, Statement *out, int max, int *count, P0Error *error) {
+    p0_out = out;
+    p0_max = max;
+    p0_count = 0;
+    p0_error = error;
+    error->type = ERR_NONE;
+    error->line = 0;
+    error->column = 0;
+    error->info[0] = '\0';
+    error->text[0] = '\0';
+
+    // one program per parse: only names it declares are visible
+    memset(p0_names, 0, sizeof(p0_names));
+    P0LexerInit(src, len);
+    int ok = (p0parse() == 0 && error->type == ERR_NONE);
+    if(!ok)
+        P0Fail(ERR_SYNTAX, "", -1); // e.g. out of parser stack: still report something
+    *count = p0_count;
+    return ok;
+}
@@ -0,0 +1,160 @@
+#include <string.h>
+#include "p0_lexer.h"
+
+// character classes, filled in once by P0LexerInit()
+#define CC_OTHER  0
+#define CC_SPACE  1     // ' ', \t, \r, \f
+#define CC_ALPHA  2     // letters
+#define CC_DIGIT  3
+#define CC_UNDER  4     // '_' (allowed inside identifiers, not first)
+#define CC_SINGLE 5     // one-character tokens: = + - * / ( ) , :
+
+static unsigned char char_class[256];
+static int classes_ready = 0;
+
+// scanner state
+static const char *src;
+static int src_len;
+static int pos;
+static int line;
+static int line_start;       // offset of the first character of the current line
+static int newline_pending;  // last token was NEWLINE: the line advances on the next call
+
+static void InitClasses() {
+    for(int c = 0; c < 256; c++)
+        char_class[c] = CC_OTHER;
+    for(int c = 'a'; c <= 'z'; c++)
+        char_class[c] = CC_ALPHA;
+    for(int c = 'A'; c <= 'Z'; c++)
+        char_class[c] = CC_ALPHA;
+    for(int c = '0'; c <= '9'; c++)
+        char_class[c] = CC_DIGIT;
+    char_class['_'] = CC_UNDER;
+    char_class[' '] = char_class['\t'] = char_class['\r'] = char_class['\f'] = CC_SPACE;
+    for(const char *s = "=+-*/(),:"; *s; s++)
+        char_class[(unsigned char)*s] = CC_SINGLE;
+    classes_ready = 1;
+}
+
+void P0LexerInit(const char *source, int len) {
+    if(!classes_ready)
+        InitClasses();
+    src = source;
+    src_len = len;
+    pos = 0;
+    line = 1;
+    line_start = 0;
+    newline_pending = 0;
+}
+
+int P0LexerLine(void) {
+    return line;
+}
+
+const char *P0LexerSource(void) {
+    return src;
+}
+
+P0Span P0LexerLineSpan(void) {
+    P0Span s;
+    s.start = line_start;
+    s.end = line_start;
+    while(s.end < src_len && src[s.end] != '\n')
+        s.end++;
+    while(s.end > s.start && char_class[(unsigned char)src[s.end - 1]] == CC_SPACE)
+        s.end--;
+    return s;
+}
+
+// class of the character at i (end of input counts as OTHER)
+static int ClassAt(int i) {
+    return i < src_len ? char_class[(unsigned char)src[i]] : CC_OTHER;
+}
+
+int p0lex(void) {
+    if(newline_pending) {
+        line++;
+        line_start = pos;
+        newline_pending = 0;
+    }
+
+    // skip whitespace and comments
+    while(pos < src_len) {
+        if(ClassAt(pos) == CC_SPACE)
+            pos++;
+        else if(src[pos] == '/' && pos + 1 < src_len && src[pos + 1] == '/') {
+            while(pos < src_len && src[pos] != '\n')
+                pos++;
+        } else
+            break;
+    }
+
+    int start = pos;
+    p0lval.span.start = start;
+    p0lval.span.end = start;
+    if(pos >= src_len)
+        return 0;
+
+    char c = src[pos];
+    int cls = ClassAt(pos);
+    int token;
+
+    if(c == '\n') {
+        pos++;
+        newline_pending = 1;
+        token = NEWLINE;
+    }
+    else if(cls == CC_ALPHA) {
+        while(ClassAt(pos) == CC_ALPHA || ClassAt(pos) == CC_DIGIT || ClassAt(pos) == CC_UNDER)
+            pos++;
+        int len = pos - start;
+        if(len == 3 && strncmp(src + start, "int", 3) == 0)
+            token = KW_INT;
+        else if(len == 1 && c == 'p')
+            token = KW_PRINT;
+        else
+            token = ID;
+    }
+    else if(cls == CC_DIGIT) {
+        while(ClassAt(pos) == CC_DIGIT)
+            pos++;
+        token = NUM;
+    }
+    else if(c == '"') {
+        // string literal with \n \t \" \\ escapes, on one line
+        pos++;
+        token = LEX_ERROR;
+        while(pos < src_len && src[pos] != '\n') {
+            if(src[pos] == '"') {
+                pos++;
+                token = STR;
+                break;
+            }
+            if(src[pos] == '\\') {
+                if(pos + 1 >= src_len || !strchr("nt\"\\", src[pos + 1]))
+                    break; // unknown escape
+                pos++;
+            }
+            pos++;
+        }
+    }
+    else if(c == '>' && pos + 2 < src_len && src[pos + 1] == '>' && src[pos + 2] == '>') {
+        pos += 3;
+        token = PROG_OPEN;
+    }
+    else if(c == '<' && pos + 2 < src_len && src[pos + 1] == '<' && src[pos + 2] == '<') {
+        pos += 3;
+        token = PROG_CLOSE;
+    }
+    else if(cls == CC_SINGLE) {
+        pos++;
+        token = c;
+    }
+    else {
+        pos++;
+        token = LEX_ERROR;
+    }
+
+    p0lval.span.end = pos;
+    return token;
+}
@@ -0,0 +1,24 @@
+#ifndef P0_LEXER_H
+#define P0_LEXER_H
+
+#include "p0_parser.h" // token numbers, P0Span, p0lval
+
+// hand-written scanner for p.0 tokens (see CFG.txt), one linear pass over the buffer
+// whitespace and // comments are skipped; every token's span is left in p0lval.span
+
+// start scanning src[0..len) (the buffer must stay alive while parsing)
+void P0LexerInit(const char *src, int len);
+
+// next token for the parser (0 at end of input)
+int p0lex(void);
+
+// 1-based line of the last token returned
+int P0LexerLine(void);
+
+// span of the whole line of the last token returned (without the newline)
+P0Span P0LexerLineSpan(void);
+
+// the buffer being scanned
+const char *P0LexerSource(void);
+
+#endif
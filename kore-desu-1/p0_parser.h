@@ -0,0 +1,133 @@
+/* A Bison parser, made by GNU Bison 3.8.2.  */
+
+/* Bison interface for Yacc-like parsers in C
+
+   Copyright (C) 1984, 1989-1990, 2000-2015, 2018-2021 Free Software Foundation,
+   Inc.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.  */
+
+/* As a special exception, you may create a larger work that contains
+   part or all of the Bison parser skeleton and distribute that work
+   under terms of your choice, so long as that work isn't itself a
+   parser generator using the skeleton or a modified version thereof
+   as a parser skeleton.  Alternatively, if you modify or redistribute
+   the parser skeleton itself, you may (at your option) remove this
+   special exception, which will cause the skeleton and the resulting
+   Bison output files to be licensed under the GNU General Public
+   License without this special exception.
+
+   This special exception was added by the Free Software Foundation in
+   version 2.2 of Bison.  */
+
+/* DO NOT RELY ON FEATURES THAT ARE NOT DOCUMENTED in the manual,
+   especially those whose name start with YY_ or yy_.  They are
+   private implementation details that can be changed or removed.  */
+
+#ifndef YY_P0_P0_PARSER_H_INCLUDED
+# define YY_P0_P0_PARSER_H_INCLUDED
+/* Debug traces.  */
+#ifndef P0DEBUG
+# if defined YYDEBUG
+#if YYDEBUG
+#   define P0DEBUG 1
+#  else
+#   define P0DEBUG 0
+#  endif
+# else /* ! defined YYDEBUG */
+#  define P0DEBUG 0
+# endif /* ! defined YYDEBUG */
+#endif  /* ! defined P0DEBUG */
+#if P0DEBUG
+extern int p0debug;
+#endif
+/* "%code requires" blocks.  */
+#line 13 "p0_grammar.y"
+
+#include <stdio.h>
+#include "parser.h"
+#include "error.h"
+
+// a piece of the source buffer: [start, end)
+typedef struct {
+    int start, end;
+} P0Span;
+
+// first error found while parsing a p.0 program
+typedef struct {
+    ErrorType type;
+    int line;            // 1-based
+    int column;          // 1-based, of the offending token
+    char info[100];      // variable name / token text for ReportError
+    char text[256];      // the offending source line
+} P0Error;
+
+#line 77 "p0_parser.h"
+
+/* Token kinds.  */
+#ifndef P0TOKENTYPE
+# define P0TOKENTYPE
+  enum p0tokentype
+  {
+    P0EMPTY = -2,
+    P0EOF = 0,                     /* "end of file"  */
+    P0error = 256,                 /* error  */
+    P0UNDEF = 257,                 /* "invalid token"  */
+    ID = 258,                      /* ID  */
+    NUM = 259,                     /* NUM  */
+    STR = 260,                     /* STR  */
+    KW_INT = 261,                  /* KW_INT  */
+    KW_PRINT = 262,                /* KW_PRINT  */
+    NEWLINE = 263,                 /* NEWLINE  */
+    PROG_OPEN = 264,               /* PROG_OPEN  */
+    PROG_CLOSE = 265,              /* PROG_CLOSE  */
+    LEX_ERROR = 266                /* LEX_ERROR  */
+  };
+  typedef enum p0tokentype p0token_kind_t;
+#endif
+
+/* Value type.  */
+#if ! defined P0STYPE && ! defined P0STYPE_IS_DECLARED
+union P0STYPE
+{
+#line 64 "p0_grammar.y"
+
+    P0Span span;
+
+#line 109 "p0_parser.h"
+
+};
+typedef union P0STYPE P0STYPE;
+# define P0STYPE_IS_TRIVIAL 1
+# define P0STYPE_IS_DECLARED 1
+#endif
+
+
+extern P0STYPE p0lval;
+
+
+int p0parse (void);
+
+/* "%code provides" blocks.  */
+#line 33 "p0_grammar.y"
+
+// parse a whole p.0 program held in src[0..len) in one pass
+// every declaration item / assignment becomes a Statement in out (at most max)
+// returns 1 on success, 0 on the first error (described in *error)
+// the statements point into src, so it has to outlive them
+int P0ParseBuffer(const char *src, int len, Statement *out, int max, int *count, P0Error *error);
+
+#line 132 "p0_parser.h"
+
+#endif /* !YY_P0_P0_PARSER_H_INCLUDED  */
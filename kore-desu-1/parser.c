@@ -3,134 +3,288 @@
 #include <stdio.h>
 #include "parser.h"
 
-// removes leading/trailing spaces from the given s (works on local buffer)
-static void TrimLocalBuffer(char *s) {
-    char *p = s;
-    while(*p && isspace(*p))
+// view of [start, end) without surrounding spaces
+static SourceSpan Trimmed(const char *start, const char *end) {
+    while(start < end && isspace((unsigned char)*start))
+        start++;
+    while(end > start && isspace((unsigned char)end[-1]))
+        end--;
+    SourceSpan s = { start, (int)(end - start) };
+    return s;
+}
+
+// first c in [start, end), or NULL
+static const char *Find(const char *start, const char *end, char c) {
+    return start < end ? memchr(start, c, end - start) : NULL;
+}
+
+// fill in one statement; lhs/rhs with a NULL text are absent
+// names are interned, the expression is copied into ir_arena (its only copy)
+static Statement MakeStatement(StmtType type, SourceSpan lhs, SourceSpan rhs, SourceSpan line) {
+    Statement s;
+    s.type = type;
+    s.bytes = 0;
+    s.lhs = lhs.text ? InternName(lhs.text, lhs.len) : -1;
+    s.rhs = rhs.text ? ArenaCopy(&ir_arena, rhs.text, rhs.len) : "";
+    s.raw = line;
+    return s;
+}
+
+// is word at ptr as a keyword (not the start of a longer name)
+static int IsKeyword(const char *ptr, const char *end, const char *word) {
+    int n = (int)strlen(word);
+    return end - ptr >= n && strncmp(ptr, word, n) == 0 &&
+           (end - ptr == n || (!isalnum((unsigned char)ptr[n]) && ptr[n] != '_'));
+}
+
+// declaration keywords with the storage size of their variables (int: 0, a doubleword)
+static const struct {
+    const char *word;
+    int bytes;
+} storage_types[] = { { "int ", 0 }, { "int32 ", 4 }, { "short ", 2 }, { "char ", 1 } };
+
+// length of the declaration keyword at ptr with its space (0 if none), its size to *bytes
+static int StorageType(const char *ptr, const char *end, int *bytes) {
+    for(int k = 0; k < (int)(sizeof(storage_types) / sizeof(storage_types[0])); k++) {
+        int n = (int)strlen(storage_types[k].word);
+        if(end - ptr >= n && strncmp(ptr, storage_types[k].word, n) == 0) {
+            *bytes = storage_types[k].bytes;
+            return n;
+        }
+    }
+    return 0;
+}
+
+static const char *SkipSpaces(const char *ptr, const char *end) {
+    while(ptr < end && isspace((unsigned char)*ptr))
+        ptr++;
+    return ptr;
+}
+
+// "(condition)" of a while/if header starting at ptr: the text between the parentheses goes
+// to *cond; returns the character after the matching ')', NULL if there is none
+static const char *Condition(const char *ptr, const char *end, SourceSpan *cond) {
+    const char *open = Find(ptr, end, '(');
+    if(!open)
+        return NULL;
+    // find the matching ')'
+    const char *close = open;
+    int depth = 0;
+    for(; close < end; close++) {
+        if(*close == '(')
+            depth++;
+        else if(*close == ')' && --depth == 0)
+            break;
+    }
+    if(close == end)
+        return NULL;
+    *cond = Trimmed(open + 1, close);
+    return close + 1;
+}
+
+// first c in [start, end) outside parentheses, or NULL
+static const char *FindOutside(const char *start, const char *end, char c) {
+    int depth = 0;
+    for(; start < end; start++) {
+        if(*start == c && depth == 0)
+            return start;
+        depth += (*start == '(') - (*start == ')');
+    }
+    return NULL;
+}
+
+// is the text a function call "name(...)"
+static int IsCallText(SourceSpan s) {
+    const char *p = s.text, *end = s.text + s.len;
+    if(p == end || !isalpha((unsigned char)*p))
+        return 0;
+    while(p < end && (isalnum((unsigned char)*p) || *p == '_'))
         p++;
-    // shift string contents to remove leading spaces
-    memmove(s, p, strlen(p) + 1);
-    // remove trailing spaces
-    int len = strlen(s);
-    while(len > 0 && isspace(s[len - 1]))
-        s[--len] = '\0';
+    p = SkipSpaces(p, end);
+    return p < end && *p == '(';
+}
+
+// one simple statement [ptr, semi): "x = expression", "x = f(...)", "f(...)" or "return expression"
+// returns the number of statements it became (0 or 1)
+static int SimpleStatement(const char *ptr, const char *semi, SourceSpan line, Statement *out) {
+    const SourceSpan none = { NULL, 0 };
+    if(IsKeyword(ptr, semi, "return")) {
+        *out = MakeStatement(STMT_RETURN, none, Trimmed(ptr + 6, semi), line);
+        return 1;
+    }
+    const char *eq = Find(ptr, semi, '=');
+    if(!eq) {
+        SourceSpan call = Trimmed(ptr, semi);
+        if(!IsCallText(call))
+            return 0;
+        *out = MakeStatement(STMT_CALL, none, call, line);
+        return 1;
+    }
+    SourceSpan lhs = Trimmed(ptr, eq);
+    SourceSpan rhs = Trimmed(eq + 1, semi);
+    if(lhs.len == 0 || rhs.len == 0) // ensure both sides are non-empty
+        return 0;
+    *out = MakeStatement(IsCallText(rhs) ? STMT_CALL : STMT_ASSIGN, lhs, rhs, line);
+    return 1;
 }
 
-// parse "int x;", "int a, b, c;"  into one or more Statement structures
-int ParseStatement(const char *line, Statement *out) {
-    char tmp[MAX_STMT_LEN];
-    // copy input line into temporary buffer to allow modification
-    strncpy(tmp, line, MAX_STMT_LEN - 1);
-    tmp[MAX_STMT_LEN - 1] = '\0';
-    // remove surrrounding spaces 
-    TrimLocalBuffer(tmp);
+static const char *ParseElse(const char *ptr, const char *end, SourceSpan line, Statement *out, int *count, int max);
 
+// one arm of an if statement, after "if (c)" or "else": "{" opens a block whose statements
+// follow (up to its "}"); otherwise the arm is a single simple statement, which ends it and then
+// the if statement, unless an else part comes next. returns where parsing goes on
+static const char *ParseArm(const char *ptr, const char *end, SourceSpan line, Statement *out, int *count, int max) {
+    const SourceSpan none = { NULL, 0 };
+    ptr = SkipSpaces(ptr, end);
+    if(ptr < end && *ptr == '{')
+        return ptr + 1;
+    const char *semi = Find(ptr, end, ';');
+    if(!semi)
+        return end;
+    if(*count < max)
+        *count += SimpleStatement(ptr, semi, line, out + *count);
+    const char *next = SkipSpaces(semi + 1, end);
+    if(IsKeyword(next, end, "else"))
+        return ParseElse(next + 4, end, line, out, count, max);
+    if(*count < max)
+        out[(*count)++] = MakeStatement(STMT_END, none, none, line);
+    return semi + 1;
+}
+
+// the else part of an if statement, after "else": "else if (c)" chains another if to it
+static const char *ParseElse(const char *ptr, const char *end, SourceSpan line, Statement *out, int *count, int max) {
+    const SourceSpan none = { NULL, 0 };
+    SourceSpan cond = none;
+    ptr = SkipSpaces(ptr, end);
+    if(IsKeyword(ptr, end, "if") && !(ptr = Condition(ptr + 2, end, &cond)))
+        return end; // incomplete header
+    if(*count < max)
+        out[(*count)++] = MakeStatement(STMT_ELSE, none, cond, line);
+    return ParseArm(ptr, end, line, out, count, max);
+}
+
+// parse "int x;", "int a, b, c;", "const int n = 8;", "x = a + 1;", "while (x < 9) {", "if (x < 9) {",
+// "if (x < 9) y = 1; else y = 2;", "} else {", "} else if (x < 9) {", "}",
+// "int f(int a, int b) {", "return a + b;", "x = f(1, 2);" and "f(x);"
+// into one or more Statement structures (at most max)
+// works on the view directly: nothing is copied or modified
+int ParseStatement(const char *text, int len, Statement *out, int max) {
+    const SourceSpan none = { NULL, 0 };
+    SourceSpan line = Trimmed(text, text + len);
+    const char *ptr = line.text;
+    const char *end = line.text + line.len;
     int count = 0; // number of parsed statements so far
-    char *ptr = tmp;
 
-    while(*ptr) {
+    while(ptr < end && count < max) {
         // skip whitespace between statements
-        while(isspace(*ptr))
+        while(ptr < end && isspace((unsigned char)*ptr))
             ptr++;
-        if(*ptr == '\0')
+        if(ptr == end)
             break;
 
-        // case 1: declaration statements
-        if(strncmp(ptr, "int ", 4) == 0) {
-            char *start = ptr + 4; // point after "int "
-            char *semi = strchr(start, ';'); // find end of this declaration
+        // case 0: end of a while body or an if arm ("} else" goes on with the other arm)
+        if(*ptr == '}') {
+            const char *next = SkipSpaces(ptr + 1, end);
+            if(IsKeyword(next, end, "else")) {
+                ptr = ParseElse(next + 4, end, line, out, &count, max);
+                continue;
+            }
+            out[count++] = MakeStatement(STMT_END, none, none, line);
+            ptr++;
+            // skip stray semicolons after the brace
+            while(ptr < end && (*ptr == ';' || isspace((unsigned char)*ptr)))
+                ptr++;
+            continue;
+        }
+
+        // case 0b: loop header "while (condition) {"
+        if(IsKeyword(ptr, end, "while")) {
+            SourceSpan cond;
+            const char *after = Condition(ptr + 5, end, &cond);
+            const char *brace = after ? Find(after, end, '{') : NULL;
+            if(!brace)
+                break; // incomplete header
+
+            out[count++] = MakeStatement(STMT_WHILE, none, cond, line);
+            ptr = brace + 1; // the body may start on the same line
+            continue;
+        }
+
+        // case 0c: "if (condition)", then a block or a single assignment (see ParseArm)
+        if(IsKeyword(ptr, end, "if")) {
+            SourceSpan cond;
+            const char *after = Condition(ptr + 2, end, &cond);
+            if(!after)
+                break; // incomplete header
+            out[count++] = MakeStatement(STMT_IF, none, cond, line);
+            ptr = ParseArm(after, end, line, out, &count, max);
+            continue;
+        }
+
+        // case 1: declaration statements ("const int" ones declare constants, "char", "short"
+        // and "int32" narrow variables)
+        int constant = IsKeyword(ptr, end, "const"), bytes, type;
+        if(constant)
+            ptr = SkipSpaces(ptr + 5, end);
+        if((type = StorageType(ptr, end, &bytes)) > 0) {
+            const char *start = ptr + type; // point after "int " (or "char ", ...)
+
+            // a function definition "int f(int a, int b) {", the body may start on the same line
+            SourceSpan name = Trimmed(start, end);
+            if(IsCallText(name)) {
+                SourceSpan params;
+                const char *open = Find(start, end, '(');
+                const char *after = Condition(open, end, &params);
+                const char *brace = after ? Find(after, end, '{') : NULL;
+                if(!brace)
+                    break; // incomplete header
+                out[count++] = MakeStatement(STMT_FUNC, Trimmed(start, open), params, line);
+                ptr = brace + 1;
+                continue;
+            }
+            const char *semi = Find(start, end, ';'); // find end of this declaration
             if(!semi)
                 break; // incomplete line
 
-            // temporarily terminate at semicolon so we process only one "int ...;" block
-            *semi = '\0';
-            char *vars = start;
-
-            // split by commas
-            char *tok = strtok(vars, ",");
-            while(tok) {
-                TrimLocalBuffer(tok); // remove spaces around each var token
-                if(tok[0] == '\0') { // skip empty tokens 
-                    tok = strtok(NULL, ",");
+            // split by commas (not those between the arguments of a call)
+            while(start < semi && count < max) {
+                const char *comma = FindOutside(start, semi, ',');
+                const char *item_end = comma ? comma : semi;
+                SourceSpan item = Trimmed(start, item_end);
+                start = item_end + 1;
+                if(item.len == 0) // skip empty items
                     continue;
-                }
-
-                Statement s;
-                s.type = STMT_DECL; // mark statement type as declaration
-                s.raw[0] = '\0'; // initialize raw buffer
 
                 // handle initialization, e.g., x = 5;
-                char *eq = strchr(tok, '=');
-                if(eq) {
-                    *eq = '\0'; // split into LHS and RHS
-                    TrimLocalBuffer(tok);
-                    TrimLocalBuffer(eq + 1);
-
-                    // copy variable name (LHS)
-                    strncpy(s.lhs, tok, sizeof(s.lhs) - 1);
-                    s.lhs[sizeof(s.lhs) - 1] = '\0';
-                    // copy expression/value (RHS)
-                    strncpy(s.rhs, eq + 1, sizeof(s.rhs) - 1);
-                    s.rhs[sizeof(s.rhs) - 1] = '\0';
-                } // handle simple declaration without initialization: e.g., int x; 
-                else {
-                    TrimLocalBuffer(tok);
-                    strncpy(s.lhs, tok, sizeof(s.lhs) - 1);
-                    s.lhs[sizeof(s.lhs) - 1] = '\0';
-                    s.rhs[0] = '\0'; // no RHS
+                const char *eq = Find(item.text, item.text + item.len, '=');
+                SourceSpan init = eq ? Trimmed(eq + 1, item.text + item.len) : none;
+                int first = count; // the item's declaration
+                if(eq && IsCallText(init)) {
+                    // "int x = f(a);": the declaration, then the call stores into it
+                    out[count++] = MakeStatement(STMT_DECL, Trimmed(item.text, eq), none, line);
+                    if(count < max)
+                        out[count++] = MakeStatement(STMT_CALL, Trimmed(item.text, eq), init, line);
                 }
-                // store original input file for reference/debugging
-                strncpy(s.raw, line, sizeof(s.raw) - 1);
-                s.raw[sizeof(s.raw) - 1] = '\0';
-
-                // save parsed statement
-                out[count++] = s;
-
-                // continue parsing next variable in same line, if any
-                tok = strtok(NULL, ",");
+                else if(eq)
+                    out[count++] = MakeStatement(constant ? STMT_CONST : STMT_DECL, Trimmed(item.text, eq), init, line);
+                else // simple declaration without initialization: e.g., int x;
+                    out[count++] = MakeStatement(STMT_DECL, item, none, line);
+                out[first].bytes = (unsigned char)bytes;
             }
 
             ptr = semi + 1;  // move past the semicolon to check for more statements
             continue;
         }
 
-        // case 2: assignment "x = expressiom;" (no "int")
-        char *semi = strchr(ptr, ';');
+        // case 2: assignment "x = expressiom;" (no "int"), a call or a return
+        const char *semi = Find(ptr, end, ';');
         if(!semi)
             break;
 
-        // Temporarily cut at semicolon
-        *semi = '\0';
-        char *eqpos = strchr(ptr, '=');
-        if(eqpos) {
-            *eqpos = '\0'; // separate LHS and RHS
-            char *lhs = ptr;
-            char *rhs = eqpos + 1;
-
-            // remove extra spaces
-            TrimLocalBuffer(lhs);
-            TrimLocalBuffer(rhs);
-            if(lhs[0] == '\0' || rhs[0] == '\0') // ensure both sides are non-empty
-                goto next_statement;
-
-            // create statement structure
-            Statement s;
-            s.type = STMT_ASSIGN;
-            strncpy(s.lhs, lhs, sizeof(s.lhs) - 1);
-            s.lhs[sizeof(s.lhs) - 1] = '\0';
-            strncpy(s.rhs, rhs, sizeof(s.rhs) - 1);
-            s.rhs[sizeof(s.rhs) - 1] = '\0';
-            strncpy(s.raw, line, sizeof(s.raw) - 1);
-            s.raw[sizeof(s.raw) - 1] = '\0';
-
-            // store result
-            out[count++] = s;
-        }
-
-    next_statement:
+        count += SimpleStatement(ptr, semi, line, out + count);
         ptr = semi + 1; // advance to after this semicolon
     }
 
     // case 3: not a declaration nor an assignment
     return count;
-}
\ No newline at end of file
+}
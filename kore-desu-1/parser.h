@@ -1,19 +1,35 @@
 #ifndef PARSER_H
 #define PARSER_H
 
+#include "ir.h"
+
 #define MAX_STMT_LEN 256
 
-typedef enum { STMT_INVALID = 0, STMT_DECL, STMT_ASSIGN } StmtType;
+// STMT_WHILE opens a loop body (rhs holds the condition), STMT_END closes the innermost one
+// STMT_IF opens the arm run when its condition (rhs) holds, STMT_ELSE switches the innermost if to
+// the other arm; an else with a condition is "else if": it opens an if chained to that arm, and the
+// STMT_END of the chain's last arm closes every if of the chain
+// STMT_PRINT (p.0 only) has no lhs, rhs holds its parts: string literals and expressions, comma-separated
+// STMT_FUNC opens a function body (lhs: its name, rhs: the parameter list "int a, int b"), closed by
+// a STMT_END; STMT_RETURN has the returned expression as rhs; STMT_CALL stores the result of the
+// call in rhs ("f(a, b + 1)") to lhs, or throws it away (lhs -1)
+// STMT_CONST declares the constant lhs with the value of rhs (made of literals and earlier constants)
+typedef enum { STMT_INVALID = 0, STMT_DECL, STMT_ASSIGN, STMT_WHILE, STMT_END, STMT_PRINT, STMT_IF, STMT_ELSE,
+               STMT_FUNC, STMT_RETURN, STMT_CALL, STMT_CONST } StmtType;
 
+// compact statement IR (32 bytes): names are interned ids, expression text lives in ir_arena,
+// raw points back at the source line, so copying a Statement is cheap
 typedef struct {
-    StmtType type;
-    char lhs[128];   // variable name on left
-    char rhs[MAX_STMT_LEN];   // right-hand expression (as string), empty for plain decl
-    char raw[300]; 
+    unsigned char type;     // StmtType
+    unsigned char bytes;    // STMT_DECL: storage of a char (1), short (2) or int32 (4), 0 for an int
+    int lhs;            // interned variable name (NameOf), -1 if none
+    const char *rhs;    // right-hand expression (as string), "" for plain decl; condition for while/if/else if; print parts
+    SourceSpan raw;     // source line the statement came from
 } Statement;
 
-// parse a line (already trimmed) into Statement
-// returns 1 if parsed, 0 if not recognized
-int ParseStatement(const char *line, Statement *out);
+// parse one source line (a view, need not be NUL-terminated) into at most max statements
+// the text must stay alive as long as the statements (raw points into it)
+// returns the number of statements parsed, 0 if not recognized
+int ParseStatement(const char *line, int len, Statement *out, int max);
 
 #endif
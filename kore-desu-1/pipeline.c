@@ -0,0 +1,148 @@
+#if !defined(_WIN32)
+#define _DEFAULT_SOURCE // pthreads, pipe and fdopen under -std=c99
+#include <pthread.h>
+#include <unistd.h>
+#include <errno.h>
+#define PIPELINE_THREADS 1
+#endif
+#include <stdlib.h>
+#include <string.h>
+#include "pipeline.h"
+
+static int threads_wanted = 0;
+
+void StageSetThreads(int threads) {
+    threads_wanted = threads;
+}
+
+#ifdef PIPELINE_THREADS
+// ring of capacity items; head: next to pop, count: items in it. one lock, the producer
+// waits on not_full and the consumer on not_empty
+struct Channel {
+    char *items;
+    size_t item_size;
+    int capacity, head, count, closed;
+    pthread_mutex_t lock;
+    pthread_cond_t not_full, not_empty;
+};
+
+struct Stage {
+    pthread_t thread;
+};
+
+Channel *ChannelOpen(int capacity, size_t item_size) {
+    Channel *ch = calloc(1, sizeof(Channel));
+    if(!ch)
+        return NULL;
+    ch->items = malloc((size_t)capacity * item_size);
+    if(!ch->items) {
+        free(ch);
+        return NULL;
+    }
+    ch->item_size = item_size;
+    ch->capacity = capacity;
+    pthread_mutex_init(&ch->lock, NULL);
+    pthread_cond_init(&ch->not_full, NULL);
+    pthread_cond_init(&ch->not_empty, NULL);
+    return ch;
+}
+
+void ChannelPush(Channel *ch, const void *item) {
+    pthread_mutex_lock(&ch->lock);
+    while(ch->count == ch->capacity)
+        pthread_cond_wait(&ch->not_full, &ch->lock);
+    memcpy(ch->items + (size_t)((ch->head + ch->count) % ch->capacity) * ch->item_size, item, ch->item_size);
+    ch->count++;
+    pthread_cond_signal(&ch->not_empty);
+    pthread_mutex_unlock(&ch->lock);
+}
+
+int ChannelPop(Channel *ch, void *item) {
+    pthread_mutex_lock(&ch->lock);
+    while(ch->count == 0 && !ch->closed)
+        pthread_cond_wait(&ch->not_empty, &ch->lock);
+    int got = ch->count > 0;
+    if(got) {
+        memcpy(item, ch->items + (size_t)ch->head * ch->item_size, ch->item_size);
+        ch->head = (ch->head + 1) % ch->capacity;
+        ch->count--;
+        pthread_cond_signal(&ch->not_full);
+    }
+    pthread_mutex_unlock(&ch->lock);
+    return got;
+}
+
+void ChannelClose(Channel *ch) {
+    pthread_mutex_lock(&ch->lock);
+    ch->closed = 1;
+    pthread_cond_signal(&ch->not_empty);
+    pthread_mutex_unlock(&ch->lock);
+}
+
+void ChannelFree(Channel *ch) {
+    if(!ch)
+        return;
+    pthread_mutex_destroy(&ch->lock);
+    pthread_cond_destroy(&ch->not_full);
+    pthread_cond_destroy(&ch->not_empty);
+    free(ch->items);
+    free(ch);
+}
+
+Stage *StageStart(void *(*run)(void *), void *arg) {
+    long threads = threads_wanted > 0 ? threads_wanted : sysconf(_SC_NPROCESSORS_ONLN);
+    if(threads < 2)
+        return NULL; // a thread per stage would only take turns on the one processor
+    Stage *stage = malloc(sizeof(Stage));
+    if(stage && pthread_create(&stage->thread, NULL, run, arg) != 0) {
+        free(stage);
+        stage = NULL;
+    }
+    return stage;
+}
+
+void StageJoin(Stage *stage) {
+    if(!stage)
+        return;
+    pthread_join(stage->thread, NULL);
+    free(stage);
+}
+
+FILE *PipeOpen(int *read_end) {
+    int ends[2];
+    if(pipe(ends) != 0)
+        return NULL;
+    FILE *writer = fdopen(ends[1], "w");
+    if(!writer) {
+        close(ends[0]);
+        close(ends[1]);
+        return NULL;
+    }
+    *read_end = ends[0];
+    return writer;
+}
+
+long PipeRead(int read_end, char *buffer, size_t size) {
+    ssize_t got;
+    do
+        got = read(read_end, buffer, size);
+    while(got < 0 && errno == EINTR);
+    return got > 0 ? (long)got : 0;
+}
+
+void PipeClose(int read_end) {
+    close(read_end);
+}
+#else
+// no threads: ChannelOpen, StageStart and PipeOpen fail, so the rest is never reached
+Channel *ChannelOpen(int capacity, size_t item_size) { (void)capacity; (void)item_size; return NULL; }
+void ChannelPush(Channel *ch, const void *item) { (void)ch; (void)item; }
+int ChannelPop(Channel *ch, void *item) { (void)ch; (void)item; return 0; }
+void ChannelClose(Channel *ch) { (void)ch; }
+void ChannelFree(Channel *ch) { (void)ch; }
+Stage *StageStart(void *(*run)(void *), void *arg) { (void)run; (void)arg; (void)threads_wanted; return NULL; }
+void StageJoin(Stage *stage) { (void)stage; }
+FILE *PipeOpen(int *read_end) { (void)read_end; return NULL; }
+long PipeRead(int read_end, char *buffer, size_t size) { (void)read_end; (void)buffer; (void)size; return 0; }
+void PipeClose(int read_end) { (void)read_end; }
+#endif
@@ -0,0 +1,51 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+// compilation stages on their own threads, connected by bounded single-producer /
+// single-consumer queues: the parser takes lines while the validator is on the next ones,
+// and the listing goes to its file and to the encoder's first pass while it is generated.
+// without threads (or when one can't be started) the caller runs the stages one after another
+
+// a bounded queue of fixed-size items between one producing and one consuming thread
+typedef struct Channel Channel;
+
+// NULL if there is no memory for it
+Channel *ChannelOpen(int capacity, size_t item_size);
+
+// copy item in, waiting while the queue is full
+void ChannelPush(Channel *ch, const void *item);
+
+// copy the oldest item out, waiting while the queue is empty; 0 once it is closed and empty
+int ChannelPop(Channel *ch, void *item);
+
+// the producer is done (the consumer gets what is left, then 0)
+void ChannelClose(Channel *ch);
+
+void ChannelFree(Channel *ch);
+
+// a thread running one stage
+typedef struct Stage Stage;
+
+// threads the compiler may use (-j): 0, the default, one per online processor. with one
+// (or on a single processor) no stage gets a thread of its own
+void StageSetThreads(int threads);
+
+// run(arg) on a new thread; NULL if it can't or shouldn't be started (nothing ran)
+Stage *StageStart(void *(*run)(void *), void *arg);
+
+// wait for the stage to return
+void StageJoin(Stage *stage);
+
+// a stream written with stdio on one thread and read in blocks on another (a pipe); NULL if
+// there is none. close the FILE to end it: PipeRead then returns 0
+FILE *PipeOpen(int *read_end);
+
+// up to size bytes of the stream, waiting for them; 0 at its end
+long PipeRead(int read_end, char *buffer, size_t size);
+
+void PipeClose(int read_end);
+
+#endif
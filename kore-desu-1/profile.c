@@ -0,0 +1,255 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "profile.h"
+#include "symbol_table.h"
+#include "scan.h"
+#include "error.h"
+
+#define MAX_MAP_LINE 4096
+
+// instructions [start, end) of the listing that belong to a source line
+typedef struct {
+    int line, start, end;
+} CodeRange;
+
+// one counter of the map, with its count once an image is read
+typedef struct {
+    long long offset;
+    int line, instructions;
+    char *text;
+    long long count;
+} MapEntry;
+
+
+// ================= map =========================
+
+static CodeRange *ranges;
+static int range_count, range_capacity;
+
+// instruction pc belongs to line (0: before the first marker, not attributed)
+static void AddInstruction(int line, int pc) {
+    if(line == 0)
+        return;
+    if(range_count > 0 && ranges[range_count - 1].line == line && ranges[range_count - 1].end == pc) {
+        ranges[range_count - 1].end++;
+        return;
+    }
+    if(range_count == range_capacity) {
+        range_capacity = range_capacity ? 2 * range_capacity : 64;
+        ranges = xrealloc(ranges, range_capacity * sizeof(CodeRange));
+    }
+    ranges[range_count].line = line;
+    ranges[range_count].start = pc;
+    ranges[range_count++].end = pc + 1;
+}
+
+// text of source line n (1-based), without surrounding whitespace; lines are asked for in
+// increasing order, so the scan goes on from the previous one
+static const char *SourceLine(const char *source, size_t size, int n, int *len) {
+    static const char *base, *at;
+    static int at_line;
+    if(base != source || n < at_line) {
+        base = at = source;
+        at_line = 1;
+    }
+    const char *end = source + size;
+    while(at_line < n && at < end) {
+        const char *nl = memchr(at, '\n', end - at);
+        at = nl ? nl + 1 : end;
+        at_line++;
+    }
+    const char *p = at, *q = at;
+    while(q < end && *q != '\n' && *q != '\0')
+        q++;
+    while(p < q && isspace((unsigned char)*p))
+        p++;
+    while(q > p && isspace((unsigned char)q[-1]))
+        q--;
+    *len = (int)(q - p);
+    return p;
+}
+
+// one map line per counter of the .data section (offsets counted like the assembler does)
+static void WriteEntry(FILE *out, const char *name, long long offset, const char *source, size_t size) {
+    int line = atoi(name + 5), instructions = 0, len;
+    char text[MAX_MAP_LINE / 2], *t = text;
+    text[0] = '\0';
+    for(int r = 0; r < range_count; r++) {
+        if(ranges[r].line != line)
+            continue;
+        instructions += ranges[r].end - ranges[r].start;
+        if(t - text < (int)sizeof(text) - 32)
+            t += sprintf(t, "%s0x%X-0x%X", t == text ? "" : ",", 4 * ranges[r].start, 4 * ranges[r].end);
+    }
+    const char *src = SourceLine(source, size, line, &len);
+    if(len > MAX_MAP_LINE / 4)
+        len = MAX_MAP_LINE / 4;
+    fprintf(out, "%s 0x%llX %d %d %s | %.*s\n", name, offset, line, instructions, text[0] ? text : "-", len, src);
+}
+
+int ProfileWriteMap(const char *asm_file, const char *map_file, const char *source, size_t size) {
+    FILE *in = fopen(asm_file, "r");
+    if(!in)
+        return 0;
+    FILE *out = fopen(map_file, "w");
+    if(!out) {
+        fclose(in);
+        return 0;
+    }
+
+    // 1) instructions by line: every marker opens a line, labels don't take space
+    char text[MAX_MAP_LINE];
+    int in_data = 0, pc = 0, line = 0, n;
+    range_count = 0;
+    while(fgets(text, sizeof(text), in)) {
+        text[strcspn(text, "\r\n")] = '\0';
+        char *p = text;
+        while(*p && isspace((unsigned char)*p))
+            p++;
+        if(sscanf(p, "# line %d", &n) == 1) {
+            line = n;
+            continue;
+        }
+        if(*p == '#' || *p == '\0')
+            continue;
+        if(strncmp(p, ".data", 5) == 0 || strncmp(p, ".code", 5) == 0) {
+            in_data = (p[1] == 'd');
+            continue;
+        }
+        if(in_data)
+            continue;
+        char *colon = strchr(p, ':');
+        if(colon) {
+            p = colon + 1;
+            while(*p && isspace((unsigned char)*p))
+                p++;
+            if(*p == '\0')
+                continue;
+        }
+        AddInstruction(line, pc++);
+    }
+
+    // 2) the counters, in .data order
+    fprintf(out, "# kore-desu profile map\n");
+    fprintf(out, "# counter, .data offset, source line, instructions, byte ranges | source text\n");
+    rewind(in);
+    in_data = 0;
+    long long offset = 0;
+    while(fgets(text, sizeof(text), in)) {
+        char name[MAX_NAME_LEN], directive[16];
+        int bytes = 8, at = -1, len;
+        if(strncmp(text, ".data", 5) == 0 || strncmp(text, ".code", 5) == 0) {
+            in_data = (text[1] == 'd');
+            continue;
+        }
+        if(!in_data || sscanf(text, " %63[^:]: .%15s %n%d", name, directive, &at, &bytes) < 2)
+            continue;
+        if(strcmp(directive, "asciiz") == 0)
+            bytes = at >= 0 && ScanString(text + at, NULL, 0, &len) ? (len + 8) / 8 * 8 : 8;
+        else if(strcmp(directive, "space") != 0)
+            bytes = 8; // .word64
+        if(strncmp(name, "_line", 5) == 0 && isdigit((unsigned char)name[5]))
+            WriteEntry(out, name, offset, source, size);
+        offset += bytes;
+    }
+    fclose(in);
+    fclose(out);
+    free(ranges);
+    ranges = NULL;
+    range_capacity = 0;
+    return 1;
+}
+
+
+// ================= report =========================
+
+long long *ProfileReadImage(const char *image_file, int *words) {
+    FILE *in = fopen(image_file, "r");
+    if(!in)
+        return NULL;
+    char text[MAX_MAP_LINE];
+    // a .mc: only what follows "# .data" is the image
+    int skipping = 0;
+    while(fgets(text, sizeof(text), in))
+        if(strncmp(text, "# .data", 7) == 0)
+            skipping = 1;
+    rewind(in);
+
+    long long *image = NULL;
+    int count = 0, capacity = 0;
+    while(fgets(text, sizeof(text), in)) {
+        if(skipping) {
+            skipping = strncmp(text, "# .data", 7) != 0;
+            continue;
+        }
+        // "<binary> : <hex>" (.mc) or just the hex word
+        char *p = strrchr(text, ':');
+        p = p ? p + 1 : text;
+        while(*p && isspace((unsigned char)*p))
+            p++;
+        if(*p == '\0' || *p == '#' || !isxdigit((unsigned char)*p))
+            continue;
+        if(count == capacity) {
+            capacity = capacity ? 2 * capacity : 256;
+            image = xrealloc(image, capacity * sizeof(long long));
+        }
+        image[count++] = (long long)strtoull(p, NULL, 16);
+    }
+    fclose(in);
+    *words = count;
+    return image ? image : xrealloc(NULL, sizeof(long long));
+}
+
+// hottest first, then in source order
+static int CompareEntries(const void *x, const void *y) {
+    const MapEntry *a = x, *b = y;
+    if(a->count != b->count)
+        return a->count < b->count ? 1 : -1;
+    return a->line - b->line;
+}
+
+int ProfileReport(const char *map_file, const long long *image, int words) {
+    FILE *in = fopen(map_file, "r");
+    if(!in)
+        return 0;
+    MapEntry *entries = NULL;
+    int count = 0, capacity = 0;
+    long long total = 0;
+    char text[MAX_MAP_LINE];
+    while(fgets(text, sizeof(text), in)) {
+        text[strcspn(text, "\r\n")] = '\0';
+        char name[MAX_NAME_LEN];
+        MapEntry e;
+        memset(&e, 0, sizeof(e));
+        if(text[0] == '#' || sscanf(text, "%63s %lli %d %d", name, &e.offset, &e.line, &e.instructions) != 4)
+            continue;
+        const char *bar = strstr(text, " | ");
+        bar = bar ? bar + 3 : "";
+        e.text = strcpy(xrealloc(NULL, strlen(bar) + 1), bar);
+        // a counter outside the image (or not on a doubleword) was never seen: 0
+        if(e.offset >= 0 && e.offset % 8 == 0 && e.offset / 8 < words)
+            e.count = image[e.offset / 8];
+        total += e.count;
+        if(count == capacity) {
+            capacity = capacity ? 2 * capacity : 64;
+            entries = xrealloc(entries, capacity * sizeof(MapEntry));
+        }
+        entries[count++] = e;
+    }
+    fclose(in);
+
+    if(count > 0)
+        qsort(entries, count, sizeof(MapEntry), CompareEntries);
+    DiagText("****** PROFILE (%d line(s), %lld line execution(s)) ******\n", count, total);
+    for(int i = 0; i < count; i++) {
+        DiagProfile(entries[i].line, entries[i].count, total ? 100.0 * entries[i].count / total : 0.0,
+                    entries[i].instructions, entries[i].text);
+        free(entries[i].text);
+    }
+    DiagText("\n");
+    free(entries);
+    return 1;
+}
@@ -0,0 +1,29 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+// line profiling (--profile): every source line has a counter slot _lineN in .data that its
+// code increments, and a "# line N" marker in the listing in front of that code.
+//
+// side map (text, one line per counter, in .data order):
+//   <counter> <.data byte offset> <source line> <instructions> <byte ranges> | <source text>
+// ranges are start-end (end exclusive, hex byte addresses of the code, 4 bytes per
+// instruction), comma-separated: a while line has its test at the bottom of the loop
+//
+// a memory image is the .data doublewords in order, one per line: the "# .data" part of a
+// .mc (everything before it is skipped) or plain hex words, as a simulator dumps them
+
+// write the map of an instrumented listing; source/size: the compiled text (for the lines)
+// returns 0 if a file can't be opened
+int ProfileWriteMap(const char *asm_file, const char *map_file, const char *source, size_t size);
+
+// read a memory image, *words doublewords; NULL if the file can't be read (free the result)
+long long *ProfileReadImage(const char *image_file, int *words);
+
+// hot-spot report: the counters of the map read from image, lines by count (highest first)
+// returns 0 if the map can't be read
+int ProfileReport(const char *map_file, const long long *image, int words);
+
+#endif
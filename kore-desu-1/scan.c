@@ -0,0 +1,280 @@
+#include <string.h>
+#include <stdint.h>
+#include "scan.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+// character classes: scalar identifiers and the first characters of a SIMD scan
+#define SC_SPACE  1
+#define SC_WHITE  2
+#define SC_IDENT  4
+#define SC_DIGIT  8
+#define SC_STMT  16     // anything but ';' ',' '\n' '\0'
+
+static unsigned char scan_class[256];
+
+typedef const char *(*Scanner)(const char *p);
+
+static struct {
+    const char *name;
+    Scanner spaces, whitespace, identifier, digits, statement;
+} scan;
+
+
+// ================= scalar =========================
+
+static void InitClasses(void) {
+    for(int c = 0; c < 256; c++) {
+        unsigned char k = SC_STMT;
+        if(c == ' ')
+            k |= SC_SPACE | SC_WHITE;
+        if(c == '\t' || c == '\r' || c == '\f' || c == '\v')
+            k |= SC_WHITE;
+        if((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_')
+            k |= SC_IDENT;
+        if(c >= '0' && c <= '9')
+            k |= SC_IDENT | SC_DIGIT;
+        if(c == ';' || c == ',' || c == '\n' || c == '\0')
+            k &= ~SC_STMT;
+        scan_class[c] = k;
+    }
+}
+
+// the scalar scanners compare the characters directly, like the loops scan.c replaced: the
+// class table costs a load per character that one or two compares don't (half the speed on
+// runs of spaces)
+static const char *SpacesScalar(const char *p) {
+    while(*p == ' ')
+        p++;
+    return p;
+}
+
+static const char *WhitespaceScalar(const char *p) {
+    while(*p == ' ' || *p == '\t' || *p == '\r' || *p == '\f' || *p == '\v')
+        p++;
+    return p;
+}
+
+// letters, digits and '_' are too many compares: one table lookup (what isalnum did) is faster
+static const char *IdentifierScalar(const char *p) {
+    while(scan_class[(unsigned char)*p] & SC_IDENT)
+        p++;
+    return p;
+}
+
+static const char *DigitsScalar(const char *p) {
+    while((unsigned)((unsigned char)*p - '0') < 10)
+        p++;
+    return p;
+}
+
+static const char *StatementScalar(const char *p) {
+    while(*p && *p != ';' && *p != ',' && *p != '\n')
+        p++;
+    return p;
+}
+
+
+#ifdef SCAN_X86
+// ================= SSE2 / AVX2 =========================
+// aligned block loads: the block holding p is read whole and the bytes before p are
+// masked off, so a read never leaves the pages the string lives in (ASan would still
+// flag the over-read, so it is not instrumented)
+
+#if defined(__SANITIZE_ADDRESS__)
+#define SCAN_NO_ASAN __attribute__((no_sanitize_address))
+#else
+#define SCAN_NO_ASAN
+#endif
+
+// byte-class tests: each yields 0xFF in the lanes that belong to the class
+#define SSE_EQ(v, c)        _mm_cmpeq_epi8(v, _mm_set1_epi8(c))
+#define SSE_RANGE(v, lo, hi) _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8((lo) - 1)), \
+                                           _mm_cmpgt_epi8(_mm_set1_epi8((hi) + 1), v))
+#define SSE_SPACE(v)  SSE_EQ(v, ' ')
+#define SSE_WHITE(v)  _mm_or_si128(_mm_or_si128(SSE_EQ(v, ' '), SSE_EQ(v, '\t')), \
+                                   _mm_or_si128(SSE_EQ(v, '\r'), SSE_RANGE(v, '\v', '\f')))
+#define SSE_DIGIT(v)  SSE_RANGE(v, '0', '9')
+#define SSE_IDENT(v)  _mm_or_si128(_mm_or_si128(SSE_RANGE(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 'z'), \
+                                                SSE_DIGIT(v)), SSE_EQ(v, '_'))
+#define SSE_STMT(v)   _mm_xor_si128(_mm_or_si128(_mm_or_si128(SSE_EQ(v, ';'), SSE_EQ(v, ',')), \
+                                                 _mm_or_si128(SSE_EQ(v, '\n'), SSE_EQ(v, '\0'))), \
+                                    _mm_set1_epi8(-1))
+
+#define SSE2_SCANNER(name, CLASS, SC)                                               \
+    __attribute__((target("sse2"))) SCAN_NO_ASAN                                    \
+    static const char *name(const char *p) {                                        \
+        if(!(scan_class[(unsigned char)p[0]] & (SC)))                               \
+            return p;                                                               \
+        if(!(scan_class[(unsigned char)p[1]] & (SC)))                               \
+            return p + 1;                                                           \
+        unsigned off = (unsigned)((uintptr_t)p & 15);                               \
+        const __m128i *q = (const __m128i *)(p - off);                              \
+        __m128i v = _mm_load_si128(q);                                              \
+        unsigned stop = ~(unsigned)_mm_movemask_epi8(CLASS(v)) & (0xFFFFu << off) & 0xFFFFu; \
+        while(!stop) {                                                              \
+            v = _mm_load_si128(++q);                                                \
+            stop = ~(unsigned)_mm_movemask_epi8(CLASS(v)) & 0xFFFFu;                \
+        }                                                                           \
+        return (const char *)q + __builtin_ctz(stop);                               \
+    }
+
+SSE2_SCANNER(SpacesSse2, SSE_SPACE, SC_SPACE)
+SSE2_SCANNER(WhitespaceSse2, SSE_WHITE, SC_WHITE)
+SSE2_SCANNER(IdentifierSse2, SSE_IDENT, SC_IDENT)
+SSE2_SCANNER(DigitsSse2, SSE_DIGIT, SC_DIGIT)
+SSE2_SCANNER(StatementSse2, SSE_STMT, SC_STMT)
+
+#define AVX_EQ(v, c)        _mm256_cmpeq_epi8(v, _mm256_set1_epi8(c))
+#define AVX_RANGE(v, lo, hi) _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8((lo) - 1)), \
+                                              _mm256_cmpgt_epi8(_mm256_set1_epi8((hi) + 1), v))
+#define AVX_SPACE(v)  AVX_EQ(v, ' ')
+#define AVX_WHITE(v)  _mm256_or_si256(_mm256_or_si256(AVX_EQ(v, ' '), AVX_EQ(v, '\t')), \
+                                      _mm256_or_si256(AVX_EQ(v, '\r'), AVX_RANGE(v, '\v', '\f')))
+#define AVX_DIGIT(v)  AVX_RANGE(v, '0', '9')
+#define AVX_IDENT(v)  _mm256_or_si256(_mm256_or_si256(AVX_RANGE(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), 'a', 'z'), \
+                                                      AVX_DIGIT(v)), AVX_EQ(v, '_'))
+#define AVX_STMT(v)   _mm256_xor_si256(_mm256_or_si256(_mm256_or_si256(AVX_EQ(v, ';'), AVX_EQ(v, ',')), \
+                                                       _mm256_or_si256(AVX_EQ(v, '\n'), AVX_EQ(v, '\0'))), \
+                                       _mm256_set1_epi8(-1))
+
+#define AVX2_SCANNER(name, CLASS, SC)                                                   \
+    __attribute__((target("avx2"))) SCAN_NO_ASAN                                        \
+    static const char *name(const char *p) {                                            \
+        if(!(scan_class[(unsigned char)p[0]] & (SC)))                                   \
+            return p;                                                                   \
+        if(!(scan_class[(unsigned char)p[1]] & (SC)))                                   \
+            return p + 1;                                                               \
+        unsigned off = (unsigned)((uintptr_t)p & 31);                                   \
+        const __m256i *q = (const __m256i *)(p - off);                                  \
+        __m256i v = _mm256_load_si256(q);                                               \
+        unsigned stop = ~(unsigned)_mm256_movemask_epi8(CLASS(v)) & (0xFFFFFFFFu << off); \
+        while(!stop) {                                                                  \
+            v = _mm256_load_si256(++q);                                                 \
+            stop = ~(unsigned)_mm256_movemask_epi8(CLASS(v));                           \
+        }                                                                               \
+        return (const char *)q + __builtin_ctz(stop);                                   \
+    }
+
+AVX2_SCANNER(SpacesAvx2, AVX_SPACE, SC_SPACE)
+AVX2_SCANNER(WhitespaceAvx2, AVX_WHITE, SC_WHITE)
+AVX2_SCANNER(IdentifierAvx2, AVX_IDENT, SC_IDENT)
+AVX2_SCANNER(DigitsAvx2, AVX_DIGIT, SC_DIGIT)
+AVX2_SCANNER(StatementAvx2, AVX_STMT, SC_STMT)
+#endif
+
+
+// ================= dispatch =========================
+
+int ScanUse(const char *name) {
+    if(!scan_class[' '])
+        InitClasses();
+#ifdef SCAN_X86
+    __builtin_cpu_init();
+    if(strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2")) {
+        scan.name = "avx2";
+        scan.spaces = SpacesAvx2;
+        scan.whitespace = WhitespaceAvx2;
+        scan.identifier = IdentifierAvx2;
+        scan.digits = DigitsAvx2;
+        scan.statement = StatementAvx2;
+        return 1;
+    }
+    if(strcmp(name, "sse2") == 0 && __builtin_cpu_supports("sse2")) {
+        scan.name = "sse2";
+        scan.spaces = SpacesSse2;
+        scan.whitespace = WhitespaceSse2;
+        scan.identifier = IdentifierSse2;
+        scan.digits = DigitsSse2;
+        scan.statement = StatementSse2;
+        return 1;
+    }
+#endif
+    if(strcmp(name, "scalar") == 0) {
+        scan.name = "scalar";
+        scan.spaces = SpacesScalar;
+        scan.whitespace = WhitespaceScalar;
+        scan.identifier = IdentifierScalar;
+        scan.digits = DigitsScalar;
+        scan.statement = StatementScalar;
+        return 1;
+    }
+    return 0;
+}
+
+// best available, on first use
+static void ScanSelect(void) {
+    if(!ScanUse("avx2") && !ScanUse("sse2"))
+        ScanUse("scalar");
+}
+
+const char *ScanImplementation(void) {
+    if(!scan.name)
+        ScanSelect();
+    return scan.name;
+}
+
+const char *ScanSpaces(const char *p) {
+    if(!scan.name)
+        ScanSelect();
+    return scan.spaces(p);
+}
+
+const char *ScanWhitespace(const char *p) {
+    if(!scan.name)
+        ScanSelect();
+    return scan.whitespace(p);
+}
+
+const char *ScanIdentifier(const char *p) {
+    if(!scan.name)
+        ScanSelect();
+    return scan.identifier(p);
+}
+
+const char *ScanDigits(const char *p) {
+    if(!scan.name)
+        ScanSelect();
+    return scan.digits(p);
+}
+
+const char *ScanStatementEnd(const char *p) {
+    if(!scan.name)
+        ScanSelect();
+    return scan.statement(p);
+}
+
+
+// ================= string literals =========================
+// p.0 print text and the .asciiz directives of the listing use the same escapes
+
+const char *ScanString(const char *p, char *out, int size, int *len) {
+    int n = 0;
+    if(*p++ != '"')
+        return NULL;
+    for(; *p != '"'; p++) {
+        char c = *p;
+        if(c == '\0' || c == '\n')
+            return NULL;
+        if(c == '\\') {
+            c = *++p;
+            if(c == 'n')
+                c = '\n';
+            else if(c == 't')
+                c = '\t';
+            else if(c != '"' && c != '\\')
+                return NULL;
+        }
+        if(n < size - 1)
+            out[n] = c;
+        n++;
+    }
+    if(size > 0)
+        out[n < size - 1 ? n : size - 1] = '\0';
+    if(len)
+        *len = n;
+    return p + 1;
+}
@@ -0,0 +1,29 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+// character scanning for the front end, 16 (SSE2) or 32 (AVX2) bytes at a time,
+// picked at run time from what the CPU supports, with a scalar fallback
+//
+// every scanner returns the first character NOT in its class; '\0' and '\n' are in no
+// class (ScanStatementEnd stops at them), so they work on NUL-terminated strings and
+// on line views of the source alike. the vector loads are aligned, so they never
+// cross into a page the string does not touch.
+
+const char *ScanSpaces(const char *p);       // ' ' only (the validator's skips)
+const char *ScanWhitespace(const char *p);   // ' ', \t, \r, \f, \v (not \n)
+const char *ScanIdentifier(const char *p);   // letters, digits, '_'
+const char *ScanDigits(const char *p);       // 0-9
+const char *ScanStatementEnd(const char *p); // stops at ';', ',', '\n' or '\0'
+
+// string literal at p (on its opening '"') with the \n \t \" \\ escapes: the text goes to out
+// (cut to size - 1 characters, NUL-terminated; size 0: nothing), its full length to *len (if not NULL)
+// returns the character after the closing '"', NULL if p isn't a complete literal on one line
+const char *ScanString(const char *p, char *out, int size, int *len);
+
+// "avx2", "sse2" or "scalar": the implementation in use
+const char *ScanImplementation(void);
+
+// switch implementation (for benchmarks/tests); returns 0 if the CPU lacks it
+int ScanUse(const char *name);
+
+#endif
@@ -0,0 +1,114 @@
+#if !defined(_WIN32)
+#define _POSIX_C_SOURCE 200809L // mmap, open, fstat under -std=c99
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "source.h"
+
+// one syscall for the common case: map the file, no copy
+static int MapFile(const char *path, SourceFile *src) {
+#if !defined(_WIN32)
+    int fd = open(path, O_RDONLY);
+    if(fd < 0)
+        return 0;
+    struct stat st;
+    int ok = 0;
+    if(fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        char *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(p != MAP_FAILED) {
+            // the final '\n' ends the last line; without it a scan could run off the mapping
+            if(p[st.st_size - 1] == '\n') {
+                src->data = p;
+                src->size = st.st_size;
+                src->mapped = 1;
+                ok = 1;
+            } else
+                munmap(p, st.st_size);
+        }
+    }
+    close(fd);
+    return ok;
+#else
+    (void)path;
+    (void)src;
+    return 0;
+#endif
+}
+
+// fallback: read everything into one NUL-terminated buffer
+static int ReadFile(const char *path, SourceFile *src) {
+    FILE *f = fopen(path, "rb");
+    if(!f)
+        return 0;
+    size_t len = 0, capacity = 1 << 16;
+    char *data = malloc(capacity + 1);
+    while(data) {
+        len += fread(data + len, 1, capacity - len, f);
+        if(len < capacity)
+            break;
+        char *grown = realloc(data, capacity * 2 + 1);
+        if(!grown) {
+            free(data);
+            data = NULL;
+            break;
+        }
+        data = grown;
+        capacity *= 2;
+    }
+    fclose(f);
+    if(!data)
+        return 0;
+    data[len] = '\0';
+    src->data = data;
+    src->size = len;
+    src->mapped = 0;
+    return 1;
+}
+
+int SourceOpen(const char *path, SourceFile *src) {
+    src->data = NULL;
+    src->size = 0;
+    src->mapped = 0;
+    return MapFile(path, src) || ReadFile(path, src);
+}
+
+void SourceClose(SourceFile *src) {
+#if !defined(_WIN32)
+    if(src->mapped)
+        munmap((void *)src->data, src->size);
+    else
+#endif
+        free((void *)src->data);
+    src->data = NULL;
+    src->size = 0;
+}
+
+int SourceNextLine(const SourceFile *src, size_t *pos, SourceSpan *line) {
+    if(*pos >= src->size)
+        return 0;
+    const char *start = src->data + *pos;
+    const char *nl = memchr(start, '\n', src->size - *pos);
+    size_t len = nl ? (size_t)(nl - start) : src->size - *pos;
+    *pos += nl ? len + 1 : len;
+    if(len > 0 && start[len - 1] == '\r')
+        len--;
+    line->text = start;
+    line->len = (int)len;
+    return 1;
+}
+
+SourceSpan TrimSpan(SourceSpan line) {
+    while(line.len > 0 && isspace((unsigned char)line.text[0])) {
+        line.text++;
+        line.len--;
+    }
+    while(line.len > 0 && isspace((unsigned char)line.text[line.len - 1]))
+        line.len--;
+    return line;
+}
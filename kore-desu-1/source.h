@@ -0,0 +1,27 @@
+#ifndef SOURCE_H
+#define SOURCE_H
+
+#include <stddef.h>
+#include "ir.h"
+
+// the whole input file in memory: mapped when it is a regular file whose last line ends
+// with '\n', otherwise read in one go (pipes, no final newline) and NUL-terminated
+// either way every line is followed by '\n' or '\0', which the validator uses as its end
+typedef struct {
+    const char *data;
+    size_t size;
+    int mapped;
+} SourceFile;
+
+// returns 1 on success, 0 if the file cannot be opened or read
+int SourceOpen(const char *path, SourceFile *src);
+void SourceClose(SourceFile *src);
+
+// next line starting at *pos (without "\n" / "\r\n"), advances *pos past it
+// returns 0 when there are no more lines
+int SourceNextLine(const SourceFile *src, size_t *pos, SourceSpan *line);
+
+// line without leading/trailing whitespace (a narrower view, nothing is modified)
+SourceSpan TrimSpan(SourceSpan line);
+
+#endif
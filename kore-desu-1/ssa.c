@@ -0,0 +1,743 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <limits.h>
+
+#include "ssa.h"
+#include "symbol_table.h"
+#include "scan.h"
+#include "error.h" // xrealloc
+
+// lowering state: the program being built
+static SsaProgram *lower_prog;
+
+// line profiling: the source buffer statements point into, NULL when off
+static const char *profile_source;
+
+
+// ================= instructions =========================
+
+SsaInsn *SsaAppend(SsaProgram *prog, SsaInsn insn) {
+    if(prog->count == prog->capacity) {
+        int capacity = prog->capacity ? 2 * prog->capacity : 256;
+        prog->insns = xrealloc(prog->insns, capacity * sizeof(SsaInsn));
+        prog->capacity = capacity;
+    }
+    prog->insns[prog->count] = insn;
+    return &prog->insns[prog->count++];
+}
+
+int SsaNewVreg(SsaProgram *prog) {
+    return prog->vreg_count++;
+}
+
+void SsaFree(SsaProgram *prog) {
+    free(prog->insns);
+    memset(prog, 0, sizeof(*prog));
+}
+
+// an instruction with no operands and no result
+static SsaInsn Blank(SsaOp kind) {
+    SsaInsn insn;
+    memset(&insn, 0, sizeof(insn));
+    insn.kind = kind;
+    insn.dst = insn.a = insn.b = insn.var = -1;
+    return insn;
+}
+
+// append an instruction defining a fresh vreg, returns the vreg
+static int Define(SsaInsn insn) {
+    insn.dst = SsaNewVreg(lower_prog);
+    SsaAppend(lower_prog, insn);
+    return insn.dst;
+}
+
+void SsaDefinitions(const SsaProgram *prog, int *defs) {
+    for(int v = 0; v < prog->vreg_count; v++)
+        defs[v] = -1;
+    for(int i = 0; i < prog->count; i++)
+        if(prog->insns[i].kind != SSA_NOP && prog->insns[i].dst >= 0)
+            defs[prog->insns[i].dst] = i;
+}
+
+long long SsaNarrow(long long value, int bytes) {
+    if(bytes <= 0 || bytes >= 8)
+        return value;
+    int shift = 64 - 8 * bytes;
+    return (long long)((unsigned long long)value << shift) >> shift;
+}
+
+void SsaVariableBytes(const SsaProgram *prog, unsigned char *bytes, int vars) {
+    memset(bytes, 8, vars);
+    for(int i = 0; i < prog->count; i++) {
+        const SsaInsn *in = &prog->insns[i];
+        if(in->kind == SSA_DECL && in->imm > 0 && in->var >= 0 && in->var < vars)
+            bytes[in->var] = (unsigned char)in->imm;
+    }
+}
+
+int SsaLoopBranch(const SsaProgram *prog, int start) {
+    int i = start + 1;
+    while(i < prog->count && prog->insns[i].kind != SSA_BRANCH)
+        i++;
+    return i;
+}
+
+int SsaLoopEnd(const SsaProgram *prog, int start) {
+    int depth = 0;
+    for(int i = start; i < prog->count; i++) {
+        if(prog->insns[i].kind == SSA_LOOP)
+            depth++;
+        else if(prog->insns[i].kind == SSA_ENDLOOP && --depth == 0)
+            return i;
+    }
+    return prog->count;
+}
+
+int SsaIfEnd(const SsaProgram *prog, int start, int *otherwise) {
+    int depth = 0;
+    *otherwise = -1;
+    for(int i = start; i < prog->count; i++) {
+        if(prog->insns[i].kind == SSA_IF)
+            depth++;
+        else if(prog->insns[i].kind == SSA_ELSE && depth == 1)
+            *otherwise = i;
+        else if(prog->insns[i].kind == SSA_ENDIF && --depth == 0)
+            return i;
+    }
+    return prog->count;
+}
+
+int SsaFunctionEnd(const SsaProgram *prog, int start) {
+    int i = start + 1;
+    while(i < prog->count && prog->insns[i].kind != SSA_ENDFUNC)
+        i++;
+    return i;
+}
+
+
+// ================= expression text -> three-address code =========================
+// same grammar the code generator used to walk:
+// E -> E + T | E - T | T,  T -> T * F | T / F | F,  F -> (E) | vars | numbers | -numbers
+// a missing operand (malformed input) is vreg -1, which instruction selection treats as 0
+
+static int Lower_E(const char **p);
+
+// the function being lowered (-1: none) and its parameters and locals: pairs of source
+// name and frame name "f.x", which every use of the source name inside it becomes
+static int scope_function = -1;
+static int *scope_names;
+static int scope_count, scope_capacity;
+
+// a variable as used at this point: a parameter/local of the current function or a global
+static int Scoped(int name) {
+    for(int k = 0; k < scope_count; k += 2)
+        if(scope_names[k] == name)
+            return scope_names[k + 1];
+    return name;
+}
+
+// a new parameter/local of the current function, returns its frame name
+static int AddLocal(int name) {
+    char text[2 * MAX_NAME_LEN + 2];
+    int len = snprintf(text, sizeof(text), "%s.%s", NameOf(scope_function), NameOf(name));
+    if(len > MAX_NAME_LEN - 1)
+        len = MAX_NAME_LEN - 1;
+    if(scope_count + 2 > scope_capacity) {
+        scope_capacity = scope_capacity ? 2 * scope_capacity : 64;
+        scope_names = xrealloc(scope_names, scope_capacity * sizeof(int));
+    }
+    scope_names[scope_count++] = name;
+    scope_names[scope_count++] = InternName(text, len);
+    return scope_names[scope_count - 1];
+}
+
+// "const int" names (frame names inside a function) and their values: a use of one is
+// its value, so a constant has no slot and is never loaded
+typedef struct {
+    int name;
+    long long value;
+} Constant;
+
+static Constant *constants;
+static int constant_count, constant_capacity;
+
+static void AddConstant(int name, long long value) {
+    if(constant_count == constant_capacity) {
+        constant_capacity = constant_capacity ? 2 * constant_capacity : 64;
+        constants = xrealloc(constants, constant_capacity * sizeof(Constant));
+    }
+    constants[constant_count].name = name;
+    constants[constant_count].value = value;
+    constant_count++;
+}
+
+// index of the constant called name, or -1
+static int FindConstant(int name) {
+    for(int k = constant_count - 1; k >= 0; k--)
+        if(constants[k].name == name)
+            return k;
+    return -1;
+}
+
+static void SkipSpaces(const char **p) {
+    *p = ScanWhitespace(*p);
+}
+
+static int Binary(char op, int a, int b) {
+    SsaInsn insn = Blank(SSA_BINOP);
+    insn.op = op;
+    insn.a = a;
+    insn.b = b;
+    return Define(insn);
+}
+
+static int Lower_F(const char **p) {
+    SkipSpaces(p);
+
+    if(**p == '(') {
+        (*p)++;
+        int v = Lower_E(p);
+        SkipSpaces(p);
+        if(**p == ')')
+            (*p)++;
+        return v;
+    }
+
+    // numeric literal (the validator allows a leading '-')
+    if(isdigit(**p) || (**p == '-' && isdigit((*p)[1]))) {
+        int negative = (**p == '-');
+        if(negative)
+            (*p)++;
+        // the front ends only let a literal through if it fits in 64 bits (NumberFits); unsigned
+        // so that -9223372036854775808 doesn't overflow on the way
+        unsigned long long val = 0;
+        while(**p && isdigit(**p)) {
+            val = val * 10 + (unsigned long long)(**p - '0');
+            (*p)++;
+        }
+        SsaInsn insn = Blank(SSA_CONST);
+        insn.imm = (long long)(negative ? 0 - val : val);
+        return Define(insn);
+    }
+
+    // variable (names longer than the symbol table keeps are cut the same way)
+    if(isalpha(**p) || **p == '_') {
+        const char *end = ScanIdentifier(*p);
+        int len = (int)(end - *p);
+        if(len > MAX_NAME_LEN - 1)
+            len = MAX_NAME_LEN - 1;
+        SsaInsn insn = Blank(SSA_LOAD);
+        insn.var = Scoped(InternName(*p, len));
+        *p = end;
+        int constant = FindConstant(insn.var);
+        if(constant >= 0) {
+            insn = Blank(SSA_CONST);
+            insn.imm = constants[constant].value;
+        }
+        return Define(insn);
+    }
+
+    return -1;
+}
+
+static int Lower_T(const char **p) {
+    int left = Lower_F(p);
+    while(1) {
+        SkipSpaces(p);
+        if(**p == '*' || **p == '/') {
+            char op = **p;
+            (*p)++;
+            SkipSpaces(p);
+            int right = Lower_F(p);
+            left = Binary(op, left, right);
+        } else
+            break;
+    }
+    return left;
+}
+
+static int Lower_E(const char **p) {
+    int left = Lower_T(p);
+    while(1) {
+        SkipSpaces(p);
+        if(**p == '+' || **p == '-') {
+            char op = **p;
+            (*p)++;
+            SkipSpaces(p);
+            int right = Lower_T(p);
+            left = Binary(op, left, right);
+        } else
+            break;
+    }
+    return left;
+}
+
+static int LowerExpression(const char *text) {
+    const char *p = text;
+    return Lower_E(&p);
+}
+
+// value of vreg v of a constant's expression, lowered from insns[first] on (every instruction of
+// it defines one vreg, in order from first_vreg): CONSTs and BINOPs only, folded with the 64-bit
+// wraparound arithmetic of the hardware (the validator lets no trapping division through)
+static long long FoldConstant(int v, int first, int first_vreg) {
+    if(v < first_vreg)
+        return 0; // a missing operand
+    const SsaInsn *in = &lower_prog->insns[first + v - first_vreg];
+    if(in->kind != SSA_BINOP)
+        return in->imm;
+    unsigned long long l = (unsigned long long)FoldConstant(in->a, first, first_vreg);
+    unsigned long long r = (unsigned long long)FoldConstant(in->b, first, first_vreg);
+    if(in->op == '+')
+        return (long long)(l + r);
+    if(in->op == '-')
+        return (long long)(l - r);
+    if(in->op == '*')
+        return (long long)(l * r);
+    if(r == 0 || (r == (unsigned long long)-1 && l == (unsigned long long)LLONG_MIN))
+        return 0;
+    return (long long)l / (long long)r;
+}
+
+// "const int name = expression": the value is worked out here and the code for it dropped again
+static void LowerConstant(int name, const char *text) {
+    int first = lower_prog->count, first_vreg = lower_prog->vreg_count;
+    long long value = FoldConstant(LowerExpression(text), first, first_vreg);
+    lower_prog->count = first;
+    lower_prog->vreg_count = first_vreg;
+    AddConstant(name, value);
+}
+
+// "lhs <op> rhs" with op one of < > <= >= == != (or none: a plain expression)
+static void LowerCondition(const char *cond) {
+    SsaInsn branch = Blank(SSA_BRANCH);
+    int pos = strcspn(cond, "<>=!");
+    // the left side stops by itself at the operator: none of <>=! continue an expression
+    branch.a = LowerExpression(cond);
+    if(cond[pos] != '\0') {
+        int two = (cond[pos + 1] == '=');
+        char op = cond[pos];
+        if(two && op == '<')
+            op = 'l';
+        else if(two && op == '>')
+            op = 'g';
+        branch.op = op;
+        branch.b = LowerExpression(cond + pos + 1 + two);
+    }
+    SsaAppend(lower_prog, branch);
+}
+
+
+// print parts, comma-separated: a string literal is a text part, an expression is lowered
+// here and becomes a value part; the parts follow the code of every value, the first marked
+static void LowerPrint(const char *text) {
+    int capacity = 1, count = 0, size = (int)strlen(text) + 1, len;
+    for(const char *c = text; *c; c++)
+        capacity += (*c == ',');
+    SsaInsn *parts = xrealloc(NULL, capacity * sizeof(SsaInsn));
+    char *literal = xrealloc(NULL, size);
+    const char *p = text;
+    while(count < capacity) {
+        SkipSpaces(&p);
+        SsaInsn part = Blank(SSA_PRINT);
+        const char *after = *p == '"' ? ScanString(p, literal, size, &len) : NULL;
+        if(after) {
+            part.op = 's';
+            part.var = InternName(literal, len);
+            p = after;
+        } else {
+            part.op = 'd';
+            part.a = Lower_E(&p);
+        }
+        parts[count++] = part;
+        SkipSpaces(&p);
+        if(*p != ',')
+            break;
+        p++;
+    }
+    parts[0].init = 1;
+    for(int i = 0; i < count; i++)
+        SsaAppend(lower_prog, parts[i]);
+    free(literal);
+    free(parts);
+}
+
+// "f(a, b + 1)": the code of the arguments, their ARG run and the CALL storing to dest (-1: none)
+static void LowerCall(const char *text, int dest) {
+    const char *p = ScanWhitespace(text);
+    const char *end = ScanIdentifier(p);
+    int function = InternName(p, (int)(end - p));
+    int capacity = 1, count = 0;
+    for(const char *c = end; *c; c++)
+        capacity += (*c == ',');
+    int *args = xrealloc(NULL, capacity * sizeof(int));
+    p = ScanWhitespace(end);
+    if(*p == '(')
+        p++;
+    SkipSpaces(&p);
+    while(*p != ')' && *p && count < capacity) {
+        args[count++] = Lower_E(&p);
+        SkipSpaces(&p);
+        if(*p == ',')
+            p++;
+    }
+    SsaInsn insn = Blank(SSA_ARG);
+    for(int k = 0; k < count; k++) {
+        insn.a = args[k];
+        SsaAppend(lower_prog, insn);
+    }
+    insn = Blank(SSA_CALL);
+    insn.imm = function;
+    insn.var = dest >= 0 ? Scoped(dest) : -1;
+    SsaAppend(lower_prog, insn);
+    free(args);
+}
+
+// "int f(int a, int b) {": FUNC, then a PARAM for each of "int a, int b" (they come into scope)
+static void LowerFunction(int name, const char *params) {
+    SsaInsn insn = Blank(SSA_FUNC);
+    insn.imm = name;
+    SsaAppend(lower_prog, insn);
+    scope_function = name;
+    scope_count = 0;
+    const char *p = params;
+    for(int k = 0; ; k++) {
+        p = ScanWhitespace(p);
+        if(strncmp(p, "int", 3) == 0)
+            p = ScanWhitespace(p + 3);
+        const char *end = ScanIdentifier(p);
+        if(end == p)
+            break;
+        insn = Blank(SSA_PARAM);
+        insn.var = AddLocal(InternName(p, (int)(end - p)));
+        insn.imm = k;
+        SsaAppend(lower_prog, insn);
+        p = ScanWhitespace(end);
+        if(*p != ',')
+            break;
+        p++;
+    }
+}
+
+char *SsaPrintFormat(const SsaProgram *prog, const int *defs, int start, int *end, int *values, int *value_count) {
+    size_t size = 1;
+    int i = start;
+    do {
+        const SsaInsn *in = &prog->insns[i];
+        size += in->op == 's' ? 2 * strlen(NameOf(in->var)) : 24;
+        i++;
+    } while(i < prog->count && prog->insns[i].kind == SSA_PRINT && !prog->insns[i].init);
+    *end = i;
+
+    char *format = xrealloc(NULL, size), *f = format;
+    *value_count = 0;
+    for(i = start; i < *end; i++) {
+        const SsaInsn *in = &prog->insns[i];
+        if(in->op == 's') {
+            for(const char *t = NameOf(in->var); *t; t++) {
+                if(*t == '%')
+                    *f++ = '%';
+                *f++ = *t;
+            }
+            continue;
+        }
+        // a missing operand (malformed input) prints as 0, like it evaluates
+        const SsaInsn *def = in->a >= 0 && defs[in->a] >= 0 ? &prog->insns[defs[in->a]] : NULL;
+        if(!def || def->kind == SSA_CONST)
+            f += sprintf(f, "%lld", def ? def->imm : 0);
+        else {
+            f += sprintf(f, "%%d");
+            values[(*value_count)++] = in->a;
+        }
+    }
+    *f = '\0';
+    return format;
+}
+
+// ================= statements -> program =========================
+
+void SsaSetProfiling(const char *source) {
+    profile_source = source;
+}
+
+// counter of a source line: COUNT on the slot _lineN (skipped if the name table is full)
+static void LowerCount(int line) {
+    char name[MAX_NAME_LEN];
+    snprintf(name, sizeof(name), "_line%d", line);
+    SsaInsn insn = Blank(SSA_COUNT);
+    insn.var = InternName(name, (int)strlen(name));
+    insn.imm = line;
+    if(insn.var >= 0)
+        SsaAppend(lower_prog, insn);
+}
+
+// a block still open while lowering: a loop ('w'), an if statement ('i'), an if chained
+// to the else of the one below it ('c', closed along with it) or a function body ('f')
+typedef struct {
+    char kind;
+    int number;
+} OpenBlock;
+
+static OpenBlock *open_blocks;
+static int open_count, open_capacity;
+
+static void PushBlock(char kind, int number) {
+    if(open_count == open_capacity) {
+        open_capacity = open_capacity ? 2 * open_capacity : 64;
+        open_blocks = xrealloc(open_blocks, open_capacity * sizeof(OpenBlock));
+    }
+    open_blocks[open_count].kind = kind;
+    open_blocks[open_count].number = number;
+    open_count++;
+}
+
+// IF n with its condition (and the counter of its line right after the IF)
+static void LowerIf(int number, const char *cond, int counter) {
+    SsaInsn insn = Blank(SSA_IF);
+    insn.imm = number;
+    SsaAppend(lower_prog, insn);
+    if(counter)
+        LowerCount(counter);
+    LowerCondition(cond);
+}
+
+void SsaLower(const Statement *stmts, int count, SsaProgram *prog) {
+    memset(prog, 0, sizeof(*prog));
+    lower_prog = prog;
+    open_count = 0;
+    scope_function = -1;
+    scope_count = 0;
+    constant_count = 0;
+    int loops = 0, ifs = 0;
+    // profiling: statements come in source order, so lines are counted as we go
+    const char *scanned = profile_source;
+    int line = 1, counted = 0;
+
+    for(int i = 0; i < count; i++) {
+        const Statement *s = &stmts[i];
+        SsaInsn insn;
+        int counter = 0; // line whose code starts with this statement, 0 if none
+        int opens = s->type == STMT_WHILE || s->type == STMT_IF || (s->type == STMT_ELSE && s->rhs[0]);
+        if(profile_source && s->type != STMT_END && s->type != STMT_FUNC && (s->type != STMT_ELSE || opens) && s->raw.text) {
+            while(scanned < s->raw.text)
+                line += (*scanned++ == '\n');
+            if(line != counted)
+                counter = counted = line;
+        }
+        if(counter && !opens)
+            LowerCount(counter);
+        switch(s->type) {
+        case STMT_DECL:
+            insn = Blank(SSA_DECL);
+            insn.var = scope_function >= 0 ? AddLocal(s->lhs) : s->lhs;
+            insn.imm = s->bytes;
+            SsaAppend(prog, insn);
+            if(s->rhs[0] == '\0' && scope_function < 0)
+                break;
+            insn.imm = 0;
+            // a local is 0 until assigned, like a global (every time the function runs)
+            insn.kind = SSA_STORE;
+            insn.init = 1;
+            insn.a = LowerExpression(s->rhs[0] ? s->rhs : "0");
+            SsaAppend(prog, insn);
+            break;
+        case STMT_CONST:
+            LowerConstant(scope_function >= 0 ? AddLocal(s->lhs) : s->lhs, s->rhs);
+            break;
+        case STMT_ASSIGN:
+            insn = Blank(SSA_STORE);
+            insn.var = Scoped(s->lhs);
+            insn.a = LowerExpression(s->rhs);
+            SsaAppend(prog, insn);
+            break;
+        case STMT_FUNC:
+            PushBlock('f', s->lhs);
+            LowerFunction(s->lhs, s->rhs);
+            break;
+        case STMT_RETURN:
+            insn = Blank(SSA_RETURN);
+            insn.a = LowerExpression(s->rhs);
+            SsaAppend(prog, insn);
+            break;
+        case STMT_CALL:
+            LowerCall(s->rhs, s->lhs);
+            break;
+        case STMT_WHILE:
+            insn = Blank(SSA_LOOP);
+            insn.imm = loops;
+            PushBlock('w', loops++);
+            SsaAppend(prog, insn);
+            if(counter)
+                LowerCount(counter);
+            LowerCondition(s->rhs);
+            break;
+        case STMT_PRINT:
+            LowerPrint(s->rhs);
+            break;
+        case STMT_IF:
+            PushBlock('i', ifs);
+            LowerIf(ifs++, s->rhs, counter);
+            break;
+        case STMT_ELSE:
+            if(open_count == 0 || open_blocks[open_count - 1].kind == 'w' || open_blocks[open_count - 1].kind == 'f')
+                break; // the validator lets no such else through
+            insn = Blank(SSA_ELSE);
+            insn.imm = open_blocks[open_count - 1].number;
+            SsaAppend(prog, insn);
+            if(s->rhs[0]) {
+                PushBlock('c', ifs);
+                LowerIf(ifs++, s->rhs, counter);
+            }
+            break;
+        case STMT_END:
+            // a loop or an if, and with it every if chained to the latter's else
+            do {
+                OpenBlock block = open_count > 0 ? open_blocks[--open_count] : (OpenBlock){ 'w', 0 };
+                insn = Blank(block.kind == 'w' ? SSA_ENDLOOP : block.kind == 'f' ? SSA_ENDFUNC : SSA_ENDIF);
+                insn.imm = block.number;
+                SsaAppend(prog, insn);
+                if(block.kind == 'f') {
+                    scope_function = -1;
+                    scope_count = 0;
+                }
+                if(block.kind != 'c')
+                    break;
+            } while(1);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+
+// ================= listing =========================
+
+static const char *ComparisonText(char op) {
+    switch(op) {
+    case '<': return "<";
+    case '>': return ">";
+    case 'l': return "<=";
+    case 'g': return ">=";
+    case '=': return "==";
+    case '!': return "!=";
+    }
+    return "?";
+}
+
+void SsaWriteString(const char *text, FILE *out) {
+    fputc('"', out);
+    for(; *text; text++) {
+        if(*text == '\n')
+            fputs("\\n", out);
+        else if(*text == '\t')
+            fputs("\\t", out);
+        else {
+            if(*text == '"' || *text == '\\')
+                fputc('\\', out);
+            fputc(*text, out);
+        }
+    }
+    fputc('"', out);
+}
+
+void SsaPrint(const SsaProgram *prog, FILE *out) {
+    int depth = 0;
+    const char *header = "while"; // the BRANCH belongs to the latest loop or if
+    for(int i = 0; i < prog->count; i++) {
+        const SsaInsn *in = &prog->insns[i];
+        if(in->kind == SSA_NOP || (in->kind == SSA_PRINT && !in->init) || in->kind == SSA_ARG)
+            continue; // a print statement's later parts are listed with its first one, arguments with their call
+        if(in->kind == SSA_ENDLOOP || in->kind == SSA_ENDIF || in->kind == SSA_ELSE || in->kind == SSA_ENDFUNC)
+            depth--;
+        fprintf(out, "%*s", 2 * depth + 2, "");
+        switch(in->kind) {
+        case SSA_CONST:
+            fprintf(out, "v%d = %lld\n", in->dst, in->imm);
+            break;
+        case SSA_LOAD:
+            fprintf(out, "v%d = load %s\n", in->dst, NameOf(in->var));
+            break;
+        case SSA_BINOP:
+            fprintf(out, "v%d = v%d %c v%d\n", in->dst, in->a, in->op, in->b);
+            break;
+        case SSA_STORE:
+            fprintf(out, "store %s, v%d%s\n", NameOf(in->var), in->a, in->init ? "  (init)" : "");
+            break;
+        case SSA_DECL:
+            fprintf(out, "decl %s", NameOf(in->var));
+            if(in->imm)
+                fprintf(out, "  (%lld bytes)", in->imm);
+            fputc('\n', out);
+            break;
+        case SSA_LOOP:
+            fprintf(out, "loop %lld:\n", in->imm);
+            header = "while";
+            depth++;
+            break;
+        case SSA_IF:
+            fprintf(out, "if %lld:\n", in->imm);
+            header = "if";
+            depth++;
+            break;
+        case SSA_ELSE:
+            fputs("else\n", out);
+            depth++;
+            break;
+        case SSA_ENDIF:
+            fprintf(out, "end if %lld\n", in->imm);
+            break;
+        case SSA_BRANCH:
+            if(in->op)
+                fprintf(out, "%s v%d %s v%d\n", header, in->a, ComparisonText(in->op), in->b);
+            else
+                fprintf(out, "%s v%d != 0\n", header, in->a);
+            break;
+        case SSA_ENDLOOP:
+            fprintf(out, "end loop %lld\n", in->imm);
+            break;
+        case SSA_COUNT:
+            fprintf(out, "count line %lld\n", in->imm);
+            break;
+        case SSA_FUNC:
+            fprintf(out, "function %s:\n", NameOf((int)in->imm));
+            depth++;
+            break;
+        case SSA_PARAM:
+            fprintf(out, "param %s\n", NameOf(in->var));
+            break;
+        case SSA_ENDFUNC:
+            fprintf(out, "end function %s\n", NameOf((int)in->imm));
+            break;
+        case SSA_RETURN:
+            fprintf(out, "return v%d\n", in->a);
+            break;
+        case SSA_CALL: {
+            int first = i;
+            while(first > 0 && prog->insns[first - 1].kind == SSA_ARG)
+                first--;
+            if(in->var >= 0)
+                fprintf(out, "%s = ", NameOf(in->var));
+            fprintf(out, "call %s(", NameOf((int)in->imm));
+            for(int k = first; k < i; k++)
+                fprintf(out, k > first ? ", v%d" : "v%d", prog->insns[k].a);
+            fputs(")\n", out);
+            break;
+        }
+        case SSA_PRINT:
+            fputs("print ", out);
+            for(int k = i; k < prog->count && prog->insns[k].kind == SSA_PRINT && (k == i || !prog->insns[k].init); k++) {
+                if(k > i)
+                    fputs(", ", out);
+                if(prog->insns[k].op == 's')
+                    SsaWriteString(NameOf(prog->insns[k].var), out);
+                else
+                    fprintf(out, "v%d", prog->insns[k].a);
+            }
+            fputc('\n', out);
+            break;
+        }
+    }
+}
@@ -0,0 +1,126 @@
+#ifndef SSA_H
+#define SSA_H
+
+#include <stdio.h>
+#include "parser.h"
+
+// three-address SSA IR between the statements and instruction selection
+//
+// every virtual register (vreg) is defined by exactly one instruction; variables stay in
+// memory and are read/written with LOAD/STORE (like LLVM before mem2reg), so values
+// crossing loop iterations go through memory and no phi nodes are needed.
+// control flow stays structured:
+//     LOOP n                 while loop n starts, its condition follows
+//       <condition>
+//     BRANCH cmp a, b        the body runs while "a cmp b" holds (cmp 0: a != 0)
+//       <body>
+//     ENDLOOP n
+// and if statements the same way:
+//     IF n                   if statement n starts, its condition follows
+//       <condition>
+//     BRANCH cmp a, b        the then arm runs if "a cmp b" holds
+//       <then arm>
+//     ELSE n                 (only with an else part)
+//       <else arm>
+//     ENDIF n
+// an "else if" is an if statement nested in the else arm
+// with line profiling on, COUNT n opens the code of source line n (for a while line: right
+// after LOOP, so it counts condition tests; for an if line right after IF)
+// a print statement is a run of PRINT parts after the code of its values, the first one
+// marked init: text (op 's', var: the interned text, escapes decoded) or a value (op 'd', a)
+// a function definition is a region of its own, skipped where it stands:
+//     FUNC                   imm: the interned function name (FUNC and ENDFUNC alike)
+//     PARAM var              one per parameter, imm: its position
+//       <body>               RETURN a anywhere in it; no RETURN at the end returns 0
+//     ENDFUNC
+// its parameters and locals are named "f.x" (function f), so they never clash with the
+// variables of the rest of the program. a call is a run of ARG a (one per argument, after
+// the code of their values) and CALL (imm: the function, var: where the result goes, or -1)
+typedef enum {
+    SSA_NOP,        // deleted by a pass
+    SSA_CONST,      // dst = imm
+    SSA_LOAD,       // dst = var
+    SSA_BINOP,      // dst = a op b (op: + - * /)
+    SSA_STORE,      // var = a (init: the initializer of the declaration just before)
+    SSA_DECL,       // var is declared here; imm: bytes of a char (1), short (2) or int32 (4), 0 for an int
+    SSA_LOOP,
+    SSA_BRANCH,     // op: < > l (<=) g (>=) = (==) ! (!=), or 0; b is -1 for op 0
+    SSA_ENDLOOP,
+    SSA_COUNT,      // var (the counter slot _lineN) += 1; imm: source line N
+    SSA_PRINT,      // one part of a print statement (init: its first part)
+    SSA_IF,         // imm: if statement number (IF, ELSE and ENDIF alike)
+    SSA_ELSE,
+    SSA_ENDIF,
+    SSA_FUNC,
+    SSA_PARAM,
+    SSA_ENDFUNC,
+    SSA_RETURN,     // the function returns a
+    SSA_ARG,        // a is the next argument of the CALL ending the run
+    SSA_CALL
+} SsaOp;
+
+typedef struct {
+    unsigned char kind;     // SsaOp
+    char op;                // BINOP operator / BRANCH comparison
+    unsigned char init;     // STORE: declaration initializer, PRINT: first part of the statement
+    int dst;                // vreg defined, -1 if none
+    int a, b;               // operand vregs, -1 if none
+    int var;                // LOAD/STORE/DECL/PARAM: interned variable name, COUNT: its counter, PRINT: text, CALL: result
+    long long imm;          // CONST value, COUNT source line, FUNC/ENDFUNC/CALL: interned function name
+} SsaInsn;
+
+typedef struct {
+    SsaInsn *insns;
+    int count, capacity;
+    int vreg_count;         // vregs are numbered 0 .. vreg_count-1
+} SsaProgram;
+
+// line profiling: SsaLower puts a COUNT in front of each source line's first statement;
+// lines are counted from source, the buffer every Statement.raw points into (NULL: off)
+void SsaSetProfiling(const char *source);
+
+// lower the statements into prog (expression text is parsed here, once)
+void SsaLower(const Statement *stmts, int count, SsaProgram *prog);
+
+void SsaFree(SsaProgram *prog);
+
+// append an instruction (dst already set by the caller, see SsaNewVreg)
+SsaInsn *SsaAppend(SsaProgram *prog, SsaInsn insn);
+int SsaNewVreg(SsaProgram *prog);
+
+// defs[v] = index of the instruction defining vreg v, -1 if none (deleted); defs has vreg_count slots
+void SsaDefinitions(const SsaProgram *prog, int *defs);
+
+// index of the BRANCH of the loop (or if statement) opened at start, and of its ENDLOOP (count if missing)
+int SsaLoopBranch(const SsaProgram *prog, int start);
+int SsaLoopEnd(const SsaProgram *prog, int start);
+
+// index of the ENDIF of the if statement opened at start (count if missing); its ELSE goes
+// to *otherwise, -1 if it has none
+int SsaIfEnd(const SsaProgram *prog, int start, int *otherwise);
+
+// index of the ENDFUNC of the function defined at start (count if missing)
+int SsaFunctionEnd(const SsaProgram *prog, int start);
+
+// the print statement whose first part is insns[start] as one printf format (malloc'd): text
+// with '%' doubled, constant values as their digits, every other value as %d; those values'
+// vregs go to values (room for one per part), their number to *value_count, and the index
+// after the statement's last part to *end. defs as filled by SsaDefinitions
+char *SsaPrintFormat(const SsaProgram *prog, const int *defs, int start, int *end, int *values, int *value_count);
+
+// text as a string literal, quoted, with the escapes ScanString reads back (print parts,
+// .asciiz in the listing)
+void SsaWriteString(const char *text, FILE *out);
+
+// a narrow variable keeps the low bytes of what is stored to it and reads them back sign-extended:
+// the value it holds after value is stored (bytes 0 or 8: an int, all of it)
+long long SsaNarrow(long long value, int bytes);
+
+// bytes[var] = storage size of every variable of prog (8 for an int, and for one not declared
+// in prog); bytes has room for vars
+void SsaVariableBytes(const SsaProgram *prog, unsigned char *bytes, int vars);
+
+// readable listing, one instruction per line
+void SsaPrint(const SsaProgram *prog, FILE *out);
+
+#endif
@@ -8,68 +8,166 @@ static struct {
     char name[MAX_NAME_LEN];
     int reg;
     uint64_t offset;
+    int size;           // bytes of memory
+    int frame;          // 1: a function's parameter/local, offset is within its stack frame
 } table[MAX_SYMBOLS];
 
 // current number of symbols in the table
 static int symbol_count = 0;
 
+// name -> index + 1 (0 = empty slot), open addressing
+#define SYMBOL_HASH_SIZE (2 * MAX_SYMBOLS)   // power of two
+static int symbol_hash[SYMBOL_HASH_SIZE];
+
 // next available register to allocate
 static int next_reg = REG_MIN;
 
 // next memory offset for .data variables
 static uint64_t next_offset = 0x0;
 
+// between SymbolEnterFunction and SymbolLeaveFunction new variables are the function's own:
+// they get frame offsets instead of .data, and their registers are handed out again after
+// the function (the callee saves whatever it overwrites)
+static int function_scope = 0;
+static int scope_reg;
+static uint64_t frame_offset;
+
 // initialize/reset the symbol table
 void SymbolInit() {
     symbol_count = 0;
     next_reg = REG_MIN;
+    next_offset = 0x0;
+    function_scope = 0;
     // clear all var names by marking them as empty strings...
     // to ensure no ghost vars exist in the leftover mmoery
     for(int i = 0; i < MAX_SYMBOLS; i++)
         table[i].name[0] = '\0';
+    memset(symbol_hash, 0, sizeof(symbol_hash));
 }
 
-// get the register number associated with a symbol
-// returns -1 if symbol not found
-int GetRegisterOfTheSymbol(const char *name) {
-    for(int i = 0; i < symbol_count; i++) {
-        if(strcmp(table[i].name, name) == 0) 
-            return table[i].reg;
-    }
-    return -1;
+// hash slot of a name: the one holding it, or the empty slot where it goes
+static int SymbolSlot(const char *name) {
+    unsigned h = 2166136261u; // FNV-1a
+    for(const char *s = name; *s && s - name < MAX_NAME_LEN - 1; s++)
+        h = (h ^ (unsigned char)*s) * 16777619u;
+    int slot = h & (SYMBOL_HASH_SIZE - 1);
+    while(symbol_hash[slot] && strncmp(table[symbol_hash[slot] - 1].name, name, MAX_NAME_LEN - 1) != 0)
+        slot = (slot + 1) & (SYMBOL_HASH_SIZE - 1);
+    return slot;
 }
 
-// allocate a register for a new symbol
-// returns the register number, or existing reg if already allocated
-// returns -1 if out of table space or registers
-int AllocateRegisterForTheSymbol(const char *name) {
-    int r = GetRegisterOfTheSymbol(name);
-    if(r != -1)
-        return r; // already allocatedd
+// index of a symbol in the table, or -1 if not found
+static int FindSymbol(const char *name) {
+    return symbol_hash[SymbolSlot(name)] - 1;
+}
+
+int SymbolAlignment(uint64_t bytes) {
+    return bytes == 1 || bytes == 2 || bytes == 4 ? (int)bytes : 8;
+}
+
+// add a symbol with the given register and the next free memory offset (aligned to its bytes
+// of memory, see SymbolAlignment), in .data or in the current function's frame
+static int AddSymbol(const char *name, int reg, uint64_t bytes, int frame) {
     if(symbol_count >= MAX_SYMBOLS)
         return -1; // table is full
-    if(next_reg > REG_MAX)
-        return -1; // out of registers
-    
-    // store symbol name and assigned register
     strncpy(table[symbol_count].name, name, MAX_NAME_LEN-1);
     table[symbol_count].name[MAX_NAME_LEN-1] = '\0';
-    table[symbol_count].reg = next_reg;
+    symbol_hash[SymbolSlot(name)] = symbol_count + 1;
+    table[symbol_count].reg = reg;
+    table[symbol_count].frame = frame;
     // assign memory offset and increment for next variable
-    table[symbol_count].offset = next_offset;
-    next_offset += 0x8;  // increments by 8 bytes (like eduMIPS64)
-    symbol_count++;
+    uint64_t *offset = frame ? &frame_offset : &next_offset;
+    uint64_t align = SymbolAlignment(bytes);
+    if(align == 8)
+        bytes = (bytes + 7) & ~(uint64_t)7;  // 8 bytes per int (like eduMIPS64)
+    *offset = (*offset + align - 1) & ~(align - 1);
+    table[symbol_count].offset = *offset;
+    table[symbol_count].size = (int)bytes;
+    *offset += bytes;
+    return symbol_count++;
+}
+
+// get the register number associated with a symbol
+// returns -1 if symbol not found (or if it has no register)
+int GetRegisterOfTheSymbol(const char *name) {
+    int i = FindSymbol(name);
+    return i == -1 ? -1 : table[i].reg;
+}
+
+// allocate a register for a new symbol
+// returns the register number, or existing reg if already allocated
+// returns -1 if out of table space or registers (the symbol keeps its offset when only registers ran out)
+int AllocateRegisterForTheSymbol(const char *name) {
+    return AllocateRegisterForTheSymbolOfSize(name, 8);
+}
+
+// the same with the variable's size: a char, short or int32 packs in with its neighbours
+int AllocateRegisterForTheSymbolOfSize(const char *name, int bytes) {
+    int i = FindSymbol(name);
+    if(i != -1)
+        return table[i].reg; // already allocatedd
+    if(next_reg > REG_MAX) {
+        AddSymbol(name, -1, bytes, function_scope); // out of registers, lives in memory only
+        return -1;
+    }
+    if(AddSymbol(name, next_reg, bytes, function_scope) == -1)
+        return -1;
     return next_reg++;
 }
 
+// reserve memory (but no register) for a compiler-generated symbol, e.g. a spill slot
+// returns its offset, or the existing one if already reserved
+uint64_t AllocateOffsetForTheSymbol(const char *name) {
+    return AllocateBytesForTheSymbol(name, 8);
+}
+
+// the same with more memory (whole doublewords), e.g. for a string
+uint64_t AllocateBytesForTheSymbol(const char *name, uint64_t bytes) {
+    int i = FindSymbol(name);
+    if(i == -1)
+        i = AddSymbol(name, -1, (bytes + 7) & ~(uint64_t)7, 0);
+    return i == -1 ? 0 : table[i].offset;
+}
+
 // get the memory offset associated with a symbol
 // returns 0 if symbol not found
 uint64_t GetOffsetOfTheSymbol(const char *name) {
-    for(int i = 0; i < symbol_count; i++) {
-        if (strcmp(table[i].name, name) == 0) 
-            return table[i].offset;
-    }
-    return 0;
+    int i = FindSymbol(name);
+    return i == -1 ? 0 : table[i].offset;
+}
+
+// get the bytes of memory of a symbol (a doubleword if not found)
+int GetSizeOfTheSymbol(const char *name) {
+    int i = FindSymbol(name);
+    return i == -1 ? 8 : table[i].size;
+}
+
+uint64_t GetDataSize() {
+    return next_offset;
+}
+
+// start allocating a function's parameters and locals (see function_scope)
+void SymbolEnterFunction() {
+    function_scope = 1;
+    scope_reg = next_reg;
+    frame_offset = 0;
+}
+
+// end of the function: later variables reuse its registers
+void SymbolLeaveFunction() {
+    function_scope = 0;
+    next_reg = scope_reg;
+}
+
+// 1 if the symbol is a function's parameter or local (its offset is relative to the frame)
+int IsFrameSymbol(const char *name) {
+    int i = FindSymbol(name);
+    return i != -1 && table[i].frame;
+}
+
+// bytes of frame handed out in the current function so far
+uint64_t GetFrameSize() {
+    return frame_offset;
 }
 
 // print all symbols with registers and offsets (for debugging)
@@ -5,10 +5,10 @@
 #include <stdint.h>
 
 // register and symbol table settings 
-#define MAX_SYMBOLS   256     // maximum number of variables that can be stored
+#define MAX_SYMBOLS   32768   // maximum number of variables (and compiler slots) that can be stored
 #define MAX_NAME_LEN  64      // maximum length of variable name
 #define REG_MIN       1       // r1 (r0 is reserved for 0)
-#define REG_MAX       30      // up to r30; 31 is also reserved
+#define REG_MAX       19      // up to r19; r20-r30 are the expression temp pool, 31 is also reserved
 
 // initialize symbol table
 void SymbolInit();
@@ -17,11 +17,42 @@ void SymbolInit();
 int GetRegisterOfTheSymbol(const char *name);
 
 // allocate a new register for a variable name (and return reg id)
+// once r1-r19 are used up the variable still gets its memory offset, but -1 is returned
 int AllocateRegisterForTheSymbol(const char *name);
 
+// the same for a variable of bytes (1: char, 2: short, 4: int32, 8: int) of memory
+int AllocateRegisterForTheSymbolOfSize(const char *name, int bytes);
+
+// reserve a .data slot for a compiler-generated name (no register), returns its offset
+uint64_t AllocateOffsetForTheSymbol(const char *name);
+
+// the same for a symbol of more than 8 bytes (rounded up to doublewords), e.g. a string
+uint64_t AllocateBytesForTheSymbol(const char *name, uint64_t bytes);
+
 // get memory offset of a variable, or 0 if not found
 uint64_t GetOffsetOfTheSymbol(const char *name);
 
+// bytes of memory of a variable (8 if not found)
+int GetSizeOfTheSymbol(const char *name);
+
+// offsets are aligned to the size for 1, 2 and 4 bytes, everything else takes whole
+// doublewords (an assembler placing the same directives in order gets the same offsets)
+int SymbolAlignment(uint64_t bytes);
+
+// bytes of .data handed out so far (the offset the next symbol gets)
+uint64_t GetDataSize();
+
+// variables allocated between these two are a function's own: they live in its stack frame
+// (frame offsets instead of .data), and their registers are reused after the function
+void SymbolEnterFunction();
+void SymbolLeaveFunction();
+
+// 1 if the variable is a function's parameter or local
+int IsFrameSymbol(const char *name);
+
+// bytes of stack frame given to the current function's variables so far
+uint64_t GetFrameSize();
+
 // print all variable–register mappings
 //void PrintAll(FILE *out);
 
@@ -0,0 +1,85 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "target.h"
+
+typedef struct {
+    const char *name;
+    const char *description;
+    const TargetInstruction *instructions;  // ends with a NULL mnemonic
+} TargetProfile;
+
+// eduMIPS64 counts a multiply or divide as three instructions with its mflo (the figures the
+// if-conversion limit was made with)
+static const TargetInstruction edumips64[] = {
+    { "dmult", 2, 0x1C, 0, 2 },
+    { "ddiv",  2, 0x1E, 0, 2 },
+    { "mflo",  1, 0x12, 0, 1 },
+    { "mfhi",  1, 0x10, 0, 1 },
+    { "movz",  3, 0x0A, 0, 1 },
+    { "movn",  3, 0x0B, 0, 1 },
+    { "jr",    1, 0x08, 0, 1 },
+    { NULL,    0, 0,    0, 0 }
+};
+
+static const TargetInstruction mips64r2[] = {
+    { "dmult", 2, 0x1C, 0, 5 },
+    { "ddiv",  2, 0x1E, 0, 35 },
+    { "mflo",  1, 0x12, 0, 1 },
+    { "mfhi",  1, 0x10, 0, 1 },
+    { "movz",  3, 0x0A, 0, 1 },
+    { "movn",  3, 0x0B, 0, 1 },
+    { "jr",    1, 0x08, 0, 1 },
+    { NULL,    0, 0,    0, 0 }
+};
+
+// release 6: HI/LO and the conditional moves are gone, the results go straight to rd
+static const TargetInstruction mips64r6[] = {
+    { "dmul",  3, 0x1C, 2, 5 },
+    { "ddiv",  3, 0x1E, 2, 35 },
+    { "dmod",  3, 0x1E, 3, 35 },
+    { "jr",    1, 0x09, 0, 1 },     // jalr r0, rs
+    { NULL,    0, 0,    0, 0 }
+};
+
+static const TargetProfile profiles[] = {
+    { "edumips64", "EduMIPS64 simulator (default): dmult/ddiv + mflo, movz/movn", edumips64 },
+    { "mips64r2",  "MIPS64 release 2: dmult/ddiv + mflo, movz/movn",              mips64r2 },
+    { "mips64r6",  "MIPS64 release 6: dmul/ddiv/dmod rd, rs, rt, no movz/movn",  mips64r6 },
+};
+#define PROFILE_COUNT ((int)(sizeof(profiles) / sizeof(profiles[0])))
+
+static const TargetProfile *current = &profiles[0];
+
+int TargetSet(const char *name) {
+    for(int i = 0; i < PROFILE_COUNT; i++)
+        if(strcmp(profiles[i].name, name) == 0) {
+            current = &profiles[i];
+            return 1;
+        }
+    return 0;
+}
+
+const char *TargetName(void) {
+    return current->name;
+}
+
+const TargetInstruction *TargetFind(const char *mnemonic) {
+    for(const TargetInstruction *in = current->instructions; in->mnemonic; in++)
+        if(strcmp(in->mnemonic, mnemonic) == 0)
+            return in;
+    return NULL;
+}
+
+int TargetKnows(const char *mnemonic) {
+    for(int i = 0; i < PROFILE_COUNT; i++)
+        for(const TargetInstruction *in = profiles[i].instructions; in->mnemonic; in++)
+            if(strcmp(in->mnemonic, mnemonic) == 0)
+                return 1;
+    return 0;
+}
+
+void TargetList(FILE *out) {
+    for(int i = 0; i < PROFILE_COUNT; i++)
+        fprintf(out, "  %-10s %s\n", profiles[i].name, profiles[i].description);
+}
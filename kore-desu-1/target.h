@@ -0,0 +1,39 @@
+#ifndef TARGET_H
+#define TARGET_H
+
+#include <stdio.h>
+
+// target ISA profiles (--target <name>): the instructions whose availability or encoding differs
+// between MIPS64 revisions. instruction selection only emits what the profile has, the assembler
+// only encodes what it has (anything else is an unknown instruction), and the if-conversion
+// weighs arms with the latencies
+//   edumips64 (default): the EduMIPS64 simulator, HI/LO multiply/divide, movz/movn
+//   mips64r2:            the same instructions, latencies of a classic in-order core
+//   mips64r6:            three-operand dmul/ddiv/dmod instead of HI/LO, no movz/movn,
+//                        jr encoded as jalr r0
+
+// a SPECIAL (opcode 0) instruction of a profile
+typedef struct {
+    const char *mnemonic;
+    int operands;       // registers in the listing ("ddiv rs, rt" or "ddiv rd, rs, rt")
+    int funct;          // function field
+    int shamt;          // sa field (R6 tells dmul/ddiv from dmuh/dmod by it), else 0
+    int latency;        // cycles until a dependent instruction can use the result (rough)
+} TargetInstruction;
+
+// select a profile by name; returns 0 if there is none of that name (the current one stays)
+int TargetSet(const char *name);
+
+const char *TargetName(void);
+
+// the profile's entry for mnemonic, NULL if the instruction isn't available on it (instructions
+// every profile shares, e.g. daddu, have no entry and are always available)
+const TargetInstruction *TargetFind(const char *mnemonic);
+
+// does any profile have the instruction (to tell "not on this target" from a typo)
+int TargetKnows(const char *mnemonic);
+
+// one line per profile: name and description
+void TargetList(FILE *out);
+
+#endif